@@ -0,0 +1,427 @@
+#include "adjoint.h"
+#include "common.h"
+#include "initial.h"
+#include "renderutil.h"
+#include "mem.h"
+#include "model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// number of parameter fields a gradient is computed for
+#define N_GRADIENTS 6
+
+static void init_adjoint_program(adjoint_program_t* p, const char* path,
+    int daily_mean) {
+    p->program      = create_cshader(path);
+    p->year_frac_l  = glGetUniformLocation(p->program, "year_frac");
+    p->day_frac_l   = glGetUniformLocation(p->program, "day_frac");
+    p->dt_l         = glGetUniformLocation(p->program, "dt");
+    p->daily_mean_l = glGetUniformLocation(p->program, "daily_mean");
+    p->polar_rows_l = glGetUniformLocation(p->program, "polar_rows");
+    glUseProgram(p->program);
+    glUniform1i(p->daily_mean_l, daily_mean);
+    glUniform2i(p->polar_rows_l, 0, 0);
+}
+
+void init_adjoint_kernel(adjoint_kernel_t* kernel, int daily_mean) {
+    init_adjoint_program(&kernel->forward, "shader/forward.cs", daily_mean);
+    init_adjoint_program(&kernel->tangent, "shader/tangent.cs", daily_mean);
+    init_adjoint_program(&kernel->adjoint, "shader/adjoint.cs", daily_mean);
+    init_adjoint_program(&kernel->filter, "shader/polar_linear.cs",
+        daily_mean);
+    kernel->mode_l = glGetUniformLocation(kernel->filter.program, "mode");
+    kernel->polar_cos_l =
+        glGetUniformLocation(kernel->filter.program, "polar_cos");
+    kernel->polar_rows[0] = 0;
+    kernel->polar_rows[1] = 0;
+    kernel->zonal_texture = 0;
+}
+
+static unsigned int make_field_texture(size_t nx, size_t ny, int channels,
+    float* data) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    if (channels == 1) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, nx, ny, 0,
+            GL_RED, GL_FLOAT, data);
+    } else if (channels == 2) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, nx, ny, 0,
+            GL_RG, GL_FLOAT, data);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, nx, ny, 0,
+            GL_RGBA, GL_FLOAT, data);
+    }
+    mem_track_texture(texture, nx * ny * channels * sizeof(float));
+    return texture;
+}
+
+// filter the zonal diffusion of every row poleward of polar_lat, as
+// model_state_set_polar_filter does for the full grid solver
+void adjoint_kernel_set_polar_filter(adjoint_kernel_t* kernel,
+    model_initial_t* initial, size_t nx, size_t ny, float polar_lat) {
+    kernel->polar_rows[0] = 0;
+    kernel->polar_rows[1] = 0;
+    if (polar_lat > 0.0f && polar_lat < 90.0f) {
+        for (size_t j = 0; j < ny; j++) {
+            if (fabsf(initial->lats[j]) > polar_lat) {
+                kernel->polar_rows[(j < ny / 2) ? 0 : 1]++;
+            }
+        }
+    }
+    if (kernel->polar_rows[0] + kernel->polar_rows[1] == 0) {
+        return;
+    }
+    if (nx > POLAR_MAX_LON) {
+        printf("Error: the polar filter supports at most %d longitudes.\n",
+            POLAR_MAX_LON);
+        exit(1);
+    }
+
+    adjoint_program_t* programs[4] = {
+        &kernel->forward, &kernel->tangent, &kernel->adjoint, &kernel->filter
+    };
+    for (int k = 0; k < 4; k++) {
+        glUseProgram(programs[k]->program);
+        glUniform2i(programs[k]->polar_rows_l, kernel->polar_rows[0],
+            kernel->polar_rows[1]);
+    }
+    glUniform1f(kernel->polar_cos_l, cosf(deg2rad(polar_lat)));
+
+    float* zeros = (float*) mem_calloc(MEM_STAGING, nx * ny * 4,
+        sizeof(float));
+    kernel->zonal_texture = make_field_texture(nx, ny, 2, zeros);
+    mem_free(zeros);
+    glBindImageTexture(5, kernel->zonal_texture, 0, GL_FALSE, 0,
+        GL_READ_WRITE, GL_RG32F);
+}
+
+void adjoint_kernel_free(adjoint_kernel_t* kernel) {
+    if (kernel->zonal_texture != 0) {
+        mem_delete_textures(1, &kernel->zonal_texture);
+    }
+}
+
+static void upload_field(unsigned int texture, size_t nx, size_t ny,
+    float* data) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, nx, ny, GL_RED, GL_FLOAT, data);
+}
+
+static void read_field(unsigned int texture, int channels, float* data) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, (channels == 1) ? GL_RED : GL_RGBA,
+        GL_FLOAT, data);
+}
+
+static void set_phase(adjoint_program_t* p, double t, float dt) {
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+    glUseProgram(p->program);
+    glUniform1f(p->year_frac_l, year_frac);
+    glUniform1f(p->day_frac_l, day_frac);
+    glUniform1f(p->dt_l, dt);
+}
+
+static void dispatch(adjoint_program_t* p, size_t nx, size_t ny, double t,
+    float dt) {
+    set_phase(p, t, dt);
+    glDispatchCompute((unsigned int) nx / 32, (unsigned int) ny / 32, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+// filter the polar rows of the state bound to image unit 0, and for the
+// tangent (mode 1) and adjoint (mode 2) passes of the field bound to unit 1
+static void filter_polar(adjoint_kernel_t* kernel, int mode, double t,
+    float dt) {
+    int rows = kernel->polar_rows[0] + kernel->polar_rows[1];
+    if (rows == 0) {
+        return;
+    }
+    set_phase(&kernel->filter, t, dt);
+    glUniform1i(kernel->mode_l, mode);
+    glDispatchCompute(1, (unsigned int) rows, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+static void forward_step(adjoint_kernel_t* kernel, size_t nx, size_t ny,
+    unsigned int in, unsigned int out, double t, float dt) {
+    glBindImageTexture(0, in, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(1, out, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    filter_polar(kernel, 0, t, dt);
+    dispatch(&kernel->forward, nx, ny, t, dt);
+}
+
+// cos(lat) weights of the cells between lat0 and lat1, normalized so that
+// J = sum(w * Ts)
+static float* make_objective_weights(model_initial_t* initial, size_t nx,
+    size_t ny, float lat0, float lat1) {
+    float* w = (float*) mem_alloc(MEM_FIELDS, nx * ny * sizeof(float));
+    double wsum = 0.0;
+    for (size_t y = 0; y < ny; y++) {
+        float lat = initial->lats[y];
+        float wy = (lat >= lat0 && lat <= lat1) ? cos(deg2rad(lat)) : 0.0f;
+        for (size_t x = 0; x < nx; x++) {
+            w[(y * nx) + x] = wy;
+        }
+        wsum += wy * nx;
+    }
+    if (wsum <= 0.0) {
+        printf("Error: no grid rows between %.2f and %.2f.\n", lat0, lat1);
+        exit(1);
+    }
+    for (size_t i = 0; i < nx * ny; i++) {
+        w[i] /= wsum;
+    }
+    return w;
+}
+
+static double weighted_sum(float* w, float* field, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (double) w[i] * field[i];
+    }
+    return sum;
+}
+
+// check the adjoint against the tangent linear model along a direction
+// that perturbs every parameter everywhere. This costs another forward run,
+// so it is only done when asked for. The first two tape textures are used
+// as ping-pong buffers and T as scratch.
+static void gradient_check(adjoint_kernel_t* kernel, size_t nx, size_t ny,
+    int n_steps, float dt, unsigned int* tape, float* checkpoints, float* w,
+    float** fields, float* T) {
+    size_t n = nx * ny;
+    const float dp[N_GRADIENTS] = {1.0f, 0.01f, 1.0f, 0.01f, 0.01f, 0.01f};
+    float* dparam = (float*) mem_alloc(MEM_STAGING, n * 4 * sizeof(float));
+    unsigned int dparam_textures[2];
+    for (int half = 0; half < 2; half++) {
+        for (size_t i = 0; i < n; i++) {
+            dparam[(i * 4) + 0] = dp[(half * 3) + 0];
+            dparam[(i * 4) + 1] = dp[(half * 3) + 1];
+            dparam[(i * 4) + 2] = dp[(half * 3) + 2];
+            dparam[(i * 4) + 3] = 0.0f;
+        }
+        dparam_textures[half] = make_field_texture(nx, ny, 4, dparam);
+    }
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, dparam_textures[0]);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, dparam_textures[1]);
+    glActiveTexture(GL_TEXTURE0);
+    memset(dparam, 0, n * 4 * sizeof(float));
+    unsigned int tl[2] = {
+        make_field_texture(nx, ny, 1, dparam),
+        make_field_texture(nx, ny, 1, dparam)
+    };
+
+    upload_field(tape[0], nx, ny, &checkpoints[0]);
+    int cur = 0;
+    for (int step = 0; step < n_steps; step++) {
+        glBindImageTexture(0, tape[cur], 0, GL_FALSE, 0, GL_READ_ONLY,
+            GL_R32F);
+        glBindImageTexture(1, tl[cur], 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(2, tl[1 - cur], 0, GL_FALSE, 0, GL_WRITE_ONLY,
+            GL_R32F);
+        filter_polar(kernel, 1, (double) step * dt, dt);
+        dispatch(&kernel->tangent, nx, ny, (double) step * dt, dt);
+        forward_step(kernel, nx, ny, tape[cur], tape[1 - cur],
+            (double) step * dt, dt);
+        cur = 1 - cur;
+    }
+    read_field(tl[cur], 1, T);
+    double dJ_tangent = weighted_sum(w, T, n);
+    double dJ_adjoint = 0.0;
+    for (int k = 0; k < N_GRADIENTS; k++) {
+        for (size_t i = 0; i < n; i++) {
+            dJ_adjoint += (double) fields[k][i] * dp[k];
+        }
+    }
+    printf("Gradient check: tangent=%.6e adjoint=%.6e rel=%.2e\n", dJ_tangent,
+        dJ_adjoint, fabs(dJ_tangent - dJ_adjoint) /
+        fmax(fabs(dJ_tangent), 1e-30));
+
+    mem_free(dparam);
+    mem_delete_textures(2, tl);
+    mem_delete_textures(2, dparam_textures);
+}
+
+int run_adjoint(model_options_t* opts, adjoint_kernel_t* kernel,
+    model_initial_t* initial, size_t nx, size_t ny, model_storage_t* model,
+    unsigned int solar_LUT, float* data) {
+    size_t n = nx * ny;
+    float dt = model->timestep;
+    int n_steps = model->n_timesteps;
+
+    // keep sqrt(n) checkpoints, recompute each segment between them once
+    int seg_len = (int) ceil(sqrt((double) n_steps));
+    int n_segs = (n_steps + seg_len - 1) / seg_len;
+    printf("Adjoint: steps=%d checkpoints=%d segment=%d\n", n_steps, n_segs,
+        seg_len);
+
+    // initial temperature from the RGBA state
+    float* T = (float*) mem_alloc(MEM_STAGING, n * sizeof(float));
+    for (size_t i = 0; i < n; i++) {
+        T[i] = data[i * 4];
+    }
+    float* checkpoints = (float*) mem_alloc(MEM_STAGING,
+        (size_t) n_segs * n * sizeof(float));
+
+    // tape of states within a segment, the first two double as ping-pong
+    // buffers for the forward sweep
+    unsigned int* tape = (unsigned int*) mem_alloc(MEM_STAGING,
+        (seg_len + 1) * sizeof(unsigned int));
+    for (int k = 0; k <= seg_len; k++) {
+        tape[k] = make_field_texture(nx, ny, 1, T);
+    }
+
+    unsigned int LUT1, LUT2;
+    make_LUTs(nx, ny, initial, &LUT1, &LUT2);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, solar_LUT);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, LUT1);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, LUT2);
+    glActiveTexture(GL_TEXTURE0);
+
+    // forward sweep, saving checkpoints and output frames. Only Ts is
+    // written, the other channels of the frame stay zero.
+    float* frame = (float*) mem_calloc(MEM_STAGING, n * 4, sizeof(float));
+    double t_start = glfwGetTime();
+    int cur = 0;
+    for (int step = 0; step < n_steps; step++) {
+        if (step % seg_len == 0) {
+            read_field(tape[cur], 1, &checkpoints[(step / seg_len) * n]);
+        }
+        forward_step(kernel, nx, ny, tape[cur], tape[1 - cur],
+            (double) step * dt, dt);
+        cur = 1 - cur;
+
+        if (step % 500 == 0 || step == n_steps - 1) {
+            read_field(tape[cur], 1, T);
+            for (size_t i = 0; i < n; i++) {
+                frame[i * 4] = T[i];
+            }
+            model_storage_add_frame(model, (double) (step + 1) * dt, frame);
+        }
+    }
+    double t_forward = glfwGetTime() - t_start;
+
+    // objective and its sensitivity to the final state
+    float* w = make_objective_weights(initial, nx, ny, opts->adjoint_lat0,
+        opts->adjoint_lat1);
+    double J = weighted_sum(w, T, n);
+    printf("Objective: mean Ts between %.2f and %.2f = %.4f K\n",
+        opts->adjoint_lat0, opts->adjoint_lat1, J);
+
+    float* zeros = (float*) mem_calloc(MEM_STAGING, n * 4, sizeof(float));
+    unsigned int adj[2] = {
+        make_field_texture(nx, ny, 1, w),
+        make_field_texture(nx, ny, 1, zeros)
+    };
+    unsigned int grad1 = make_field_texture(nx, ny, 4, zeros);
+    unsigned int grad2 = make_field_texture(nx, ny, 4, zeros);
+    glBindImageTexture(3, grad1, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(4, grad2, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    // reverse sweep, one segment at a time from the last checkpoint
+    t_start = glfwGetTime();
+    int ac = 0;
+    for (int seg = n_segs - 1; seg >= 0; seg--) {
+        int s0 = seg * seg_len;
+        int s1 = (s0 + seg_len < n_steps) ? s0 + seg_len : n_steps;
+
+        upload_field(tape[0], nx, ny, &checkpoints[seg * n]);
+        for (int step = s0; step < s1 - 1; step++) {
+            forward_step(kernel, nx, ny, tape[step - s0], tape[step - s0 + 1],
+                (double) step * dt, dt);
+        }
+
+        for (int step = s1 - 1; step >= s0; step--) {
+            glBindImageTexture(0, tape[step - s0], 0, GL_FALSE, 0,
+                GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, adj[ac], 0, GL_FALSE, 0, GL_READ_ONLY,
+                GL_R32F);
+            glBindImageTexture(2, adj[1 - ac], 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                GL_R32F);
+            filter_polar(kernel, 2, (double) step * dt, dt);
+            dispatch(&kernel->adjoint, nx, ny, (double) step * dt, dt);
+            ac = 1 - ac;
+        }
+    }
+    double t_reverse = glfwGetTime() - t_start;
+
+    // unpack gradients, A, B, depth, a0, a2, ai, then the initial state
+    float* g1 = (float*) mem_alloc(MEM_STAGING, n * 4 * sizeof(float));
+    float* g2 = (float*) mem_alloc(MEM_STAGING, n * 4 * sizeof(float));
+    read_field(grad1, 4, g1);
+    read_field(grad2, 4, g2);
+    float* fields[N_GRADIENTS + 1];
+    for (int k = 0; k <= N_GRADIENTS; k++) {
+        fields[k] = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            fields[k][i] = g1[(i * 4) + k];
+            fields[k + 3][i] = g2[(i * 4) + k];
+        }
+    }
+    read_field(adj[ac], 1, fields[N_GRADIENTS]);
+
+    double t_tangent = 0.0;
+    if (opts->adjoint_check) {
+        t_start = glfwGetTime();
+        gradient_check(kernel, nx, ny, n_steps, dt, tape, checkpoints, w,
+            fields, T);
+        t_tangent = glfwGetTime() - t_start;
+    }
+    printf("Adjoint complete: forward=%.2fs reverse=%.2fs", t_forward,
+        t_reverse);
+    if (opts->adjoint_check) {
+        printf(" tangent=%.2fs", t_tangent);
+    }
+    printf("\n");
+
+    // forward trajectory first, then the gradients next to it
+    model_storage_write(nx, ny, model, initial, opts->output_path);
+    model_storage_free(model);
+    const char* names[N_GRADIENTS + 1] = {
+        "dJ_dA", "dJ_dB", "dJ_ddepth", "dJ_da0", "dJ_da2", "dJ_dai",
+        "dJ_dTs_initial"
+    };
+    const char* units[N_GRADIENTS + 1] = {
+        "K m2/W", "K2 m2/W", "K/m", "K", "K", "K", "none"
+    };
+    append_2d_fields(opts->output_path, nx, ny, N_GRADIENTS + 1, names,
+        units, fields);
+
+    // clean up
+    for (int k = 0; k <= N_GRADIENTS; k++) {
+        mem_free(fields[k]);
+    }
+    mem_free(g1);
+    mem_free(g2);
+    mem_free(zeros);
+    mem_free(w);
+    mem_free(T);
+    mem_free(checkpoints);
+    mem_free(frame);
+    mem_delete_textures(seg_len + 1, tape);
+    mem_free(tape);
+    mem_delete_textures(2, adj);
+    mem_delete_textures(1, &grad1);
+    mem_delete_textures(1, &grad2);
+    mem_delete_textures(1, &LUT1);
+    mem_delete_textures(1, &LUT2);
+
+    return 0;
+}
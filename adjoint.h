@@ -0,0 +1,31 @@
+#ifndef _ADJOINT_H
+#define _ADJOINT_H
+
+#include <stddef.h>
+#include "nctools.h"
+#include "options.h"
+
+// one of the forward, tangent linear or adjoint kernels
+typedef struct {
+    unsigned int program;
+    unsigned int year_frac_l, day_frac_l, dt_l, daily_mean_l, polar_rows_l;
+} adjoint_program_t;
+
+// the polar rows are filtered by polar_linear.cs before each of the others
+typedef struct {
+    adjoint_program_t forward, tangent, adjoint, filter;
+    unsigned int mode_l, polar_cos_l;
+    int polar_rows[2];
+    unsigned int zonal_texture; // 0 when no rows are filtered
+} adjoint_kernel_t;
+
+void init_adjoint_kernel(adjoint_kernel_t* kernel, int daily_mean);
+void adjoint_kernel_set_polar_filter(adjoint_kernel_t* kernel,
+    model_initial_t* initial, size_t nx, size_t ny, float polar_lat);
+void adjoint_kernel_free(adjoint_kernel_t* kernel);
+
+int run_adjoint(model_options_t* opts, adjoint_kernel_t* kernel,
+    model_initial_t* initial, size_t nx, size_t ny, model_storage_t* model,
+    unsigned int solar_LUT, float* data);
+
+#endif // _ADJOINT_H
@@ -0,0 +1,333 @@
+#include "batch.h"
+#include "common.h"
+#include "initial.h"
+#include "fetch.h"
+#include "nctools.h"
+#include "spinup.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+// input read on a background thread while the previous job runs
+typedef struct {
+    char* path;
+    size_t nx, ny;
+    model_initial_t model;
+    pthread_t thread;
+} batch_prefetch_t;
+
+static int parse_param(const char* name, batch_param_t* param) {
+    if (strcmp(name, "A") == 0) {
+        *param = BATCH_PARAM_A;
+    } else if (strcmp(name, "B") == 0) {
+        *param = BATCH_PARAM_B;
+    } else if (strcmp(name, "depth") == 0) {
+        *param = BATCH_PARAM_DEPTH;
+    } else if (strcmp(name, "a0") == 0) {
+        *param = BATCH_PARAM_A0;
+    } else if (strcmp(name, "a2") == 0) {
+        *param = BATCH_PARAM_A2;
+    } else if (strcmp(name, "ai") == 0) {
+        *param = BATCH_PARAM_AI;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// parse "name=value" or "name*=value"
+static void parse_override(char* token, int line, batch_override_t* o) {
+    char* eq = strchr(token, '=');
+    if (eq == NULL || eq == token) {
+        printf("Error: bad override '%s' on line %d of job list.\n",
+            token, line);
+        exit(1);
+    }
+    *eq = '\0';
+    o->scale = 0;
+    if (eq[-1] == '*') {
+        o->scale = 1;
+        eq[-1] = '\0';
+    }
+    if (!parse_param(token, &o->param)) {
+        printf("Error: unknown parameter '%s' on line %d of job list.\n",
+            token, line);
+        exit(1);
+    }
+    o->value = atof(eq + 1);
+}
+
+// each line is "<input.nc|-> <output.nc> [overrides...]", # starts a comment
+static batch_job_t* read_jobs(const char* path, int* n_jobs) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Error: unable to open job list %s\n", path);
+        exit(1);
+    }
+
+    int capacity = 16;
+    batch_job_t* jobs = (batch_job_t*) malloc(capacity * sizeof(batch_job_t));
+    *n_jobs = 0;
+
+    char buffer[1024];
+    int line = 0;
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        line++;
+        char* comment = strchr(buffer, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char* input = strtok(buffer, " \t\r\n");
+        if (input == NULL) {
+            continue;
+        }
+        char* output = strtok(NULL, " \t\r\n");
+        if (output == NULL) {
+            printf("Error: missing output path on line %d of job list.\n",
+                line);
+            exit(1);
+        }
+
+        if (*n_jobs == capacity) {
+            capacity *= 2;
+            jobs = (batch_job_t*) realloc(jobs,
+                capacity * sizeof(batch_job_t));
+        }
+        batch_job_t* job = &jobs[(*n_jobs)++];
+        job->input_path = (strcmp(input, "-") == 0) ? NULL : strdup(input);
+        job->output_path = strdup(output);
+        job->n_overrides = 0;
+
+        char* token;
+        while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+            if (job->n_overrides == BATCH_MAX_OVERRIDES) {
+                printf("Error: too many overrides on line %d of job list.\n",
+                    line);
+                exit(1);
+            }
+            parse_override(token, line, &job->overrides[job->n_overrides++]);
+        }
+    }
+    fclose(file);
+
+    if (*n_jobs == 0 || jobs[0].input_path == NULL) {
+        printf("Error: the first job in %s must name an input file.\n", path);
+        exit(1);
+    }
+
+    return jobs;
+}
+
+static void* prefetch_main(void* arg) {
+    batch_prefetch_t* prefetch = (batch_prefetch_t*) arg;
+    read_input(prefetch->path, &prefetch->nx, &prefetch->ny, &prefetch->model);
+    return NULL;
+}
+
+static void start_prefetch(batch_prefetch_t* prefetch, char* path) {
+    prefetch->path = path;
+    if (pthread_create(&prefetch->thread, NULL, prefetch_main, prefetch)) {
+        printf("Error: unable to start input prefetch thread.\n");
+        exit(1);
+    }
+}
+
+static void finish_prefetch(batch_prefetch_t* prefetch) {
+    pthread_join(prefetch->thread, NULL);
+}
+
+static void apply_overrides(batch_job_t* job, model_initial_t* m, size_t n) {
+    for (int k = 0; k < job->n_overrides; k++) {
+        batch_override_t* o = &job->overrides[k];
+        float* field;
+        switch (o->param) {
+        case BATCH_PARAM_A:     field = m->As;     break;
+        case BATCH_PARAM_B:     field = m->Bs;     break;
+        case BATCH_PARAM_DEPTH: field = m->depths; break;
+        case BATCH_PARAM_A0:    field = m->a0s;    break;
+        case BATCH_PARAM_A2:    field = m->a2s;    break;
+        default:                field = m->ais;    break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            field[i] = o->scale ? field[i] * o->value : o->value;
+        }
+    }
+}
+
+// integrate one job from rest and write its output, returns steps taken.
+// Metrics count steps_done from the earlier jobs as well, so the step
+// counter keeps growing across jobs.
+static int run_job(batch_job_t* job, model_options_t* opts,
+    compute_kernel_t* kernel, unsigned int solar_LUT, model_state_t* state,
+    model_initial_t* m, metrics_t* metrics, unsigned long long steps_done) {
+    model_storage_t model;
+    init_model_storage(&model, opts->run_years * days_per_year, state->nx, state->ny);
+    if (opts->timestep > 0.0f) {
+        model.timestep = opts->timestep / (24.0f * 60.0f);
+        model.n_timesteps = (int) ceil(model.final_time / model.timestep);
+    }
+
+    float* data;
+    if (opts->spinup_levels > 0) {
+        data = run_spinup(m, state->nx, state->ny, opts, kernel, solar_LUT,
+            model.timestep);
+    } else {
+        data = make_2d_initial(state->nx, state->ny);
+    }
+    model_state_reset(state, m, data);
+
+    // the starting state buffer is reused for every sample
+    float* frame = data;
+
+    float Tmin =  1e9; float qmin =  1e9; float umin =  1e9; float vmin =  1e9;
+    float Tmax = 1e-9; float qmax = -1e9; float umax = -1e9; float vmax = -1e9;
+
+    // time is derived from the step count so it never accumulates rounding
+    double t = 0.0;
+    float dt = model.timestep;
+    unsigned long long step = 0;
+    long pending_frames = 0;
+    double t_phase = glfwGetTime();
+    while (1) {
+        // diagnostics are only written on steps that are sampled
+        int sample = (step % 500 == 0) || (t + dt > model.final_time);
+        metrics_gpu_begin(metrics, METRICS_PHASE_STEP);
+        model_state_step(state, kernel, solar_LUT, t, dt, sample);
+        metrics_gpu_end(metrics);
+        t = (double) (step + 1) * dt;
+        double t_now = glfwGetTime();
+        metrics_add_phase(metrics, METRICS_PHASE_STEP, t_now - t_phase);
+        metrics_progress(metrics, steps_done + step + 1, t, dt, t_now);
+        t_phase = t_now;
+
+        if (sample) {
+            fetch_2d_state(model_state_texture(state), state->diag_texture,
+                state->nx, state->ny, m->lats, frame, &Tmax, &Tmin, &qmax,
+                &qmin, &umax, &umin, &vmax, &vmin);
+            metrics_set_Tmean(metrics, global_mean_T(frame, state->nx,
+                state->ny, m->lats));
+            model_storage_add_frame(&model, t, frame);
+            metrics_set_pending_frames(metrics, ++pending_frames);
+            t_now = glfwGetTime();
+            metrics_add_phase(metrics, METRICS_PHASE_READBACK, t_now - t_phase);
+            t_phase = t_now;
+        }
+        if (sample && t > model.final_time) {
+            break;
+        }
+        step++;
+    }
+
+    model_storage_write(state->nx, state->ny, &model, m, job->output_path);
+    model_storage_free(&model);
+    mem_free(frame);
+    metrics_set_pending_frames(metrics, 0);
+    metrics_add_phase(metrics, METRICS_PHASE_OUTPUT, glfwGetTime() - t_phase);
+
+    return step + 1;
+}
+
+int run_batch(model_options_t* opts, compute_kernel_t* kernel,
+    unsigned int solar_LUT, metrics_t* metrics) {
+    int n_jobs;
+    batch_job_t* jobs = read_jobs(opts->batch_path, &n_jobs);
+    printf("Batch: %d jobs from %s\n", n_jobs, opts->batch_path);
+    if (opts->reduced_grid || opts->daily_mean) {
+        printf("Note: batch jobs always step the full 2-D grid.\n");
+    }
+
+    batch_prefetch_t prefetch;
+    start_prefetch(&prefetch, jobs[0].input_path);
+
+    model_initial_t base;
+    size_t nx = 0, ny = 0;
+    int have_base = 0;
+    model_state_t state;
+    int have_state = 0;
+
+    double t_batch = glfwGetTime();
+    double t_wait = 0.0;
+    unsigned long long steps_done = 0;
+    for (int i = 0; i < n_jobs; i++) {
+        batch_job_t* job = &jobs[i];
+
+        // pick up this job's input, then start reading the next one
+        if (job->input_path != NULL) {
+            double t_start = glfwGetTime();
+            finish_prefetch(&prefetch);
+            t_wait += glfwGetTime() - t_start;
+
+            if (have_base) {
+                free_initial(&base);
+            }
+            base = prefetch.model;
+            have_base = 1;
+            if (base.time_varying) {
+                printf("Warning: batch jobs only use the first time slice of "
+                    "%s.\n", job->input_path);
+            }
+
+            // textures are only reallocated when the grid changes
+            if (have_state && (prefetch.nx != nx || prefetch.ny != ny)) {
+                model_state_free(&state);
+                have_state = 0;
+            }
+            nx = prefetch.nx;
+            ny = prefetch.ny;
+
+            for (int j = i + 1; j < n_jobs; j++) {
+                if (jobs[j].input_path != NULL) {
+                    start_prefetch(&prefetch, jobs[j].input_path);
+                    break;
+                }
+            }
+        }
+
+        // parameter overrides act on a private copy of the input
+        model_initial_t work;
+        copy_initial(&base, &work, nx, ny);
+        apply_overrides(job, &work, nx * ny);
+        if (!have_state) {
+            float* data = make_2d_initial(nx, ny);
+            init_model_state(&state, nx, ny, &work, data);
+            model_state_set_polar_filter(&state, &work, opts->polar_lat);
+            mem_free(data);
+            have_state = 1;
+            metrics_set_gpu_bytes(metrics, model_state_gpu_bytes(&state));
+        }
+
+        printf("Job %d/%d: %s -> %s (%d overrides)\n", i + 1, n_jobs,
+            job->input_path ? job->input_path : "(previous input)",
+            job->output_path, job->n_overrides);
+        double t_start = glfwGetTime();
+        int steps = run_job(job, opts, kernel, solar_LUT, &state, &work,
+            metrics, steps_done);
+        steps_done += steps;
+        double t_job = glfwGetTime() - t_start;
+        printf("Job %d/%d done: steps=%d wall=%.2fs sps=%.1f\n", i + 1,
+            n_jobs, steps, t_job, steps / t_job);
+
+        free_initial(&work);
+    }
+
+    printf("Batch complete: jobs=%d wall=%.2fs input wait=%.2fs\n", n_jobs,
+        glfwGetTime() - t_batch, t_wait);
+
+    if (have_state) {
+        model_state_free(&state);
+    }
+    if (have_base) {
+        free_initial(&base);
+    }
+    for (int i = 0; i < n_jobs; i++) {
+        free(jobs[i].input_path);
+        free(jobs[i].output_path);
+    }
+    free(jobs);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "options.h"
+#include "model.h"
+#include "metrics.h"
+
+#define BATCH_MAX_OVERRIDES 8
+
+// which parameter field an override applies to
+typedef enum {
+    BATCH_PARAM_A,
+    BATCH_PARAM_B,
+    BATCH_PARAM_DEPTH,
+    BATCH_PARAM_A0,
+    BATCH_PARAM_A2,
+    BATCH_PARAM_AI
+} batch_param_t;
+
+// set (or with scale, multiply) a whole parameter field
+typedef struct {
+    batch_param_t param;
+    int scale;
+    float value;
+} batch_override_t;
+
+// one line of the job list, input_path is NULL when the previous input is
+// reused
+typedef struct {
+    char* input_path;
+    char* output_path;
+    int n_overrides;
+    batch_override_t overrides[BATCH_MAX_OVERRIDES];
+} batch_job_t;
+
+int run_batch(model_options_t* opts, compute_kernel_t* kernel,
+    unsigned int solar_LUT, metrics_t* metrics);
+
+#endif // _BATCH_H
@@ -0,0 +1,134 @@
+#include "column.h"
+#include "common.h"
+#include "initial.h"
+#include "renderutil.h"
+#include "mem.h"
+#include <stdlib.h>
+
+void init_column_kernel(column_kernel_t* kernel) {
+    kernel->program = create_cshader("shader/column.cs");
+    kernel->year_frac_l = glGetUniformLocation(kernel->program, "year_frac");
+    kernel->dt_l        = glGetUniformLocation(kernel->program, "dt");
+}
+
+void init_column_state(column_state_t* state, size_t nx, size_t ny,
+    model_initial_t* initial, float* data) {
+    state->nx = nx;
+    state->ny = ny;
+    state->current = 0;
+
+    // take the parameters from the first column, they are all the same
+    model_initial_t column;
+    column.lats   = initial->lats;
+    column.lons   = initial->lons;
+    column.Ts     = (float*) malloc(ny * sizeof(float));
+    column.Bs     = (float*) malloc(ny * sizeof(float));
+    column.As     = (float*) malloc(ny * sizeof(float));
+    column.depths = (float*) malloc(ny * sizeof(float));
+    column.a0s    = (float*) malloc(ny * sizeof(float));
+    column.a2s    = (float*) malloc(ny * sizeof(float));
+    column.ais    = (float*) malloc(ny * sizeof(float));
+    for (size_t y = 0; y < ny; y++) {
+        column.Ts[y]     = initial->Ts[y * nx];
+        column.Bs[y]     = initial->Bs[y * nx];
+        column.As[y]     = initial->As[y * nx];
+        column.depths[y] = initial->depths[y * nx];
+        column.a0s[y]    = initial->a0s[y * nx];
+        column.a2s[y]    = initial->a2s[y * nx];
+        column.ais[y]    = initial->ais[y * nx];
+    }
+    make_LUTs(1, ny, &column, &state->physp_LUT1, &state->physp_LUT2);
+    free(column.Ts);
+    free(column.Bs);
+    free(column.As);
+    free(column.depths);
+    free(column.a0s);
+    free(column.a2s);
+    free(column.ais);
+
+    // zonal mean of the initial state
+    float* col = (float*) malloc(ny * 4 * sizeof(float));
+    for (size_t y = 0; y < ny; y++) {
+        for (size_t ch = 0; ch < 4; ch++) {
+            float sum = 0.0f;
+            for (size_t x = 0; x < nx; x++) {
+                sum += data[(((y * nx) + x) * 4) + ch];
+            }
+            col[(y * 4) + ch] = sum / nx;
+        }
+    }
+
+    // create ping-pong state textures
+    glGenTextures(2, state->state_textures);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, state->state_textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 1, ny, 0,
+            GL_RGBA, GL_FLOAT, col);
+        mem_track_texture(state->state_textures[i], ny * 4 * sizeof(float));
+    }
+    free(col);
+}
+
+void column_state_step(column_state_t* state, column_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt) {
+    // bind state and lookup tables
+    glBindImageTexture(0, state->state_textures[state->current], 0, GL_FALSE,
+        0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(1, state->state_textures[1 - state->current], 0,
+        GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, solar_LUT);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, state->physp_LUT1);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, state->physp_LUT2);
+    glActiveTexture(GL_TEXTURE0);
+
+    // dispatch a single column
+    // the column is zonally averaged, so only the time of year matters
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+    glUseProgram(kernel->program);
+    glUniform1f(kernel->year_frac_l, year_frac);
+    glUniform1f(kernel->dt_l, dt);
+    glDispatchCompute(1, (unsigned int) state->ny / 32, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    state->current = 1 - state->current;
+}
+
+unsigned int column_state_texture(column_state_t* state) {
+    return state->state_textures[state->current];
+}
+
+void column_state_broadcast(column_state_t* state, float* data) {
+    size_t nx = state->nx;
+    size_t ny = state->ny;
+
+    // read the column back
+    float* col = (float*) malloc(ny * 4 * sizeof(float));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, column_state_texture(state));
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, col);
+
+    // and copy it along every row
+    for (size_t y = 0; y < ny; y++) {
+        for (size_t x = 0; x < nx; x++) {
+            for (size_t ch = 0; ch < 4; ch++) {
+                data[(((y * nx) + x) * 4) + ch] = col[(y * 4) + ch];
+            }
+        }
+    }
+    free(col);
+}
+
+void column_state_free(column_state_t* state) {
+    mem_delete_textures(2, state->state_textures);
+    mem_delete_textures(1, &state->physp_LUT1);
+    mem_delete_textures(1, &state->physp_LUT2);
+}
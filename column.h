@@ -0,0 +1,32 @@
+#ifndef _COLUMN_H
+#define _COLUMN_H
+
+#include <stddef.h>
+#include "nctools.h"
+
+// compiled single column shader
+typedef struct {
+    unsigned int program;
+    unsigned int year_frac_l, dt_l;
+} column_kernel_t;
+
+// latitude-only state for zonally symmetric runs, one texel per row
+typedef struct {
+    size_t nx, ny;
+    unsigned int state_textures[2];
+    unsigned int physp_LUT1, physp_LUT2;
+    int current;
+} column_state_t;
+
+void init_column_kernel(column_kernel_t* kernel);
+
+void init_column_state(column_state_t* state, size_t nx, size_t ny,
+    model_initial_t* initial, float* data);
+void column_state_step(column_state_t* state, column_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt);
+unsigned int column_state_texture(column_state_t* state);
+// fills data (nx * ny RGBA) with the column copied along every row
+void column_state_broadcast(column_state_t* state, float* data);
+void column_state_free(column_state_t* state);
+
+#endif // _COLUMN_H
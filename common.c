@@ -1,4 +1,5 @@
 #include "common.h"
+#include <math.h>
 
 float deg2rad(float x) {
     return pi / 180.0f * x;
@@ -10,6 +11,18 @@ void mmm(float x, float* min, float* max, float* mean) {
     *mean += x;
 }
 
+// split model time (days) into the fractions of the year and of the day that
+// the kernels take, float t alone loses the diurnal phase after a few decades
+void model_phase(double t, float* year_frac, float* day_frac) {
+    double year = fmod(t, (double) days_per_year) / (double) days_per_year;
+    double day = fmod(t, 1.0);
+    *year_frac = (float) year;
+    *day_frac = (float) day;
+    // rounding to float can land exactly on 1
+    if (*year_frac >= 1.0f) *year_frac = 0.0f;
+    if (*day_frac >= 1.0f) *day_frac = 0.0f;
+}
+
 // physical constants
 const float pi            =    3.14159265f;
 const float days_per_year =  365.2422f;
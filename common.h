@@ -16,6 +16,7 @@
 
 float deg2rad(float x);
 void mmm(float x, float* min, float* max, float* mean);
+void model_phase(double t, float* year_frac, float* day_frac);
 
 // physical constants
 extern const float pi, days_per_year, S0, ecc, obliquity, long_peri;
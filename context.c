@@ -0,0 +1,95 @@
+#include "context.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void error_callback(int error, const char* description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+static const char* get_gl_err_type_str(GLenum type) {
+    switch(type) {
+    case GL_DEBUG_TYPE_ERROR:
+        return "GL_ERROR";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+        return "GL_DEPRECATED_BEHAVIOR";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+        return "GL_UNDEFINED_BEHAVIOR";
+        break;
+    case GL_DEBUG_TYPE_PORTABILITY:
+        return "GL_PORTABILITY";
+    case GL_DEBUG_TYPE_PERFORMANCE:
+        return "GL_PERFORMANCE";
+    case GL_DEBUG_TYPE_OTHER:
+        return "GL_INFO";
+    }
+
+    return "GL_UNKNOWN";
+}
+
+static void GLAPIENTRY messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+	const GLchar* message, const void* userParam){
+
+    printf("[%s] type=%#02x severity=%#02x source=%#02x id=%#02x message: %s\n",
+        get_gl_err_type_str(type), type, severity, source, id, message);
+
+	if (type == GL_DEBUG_TYPE_ERROR) {
+		exit(-20); // commenting this makes screen sharing possible i have no idea why
+	}
+
+}
+
+// everything up to a current context with GL loaded, NULL on failure. This
+// never exits and installs no callbacks, so a library can use it inside a
+// host process.
+GLFWwindow* open_gl_context(int visible) {
+    if (!glfwInit()) {
+        printf("Error: unable to initialize GLFW.\n");
+        return NULL;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    #ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    #endif
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
+    // glfw window creation
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "glGCM", NULL, NULL);
+    if (window == NULL) {
+        printf("Error: unable to create a GL 4.3 context.\n");
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+
+    // initialize glew
+    GLenum res = glewInit();
+    if (res != GLEW_OK) {
+        printf("Error: unable to load GL entry points: %s\n",
+            glewGetErrorString(res));
+        glfwMakeContextCurrent(NULL);
+        glfwDestroyWindow(window);
+        return NULL;
+    }
+    return window;
+}
+
+GLFWwindow* create_gl_context(int visible) {
+    // register an error callback
+    glfwSetErrorCallback(error_callback);
+
+    GLFWwindow* window = open_gl_context(visible);
+    if (window == NULL) {
+        glfwTerminate();
+        exit(1);
+    }
+    printf("Loaded GLFW: %s\n", glfwGetVersionString());
+    printf("Loaded GLEW: %s\n", glewGetString(GLEW_VERSION));
+
+    // setup GL
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(messageCallback, 0);
+
+    return window;
+}
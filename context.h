@@ -0,0 +1,15 @@
+#ifndef _CONTEXT_H
+#define _CONTEXT_H
+
+#include "common.h"
+
+// create a GL 4.3 core context (hidden unless visible is set), make it
+// current and load the GL entry points. Exits on failure and stops on the
+// first GL error, which is what the glEBM executable wants.
+GLFWwindow* create_gl_context(int visible);
+
+// the same for a library inside someone else's process: returns NULL on
+// failure and leaves GL errors and the GLFW error callback alone
+GLFWwindow* open_gl_context(int visible);
+
+#endif // _CONTEXT_H
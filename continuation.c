@@ -0,0 +1,325 @@
+#include "continuation.h"
+#include "common.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char* field_names[GLEBM_N_PARAMS] = {
+    [GLEBM_A] = "A", [GLEBM_B] = "B", [GLEBM_DEPTH] = "depth",
+    [GLEBM_A0] = "a0", [GLEBM_A2] = "a2", [GLEBM_AI] = "ai"
+};
+static const char* field_units[GLEBM_N_PARAMS] = {
+    [GLEBM_A] = "W/m^2", [GLEBM_B] = "W/m^2/K", [GLEBM_DEPTH] = "m",
+    [GLEBM_A0] = "1", [GLEBM_A2] = "1", [GLEBM_AI] = "1"
+};
+
+static int find_field(const char* name) {
+    for (int k = 0; k < GLEBM_N_PARAMS; k++) {
+        if (strcmp(name, field_names[k]) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// units of the swept parameter, NULL if it is unknown
+static const char* param_units(const char* name) {
+    int k = find_field(name);
+    if (k >= 0) {
+        return field_units[k];
+    } else if (strcmp(name, "S0") == 0) {
+        return "W/m^2";
+    } else if (strcmp(name, "D") == 0) {
+        return "W/m^2/K";
+    } else if (strcmp(name, "Tf") == 0) {
+        return "K";
+    }
+    return NULL;
+}
+
+// the swept parameter as it was before the sweep, every point offsets or
+// scales this value like the steering commands do
+typedef struct {
+    const char* name;
+    char op;
+    int field;       // -1 for a constant
+    float* original; // n, fields only
+    float original_constant;
+    size_t n;
+} sweep_param_t;
+
+static float* constant_target(glebm_constants_t* c, const char* name) {
+    if (strcmp(name, "S0") == 0) {
+        return &c->solar_constant;
+    } else if (strcmp(name, "D") == 0) {
+        return &c->diffusivity;
+    }
+    return &c->freezing_T;
+}
+
+static float apply_op(float x, char op, float value) {
+    switch (op) {
+    case '+':
+        return x + value;
+    case '*':
+        return x * value;
+    default:
+        return value;
+    }
+}
+
+static void init_sweep_param(sweep_param_t* p, glebm_t* sim, const char* name,
+    char op, size_t n) {
+    p->name = name;
+    p->op = op;
+    p->field = find_field(name);
+    p->original = NULL;
+    p->n = n;
+    if (p->field >= 0) {
+        p->original = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+        memcpy(p->original, glebm_param(sim, (glebm_param_t) p->field),
+            n * sizeof(float));
+    } else {
+        glebm_constants_t c;
+        glebm_constants(sim, &c);
+        p->original_constant = *constant_target(&c, name);
+    }
+}
+
+// depth, B and the constants divide or scale the tendency, so they have to
+// stay positive at the value in every cell
+static int sweep_stays_positive(const sweep_param_t* p, float value) {
+    if (p->field < 0) {
+        return apply_op(p->original_constant, p->op, value) > 0.0f;
+    }
+    if (p->field != GLEBM_DEPTH && p->field != GLEBM_B) {
+        return 1;
+    }
+    for (size_t i = 0; i < p->n; i++) {
+        if (apply_op(p->original[i], p->op, value) <= 0.0f) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void set_param(glebm_t* sim, const sweep_param_t* p, float value) {
+    if (p->field >= 0) {
+        float* field = glebm_param(sim, (glebm_param_t) p->field);
+        for (size_t i = 0; i < p->n; i++) {
+            field[i] = apply_op(p->original[i], p->op, value);
+        }
+        glebm_params_changed(sim);
+        return;
+    }
+
+    glebm_constants_t c;
+    glebm_constants(sim, &c);
+    *constant_target(&c, p->name) =
+        apply_op(p->original_constant, p->op, value);
+    glebm_set_constants(sim, &c);
+}
+
+// integrate whole years from the current state until the annual mean global
+// temperature changes by less than tol, the annual means of the last year
+// go into point
+static void find_equilibrium(glebm_t* sim, size_t ny, float tol,
+    int max_years, sweep_point_t* point) {
+    glebm_constants_t c;
+    glebm_constants(sim, &c);
+    float dt = c.timestep / (24.0f * 60.0f);
+    unsigned long long steps_per_year =
+        (unsigned long long) roundf(days_per_year / dt);
+
+    float Tlast = 0.0f;
+    point->converged = 0;
+    for (point->years = 1; point->years <= max_years; point->years++) {
+        double sums[7] = { 0.0 };
+        for (size_t j = 0; j < ny; j++) {
+            point->Ts_zonal[j] = 0.0f;
+        }
+
+        // the stats are reduced on the GPU, so sampling is cheap
+        for (int k = 0; k < SWEEP_SAMPLES; k++) {
+            glebm_step(sim, (k + 1) * steps_per_year / SWEEP_SAMPLES -
+                k * steps_per_year / SWEEP_SAMPLES);
+            glebm_stats_t stats;
+            glebm_stats(sim, &stats);
+            sums[0] += stats.Ts;
+            sums[1] += stats.ASR;
+            sums[2] += stats.OLR;
+            sums[3] += stats.imbalance;
+            sums[4] += stats.ice_edge[0];
+            sums[5] += stats.ice_edge[1];
+            sums[6] += stats.ice_fraction;
+            for (size_t j = 0; j < ny; j++) {
+                point->Ts_zonal[j] += stats.zonal[j * 4] / SWEEP_SAMPLES;
+            }
+        }
+        point->Ts           = sums[0] / SWEEP_SAMPLES;
+        point->ASR          = sums[1] / SWEEP_SAMPLES;
+        point->OLR          = sums[2] / SWEEP_SAMPLES;
+        point->imbalance    = sums[3] / SWEEP_SAMPLES;
+        point->ice_edge[0]  = sums[4] / SWEEP_SAMPLES;
+        point->ice_edge[1]  = sums[5] / SWEEP_SAMPLES;
+        point->ice_fraction = sums[6] / SWEEP_SAMPLES;
+
+#ifndef REDUCED_OUTPUT
+        printf("  year=%d Tmean=%.4f dT=%.4e imbalance=%.3f\n", point->years,
+            point->Ts, point->Ts - Tlast, point->imbalance);
+#endif // REDUCED_OUTPUT
+        if (point->years > 1 && fabsf(point->Ts - Tlast) < tol) {
+            point->converged = 1;
+            break;
+        }
+        Tlast = point->Ts;
+    }
+    if (!point->converged) {
+        point->years = max_years;
+    }
+}
+
+static void write_sweep(model_options_t* opts, sweep_point_t* points,
+    int n_points, size_t ny) {
+    const char* names[] = {
+        "sweep_direction", "sweep_years", "Ts_global", "ASR_global",
+        "OLR_global", "imbalance_global", "ice_edge_south", "ice_edge_north",
+        "ice_fraction", "Ts_zonal"
+    };
+    const char* units[] = {
+        "1", "years", "K", "W/m^2", "W/m^2", "W/m^2", "degrees_north",
+        "degrees_north", "1", "K"
+    };
+    const int n_vars = sizeof(names) / sizeof(names[0]);
+    int lengths[sizeof(names) / sizeof(names[0])];
+    float* values[sizeof(names) / sizeof(names[0])];
+    for (int k = 0; k < n_vars; k++) {
+        lengths[k] = (k == n_vars - 1) ? (int) ny : 1;
+        values[k] = (float*) malloc(n_points * lengths[k] * sizeof(float));
+    }
+
+    double* sweep_values = (double*) malloc(n_points * sizeof(double));
+    for (int i = 0; i < n_points; i++) {
+        sweep_point_t* p = &points[i];
+        sweep_values[i] = p->value;
+        values[0][i] = (float) p->direction;
+        values[1][i] = p->converged ? (float) p->years : -(float) p->years;
+        values[2][i] = p->Ts;
+        values[3][i] = p->ASR;
+        values[4][i] = p->OLR;
+        values[5][i] = p->imbalance;
+        values[6][i] = p->ice_edge[0];
+        values[7][i] = p->ice_edge[1];
+        values[8][i] = p->ice_fraction;
+        memcpy(&values[9][i * ny], p->Ts_zonal, ny * sizeof(float));
+    }
+
+    // a scale has no units of its own
+    const char* axis_units = (opts->sweep_op == '*') ? "1" :
+        param_units(opts->sweep_param);
+    append_time_series(opts->output_path, "sweep_value", axis_units, n_points,
+        sweep_values, n_vars, names, units, lengths, values);
+
+    free(sweep_values);
+    for (int k = 0; k < n_vars; k++) {
+        free(values[k]);
+    }
+}
+
+// step one parameter up through the schedule and back down, every point
+// starting from the equilibrium of the one before
+int run_continuation(model_options_t* opts, glebm_t* sim,
+    model_initial_t* initial, size_t nx, size_t ny) {
+    if (param_units(opts->sweep_param) == NULL) {
+        printf("Error: unknown sweep parameter '%s'.\n", opts->sweep_param);
+        exit(1);
+    }
+    if (find_field(opts->sweep_param) >= 0 && opts->sweep_op == '=') {
+        printf("Error: fields are swept as an offset (%s+) or a scale (%s*) "
+            "of the input.\n", opts->sweep_param, opts->sweep_param);
+        exit(1);
+    }
+
+    // the values are printed as name+ or name* for offsets and scales
+    char label[20];
+    snprintf(label, sizeof(label), "%s%s", opts->sweep_param,
+        (opts->sweep_op == '+') ? "+" : (opts->sweep_op == '*') ? "*" : "");
+    sweep_param_t param;
+    init_sweep_param(&param, sim, opts->sweep_param, opts->sweep_op, nx * ny);
+    if (!sweep_stays_positive(&param, opts->sweep_from) ||
+        !sweep_stays_positive(&param, opts->sweep_to)) {
+        printf("Error: %s must stay positive over the sweep.\n",
+            opts->sweep_param);
+        exit(1);
+    }
+
+    float span = opts->sweep_to - opts->sweep_from;
+    float step = (span > 0.0f) ? opts->sweep_step : -opts->sweep_step;
+    int n_values = (int) floorf(fabsf(span) / opts->sweep_step + 1e-3f) + 1;
+    int n_points = 2 * n_values;
+    printf("Continuation: %s from %g to %g and back in %d steps\n",
+        label, opts->sweep_from, opts->sweep_to, n_values - 1);
+
+    // every equilibrium is also kept as a frame of the output file
+    model_storage_t model;
+    init_model_storage(&model, 0.0, nx, ny);
+
+    sweep_point_t* points =
+        (sweep_point_t*) malloc(n_points * sizeof(sweep_point_t));
+    double t_start = glfwGetTime();
+    for (int i = 0; i < n_points; i++) {
+        sweep_point_t* p = &points[i];
+        int k = (i < n_values) ? i : n_points - 1 - i;
+        p->value = opts->sweep_from + k * step;
+        p->direction = (i < n_values) ? 1 : -1;
+        p->Ts_zonal = (float*) malloc(ny * sizeof(float));
+
+        set_param(sim, &param, p->value);
+        find_equilibrium(sim, ny, opts->spinup_tol, opts->spinup_max_years,
+            p);
+        printf("Point %d/%d: %s=%g %s years=%d Tmean=%.3f ice edges=%.1f,%.1f"
+            "%s\n", i + 1, n_points, label, p->value,
+            (p->direction > 0) ? "up" : "down", p->years, p->Ts,
+            p->ice_edge[0], p->ice_edge[1],
+            p->converged ? "" : " (not converged)");
+
+        model_storage_add_frame(&model, glebm_time(sim),
+            glebm_diagnostics(sim));
+    }
+
+    // the branches split where the ice-albedo feedback switches states
+    float lo = 0.0f, hi = 0.0f;
+    int split = 0;
+    for (int k = 0; k < n_values; k++) {
+        sweep_point_t* up = &points[k];
+        sweep_point_t* down = &points[n_points - 1 - k];
+        if (up->converged && down->converged &&
+            fabsf(up->Ts - down->Ts) > 1.0f) {
+            lo = split ? fminf(lo, up->value) : up->value;
+            hi = split ? fmaxf(hi, up->value) : up->value;
+            split = 1;
+        }
+    }
+    if (split) {
+        printf("Continuation complete: branches differ by more than 1 K for "
+            "%s in [%g, %g], wall=%.2fs\n", label, lo, hi,
+            glfwGetTime() - t_start);
+    } else {
+        printf("Continuation complete: no hysteresis, wall=%.2fs\n",
+            glfwGetTime() - t_start);
+    }
+
+    model_storage_write(nx, ny, &model, initial, opts->output_path);
+    model_storage_free(&model);
+    write_sweep(opts, points, n_points, ny);
+
+    for (int i = 0; i < n_points; i++) {
+        free(points[i].Ts_zonal);
+    }
+    free(points);
+    mem_free(param.original);
+
+    return 0;
+}
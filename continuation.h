@@ -0,0 +1,26 @@
+#ifndef _CONTINUATION_H
+#define _CONTINUATION_H
+
+#include <stddef.h>
+#include "nctools.h"
+#include "options.h"
+#include "glebm.h"
+
+#define SWEEP_SAMPLES 24 // stats samples per year for the annual means
+
+// annual mean equilibrium at one value of the swept parameter
+typedef struct {
+    float value;
+    int direction; // 1 on the way up, -1 on the way back
+    int years;
+    int converged;
+    float Ts, ASR, OLR, imbalance;
+    float ice_edge[2];
+    float ice_fraction;
+    float* Ts_zonal; // ny
+} sweep_point_t;
+
+int run_continuation(model_options_t* opts, glebm_t* sim,
+    model_initial_t* initial, size_t nx, size_t ny);
+
+#endif // _CONTINUATION_H
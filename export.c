@@ -0,0 +1,349 @@
+#include "export.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <zlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static void put_u32(unsigned char* p, unsigned int v) {
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static void write_chunk(FILE* file, const char* type,
+    const unsigned char* data, unsigned int length) {
+    unsigned char head[8], tail[4];
+    put_u32(head, length);
+    memcpy(&head[4], type, 4);
+    uLong crc = crc32(0L, &head[4], 4);
+    if (length > 0) {
+        // crc32 with a NULL buffer returns the initial value
+        crc = crc32(crc, data, length);
+    }
+    put_u32(tail, (unsigned int) crc);
+
+    fwrite(head, 1, 8, file);
+    fwrite(data, 1, length, file);
+    fwrite(tail, 1, 4, file);
+}
+
+// 8 bit RGB PNG, rows are flipped so north ends up on top
+static void write_png(const char* path, int width, int height,
+    const unsigned char* pixels) {
+    size_t row = 3 * (size_t) width;
+    size_t raw_size = (row + 1) * height;
+    unsigned char* raw = (unsigned char*) mem_alloc(MEM_STAGING, raw_size);
+    for (int y = 0; y < height; y++) {
+        unsigned char* out = &raw[y * (row + 1)];
+        out[0] = 0; // no filter
+        memcpy(&out[1], &pixels[(height - 1 - y) * row], row);
+    }
+
+    uLongf packed_size = compressBound(raw_size);
+    unsigned char* packed = (unsigned char*) mem_alloc(MEM_STAGING,
+        packed_size);
+    compress2(packed, &packed_size, raw, raw_size, Z_BEST_SPEED);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Error: unable to write %s.\n", path);
+        exit(1);
+    }
+    static const unsigned char signature[8] =
+        { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    unsigned char header[13];
+    put_u32(&header[0], width);
+    put_u32(&header[4], height);
+    header[8] = 8;  // bit depth
+    header[9] = 2;  // RGB
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering
+    header[12] = 0; // not interlaced
+    fwrite(signature, 1, 8, file);
+    write_chunk(file, "IHDR", header, 13);
+    write_chunk(file, "IDAT", packed, packed_size);
+    write_chunk(file, "IEND", NULL, 0);
+    fclose(file);
+
+    mem_free(raw);
+    mem_free(packed);
+}
+
+// 0 once the command has gone away
+static int write_raw(FILE* pipe, int width, int height,
+    const unsigned char* pixels) {
+    size_t row = 3 * (size_t) width;
+    for (int y = height - 1; y >= 0; y--) {
+        if (fwrite(&pixels[y * row], 1, row, pipe) != row) {
+            return 0;
+        }
+    }
+    return fflush(pipe) == 0 && !ferror(pipe);
+}
+
+static void* export_worker(void* arg) {
+    export_t* e = (export_t*) arg;
+    char path[1024];
+
+    pthread_mutex_lock(&e->lock);
+    while (1) {
+        if (e->queue_count == 0) {
+            if (!e->running) {
+                break;
+            }
+            pthread_cond_wait(&e->ready, &e->lock);
+            continue;
+        }
+        export_job_t job = e->queue[e->queue_head];
+        e->queue_head = (e->queue_head + 1) % EXPORT_QUEUE;
+        e->queue_count--;
+        pthread_cond_signal(&e->space);
+        pthread_mutex_unlock(&e->lock);
+
+        // a pipe has a single worker, so frames arrive in order. Once the
+        // command is gone the rest of the frames are dropped.
+        if (e->pipe != NULL) {
+            if (!e->failed && !write_raw(e->pipe, e->width, e->height,
+                job.pixels)) {
+                printf("Warning: export command stopped after frame %ld, "
+                    "no more frames will be exported.\n", job.index);
+                pthread_mutex_lock(&e->lock);
+                e->failed = 1;
+                pthread_mutex_unlock(&e->lock);
+            }
+        } else {
+            snprintf(path, sizeof(path), "%s/frame_%06ld.png", e->dir,
+                job.index);
+            write_png(path, e->width, e->height, job.pixels);
+        }
+
+        pthread_mutex_lock(&e->lock);
+        e->free_pixels[e->n_free++] = job.pixels;
+        pthread_cond_signal(&e->space);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+// a target starting with '|' is a command that gets raw RGB frames on
+// stdin, anything else is a directory for the PNG sequence
+void init_export(export_t* e, const char* target, int width, int height) {
+    e->width = width;
+    e->height = height;
+    e->dir = NULL;
+    e->pipe = NULL;
+    e->failed = 0;
+    if (target[0] == '|') {
+        // a command that exits early must not take the model down with it,
+        // the failed write is noticed instead
+        signal(SIGPIPE, SIG_IGN);
+        e->pipe = popen(&target[1], "w");
+        if (e->pipe == NULL) {
+            printf("Error: unable to start %s.\n", &target[1]);
+            exit(1);
+        }
+        e->n_workers = 1;
+    } else {
+        struct stat st = {0};
+        if (stat(target, &st) == -1) {
+            mkdir(target, 0777);
+        }
+        e->dir = target;
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        e->n_workers = (n_cpus > 2) ? (int) ((n_cpus > 5) ? 4 : n_cpus - 1) :
+            1;
+    }
+
+    // offscreen colour target at the export resolution
+    glGenFramebuffers(1, &e->fbo);
+    glGenRenderbuffers(1, &e->color_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, e->color_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, e->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, e->color_rb);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Error: unable to create a %dx%d export framebuffer.\n",
+            width, height);
+        exit(1);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(EXPORT_RING, e->pbos);
+    for (int k = 0; k < EXPORT_RING; k++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, e->pbos[k]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 3 * (size_t) width * height, NULL,
+            GL_STREAM_READ);
+        mem_track_buffer(e->pbos[k], 3 * (size_t) width * height);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    e->ring_head = 0;
+    e->ring_count = 0;
+    e->n_frames = 0;
+    e->stall_seconds = 0.0;
+
+    e->queue_head = 0;
+    e->queue_count = 0;
+    e->running = 1;
+    e->n_pool = 0;
+    e->n_free = 0;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->ready, NULL);
+    pthread_cond_init(&e->space, NULL);
+    e->workers = (pthread_t*) malloc(e->n_workers * sizeof(pthread_t));
+    for (int k = 0; k < e->n_workers; k++) {
+        if (pthread_create(&e->workers[k], NULL, export_worker, e)) {
+            printf("Error: unable to start export thread.\n");
+            exit(1);
+        }
+    }
+}
+
+// a frame buffer from the pool, made if there are fewer than EXPORT_POOL.
+// Otherwise this waits for an encoder to finish with one.
+static unsigned char* take_pixels(export_t* e) {
+    pthread_mutex_lock(&e->lock);
+    if (e->n_free == 0 && e->n_pool < EXPORT_POOL) {
+        e->pool[e->n_pool] = (unsigned char*) mem_alloc(MEM_STAGING,
+            3 * (size_t) e->width * e->height);
+        e->free_pixels[e->n_free++] = e->pool[e->n_pool++];
+    }
+    if (e->n_free == 0) {
+        double t_start = glfwGetTime();
+        while (e->n_free == 0) {
+            pthread_cond_wait(&e->space, &e->lock);
+        }
+        e->stall_seconds += glfwGetTime() - t_start;
+    }
+    unsigned char* pixels = e->free_pixels[--e->n_free];
+    pthread_mutex_unlock(&e->lock);
+    return pixels;
+}
+
+static void push_job(export_t* e, long index, unsigned char* pixels) {
+    pthread_mutex_lock(&e->lock);
+    if (e->queue_count == EXPORT_QUEUE) {
+        double t_start = glfwGetTime();
+        while (e->queue_count == EXPORT_QUEUE) {
+            pthread_cond_wait(&e->space, &e->lock);
+        }
+        e->stall_seconds += glfwGetTime() - t_start;
+    }
+    int k = (e->queue_head + e->queue_count) % EXPORT_QUEUE;
+    e->queue[k].index = index;
+    e->queue[k].pixels = pixels;
+    e->queue_count++;
+    pthread_cond_signal(&e->ready);
+    pthread_mutex_unlock(&e->lock);
+}
+
+// hand every finished readback to the encoders, oldest first. With wait set
+// the oldest one is waited for.
+static void collect(export_t* e, int wait) {
+    size_t bytes = 3 * (size_t) e->width * e->height;
+    while (e->ring_count > 0) {
+        int slot = e->ring_head;
+        GLenum status;
+        if (wait) {
+            double t_start = glfwGetTime();
+            do {
+                status = glClientWaitSync(e->fences[slot],
+                    GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            e->stall_seconds += glfwGetTime() - t_start;
+            wait = 0;
+        } else {
+            status = glClientWaitSync(e->fences[slot], 0, 0);
+        }
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            return;
+        }
+
+        unsigned char* pixels = take_pixels(e);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, e->pbos[slot]);
+        void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes,
+            GL_MAP_READ_BIT);
+        memcpy(pixels, mapped, bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteSync(e->fences[slot]);
+
+        push_job(e, e->ring_index[slot], pixels);
+        e->ring_head = (e->ring_head + 1) % EXPORT_RING;
+        e->ring_count--;
+    }
+}
+
+// draw the quad with whatever program and textures are bound into the
+// offscreen target and start reading it back
+void export_frame(export_t* e, unsigned int vao) {
+    pthread_mutex_lock(&e->lock);
+    int failed = e->failed;
+    pthread_mutex_unlock(&e->lock);
+    if (failed) {
+        return;
+    }
+
+    collect(e, 0);
+    if (e->ring_count == EXPORT_RING) {
+        collect(e, 1);
+    }
+
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, e->fbo);
+    glViewport(0, 0, e->width, e->height);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+
+    int slot = (e->ring_head + e->ring_count) % EXPORT_RING;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, e->pbos[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, e->width, e->height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    e->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    e->ring_index[slot] = e->n_frames++;
+    e->ring_count++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void export_free(export_t* e) {
+    while (e->ring_count > 0) {
+        collect(e, 1);
+    }
+
+    pthread_mutex_lock(&e->lock);
+    e->running = 0;
+    pthread_cond_broadcast(&e->ready);
+    pthread_mutex_unlock(&e->lock);
+    for (int k = 0; k < e->n_workers; k++) {
+        pthread_join(e->workers[k], NULL);
+    }
+    if (e->pipe != NULL) {
+        pclose(e->pipe);
+    }
+
+#ifndef REDUCED_OUTPUT
+    printf("Export: %ld frames of %dx%d, stalled %.3fs\n", e->n_frames,
+        e->width, e->height, e->stall_seconds);
+#endif // REDUCED_OUTPUT
+
+    free(e->workers);
+    for (int k = 0; k < e->n_pool; k++) {
+        mem_free(e->pool[k]);
+    }
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->ready);
+    pthread_cond_destroy(&e->space);
+    mem_delete_buffers(EXPORT_RING, e->pbos);
+    glDeleteRenderbuffers(1, &e->color_rb);
+    glDeleteFramebuffers(1, &e->fbo);
+}
@@ -0,0 +1,55 @@
+#ifndef _EXPORT_H
+#define _EXPORT_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "common.h"
+
+#define EXPORT_RING  3 // pixel pack buffers in flight
+#define EXPORT_QUEUE 8 // frames waiting for an encoder
+#define EXPORT_POOL  (EXPORT_QUEUE + EXPORT_RING) // host frame buffers
+
+typedef struct {
+    long index;
+    unsigned char* pixels; // RGB, bottom row first as read back
+} export_job_t;
+
+// renders the colour mapped state into an offscreen framebuffer and reads
+// it back asynchronously through a ring of pixel pack buffers. Finished
+// frames are written as a PNG sequence into a directory, or as raw RGB to
+// the stdin of a command, by encoder threads.
+typedef struct {
+    int width, height;
+    const char* dir; // NULL when piping
+    FILE* pipe;
+    int failed; // the command went away, frames are no longer exported
+
+    unsigned int fbo, color_rb;
+    unsigned int pbos[EXPORT_RING];
+    GLsync fences[EXPORT_RING];
+    long ring_index[EXPORT_RING];
+    int ring_head, ring_count;
+    long n_frames;
+
+    int n_workers;
+    pthread_t* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t ready, space;
+    export_job_t queue[EXPORT_QUEUE];
+    int queue_head, queue_count;
+    int running;
+
+    // frame buffers are made on demand up to EXPORT_POOL and then reused,
+    // the encoders hand them back once a frame is written
+    unsigned char* pool[EXPORT_POOL];
+    int n_pool, n_free;
+    unsigned char* free_pixels[EXPORT_POOL];
+
+    double stall_seconds; // main thread waiting on the GPU or the encoders
+} export_t;
+
+void init_export(export_t* e, const char* target, int width, int height);
+void export_frame(export_t* e, unsigned int vao);
+void export_free(export_t* e);
+
+#endif // _EXPORT_H
@@ -1,38 +1,108 @@
 #include "fetch.h"
 #include "common.h"
+#include "mem.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <string.h>
+
+float half_to_float(unsigned short h) {
+    unsigned int sign = (unsigned int) (h & 0x8000) << 16;
+    unsigned int exponent = (h >> 10) & 0x1f;
+    unsigned int mantissa = h & 0x3ff;
+    unsigned int bits;
+
+    if (exponent == 0) {
+        // zero or subnormal
+        float f = ldexpf((float) mantissa, -24);
+        return sign ? -f : f;
+    } else if (exponent == 31) {
+        // inf or nan
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
 
-float* fetch_2d_state(unsigned int texture, int nx, int ny, float* Tmax,
-    float* Tmin, float* qmax, float* qmin, float* umax, float* umin,
-    float* vmax, float* vmin) {
-    // create a buffer
-    float* data = malloc(nx * ny * 4 * sizeof(float));
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
 
-    // read texture into buffer
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, data);
+// readback buffers only live for one fetch, so they come out of a block that
+// is reused every time
+static mem_arena_t readback_arena = { .category = MEM_STAGING };
 
-    // prepare search
-    float Tmean = 0.0f;
-    float qmean = 0.0f;
-    float umean = 0.0f;
-    float vmean = 0.0f;
+void fetch_2d_fields(unsigned int T_texture, unsigned int diag_texture,
+    int nx, int ny, float* data) {
+    mem_arena_reset(&readback_arena);
+    float* T = mem_arena_alloc(&readback_arena, nx * ny * sizeof(float));
+    unsigned short* diag = mem_arena_alloc(&readback_arena,
+        nx * ny * 4 * sizeof(unsigned short));
 
-    // explore texture
+    // prognostic temperature at full precision
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, T_texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, T);
+
+    // diagnostics come back as raw halves, half the size of a float readback
+    glBindTexture(GL_TEXTURE_2D, diag_texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_HALF_FLOAT, diag);
+
+    // interleave as Ts, dT/dt (K/s), Q, albedo
     for (size_t i = 0; i < nx * ny; i++) {
-        mmm(data[(i * 4) + 0], Tmin, Tmax, &Tmean);
-        mmm(data[(i * 4) + 1], qmin, qmax, &qmean);
-        mmm(data[(i * 4) + 2], umin, umax, &umean);
-        mmm(data[(i * 4) + 3], vmin, vmax, &vmean);
+        data[(i * 4) + 0] = T[i];
+        data[(i * 4) + 1] = half_to_float(diag[(i * 4) + 0]) / 86400.0f;
+        data[(i * 4) + 2] = half_to_float(diag[(i * 4) + 1]);
+        data[(i * 4) + 3] = half_to_float(diag[(i * 4) + 2]);
+    }
+}
+
+// read the state into data, which holds nx * ny * 4 floats
+void fetch_2d_state(unsigned int T_texture, unsigned int diag_texture,
+    int nx, int ny, float* lats, float* data, float* Tmax, float* Tmin,
+    float* qmax, float* qmin, float* umax, float* umin, float* vmax,
+    float* vmin) {
+    fetch_2d_fields(T_texture, diag_texture, nx, ny, data);
+
+    summarize_2d_state(data, nx, ny, lats, Tmax, Tmin, qmax, qmin, umax,
+        umin, vmax, vmin);
+}
+
+void summarize_2d_state(float* data, int nx, int ny, float* lats,
+    float* Tmax, float* Tmin, float* qmax, float* qmin, float* umax,
+    float* umin, float* vmax, float* vmin) {
+    // prepare search
+    double Tmean = 0.0;
+    double qmean = 0.0;
+    double umean = 0.0;
+    double vmean = 0.0;
+    double wsum = 0.0;
+
+    // explore texture, means are weighted by cell area
+    for (size_t y = 0; y < ny; y++) {
+        float Trow = 0.0f, qrow = 0.0f, urow = 0.0f, vrow = 0.0f;
+        for (size_t x = 0; x < nx; x++) {
+            size_t i = y * nx + x;
+            mmm(data[(i * 4) + 0], Tmin, Tmax, &Trow);
+            mmm(data[(i * 4) + 1], qmin, qmax, &qrow);
+            mmm(data[(i * 4) + 2], umin, umax, &urow);
+            mmm(data[(i * 4) + 3], vmin, vmax, &vrow);
+        }
+        double w = cos(deg2rad(lats[y]));
+        Tmean += w * Trow;
+        qmean += w * qrow;
+        umean += w * urow;
+        vmean += w * vrow;
+        wsum  += w * nx;
     }
 
     // convert sums to means
-    Tmean = Tmean / ((float) nx * ny);
-    qmean = qmean / ((float) nx * ny);
-    umean = umean / ((float) nx * ny);
-    vmean = vmean / ((float) nx * ny);
+    Tmean = Tmean / wsum;
+    qmean = qmean / wsum;
+    umean = umean / wsum;
+    vmean = vmean / wsum;
 
 #ifndef REDUCED_OUTPUT
     printf("  Temperature  min=%.4f max=%.4f mean=%.4f\n", *Tmin, *Tmax, Tmean);
@@ -40,15 +110,13 @@ float* fetch_2d_state(unsigned int texture, int nx, int ny, float* Tmax,
     printf("  Insolation   min=%.4e max=%.4e mean=%.4e\n", *umin, *umax, umean);
     printf("  Albedo       min=%.4e max=%.4e mean=%.4e\n", *vmin, *vmax, vmean);
 #endif // REDUCED_OUTPUT
-
-    return data;
 }
 
 void fetch_and_dump_state(unsigned int surf_texture, int nx, int ny,
     const char* path) {
     // create buffers
     char fname[256];
-    float* data = malloc(nx * ny * 4 * sizeof(float));
+    float* data = mem_alloc(MEM_STAGING, nx * ny * 4 * sizeof(float));
 
     // read texture into buffer
     glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, data);
@@ -135,4 +203,6 @@ void fetch_and_dump_state(unsigned int surf_texture, int nx, int ny,
         fprintf(file, "\n");
     }
     fclose(file);
+
+    mem_free(data);
 }
@@ -1,9 +1,19 @@
 #ifndef _FETCH_H
 #define _FETCH_H
 
-float* fetch_2d_state(unsigned int texture, int nx, int ny, float* Tmax,
-    float* Tmin, float* qmax, float* qmin, float* umax, float* umin,
-    float* vmax, float* vmin);
+float half_to_float(unsigned short h);
+
+void fetch_2d_fields(unsigned int T_texture, unsigned int diag_texture,
+    int nx, int ny, float* data);
+void fetch_2d_state(unsigned int T_texture, unsigned int diag_texture,
+    int nx, int ny, float* lats, float* data, float* Tmax, float* Tmin,
+    float* qmax, float* qmin, float* umax, float* umin, float* vmax,
+    float* vmin);
+
+// min/max of every channel and their cos(lat) weighted means
+void summarize_2d_state(float* data, int nx, int ny, float* lats,
+    float* Tmax, float* Tmin, float* qmax, float* qmin, float* umax,
+    float* umin, float* vmax, float* vmin);
 
 void fetch_and_dump_state(unsigned int surf_texture, int nx, int ny,
     const char* path);
@@ -0,0 +1,230 @@
+#include "forcing.h"
+#include "common.h"
+#include "initial.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static float* forced_field(model_initial_t* params, forcing_field_t field) {
+    switch (field) {
+    case FORCING_A:
+        return params->As;
+    case FORCING_B:
+        return params->Bs;
+    case FORCING_DEPTH:
+        return params->depths;
+    case FORCING_A0:
+        return params->a0s;
+    case FORCING_A2:
+        return params->a2s;
+    case FORCING_AI:
+        return params->ais;
+    default:
+        return NULL;
+    }
+}
+
+static void* forcing_reader(void* arg) {
+    forcing_t* f = (forcing_t*) arg;
+
+    pthread_mutex_lock(&f->lock);
+    while (f->running) {
+        long slice = f->wanted_slice;
+        if (slice < 0 || slice == f->staged_slice) {
+            pthread_cond_wait(&f->cond, &f->lock);
+            continue;
+        }
+
+        // read without holding the lock so the model keeps stepping
+        pthread_mutex_unlock(&f->lock);
+        read_forcing_slice(&f->file, slice, f->nx, f->ny, f->reading);
+        pthread_mutex_lock(&f->lock);
+
+        float* tmp = f->staged;
+        f->staged = f->reading;
+        f->reading = tmp;
+        f->staged_slice = slice;
+        f->n_reads++;
+        pthread_cond_broadcast(&f->cond);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+
+static void prefetch_slice(forcing_t* f, long slice) {
+    pthread_mutex_lock(&f->lock);
+    f->wanted_slice = slice;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+}
+
+// copy the forced fields of a set into the parameters and upload them
+static void upload_set(forcing_t* f, int set) {
+    size_t n = f->nx * f->ny;
+    for (int k = 0; k < f->file.n_fields; k++) {
+        memcpy(forced_field(f->params, f->file.fields[k]),
+            &f->slices[set][k * n], n * sizeof(float));
+    }
+    update_LUTs(f->nx, f->ny, f->params, f->LUT1[set], f->LUT2[set]);
+}
+
+// put a slice into a set, waiting on the reader if it is not staged yet
+static void load_slice(forcing_t* f, int set, long slice) {
+    size_t bytes = f->file.n_fields * f->nx * f->ny * sizeof(float);
+
+    pthread_mutex_lock(&f->lock);
+    if (f->staged_slice != slice) {
+        double t_start = glfwGetTime();
+        f->wanted_slice = slice;
+        pthread_cond_broadcast(&f->cond);
+        while (f->staged_slice != slice) {
+            pthread_cond_wait(&f->cond, &f->lock);
+        }
+        f->wait_seconds += glfwGetTime() - t_start;
+    }
+    memcpy(f->slices[set], f->staged, bytes);
+    pthread_mutex_unlock(&f->lock);
+
+    f->slice_in[set] = slice;
+    upload_set(f, set);
+}
+
+int init_forcing(forcing_t* f, const char* path, model_initial_t* params,
+    size_t nx, size_t ny, model_state_t* state) {
+    int n_fields = open_forcing_file(path, nx, ny, &f->file);
+    if (n_fields <= 0) {
+        return n_fields;
+    }
+    if (f->file.n_slices < 2) {
+        // read_input already loaded the only slice as a static field
+        close_forcing_file(&f->file);
+        return 0;
+    }
+
+    f->nx = nx;
+    f->ny = ny;
+    f->params = params;
+
+    size_t n = f->file.n_fields * nx * ny;
+    f->slices[0] = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    f->slices[1] = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    f->staged    = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    f->reading   = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    f->slice_in[0] = -1;
+    f->slice_in[1] = -1;
+    f->lo = 0;
+    f->cur = 0;
+
+    // set 0 is the state's own LUT pair, set 1 is added for the next slice
+    f->LUT1[0] = state->physp_LUT1;
+    f->LUT2[0] = state->physp_LUT2;
+    make_LUTs(nx, ny, params, &f->LUT1[1], &f->LUT2[1]);
+    state->forcing_LUT1 = f->LUT1[1];
+    state->forcing_LUT2 = f->LUT2[1];
+
+    f->staged_slice = -1;
+    f->wanted_slice = -1;
+    f->n_reads = 0;
+    f->wait_seconds = 0.0;
+    f->running = 1;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+    if (pthread_create(&f->thread, NULL, forcing_reader, f)) {
+        printf("Error: unable to start forcing reader thread.\n");
+        pthread_mutex_destroy(&f->lock);
+        pthread_cond_destroy(&f->cond);
+        state->physp_LUT1 = f->LUT1[0];
+        state->physp_LUT2 = f->LUT2[0];
+        state->forcing_LUT1 = 0;
+        state->forcing_LUT2 = 0;
+        mem_delete_textures(1, &f->LUT1[1]);
+        mem_delete_textures(1, &f->LUT2[1]);
+        mem_free(f->slices[0]);
+        mem_free(f->slices[1]);
+        mem_free(f->staged);
+        mem_free(f->reading);
+        close_forcing_file(&f->file);
+        return -1;
+    }
+
+    forcing_update(f, state, 0.0);
+    return 1;
+}
+
+void forcing_update(forcing_t* f, model_state_t* state, double t) {
+    long n = (long) f->file.n_slices;
+    double* times = f->file.times;
+
+    // bracketing slices i and i + 1, held constant outside the file's range
+    long i = f->cur;
+    float w;
+    if (t <= times[0]) {
+        i = 0;
+        w = 0.0f;
+    } else if (t >= times[n - 1]) {
+        i = n - 2;
+        w = 1.0f;
+    } else {
+        while (i + 1 < n - 1 && times[i + 1] <= t) {
+            i++;
+        }
+        while (i > 0 && times[i] > t) {
+            i--;
+        }
+        w = (float) ((t - times[i]) / (times[i + 1] - times[i]));
+    }
+    f->cur = i;
+
+    if (f->slice_in[f->lo] != i || f->slice_in[1 - f->lo] != i + 1) {
+        // normally the upper slice just becomes the lower one
+        if (f->slice_in[1 - f->lo] == i) {
+            f->lo = 1 - f->lo;
+        }
+        if (f->slice_in[f->lo] != i) {
+            load_slice(f, f->lo, i);
+        }
+        if (f->slice_in[1 - f->lo] != i + 1) {
+            load_slice(f, 1 - f->lo, i + 1);
+        }
+        if (i + 2 < n) {
+            prefetch_slice(f, i + 2);
+        }
+
+        state->physp_LUT1   = f->LUT1[f->lo];
+        state->physp_LUT2   = f->LUT2[f->lo];
+        state->forcing_LUT1 = f->LUT1[1 - f->lo];
+        state->forcing_LUT2 = f->LUT2[1 - f->lo];
+    }
+    state->forcing_w = w;
+}
+
+// the static fields changed, upload both sets again
+void forcing_refresh(forcing_t* f) {
+    for (int set = 0; set < 2; set++) {
+        if (f->slice_in[set] >= 0) {
+            upload_set(f, set);
+        }
+    }
+}
+
+void forcing_free(forcing_t* f) {
+    pthread_mutex_lock(&f->lock);
+    f->running = 0;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    pthread_join(f->thread, NULL);
+
+#ifndef REDUCED_OUTPUT
+    printf("Forcing: read %d slices, waited %.3fs\n", f->n_reads,
+        f->wait_seconds);
+#endif // REDUCED_OUTPUT
+
+    close_forcing_file(&f->file);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+    mem_free(f->slices[0]);
+    mem_free(f->slices[1]);
+    mem_free(f->staged);
+    mem_free(f->reading);
+}
@@ -0,0 +1,45 @@
+#ifndef _FORCING_H
+#define _FORCING_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "nctools.h"
+#include "model.h"
+
+// time varying parameters. Only the two slices bracketing the model time are
+// kept, one in each of a pair of parameter LUT sets, and the kernel blends
+// between them. A reader thread fetches the slice after next while the
+// current pair is in use.
+typedef struct {
+    forcing_file_t file;
+    size_t nx, ny;
+    model_initial_t* params; // forced fields are overwritten on upload
+
+    // GPU sets and the host copy of the slice each holds
+    unsigned int LUT1[2], LUT2[2];
+    float* slices[2];
+    long slice_in[2];
+    int lo;
+    long cur;
+
+    // reader thread
+    float* staged;
+    float* reading;
+    long staged_slice, wanted_slice;
+    int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int n_reads;
+    double wait_seconds;
+} forcing_t;
+
+// 1 when the file forces some fields, 0 when it has nothing time varying
+// and -1 when it can not be used, which has been printed
+int init_forcing(forcing_t* f, const char* path, model_initial_t* params,
+    size_t nx, size_t ny, model_state_t* state);
+void forcing_update(forcing_t* f, model_state_t* state, double t);
+void forcing_refresh(forcing_t* f);
+void forcing_free(forcing_t* f);
+
+#endif // _FORCING_H
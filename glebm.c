@@ -0,0 +1,369 @@
+#include "glebm.h"
+#include "common.h"
+#include "context.h"
+#include "renderutil.h"
+#include "initial.h"
+#include "nctools.h"
+#include "model.h"
+#include "forcing.h"
+#include "stats.h"
+#include "orbit.h"
+#include "fetch.h"
+#include "options.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+struct glebm {
+    size_t nx, ny;
+    GLFWwindow* window; // only set when the model made its own context
+
+    model_initial_t initial;
+    model_state_t state;
+    compute_kernel_t kernel;
+    unsigned int solar_LUT;
+    forcing_t* forcing; // NULL without time varying parameters
+    stats_t* stats;     // made on the first glebm_stats
+    insol_kernel_t* insol; // made on the first glebm_set_orbit
+    glebm_orbit_t orbit;
+    int daily_mean;
+
+    // the time is t0 plus the steps taken since the timestep last changed
+    unsigned long long step, step0;
+    double t0;
+    float dt; // days
+
+    // host mirrors and whether they match the GPU
+    float* Ts;
+    float* diag;
+    int Ts_valid, diag_valid;
+};
+
+static float* copy_or_fill(const float* src, size_t n, float value) {
+    float* dst = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    if (src != NULL) {
+        memcpy(dst, src, n * sizeof(float));
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = value;
+        }
+    }
+    return dst;
+}
+
+glebm_t* glebm_create(const glebm_config_t* config) {
+    size_t nx = config->nx;
+    size_t ny = config->ny;
+    if (nx == 0 || ny == 0 || nx % 32 != 0 || ny % 32 != 0) {
+        printf("Error: model size must be a multiple of 32 (got %lux%lu).\n",
+            nx, ny);
+        return NULL;
+    }
+    if (config->lats == NULL || config->lons == NULL) {
+        printf("Error: lats and lons are required.\n");
+        return NULL;
+    }
+    for (int k = 0; k < GLEBM_N_PARAMS; k++) {
+        if (config->params[k] == NULL) {
+            printf("Error: parameter field %d is missing.\n", k);
+            return NULL;
+        }
+    }
+    float polar_lat = (config->polar_lat > 0.0f) ? config->polar_lat :
+        DEFAULT_POLAR_LAT;
+    for (size_t j = 0; j < ny && nx > POLAR_MAX_LON; j++) {
+        if (polar_lat < 90.0f && fabsf(config->lats[j]) > polar_lat) {
+            printf("Error: the polar filter supports at most %d longitudes, "
+                "set polar_lat to 90 to turn it off.\n", POLAR_MAX_LON);
+            return NULL;
+        }
+    }
+
+    glebm_t* m = (glebm_t*) calloc(1, sizeof(glebm_t));
+    m->nx = nx;
+    m->ny = ny;
+
+    // embedders usually have no context of their own, glfwInit does nothing
+    // if GLFW is already up. Failures are returned rather than exiting the
+    // host process.
+    if (glfwInit() && glfwGetCurrentContext() != NULL) {
+        if (glewInit() != GLEW_OK) {
+            printf("Error: unable to load GL entry points.\n");
+            free(m);
+            return NULL;
+        }
+    } else {
+        m->window = open_gl_context(0);
+        if (m->window == NULL) {
+            free(m);
+            return NULL;
+        }
+    }
+    set_shader_root(config->shader_root);
+
+    // shaders built later on demand have to be there as well
+    if (!shader_readable("shader/stats.cs") ||
+        !shader_readable("shader/insolation.cs") ||
+        !load_compute_kernel(&m->kernel, "shader/compute.cs")) {
+        printf("Error: unable to build the shaders, check shader_root.\n");
+        if (m->window != NULL) {
+            glfwDestroyWindow(m->window);
+        }
+        free(m);
+        return NULL;
+    }
+
+    // own copies of every field so callers can drop theirs
+    size_t n = nx * ny;
+    m->initial.lats   = copy_or_fill(config->lats, ny, 0.0f);
+    m->initial.lons   = copy_or_fill(config->lons, nx, 0.0f);
+    m->initial.Ts     = copy_or_fill(config->Ts, n, 273.15f);
+    m->initial.As     = copy_or_fill(config->params[GLEBM_A], n, 0.0f);
+    m->initial.Bs     = copy_or_fill(config->params[GLEBM_B], n, 0.0f);
+    m->initial.depths = copy_or_fill(config->params[GLEBM_DEPTH], n, 0.0f);
+    m->initial.a0s    = copy_or_fill(config->params[GLEBM_A0], n, 0.0f);
+    m->initial.a2s    = copy_or_fill(config->params[GLEBM_A2], n, 0.0f);
+    m->initial.ais    = copy_or_fill(config->params[GLEBM_AI], n, 0.0f);
+    m->initial.zonally_symmetric = 0;
+    m->initial.time_varying = 0;
+
+    m->dt = (config->timestep > 0.0f) ?
+        config->timestep / (24.0f * 60.0f) :
+        (1.0f / 24.0f) * (5.0f / 60.0f);
+    m->step = 0;
+    m->step0 = 0;
+    m->t0 = 0.0;
+
+    m->solar_LUT = make_solar_table();
+    m->orbit.ecc = ecc;
+    m->orbit.obliquity = obliquity;
+    m->orbit.long_peri = long_peri;
+    glUseProgram(m->kernel.program);
+    glUniform1i(m->kernel.daily_mean_l, config->daily_mean);
+    m->daily_mean = config->daily_mean;
+
+    float* data = make_2d_initial(nx, ny);
+    for (size_t i = 0; i < n; i++) {
+        data[i * 4] = m->initial.Ts[i];
+    }
+    init_model_state(&m->state, nx, ny, &m->initial, data);
+    model_state_set_polar_filter(&m->state, &m->initial, polar_lat);
+    mem_free(data);
+    if (config->slow_every > 1) {
+        if (!load_multirate_kernel(&m->kernel)) {
+            glebm_destroy(m);
+            return NULL;
+        }
+        glUseProgram(m->kernel.slow_program);
+        glUniform1i(m->kernel.slow_daily_mean_l, config->daily_mean);
+        model_state_set_multirate(&m->state, config->slow_every);
+    }
+
+    if (config->forcing_path != NULL) {
+        m->forcing = (forcing_t*) malloc(sizeof(forcing_t));
+        int forced = init_forcing(m->forcing, config->forcing_path,
+            &m->initial, nx, ny, &m->state);
+        if (forced <= 0) {
+            free(m->forcing);
+            m->forcing = NULL;
+        }
+        if (forced < 0) {
+            glebm_destroy(m);
+            return NULL;
+        }
+    }
+
+    m->Ts = (float*) mem_alloc(MEM_STAGING, n * sizeof(float));
+    m->diag = (float*) mem_alloc(MEM_STAGING, n * 4 * sizeof(float));
+    m->Ts_valid = 0;
+    m->diag_valid = 0;
+
+    return m;
+}
+
+void glebm_destroy(glebm_t* m) {
+    if (m == NULL) {
+        return;
+    }
+    if (m->forcing != NULL) {
+        forcing_free(m->forcing);
+        free(m->forcing);
+    }
+    if (m->stats != NULL) {
+        stats_free(m->stats);
+        free(m->stats);
+    }
+    if (m->insol != NULL) {
+        insol_kernel_free(m->insol);
+        free(m->insol);
+    }
+    model_state_free(&m->state);
+    glDeleteProgram(m->kernel.program);
+    glDeleteProgram(m->kernel.filter_program);
+    if (m->kernel.slow_program != 0) {
+        glDeleteProgram(m->kernel.slow_program);
+    }
+    mem_delete_textures(1, &m->solar_LUT);
+    free_initial(&m->initial);
+    mem_free(m->Ts);
+    mem_free(m->diag);
+    if (m->window != NULL) {
+        glfwDestroyWindow(m->window);
+    }
+    free(m);
+}
+
+void glebm_step(glebm_t* m, unsigned long long n_steps) {
+    for (unsigned long long k = 0; k < n_steps; k++) {
+        double t = glebm_time(m);
+        if (m->forcing != NULL) {
+            forcing_update(m->forcing, &m->state, t);
+        }
+        model_state_step(&m->state, &m->kernel, m->solar_LUT, t, m->dt, 0);
+        m->step++;
+    }
+    if (n_steps > 0) {
+        m->Ts_valid = 0;
+        m->diag_valid = 0;
+    }
+}
+
+unsigned long long glebm_step_count(glebm_t* m) {
+    return m->step;
+}
+
+double glebm_time(glebm_t* m) {
+    return m->t0 + (double) (m->step - m->step0) * m->dt;
+}
+
+float* glebm_state(glebm_t* m) {
+    if (!m->Ts_valid) {
+        model_state_read_T(&m->state, m->Ts);
+        m->Ts_valid = 1;
+    }
+    return m->Ts;
+}
+
+void glebm_state_changed(glebm_t* m) {
+    model_state_write_T(&m->state, m->Ts);
+    m->Ts_valid = 1;
+    m->state.slow_age = 0;
+    m->diag_valid = 0;
+}
+
+const float* glebm_diagnostics(glebm_t* m) {
+    if (!m->diag_valid) {
+        if (m->forcing != NULL) {
+            forcing_update(m->forcing, &m->state, glebm_time(m));
+        }
+        model_state_diagnose(&m->state, &m->kernel, m->solar_LUT,
+            glebm_time(m), m->dt);
+        model_state_read(&m->state, m->diag);
+        m->diag_valid = 1;
+    }
+    return m->diag;
+}
+
+void glebm_stats(glebm_t* m, glebm_stats_t* stats) {
+    if (m->stats == NULL) {
+        m->stats = (stats_t*) malloc(sizeof(stats_t));
+        init_stats(m->stats, m->ny, m->daily_mean);
+    }
+    if (m->forcing != NULL) {
+        forcing_update(m->forcing, &m->state, glebm_time(m));
+    }
+    stats_compute(m->stats, &m->state, m->solar_LUT, glebm_time(m));
+    stats_get(m->stats, stats);
+}
+
+float* glebm_param(glebm_t* m, glebm_param_t which) {
+    switch (which) {
+    case GLEBM_A:
+        return m->initial.As;
+    case GLEBM_B:
+        return m->initial.Bs;
+    case GLEBM_DEPTH:
+        return m->initial.depths;
+    case GLEBM_A0:
+        return m->initial.a0s;
+    case GLEBM_A2:
+        return m->initial.a2s;
+    case GLEBM_AI:
+        return m->initial.ais;
+    default:
+        return NULL;
+    }
+}
+
+void glebm_params_changed(glebm_t* m) {
+    if (m->forcing != NULL) {
+        forcing_refresh(m->forcing);
+    } else {
+        update_LUTs(m->nx, m->ny, &m->initial, m->state.physp_LUT1,
+            m->state.physp_LUT2);
+    }
+    m->state.slow_age = 0;
+    m->diag_valid = 0;
+}
+
+void glebm_param_rows_changed(glebm_t* m, size_t j0, size_t j1) {
+    if (m->forcing != NULL) {
+        forcing_refresh(m->forcing);
+    } else if (j0 < j1 && j1 <= m->ny) {
+        update_LUT_rows(m->nx, m->ny, &m->initial, m->state.physp_LUT1,
+            m->state.physp_LUT2, j0, j1);
+    }
+    m->state.slow_age = 0;
+    m->diag_valid = 0;
+}
+
+void glebm_constants(glebm_t* m, glebm_constants_t* constants) {
+    constants->diffusivity = m->state.diffusivity;
+    constants->freezing_T = m->state.freezing_T;
+    constants->solar_constant = m->state.solar_constant;
+    constants->timestep = m->dt * 24.0f * 60.0f;
+}
+
+void glebm_set_constants(glebm_t* m, const glebm_constants_t* constants) {
+    m->state.diffusivity = constants->diffusivity;
+    m->state.freezing_T = constants->freezing_T;
+    m->state.solar_constant = constants->solar_constant;
+    float dt = constants->timestep / (24.0f * 60.0f);
+    if (dt > 0.0f && dt != m->dt) {
+        // keep the time continuous across the change
+        m->t0 = glebm_time(m);
+        m->step0 = m->step;
+        m->dt = dt;
+    }
+    m->state.slow_age = 0;
+    m->diag_valid = 0;
+}
+
+void glebm_orbit(glebm_t* m, glebm_orbit_t* orbit) {
+    *orbit = m->orbit;
+}
+
+void glebm_set_orbit(glebm_t* m, const glebm_orbit_t* orbit) {
+    if (m->insol == NULL) {
+        m->insol = (insol_kernel_t*) malloc(sizeof(insol_kernel_t));
+        init_insol_kernel(m->insol);
+    }
+    insol_kernel_fill(m->insol, m->solar_LUT, orbit);
+    m->orbit = *orbit;
+    m->state.slow_age = 0;
+    m->diag_valid = 0;
+}
+
+unsigned int glebm_texture(glebm_t* m) {
+    return model_state_texture(&m->state);
+}
+
+size_t glebm_gpu_bytes(glebm_t* m) {
+    return model_state_gpu_bytes(&m->state);
+}
+
+size_t glebm_bytes_per_step(glebm_t* m, int diagnostics) {
+    return model_state_bytes_per_step(&m->state, diagnostics);
+}
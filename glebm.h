@@ -0,0 +1,114 @@
+#ifndef _GLEBM_H
+#define _GLEBM_H
+
+#include <stddef.h>
+
+// C interface of libglebm. Fields are nx * ny floats in row major order with
+// latitude as the slow index, the same layout as the NetCDF files. The model
+// keeps its state on the GPU, the pointers returned below are host mirrors
+// owned by the model that stay valid until glebm_destroy.
+
+typedef struct glebm glebm_t;
+
+// parameter fields that can be read and changed in place
+typedef enum {
+    GLEBM_A,     // OLR intercept (W/m^2)
+    GLEBM_B,     // OLR slope (W/m^2/K)
+    GLEBM_DEPTH, // mixed layer depth (m)
+    GLEBM_A0,    // albedo
+    GLEBM_A2,    // albedo P2 coefficient
+    GLEBM_AI,    // ice albedo
+    GLEBM_N_PARAMS
+} glebm_param_t;
+
+typedef struct {
+    size_t nx, ny;       // both multiples of 32
+    const float* lats;   // ny, degrees north
+    const float* lons;   // nx, degrees east
+    const float* Ts;     // initial temperature (K), NULL for 273.15 K
+    const float* params[GLEBM_N_PARAMS];
+    float timestep;      // minutes, 0 for the default of 5
+    int daily_mean;      // use daily mean insolation
+    const char* shader_root; // directory holding shader/, NULL for the cwd
+    const char* forcing_path; // NetCDF file with (time, lat, lon) parameter
+                              // fields, NULL for constant parameters
+    float polar_lat;     // filter zonal diffusion poleward of this latitude,
+                         // 0 for the default of 60, 90 for no filter
+    int slow_every;      // recompute insolation, albedo, OLR and the moist
+                         // amplification only every this many steps and
+                         // step just the diffusion in between, 0 or 1 for
+                         // every step
+} glebm_config_t;
+
+// uses the current GL context, or creates a hidden one when there is none.
+// returns NULL if the configuration is invalid or no GL 4.3 context can be
+// had. The library never exits the process and prints nothing but errors.
+glebm_t* glebm_create(const glebm_config_t* config);
+void glebm_destroy(glebm_t* m);
+
+void glebm_step(glebm_t* m, unsigned long long n_steps);
+unsigned long long glebm_step_count(glebm_t* m);
+double glebm_time(glebm_t* m); // days
+
+// Ts after the last step, read back only when it has changed. Writes made
+// through the pointer take effect after glebm_state_changed.
+float* glebm_state(glebm_t* m);
+void glebm_state_changed(glebm_t* m);
+
+// Ts, dT/dt (K/day), Q and albedo of the current state as 4 * nx * ny floats
+const float* glebm_diagnostics(glebm_t* m);
+
+// cos(lat) weighted means of the current state, reduced on the GPU so only
+// a few numbers per row are read back
+typedef struct {
+    float Ts, ASR, OLR;  // global means (K, W/m^2)
+    float imbalance;     // ASR - OLR (W/m^2)
+    float ice_edge[2];   // southern and northern ice edge (degrees north),
+                         // -90 and 90 for an ice free hemisphere
+    float ice_fraction;  // of the global area
+    const float* zonal;  // 4 * ny: Ts, ASR, OLR and ice fraction of each row
+} glebm_stats_t;
+
+void glebm_stats(glebm_t* m, glebm_stats_t* stats);
+
+// parameter field, writes take effect after glebm_params_changed. Fields
+// read from the forcing file are replaced whenever a new slice is loaded.
+// When only rows j0 <= j < j1 were written, glebm_param_rows_changed uploads
+// just those.
+float* glebm_param(glebm_t* m, glebm_param_t which);
+void glebm_params_changed(glebm_t* m);
+void glebm_param_rows_changed(glebm_t* m, size_t j0, size_t j1);
+
+// scalar constants, changes take effect from the next step on without
+// disturbing the state. Changing them, the parameters, the orbit or the
+// state also refreshes the slow physics of a multi-rate model.
+typedef struct {
+    float diffusivity; // D (W/m^2/K), default 0.555
+    float freezing_T;  // albedo is ai below this (K), default 263.15
+    float solar_constant; // S0 (W/m^2), default 1365.2
+    float timestep;    // minutes
+} glebm_constants_t;
+
+void glebm_constants(glebm_t* m, glebm_constants_t* constants);
+void glebm_set_constants(glebm_t* m, const glebm_constants_t* constants);
+
+// orbit the insolation table is built from, present day by default.
+// glebm_set_orbit rebuilds the table on the GPU, so it is cheap enough to
+// call whenever an accelerated orbital forcing moves on.
+typedef struct {
+    float ecc;
+    float obliquity; // degrees
+    float long_peri; // degrees, from the autumnal equinox
+} glebm_orbit_t;
+
+void glebm_orbit(glebm_t* m, glebm_orbit_t* orbit);
+void glebm_set_orbit(glebm_t* m, const glebm_orbit_t* orbit);
+
+// GL texture holding Ts, for callers sharing the context
+unsigned int glebm_texture(glebm_t* m);
+size_t glebm_gpu_bytes(glebm_t* m);
+
+// nominal texture traffic of one step, with or without the diagnostics
+size_t glebm_bytes_per_step(glebm_t* m, int diagnostics);
+
+#endif // _GLEBM_H
@@ -4,10 +4,13 @@
 #include "common.h"
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include "nctools.h"
+#include "mem.h"
 
+// the state is staged in a MEM_STAGING buffer the caller releases
 float* make_2d_initial(int nx, int ny) {
-    float* data = (float*) malloc(nx * ny * 4 * sizeof(float));
+    float* data = (float*) mem_alloc(MEM_STAGING, nx * ny * 4 * sizeof(float));
 
     for (size_t y = 0; y < ny; y++) {
         for (size_t x = 0; x < nx; x++) {
@@ -24,63 +27,107 @@ float* make_2d_initial(int nx, int ny) {
     return data;
 }
 
-unsigned int make_solar_table() {
-    const int nx = 512;
-    const int ny = 512;
-    unsigned int solar_LUT;
-    float* data = (float*) malloc(nx * ny * 4 * sizeof(float));
-    for (size_t i = 0; i < nx * ny * 4; data[i++] = 0.0f);
-
+// the orbit only depends on the day, so each column is computed once and
+// repeated down all the latitude rows
+void fill_solar_table(float* data) {
+    const int nx = SOLAR_TABLE_NX;
+    const int ny = SOLAR_TABLE_NY;
     float long_peri_rad = deg2rad(long_peri);
 
     for (size_t x = 0; x < nx; x++) {
-        for (size_t y = 0; y < ny; y++) {
-            float lat = (((float) y + 0.5) / ((float) ny) * 180.0f) - 90.0f;
-            float day = ((float) x) / ((float) nx) * days_per_year;
-
-            float slon = solar_lon(ecc, long_peri_rad, day);
-            float abra = a2_b2_ratio(ecc, slon, long_peri_rad);
-            float delta = asin(sin(deg2rad(obliquity)) * sin(slon));
-
-            data[((y * nx) + x) * 4 + 0] = abra;
-            data[((y * nx) + x) * 4 + 1] = delta;
-            data[((y * nx) + x) * 4 + 2] = 0.0f;
-            data[((y * nx) + x) * 4 + 3] = 0.0f;
-        }
+        float day = ((float) x) / ((float) nx) * days_per_year;
+
+        float slon = solar_lon(ecc, long_peri_rad, day);
+        float abra = a2_b2_ratio(ecc, slon, long_peri_rad);
+        float delta = asin(sin(deg2rad(obliquity)) * sin(slon));
+
+        data[(x * 4) + 0] = abra;
+        data[(x * 4) + 1] = delta;
+        data[(x * 4) + 2] = 0.0f;
+        data[(x * 4) + 3] = 0.0f;
+    }
+    for (size_t y = 1; y < ny; y++) {
+        memcpy(&data[y * nx * 4], data, nx * 4 * sizeof(float));
     }
+}
 
+unsigned int upload_solar_table(float* data) {
+    unsigned int solar_LUT;
     glGenTextures(1, &solar_LUT);
     glBindTexture(GL_TEXTURE_2D, solar_LUT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, nx, ny, 0,
-                 GL_RGBA, GL_FLOAT, data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, SOLAR_TABLE_NX, SOLAR_TABLE_NY,
+                 0, GL_RGBA, GL_FLOAT, data);
+    mem_track_texture(solar_LUT,
+        SOLAR_TABLE_NX * SOLAR_TABLE_NY * 4 * sizeof(float));
+    return solar_LUT;
+}
+
+unsigned int make_solar_table() {
+    float* data = (float*) mem_alloc(MEM_STAGING,
+        SOLAR_TABLE_NX * SOLAR_TABLE_NY * 4 * sizeof(float));
+    fill_solar_table(data);
+    unsigned int solar_LUT = upload_solar_table(data);
+    mem_free(data);
 
     return solar_LUT;
 }
 
+// interleave rows j0 <= j < j1 of the parameter fields into the two LUT
+// layouts
+static void fill_LUT_rows(size_t model_width, size_t j0, size_t j1,
+    model_initial_t* model, float* data1, float* data2) {
+    for (size_t i = j0 * model_width; i < j1 * model_width; i++) {
+        size_t k = i - j0 * model_width;
+        data1[(k * 4) + 0] = model->lats[i / model_width];
+        data1[(k * 4) + 1] = model->lons[i % model_width];
+        data1[(k * 4) + 2] = model->Bs[i];
+        data1[(k * 4) + 3] = model->As[i];
+        data2[(k * 4) + 0] = model->a0s[i];
+        data2[(k * 4) + 1] = model->a2s[i];
+        data2[(k * 4) + 2] = model->ais[i];
+        data2[(k * 4) + 3] = model->depths[i];
+    }
+}
+
+// interleave the block of w x h cells starting at (x0, y0), for tiles
+void fill_LUT_block(size_t model_width, size_t x0, size_t y0, size_t w,
+    size_t h, model_initial_t* model, float* data1, float* data2) {
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+            size_t i = ((y0 + y) * model_width) + x0 + x;
+            size_t k = (y * w) + x;
+            data1[(k * 4) + 0] = model->lats[y0 + y];
+            data1[(k * 4) + 1] = model->lons[x0 + x];
+            data1[(k * 4) + 2] = model->Bs[i];
+            data1[(k * 4) + 3] = model->As[i];
+            data2[(k * 4) + 0] = model->a0s[i];
+            data2[(k * 4) + 1] = model->a2s[i];
+            data2[(k * 4) + 2] = model->ais[i];
+            data2[(k * 4) + 3] = model->depths[i];
+        }
+    }
+}
+
+static void fill_LUTs(size_t model_width, size_t model_height,
+    model_initial_t* model, float* data1, float* data2) {
+    fill_LUT_rows(model_width, 0, model_height, model, data1, data2);
+}
+
 void make_LUTs(size_t model_width, size_t model_height,
     model_initial_t* model, unsigned int* LUT1, unsigned int* LUT2) {
     // allocate memory for LUT1
-    float* data1 = (float*) malloc(
+    float* data1 = (float*) mem_alloc(MEM_STAGING,
         model_width * model_height * 4 * sizeof(float));
         // allocate memory for LUT2
-    float* data2 = (float*) malloc(
+    float* data2 = (float*) mem_alloc(MEM_STAGING,
         model_width * model_height * 4 * sizeof(float));
 
     // copy stuff over
-    for (size_t i = 0; i < model_width * model_height; i++) {
-        data1[(i * 4) + 0] = model->lats[i / model_width];
-        data1[(i * 4) + 1] = model->lons[i % model_width];
-        data1[(i * 4) + 2] = model->Bs[i];
-        data1[(i * 4) + 3] = model->As[i];
-        data2[(i * 4) + 0] = model->a0s[i];
-        data2[(i * 4) + 1] = model->a2s[i];
-        data2[(i * 4) + 2] = model->ais[i];
-        data2[(i * 4) + 3] = model->depths[i];
-    }
+    fill_LUTs(model_width, model_height, model, data1, data2);
 
     // gemerate textures
     glGenTextures(1, LUT1);
@@ -99,4 +146,49 @@ void make_LUTs(size_t model_width, size_t model_height,
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, model_width, model_height, 0,
                  GL_RGBA, GL_FLOAT, data2);
+    mem_track_texture(*LUT1, model_width * model_height * 4 * sizeof(float));
+    mem_track_texture(*LUT2, model_width * model_height * 4 * sizeof(float));
+
+    mem_free(data1);
+    mem_free(data2);
+}
+
+void update_LUTs(size_t model_width, size_t model_height,
+    model_initial_t* model, unsigned int LUT1, unsigned int LUT2) {
+    float* data1 = (float*) mem_alloc(MEM_STAGING,
+        model_width * model_height * 4 * sizeof(float));
+    float* data2 = (float*) mem_alloc(MEM_STAGING,
+        model_width * model_height * 4 * sizeof(float));
+    fill_LUTs(model_width, model_height, model, data1, data2);
+
+    // overwrite the existing storage rather than reallocating it
+    glBindTexture(GL_TEXTURE_2D, LUT1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, model_width, model_height,
+                    GL_RGBA, GL_FLOAT, data1);
+    glBindTexture(GL_TEXTURE_2D, LUT2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, model_width, model_height,
+                    GL_RGBA, GL_FLOAT, data2);
+
+    mem_free(data1);
+    mem_free(data2);
+}
+
+// upload only rows j0 <= j < j1, e.g. after editing a latitude band
+void update_LUT_rows(size_t model_width, size_t model_height,
+    model_initial_t* model, unsigned int LUT1, unsigned int LUT2, size_t j0,
+    size_t j1) {
+    size_t n = model_width * (j1 - j0);
+    float* data1 = (float*) mem_alloc(MEM_STAGING, n * 4 * sizeof(float));
+    float* data2 = (float*) mem_alloc(MEM_STAGING, n * 4 * sizeof(float));
+    fill_LUT_rows(model_width, j0, j1, model, data1, data2);
+
+    glBindTexture(GL_TEXTURE_2D, LUT1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, j0, model_width, j1 - j0,
+                    GL_RGBA, GL_FLOAT, data1);
+    glBindTexture(GL_TEXTURE_2D, LUT2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, j0, model_width, j1 - j0,
+                    GL_RGBA, GL_FLOAT, data2);
+
+    mem_free(data1);
+    mem_free(data2);
 }
@@ -4,9 +4,22 @@
 #include <stddef.h>
 #include "nctools.h"
 
+// the solar LUT is indexed by day (x) and latitude (y)
+#define SOLAR_TABLE_NX 512
+#define SOLAR_TABLE_NY 512
+
 float* make_2d_initial(int nx, int ny);
 unsigned int make_solar_table();
+void fill_solar_table(float* data);
+unsigned int upload_solar_table(float* data);
 void make_LUTs(size_t model_width, size_t model_height,
     model_initial_t* model, unsigned int* LUT1, unsigned int* LUT2);
+void update_LUTs(size_t model_width, size_t model_height,
+    model_initial_t* model, unsigned int LUT1, unsigned int LUT2);
+void fill_LUT_block(size_t model_width, size_t x0, size_t y0, size_t w,
+    size_t h, model_initial_t* model, float* data1, float* data2);
+void update_LUT_rows(size_t model_width, size_t model_height,
+    model_initial_t* model, unsigned int LUT1, unsigned int LUT2, size_t j0,
+    size_t j1);
 
 #endif
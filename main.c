@@ -1,54 +1,46 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <math.h>
 #include "common.h"
 #include "profile.h"
 #include "initial.h"
 #include "fetch.h"
 #include "renderutil.h"
 #include "nctools.h"
+#include "model.h"
+#include "options.h"
+#include "spinup.h"
+#include "reduced.h"
+#include "column.h"
+#include "parallel.h"
+#include "batch.h"
+#include "adjoint.h"
+#include "metrics.h"
+#include "context.h"
+#include "glebm.h"
+#include "stats.h"
+#include "steer.h"
+#include "export.h"
+#include "continuation.h"
+#include "tiled.h"
+#include "orbit.h"
+#include "parareal.h"
+#include "shooting.h"
+#include "startup.h"
+#include "segment.h"
+#include "mem.h"
+#include "process/ebm.h"
+
+// the window shows a reduced grid run no more often than this
+#define REMAP_DISPLAY_HZ 30.0f
 
 // https://learnopengl.com/Guest-Articles/2022/Compute-Shaders/Introduction
 // https://medium.com/@daniel.coady/compute-shaders-in-opengl-4-3-d1c741998c03
 // https://stackoverflow.com/questions/45282300/writing-to-an-empty-3d-texture-in-a-compute-shader
 
-void error_callback(int error, const char* description) {
-    fprintf(stderr, "Error: %s\n", description);
-}
-
-const char* get_gl_err_type_str(GLenum type) {
-    switch(type) {
-    case GL_DEBUG_TYPE_ERROR:
-        return "GL_ERROR";
-    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
-        return "GL_DEPRECATED_BEHAVIOR";
-    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
-        return "GL_UNDEFINED_BEHAVIOR";
-        break;
-    case GL_DEBUG_TYPE_PORTABILITY:
-        return "GL_PORTABILITY";
-    case GL_DEBUG_TYPE_PERFORMANCE:
-        return "GL_PERFORMANCE";
-    case GL_DEBUG_TYPE_OTHER:
-        return "GL_INFO";
-    }
-
-    return "GL_UNKNOWN";
-}
-
-void GLAPIENTRY messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
-	const GLchar* message, const void* userParam){
-
-    printf("[%s] type=%#02x severity=%#02x source=%#02x id=%#02x message: %s\n",
-        get_gl_err_type_str(type), type, severity, source, id, message);
-
-	if (type == GL_DEBUG_TYPE_ERROR) {
-		exit(-20); // commenting this makes screen sharing possible i have no idea why
-	}
-
-}
-
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 	// make sure the viewport matches the new window dimensions; note that width and
 	// height will be significantly larger than specified on retina displays.
@@ -59,65 +51,111 @@ bool is_pow2(int x) {
     return (x > 0) && ((x & (x - 1)) == 0);
 }
 
-int main(int argc, char *argv[]) {
-    // verify input arguments
-    char* path;
-    if (argc != 3) {
-        printf("Useage: glEBM <input_file.nc> <output_file.nc>\n");
-        return 1;
+// hand the input fields and starting temperatures to the library
+static glebm_t* create_sim(model_initial_t* initial, size_t nx, size_t ny,
+    model_options_t* opts, float* data) {
+    float* Ts = (float*) malloc(nx * ny * sizeof(float));
+    for (size_t i = 0; i < nx * ny; i++) {
+        Ts[i] = data[i * 4];
     }
 
-    // register an error callback
-    glfwSetErrorCallback(error_callback);
-
-    // initialize glfw
-    if (!glfwInit()) {
-        printf("Unable to initialize GLFW. Exiting...\n");
+    glebm_config_t config = {
+        .nx = nx, .ny = ny,
+        .lats = initial->lats, .lons = initial->lons, .Ts = Ts,
+        .params = {
+            [GLEBM_A] = initial->As, [GLEBM_B] = initial->Bs,
+            [GLEBM_DEPTH] = initial->depths, [GLEBM_A0] = initial->a0s,
+            [GLEBM_A2] = initial->a2s, [GLEBM_AI] = initial->ais
+        },
+        .timestep = opts->timestep,
+        .daily_mean = opts->daily_mean,
+        .shader_root = NULL,
+        .forcing_path = initial->time_varying ? opts->input_path : NULL,
+        .polar_lat = opts->polar_lat,
+        .slow_every = opts->slow_every
+    };
+    glebm_t* sim = glebm_create(&config);
+    free(Ts);
+    if (sim == NULL) {
         exit(1);
     }
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    #endif
-    printf("Loaded GLFW: %s\n", glfwGetVersionString());
-
-    // glfw window creation
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "glGCM", NULL, NULL);
-    if (window == NULL) {
-        printf("Failed to create GLFW window\n");
-        glfwTerminate();
-        return -1;
+#ifndef REDUCED_OUTPUT
+    printf("State traffic: %lu bytes/step (%lu with diagnostics)\n",
+        glebm_bytes_per_step(sim, 0), glebm_bytes_per_step(sim, 1));
+#endif // REDUCED_OUTPUT
+    return sim;
+}
+
+// Ts, dT/dt, Q and albedo from whichever solver is running
+static void fetch_frame(glebm_t* sim, column_state_t* column,
+    model_state_t* state, tiled_grid_t* tiled, size_t nx, size_t ny,
+    float* data) {
+    if (column != NULL) {
+        column_state_broadcast(column, data);
+    } else if (tiled != NULL) {
+        tiled_grid_read(tiled, data);
+    } else if (state != NULL) {
+        model_state_read(state, data);
+    } else {
+        memcpy(data, glebm_diagnostics(sim), nx * ny * 4 * sizeof(float));
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSwapInterval(0);
+}
 
-    // initialize glew
-    GLenum res = glewInit();
-    if (res != GLEW_OK) {
-        fprintf(stderr, "Error: '%s'\n", glewGetErrorString(res));
-        exit(1);
+int main(int argc, char *argv[]) {
+    double t_launch = startup_clock();
+
+    // verify input arguments
+    model_options_t opts;
+    parse_options(argc, argv, &opts);
+
+    // whatever is still allocated when the run ends shows up as current
+    atexit(mem_report);
+
+    // cluster runs step on the CPU and never touch GL
+    if (opts.mpi_blocks > 0) {
+        return run_parallel(&opts);
     }
-    printf("Loaded GLEW: %s\n", glewGetString(GLEW_VERSION));
 
-    // setup GL
-    glEnable(GL_DEBUG_OUTPUT);
-    glDebugMessageCallback(messageCallback, 0);
+    // telemetry for the scheduler, served from its own thread
+    metrics_t metrics;
+    init_metrics(&metrics);
+    if (opts.metrics_address != NULL) {
+        metrics_start(&metrics, opts.metrics_address);
+    }
+
+    // window and GL context, shaders, input and solar LUT, overlapped
+    startup_t startup;
+    run_startup(&startup, &opts);
+    GLFWwindow* window = startup.window;
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    compute_kernel_t compute_kernel = startup.compute_kernel;
+    unsigned int solat_LUT = startup.solar_LUT;
+
+    // batch runs keep the context, programs and solar LUT between jobs
+    if (opts.batch_path != NULL) {
+        int ret = run_batch(&opts, &compute_kernel, solat_LUT, &metrics);
+        mem_delete_textures(1, &solat_LUT);
+        metrics_gpu_free(&metrics);
+        metrics_stop(&metrics);
+        glfwTerminate();
+        return ret;
+    }
 
     // setup profiling data
     profile_t profldat;
     init_profile(&profldat);
 
-    // load netcdf4 input file
-    model_initial_t initial_model;
-    size_t model_size_x, model_size_y;
-    read_input(argv[1], &model_size_x, &model_size_y, &initial_model);
+    // netcdf4 input file
+    model_initial_t initial_model = startup.initial;
+    size_t model_size_x = startup.nx, model_size_y = startup.ny;
 
     model_storage_t model;
-    init_model_storage(&model, 3.0 * days_per_year,
+    init_model_storage(&model, opts.run_years * days_per_year,
         model_size_x, model_size_y);
+    if (opts.timestep > 0.0f) {
+        model.timestep = opts.timestep / (24.0f * 60.0f);
+        model.n_timesteps = (int) ceil(model.final_time / model.timestep);
+    }
 
     // query limitations
     int max_compute_work_group_count[3];
@@ -157,30 +195,253 @@ int main(int argc, char *argv[]) {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 
-    // create 2d state texture
-    float* data = make_2d_initial(model_size_x, model_size_y);
-    unsigned int surf_texture;
-    glGenTextures(1, &surf_texture);
-    glBindTexture(GL_TEXTURE_2D, surf_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, model_size_x, model_size_y, 0,
-        GL_RGBA, GL_FLOAT, data);
-    glBindImageTexture(0, surf_texture, 0, GL_FALSE, 0, GL_READ_WRITE,
-        GL_RGBA32F);
-
-    // create solar LUT texture
-    unsigned int solat_LUT = make_solar_table();
-
-    // create physical LUT (lat, lon, B, lambda) texture
-    unsigned int physp_LUT1, physp_LUT2;
-    make_LUTs(model_size_x, model_size_y, &initial_model, &physp_LUT1, &physp_LUT2);
-
-    // make shaders
-    unsigned int compute_shader = create_cshader("shader/compute.cs");
-    unsigned int screen_shader  = create_shader("shader/screen.vs", "shader/screen.fs");
+    // orbital forcing rebuilds the table on the GPU whenever the orbit has
+    // moved, spin-up already sees the starting orbit
+    int orbit_mode = opts.orbit_source[0] != '\0';
+    orbit_forcing_t orbit_forcing;
+    insol_kernel_t insol_kernel;
+    if (orbit_mode) {
+        init_orbit_forcing(&orbit_forcing, opts.orbit_source,
+            opts.orbit_start_kyr, opts.orbit_accel);
+        init_insol_kernel(&insol_kernel);
+        glebm_orbit_t orbit;
+        orbit_forcing_update(&orbit_forcing, 0.0, &orbit);
+        insol_kernel_fill(&insol_kernel, solat_LUT, &orbit);
+#ifndef REDUCED_OUTPUT
+        printf("Orbit at %.1f kyr: ecc=%.5f obliquity=%.3f long_peri=%.2f "
+            "(%.0fx accelerated)\n", opts.orbit_start_kyr, orbit.ecc,
+            orbit.obliquity, orbit.long_peri, opts.orbit_accel);
+#endif // REDUCED_OUTPUT
+    }
+
+    unsigned int screen_shader = startup.screen_shader;
+
+    // create 2d state texture, optionally spun up from coarser grids
+    float* data;
+    if (opts.spinup_levels > 0) {
+        data = run_spinup(&initial_model, model_size_x, model_size_y, &opts,
+            &compute_kernel, solat_LUT, model.timestep);
+    } else {
+        data = make_2d_initial(model_size_x, model_size_y);
+    }
+    if (opts.shooting) {
+        float* equilibrium = run_shooting(&initial_model, model_size_x,
+            model_size_y, &opts, &compute_kernel, solat_LUT, model.timestep,
+            data);
+        mem_free(data);
+        data = equilibrium;
+    }
+
+    // sensitivity runs integrate the differentiable model without a window
+    if (opts.adjoint) {
+        if (initial_model.time_varying) {
+            printf("Warning: sensitivity runs only use the first time slice "
+                "of the input.\n");
+        }
+        float dt_limit = ebm_diffusion_limit(&initial_model, model_size_x,
+            model_size_y, opts.polar_lat);
+        if (model.timestep > dt_limit) {
+            printf("Warning: timestep of %.1f min exceeds the diffusion "
+                "limit of %.1f min.\n", model.timestep * 24.0f * 60.0f,
+                dt_limit * 24.0f * 60.0f);
+        }
+        adjoint_kernel_t adjoint_kernel;
+        init_adjoint_kernel(&adjoint_kernel, opts.daily_mean);
+        adjoint_kernel_set_polar_filter(&adjoint_kernel, &initial_model,
+            model_size_x, model_size_y, opts.polar_lat);
+        int ret = run_adjoint(&opts, &adjoint_kernel, &initial_model,
+            model_size_x, model_size_y, &model, solat_LUT, data);
+        adjoint_kernel_free(&adjoint_kernel);
+        mem_free(data);
+        mem_delete_textures(1, &solat_LUT);
+        free_initial(&initial_model);
+        glfwTerminate();
+        return ret;
+    }
+
+    // Parareal steps its slices without a window
+    if (opts.parareal_slices > 0) {
+        if (initial_model.time_varying) {
+            printf("Warning: Parareal runs only use the first time slice "
+                "of the input.\n");
+        }
+        int ret = run_parareal(&opts, &compute_kernel, &initial_model,
+            model_size_x, model_size_y, &model, solat_LUT, data);
+        mem_free(data);
+        mem_delete_textures(1, &solat_LUT);
+        free_initial(&initial_model);
+        glfwTerminate();
+        return ret;
+    }
+
+    // continuation sweeps step the full grid through the library, warm
+    // starting every point from the last equilibrium
+    if (opts.sweep_param[0] != '\0') {
+        if (initial_model.time_varying) {
+            printf("Warning: continuation runs only use the first time slice "
+                "of the input.\n");
+            initial_model.time_varying = 0;
+        }
+        float dt_limit = ebm_diffusion_limit(&initial_model, model_size_x,
+            model_size_y, opts.polar_lat);
+        if (model.timestep > dt_limit) {
+            printf("Warning: timestep of %.1f min exceeds the diffusion "
+                "limit of %.1f min.\n", model.timestep * 24.0f * 60.0f,
+                dt_limit * 24.0f * 60.0f);
+        }
+        glebm_t* sim = create_sim(&initial_model, model_size_x, model_size_y,
+            &opts, data);
+        mem_free(data);
+        int ret = run_continuation(&opts, sim, &initial_model, model_size_x,
+            model_size_y);
+        glebm_destroy(sim);
+        mem_delete_textures(1, &solat_LUT);
+        free_initial(&initial_model);
+        glfwTerminate();
+        return ret;
+    }
+
+    // with daily mean insolation a zonally symmetric model stays symmetric,
+    // so only a single column has to be stepped. Time varying parameters
+    // are only streamed into the full grid.
+    column_kernel_t column_kernel;
+    column_state_t column;
+    int column_mode = opts.daily_mean && initial_model.zonally_symmetric &&
+        !initial_model.time_varying && !opts.force_2d;
+    if (column_mode) {
+        printf("Using 1-D zonally symmetric solver.\n");
+        init_column_kernel(&column_kernel);
+        init_column_state(&column, model_size_x, model_size_y,
+            &initial_model, data);
+    }
+
+    // grids beyond the texture size limit are split into tiles, which are
+    // stepped one after another
+    int max_texture_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    size_t tile_nx = opts.tile_width;
+    size_t tile_ny = opts.tile_height;
+    int oversized = model_size_x > (size_t) max_texture_size ||
+        model_size_y > (size_t) max_texture_size;
+    int tiled_mode = !column_mode && (tile_nx > 0 || oversized);
+    tile_kernel_t tile_kernel;
+    tiled_grid_t tiled;
+    if (tiled_mode) {
+        if (opts.reduced_grid || opts.export_target != NULL) {
+            printf("Error: a %lux%lu grid exceeds the maximum texture size "
+                "of %d and needs tiles, which do not support -R or -V.\n",
+                model_size_x, model_size_y, max_texture_size);
+            exit(1);
+        }
+        if (tile_nx == 0) {
+            tile_nx = tiled_tile_size(model_size_x, max_texture_size);
+            tile_ny = tiled_tile_size(model_size_y, max_texture_size);
+            if (tile_nx == 0 || tile_ny == 0) {
+                printf("Error: no tile size fits a %lux%lu grid, set one "
+                    "with -T.\n", model_size_x, model_size_y);
+                exit(1);
+            }
+        }
+        if (initial_model.time_varying) {
+            printf("Warning: tiles only use the first time slice of the "
+                "input.\n");
+        }
+        float dt_limit = ebm_diffusion_limit(&initial_model, model_size_x,
+            model_size_y, 90.0f);
+        if (model.timestep > dt_limit) {
+            printf("Warning: timestep of %.1f min exceeds the diffusion "
+                "limit of %.1f min, tiles are not polar filtered.\n",
+                model.timestep * 24.0f * 60.0f, dt_limit * 24.0f * 60.0f);
+        }
+        init_tile_kernel(&tile_kernel);
+        glUseProgram(tile_kernel.program);
+        glUniform1i(tile_kernel.daily_mean_l, opts.daily_mean);
+        init_tiled_grid(&tiled, model_size_x, model_size_y, tile_nx, tile_ny,
+            opts.tile_resident, &initial_model, data);
+        metrics_set_gpu_bytes(&metrics, tiled_grid_gpu_bytes(&tiled));
+    }
+
+    // optionally step on a reduced grid, remapping into the state texture
+    reduced_kernel_t reduced_kernel;
+    reduced_grid_t reduced_grid;
+    model_state_t state;
+    int reduced_mode = opts.reduced_grid && !column_mode;
+    if (reduced_mode) {
+        if (initial_model.time_varying) {
+            printf("Warning: the reduced grid only uses the first time slice "
+                "of the input.\n");
+        }
+        init_reduced_kernel(&reduced_kernel);
+        glUseProgram(reduced_kernel.step_program);
+        glUniform1i(reduced_kernel.daily_mean_l, opts.daily_mean);
+        init_reduced_grid(&reduced_grid, model_size_x, model_size_y,
+            &initial_model, data);
+        init_model_state(&state, model_size_x, model_size_y, &initial_model,
+            data);
+        metrics_set_gpu_bytes(&metrics, model_state_gpu_bytes(&state));
+    }
+
+    // the full grid is stepped through the library interface
+    glebm_t* sim = NULL;
+    float dt_limit = 0.0f;
+    if (!column_mode && !reduced_mode && !tiled_mode) {
+        dt_limit = ebm_diffusion_limit(&initial_model, model_size_x,
+            model_size_y, opts.polar_lat);
+#ifndef REDUCED_OUTPUT
+        printf("Diffusion timestep limit: %.1f min (%.1f min unfiltered)\n",
+            dt_limit * 24.0f * 60.0f, ebm_diffusion_limit(&initial_model,
+            model_size_x, model_size_y, 90.0f) * 24.0f * 60.0f);
+#endif // REDUCED_OUTPUT
+        if (model.timestep > dt_limit) {
+            printf("Warning: timestep of %.1f min exceeds the diffusion "
+                "limit of %.1f min.\n", model.timestep * 24.0f * 60.0f,
+                dt_limit * 24.0f * 60.0f);
+        }
+        sim = create_sim(&initial_model, model_size_x, model_size_y, &opts,
+            data);
+        metrics_set_gpu_bytes(&metrics, glebm_gpu_bytes(sim));
+        if (orbit_mode) {
+            glebm_set_orbit(sim, &orbit_forcing.current);
+        }
+    }
+
+    if (opts.slow_every > 1 && sim == NULL) {
+        printf("Warning: multi-rate stepping only applies to the full "
+            "grid.\n");
+    }
+
+    // zonal means and the energy budget are reduced on the full grid only
+    stats_series_t stats_series;
+    init_stats_series(&stats_series, model_size_y);
+    int stats_every = (sim != NULL) ? opts.stats_every : 0;
+    if (opts.stats_every > 0 && sim == NULL) {
+        printf("Warning: zonal means are only written for the full grid.\n");
+    }
+
+    // parameters can be changed while running on the full grid, from the
+    // keyboard and with -i from stdin
+    steer_t steer;
+    if (sim != NULL) {
+        init_steer(&steer, window, opts.interactive, initial_model.lats,
+            model_size_x, model_size_y, dt_limit);
+    } else if (opts.interactive) {
+        printf("Warning: steering is only supported on the full grid.\n");
+    }
+
+    // output split into segments that are published while the run goes on
+    segment_writer_t segments;
+    int segmented = opts.segment_frames > 0 || opts.segment_years > 0.0f;
+    if (segmented) {
+        init_segment_writer(&segments, opts.output_path, opts.segment_frames,
+            opts.segment_years, model_size_x, model_size_y, &initial_model);
+    }
+
+    // animation frames are rendered offscreen and encoded in the background
+    export_t exporter;
+    if (opts.export_target != NULL) {
+        init_export(&exporter, opts.export_target, opts.export_width,
+            opts.export_height);
+    }
 
     // configure screen shader
     glUseProgram(screen_shader);
@@ -188,33 +449,20 @@ int main(int argc, char *argv[]) {
     unsigned int ss_maxs_l = glGetUniformLocation(screen_shader, "maxs");
     unsigned int ss_mins_l = glGetUniformLocation(screen_shader, "mins");
 
-    // figure out compute shader stuff
-    unsigned int css_t_l          = glGetUniformLocation(compute_shader, "t");
-    unsigned int css_dt_l         = glGetUniformLocation(compute_shader, "dt");
-    unsigned int css_insol_LUT_l  = glGetUniformLocation(compute_shader, "insol_LUT");
-    unsigned int css_physp_LUT1_l = glGetUniformLocation(compute_shader, "physp_LUT1");
-    unsigned int css_physp_LUT2_l = glGetUniformLocation(compute_shader, "physp_LUT2");
-
     // timing state info
     float currentFrame, delta, tlast = 0.0f;
-    int frame_ctr = 0;
+    unsigned long long frame_ctr = 0;
 
     // state info
     float Tmin =  1e9; float qmin =  1e9; float umin =  1e9; float vmin =  1e9;
     float Tmax = 1e-9; float qmax = -1e9; float umax = -1e9; float vmax = -1e9;
 
-    // bind textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, surf_texture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, solat_LUT);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, physp_LUT1);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, physp_LUT2);
-
-    float t = 0.0f; // in days
+    // model time is derived from the step count in double precision, so it
+    // neither drifts nor stalls on long runs
+    double t = 0.0; // in days
     float dt = model.timestep; // 5 mins
+    float last_remap = -1.0f; // wall time of the last reduced grid remap
+    long pending_frames = 0;
 
     // process window/graphics
     while (!glfwWindowShouldClose(window)) {
@@ -223,15 +471,66 @@ int main(int argc, char *argv[]) {
         delta = currentFrame - tlast;
         tlast = currentFrame;
 
+        double t_phase = glfwGetTime();
+
+        // changes take effect before the next step
+        if (sim != NULL && steer_apply(&steer, sim)) {
+            glebm_constants_t constants;
+            glebm_constants(sim, &constants);
+            dt = constants.timestep / (24.0f * 60.0f);
+        }
+
+        // the orbit is checked once per model day
+        glebm_orbit_t orbit;
+        if (orbit_mode && orbit_forcing_update(&orbit_forcing, t, &orbit)) {
+            if (sim != NULL) {
+                glebm_set_orbit(sim, &orbit);
+            } else {
+                insol_kernel_fill(&insol_kernel, solat_LUT, &orbit);
+            }
+        }
+
         // dispatch compute shader
-        glUseProgram(compute_shader);
-        glUniform1f(css_t_l, t);
-        glUniform1f(css_dt_l, dt);
-        glUniform1i(css_insol_LUT_l, 1);
-        glUniform1i(css_physp_LUT1_l, 2);
-        glUniform1i(css_physp_LUT2_l, 3);
-        glDispatchCompute((unsigned int)model_size_x / 32, (unsigned int)model_size_y / 32, 1);
-        t += dt;
+        metrics_gpu_begin(&metrics, METRICS_PHASE_STEP);
+        if (column_mode) {
+            column_state_step(&column, &column_kernel, solat_LUT, t, dt);
+        } else if (reduced_mode) {
+            reduced_grid_step(&reduced_grid, &reduced_kernel, solat_LUT, t, dt);
+
+            // the regular grid is only filled in for output, exported
+            // frames and the window at most REMAP_DISPLAY_HZ times a second
+            int sample = frame_ctr % 500 == 0 ||
+                (double) (frame_ctr + 1) * dt > model.final_time ||
+                (opts.export_target != NULL &&
+                (frame_ctr + 1) % opts.export_every == 0) ||
+                currentFrame - last_remap >= 1.0f / REMAP_DISPLAY_HZ;
+            if (sample) {
+                reduced_grid_remap(&reduced_grid, &reduced_kernel,
+                    model_state_texture(&state), state.diag_texture);
+                last_remap = currentFrame;
+            }
+        } else if (tiled_mode) {
+            // diagnostics are only written for the steps that are sampled
+            int sample = frame_ctr % 500 == 0 ||
+                (double) (frame_ctr + 1) * dt > model.final_time;
+            tiled_grid_step(&tiled, &tile_kernel, solat_LUT, t, dt, sample);
+        } else {
+            glebm_step(sim, 1);
+        }
+        metrics_gpu_end(&metrics);
+        if (frame_ctr == 0) {
+            glFinish();
+            printf("Time to first step: %.3fs\n", startup_clock() - t_launch);
+        }
+        t = (sim != NULL) ? glebm_time(sim) : (double) (frame_ctr + 1) * dt;
+        if (stats_every > 0 && (frame_ctr + 1) % stats_every == 0) {
+            glebm_stats_t stats;
+            glebm_stats(sim, &stats);
+            stats_series_add(&stats_series, t, &stats);
+        }
+        double t_now = glfwGetTime();
+        metrics_add_phase(&metrics, METRICS_PHASE_STEP, t_now - t_phase);
+        t_phase = t_now;
 
         // render image to quad
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -240,46 +539,108 @@ int main(int argc, char *argv[]) {
         glUniform4f(ss_maxs_l, Tmax, qmax, umax, vmax);
         glUniform4f(ss_mins_l, Tmin, qmin, umin, vmin);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, surf_texture);
-        glBindVertexArray(quadVAO);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
+        if (tiled_mode) {
+            // the window viewport follows the framebuffer size
+            int viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            tiled_grid_draw(&tiled, quadVAO, viewport[2], viewport[3]);
+        } else {
+            if (column_mode) {
+                glBindTexture(GL_TEXTURE_2D, column_state_texture(&column));
+            } else if (reduced_mode) {
+                glBindTexture(GL_TEXTURE_2D, model_state_texture(&state));
+            } else {
+                glBindTexture(GL_TEXTURE_2D, glebm_texture(sim));
+            }
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            glBindVertexArray(0);
+        }
+        if (opts.export_target != NULL &&
+            (frame_ctr + 1) % opts.export_every == 0) {
+            export_frame(&exporter, quadVAO);
+        }
 
         // finish frame
         glfwSwapBuffers(window);
         glfwPollEvents();
+        t_now = glfwGetTime();
+        metrics_add_phase(&metrics, METRICS_PHASE_RENDER, t_now - t_phase);
+        t_phase = t_now;
 
         // update profiling
         tick_profile(&profldat, delta, frame_ctr);
+        metrics_progress(&metrics, frame_ctr + 1, t, dt, t_now);
 
         // collect statistics
         if (frame_ctr % 500 == 0) {
 #ifndef REDUCED_OUTPUT
             if (t <= days_per_year) {
-                printf("fc=%d t=%.4f (days) dt=%.4f (mins) tps=%.2f\n", frame_ctr,
+                printf("fc=%llu t=%.4f (days) dt=%.4f (mins) tps=%.2f\n", frame_ctr,
                     t, dt * 24.0f * 60.0f, 1.0f / delta);
             } else {
-                printf("fc=%d t=%.4f (yr) dt=%.4f (mins) tps=%.2f\n", frame_ctr,
+                printf("fc=%llu t=%.4f (yr) dt=%.4f (mins) tps=%.2f\n", frame_ctr,
                     t / days_per_year, dt * 24.0f * 60.0f, 1.0f / delta);
             }
 #endif // REDUCED_OUTPUT
-            float* data = fetch_2d_state(
-                surf_texture, model_size_x, model_size_y, &Tmax, &Tmin,
-                &qmax, &qmin, &umax, &umin, &vmax, &vmin);
+            fetch_frame(sim, column_mode ? &column : NULL,
+                reduced_mode ? &state : NULL, tiled_mode ? &tiled : NULL,
+                model_size_x, model_size_y, data);
+            summarize_2d_state(data, model_size_x, model_size_y,
+                initial_model.lats, &Tmax, &Tmin, &qmax, &qmin, &umax, &umin,
+                &vmax, &vmin);
+            metrics_set_Tmean(&metrics, global_mean_T(data, model_size_x,
+                model_size_y, initial_model.lats));
             model_storage_add_frame(&model, t, data);
+            metrics_set_pending_frames(&metrics, ++pending_frames);
+            if (segmented && segment_writer_add(&segments, t)) {
+                segment_writer_flush(&segments, &model, t);
+                pending_frames = 0;
+                metrics_set_pending_frames(&metrics, 0);
+            }
+            t_now = glfwGetTime();
+            metrics_add_phase(&metrics, METRICS_PHASE_READBACK,
+                t_now - t_phase);
+            t_phase = t_now;
         }
 
         // run for 8 years
         if (t > model.final_time) {
-            printf("Run complete.\nSaving results to %s...\n", path);
+            printf("Run complete.\nSaving results to %s...\n", opts.output_path);
             // get the data agian
-            float* data = fetch_2d_state(
-                surf_texture, model_size_x, model_size_y, &Tmax, &Tmin,
-                &qmax, &qmin, &umax, &umin, &vmax, &vmin);
+            fetch_frame(sim, column_mode ? &column : NULL,
+                reduced_mode ? &state : NULL, tiled_mode ? &tiled : NULL,
+                model_size_x, model_size_y, data);
+            summarize_2d_state(data, model_size_x, model_size_y,
+                initial_model.lats, &Tmax, &Tmin, &qmax, &qmin, &umax, &umin,
+                &vmax, &vmin);
             // add it to the pile
             model_storage_add_frame(&model, t, data);
-            // write it to disk
-            model_storage_write(model_size_x, model_size_y, &model, &initial_model, argv[2]);
+            // write it to disk, the series of the whole run go with the
+            // last segment
+            const char* output_path = opts.output_path;
+            if (segmented) {
+                segment_writer_add(&segments, t);
+                output_path = segment_writer_finish(&segments, &model, t);
+            } else {
+                model_storage_write(model_size_x, model_size_y, &model,
+                    &initial_model, output_path);
+            }
+            stats_series_write(&stats_series, output_path);
+            if (orbit_mode) {
+                orbit_forcing_write(&orbit_forcing, output_path);
+#ifndef REDUCED_OUTPUT
+                printf("Orbit updates: %d, ending at %.1f kyr\n",
+                    orbit_forcing.n_updates,
+                    orbit_forcing_kyr(&orbit_forcing, t));
+#endif // REDUCED_OUTPUT
+            }
+            if (segmented) {
+                segment_writer_close(&segments, 1);
+            }
+            metrics_set_pending_frames(&metrics, 0);
+            metrics_add_phase(&metrics, METRICS_PHASE_OUTPUT,
+                glfwGetTime() - t_phase);
             // delete it
             model_storage_free(&model);
             // stop the run
@@ -291,6 +652,38 @@ int main(int argc, char *argv[]) {
         frame_ctr++;
     }
 
+    stats_series_free(&stats_series);
+    if (segmented) {
+        segment_writer_close(&segments, 0);
+    }
+    if (opts.export_target != NULL) {
+        export_free(&exporter);
+    }
+    if (sim != NULL) {
+        steer_free(&steer);
+    }
+    glebm_destroy(sim);
+    if (column_mode) {
+        column_state_free(&column);
+    }
+    if (reduced_mode) {
+        reduced_grid_free(&reduced_grid);
+        model_state_free(&state);
+    }
+    if (tiled_mode) {
+        tiled_grid_free(&tiled);
+    }
+    if (orbit_mode) {
+        orbit_forcing_free(&orbit_forcing);
+        insol_kernel_free(&insol_kernel);
+    }
+    // frames are left over when the window was closed early
+    model_storage_free(&model);
+    mem_delete_textures(1, &solat_LUT);
+    free_initial(&initial_model);
+    mem_free(data);
+    metrics_gpu_free(&metrics);
+    metrics_stop(&metrics);
     glfwTerminate();
 
     return 0;
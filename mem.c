@@ -0,0 +1,212 @@
+#include "mem.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+
+static const char* category_names[MEM_N_CATEGORIES] = {
+    [MEM_FIELDS] = "fields", [MEM_FRAMES] = "frames",
+    [MEM_STAGING] = "staging", [MEM_GL_TEXTURES] = "gl_textures",
+    [MEM_GL_BUFFERS] = "gl_buffers"
+};
+
+// encoder and prefetch threads allocate too
+static _Atomic long long current[MEM_N_CATEGORIES];
+static _Atomic long long peak[MEM_N_CATEGORIES];
+
+// keeps the memory after it aligned for any type
+typedef union {
+    struct {
+        size_t size;
+        mem_category_t category;
+    } info;
+    max_align_t align;
+} mem_header_t;
+
+static void count(mem_category_t category, long long delta) {
+    long long now = atomic_fetch_add(&current[category], delta) + delta;
+    long long old = atomic_load(&peak[category]);
+    while (now > old &&
+        !atomic_compare_exchange_weak(&peak[category], &old, now));
+}
+
+void* mem_alloc(mem_category_t category, size_t bytes) {
+    mem_header_t* header = (mem_header_t*) malloc(sizeof(mem_header_t) + bytes);
+    if (header == NULL) {
+        printf("Error: unable to allocate %lu bytes of %s.\n", bytes,
+            category_names[category]);
+        exit(1);
+    }
+    header->info.size = bytes;
+    header->info.category = category;
+    count(category, (long long) bytes);
+    return header + 1;
+}
+
+void* mem_calloc(mem_category_t category, size_t n, size_t size) {
+    void* ptr = mem_alloc(category, n * size);
+    memset(ptr, 0, n * size);
+    return ptr;
+}
+
+void* mem_realloc(mem_category_t category, void* ptr, size_t bytes) {
+    if (ptr == NULL) {
+        return mem_alloc(category, bytes);
+    }
+    mem_header_t* header = (mem_header_t*) ptr - 1;
+    long long old_size = (long long) header->info.size;
+    mem_category_t old_category = header->info.category;
+    header = (mem_header_t*) realloc(header, sizeof(mem_header_t) + bytes);
+    if (header == NULL) {
+        printf("Error: unable to allocate %lu bytes of %s.\n", bytes,
+            category_names[category]);
+        exit(1);
+    }
+    header->info.size = bytes;
+    count(old_category, -old_size);
+    count(old_category, (long long) bytes);
+    return header + 1;
+}
+
+void mem_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    mem_header_t* header = (mem_header_t*) ptr - 1;
+    count(header->info.category, -(long long) header->info.size);
+    free(header);
+}
+
+void init_mem_arena(mem_arena_t* arena, mem_category_t category) {
+    arena->category = category;
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->wanted = 0;
+    arena->overflow = NULL;
+    arena->n_overflow = 0;
+    arena->overflow_capacity = 0;
+}
+
+void* mem_arena_alloc(mem_arena_t* arena, size_t bytes) {
+    bytes = (bytes + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    arena->wanted += bytes;
+    if (arena->used + bytes <= arena->size) {
+        void* ptr = arena->base + arena->used;
+        arena->used += bytes;
+        return ptr;
+    }
+
+    // the block is too small this time, it grows on the next reset
+    if (arena->n_overflow == arena->overflow_capacity) {
+        arena->overflow_capacity = (arena->overflow_capacity > 0) ?
+            2 * arena->overflow_capacity : 4;
+        arena->overflow = (void**) realloc(arena->overflow,
+            arena->overflow_capacity * sizeof(void*));
+    }
+    void* ptr = mem_alloc(arena->category, bytes);
+    arena->overflow[arena->n_overflow++] = ptr;
+    return ptr;
+}
+
+void mem_arena_reset(mem_arena_t* arena) {
+    for (int k = 0; k < arena->n_overflow; k++) {
+        mem_free(arena->overflow[k]);
+    }
+    arena->n_overflow = 0;
+    if (arena->wanted > arena->size) {
+        mem_free(arena->base);
+        arena->base = (char*) mem_alloc(arena->category, arena->wanted);
+        arena->size = arena->wanted;
+    }
+    arena->used = 0;
+    arena->wanted = 0;
+}
+
+void mem_arena_free(mem_arena_t* arena) {
+    mem_arena_reset(arena);
+    mem_free(arena->base);
+    free(arena->overflow);
+    init_mem_arena(arena, arena->category);
+}
+
+// bytes of every GL object name, names are small integers handed out in
+// order so a flat table is enough
+typedef struct {
+    size_t* bytes;
+    size_t n;
+} gl_table_t;
+
+static gl_table_t textures = { NULL, 0 };
+static gl_table_t buffers = { NULL, 0 };
+static pthread_mutex_t gl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void gl_track(gl_table_t* table, mem_category_t category,
+    unsigned int name, size_t bytes) {
+    pthread_mutex_lock(&gl_lock);
+    if (name >= table->n) {
+        size_t n = (table->n > 0) ? table->n : 64;
+        while (n <= name) {
+            n *= 2;
+        }
+        table->bytes = (size_t*) realloc(table->bytes, n * sizeof(size_t));
+        memset(&table->bytes[table->n], 0, (n - table->n) * sizeof(size_t));
+        table->n = n;
+    }
+    count(category, (long long) bytes - (long long) table->bytes[name]);
+    table->bytes[name] = bytes;
+    pthread_mutex_unlock(&gl_lock);
+}
+
+void mem_track_texture(unsigned int texture, size_t bytes) {
+    gl_track(&textures, MEM_GL_TEXTURES, texture, bytes);
+}
+
+void mem_track_buffer(unsigned int buffer, size_t bytes) {
+    gl_track(&buffers, MEM_GL_BUFFERS, buffer, bytes);
+}
+
+void mem_delete_textures(int n, const unsigned int* names) {
+    for (int k = 0; k < n; k++) {
+        if (names[k] != 0) {
+            gl_track(&textures, MEM_GL_TEXTURES, names[k], 0);
+        }
+    }
+    glDeleteTextures(n, names);
+}
+
+void mem_delete_buffers(int n, const unsigned int* names) {
+    for (int k = 0; k < n; k++) {
+        if (names[k] != 0) {
+            gl_track(&buffers, MEM_GL_BUFFERS, names[k], 0);
+        }
+    }
+    glDeleteBuffers(n, names);
+}
+
+long long mem_current(mem_category_t category) {
+    return atomic_load(&current[category]);
+}
+
+long long mem_peak(mem_category_t category) {
+    return atomic_load(&peak[category]);
+}
+
+const char* mem_category_name(mem_category_t category) {
+    return category_names[category];
+}
+
+void mem_report() {
+#ifndef REDUCED_OUTPUT
+    printf("Memory (MiB):");
+    for (int k = 0; k < MEM_N_CATEGORIES; k++) {
+        printf(" %s=%.2f/%.2f", category_names[k],
+            mem_current((mem_category_t) k) / 1048576.0,
+            mem_peak((mem_category_t) k) / 1048576.0);
+    }
+    printf(" (current/peak)\n");
+#endif // REDUCED_OUTPUT
+}
@@ -0,0 +1,53 @@
+#ifndef _MEM_H
+#define _MEM_H
+
+#include <stddef.h>
+
+// what an allocation is for. Host categories are counted by mem_alloc and
+// mem_free, GL categories by the texture and buffer helpers below.
+typedef enum {
+    MEM_FIELDS,      // input and parameter fields
+    MEM_FRAMES,      // frames and samples held for the output file
+    MEM_STAGING,     // upload, readback and shader source buffers
+    MEM_GL_TEXTURES,
+    MEM_GL_BUFFERS,
+    MEM_N_CATEGORIES
+} mem_category_t;
+
+// host allocations carry a small header with their size and category, so
+// they must be released with mem_free
+void* mem_alloc(mem_category_t category, size_t bytes);
+void* mem_calloc(mem_category_t category, size_t n, size_t size);
+void* mem_realloc(mem_category_t category, void* ptr, size_t bytes);
+void mem_free(void* ptr);
+
+// bump allocator for per-frame buffers. Everything handed out lives until
+// the next reset, which also grows the block to the largest set of buffers
+// seen so far, so steady state sampling allocates nothing.
+typedef struct {
+    mem_category_t category;
+    char* base;
+    size_t size, used;
+    size_t wanted;   // asked for since the last reset
+    void** overflow; // blocks that did not fit, freed on reset
+    int n_overflow, overflow_capacity;
+} mem_arena_t;
+
+void init_mem_arena(mem_arena_t* arena, mem_category_t category);
+void* mem_arena_alloc(mem_arena_t* arena, size_t bytes);
+void mem_arena_reset(mem_arena_t* arena);
+void mem_arena_free(mem_arena_t* arena);
+
+// GL storage is counted per object name, respecifying an object replaces its
+// old size
+void mem_track_texture(unsigned int texture, size_t bytes);
+void mem_track_buffer(unsigned int buffer, size_t bytes);
+void mem_delete_textures(int n, const unsigned int* textures);
+void mem_delete_buffers(int n, const unsigned int* buffers);
+
+long long mem_current(mem_category_t category);
+long long mem_peak(mem_category_t category);
+const char* mem_category_name(mem_category_t category);
+void mem_report();
+
+#endif // _MEM_H
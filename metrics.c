@@ -0,0 +1,379 @@
+#include "metrics.h"
+#include "common.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// refresh the steps/sec gauge at most this often
+#define METRICS_RATE_WINDOW 1.0 // s
+// a client that sends no request within this is dropped
+#define METRICS_CLIENT_TIMEOUT 500 // ms
+
+static const char* phase_names[METRICS_N_PHASES] = {
+    "step", "render", "readback", "output"
+};
+
+void init_metrics(metrics_t* m) {
+    atomic_store(&m->steps, 0);
+    atomic_store(&m->t_days, 0.0);
+    atomic_store(&m->steps_per_sec, 0.0);
+    atomic_store(&m->sim_years_per_day, 0.0);
+    atomic_store(&m->Tmean, 0.0);
+    for (int p = 0; p < METRICS_N_PHASES; p++) {
+        atomic_store(&m->phase_seconds[p], 0.0);
+        atomic_store(&m->gpu_seconds[p], 0.0);
+        atomic_store(&m->gpu_samples[p], 0);
+        m->queries[p][0] = 0;
+        m->query_head[p] = 0;
+        m->query_count[p] = 0;
+    }
+    m->query_open = -1;
+    atomic_store(&m->pending_frames, 0);
+    atomic_store(&m->gpu_bytes, 0);
+    m->window_steps = 0;
+    m->window_start = -1.0;
+    m->address = NULL;
+    m->fd = -1;
+    m->running = 0;
+}
+
+void metrics_progress(metrics_t* m, unsigned long long steps, double t_days,
+    double dt_days, double wall) {
+    atomic_store(&m->steps, steps);
+    atomic_store(&m->t_days, t_days);
+
+    // a count that went backwards starts a new window instead of wrapping
+    if (m->window_start < 0.0 || steps < m->window_steps) {
+        m->window_start = wall;
+        m->window_steps = steps;
+    } else if (wall - m->window_start >= METRICS_RATE_WINDOW) {
+        double sps = (steps - m->window_steps) / (wall - m->window_start);
+        atomic_store(&m->steps_per_sec, sps);
+        atomic_store(&m->sim_years_per_day,
+            sps * dt_days / days_per_year * 86400.0);
+        m->window_start = wall;
+        m->window_steps = steps;
+    }
+}
+
+void metrics_add_phase(metrics_t* m, metrics_phase_t phase, double seconds) {
+    // single writer, so load + store is enough
+    atomic_store(&m->phase_seconds[phase],
+        atomic_load(&m->phase_seconds[phase]) + seconds);
+}
+
+// add the finished queries of a phase, oldest first, without waiting
+static void collect_queries(metrics_t* m, metrics_phase_t phase) {
+    while (m->query_count[phase] > 0) {
+        unsigned int query = m->queries[phase][m->query_head[phase]];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+
+        // some drivers time the very first query from zero, anything longer
+        // than the wall time since glBeginQuery cannot be real
+        double seconds = (double) ns * 1.0e-9;
+        double wall = glfwGetTime() -
+            m->query_start[phase][m->query_head[phase]];
+        if (seconds <= wall) {
+            atomic_store(&m->gpu_seconds[phase],
+                atomic_load(&m->gpu_seconds[phase]) + seconds);
+            atomic_store(&m->gpu_samples[phase],
+                atomic_load(&m->gpu_samples[phase]) + 1);
+        }
+        m->query_head[phase] = (m->query_head[phase] + 1) % METRICS_GPU_RING;
+        m->query_count[phase]--;
+    }
+}
+
+void metrics_gpu_begin(metrics_t* m, metrics_phase_t phase) {
+    // nobody would read the times
+    if (!m->running) {
+        return;
+    }
+    if (m->queries[phase][0] == 0) {
+        glGenQueries(METRICS_GPU_RING, m->queries[phase]);
+    }
+    collect_queries(m, phase);
+    if (m->query_count[phase] == METRICS_GPU_RING) {
+        return;
+    }
+    int slot = (m->query_head[phase] + m->query_count[phase]) %
+        METRICS_GPU_RING;
+    m->query_start[phase][slot] = glfwGetTime();
+    glBeginQuery(GL_TIME_ELAPSED, m->queries[phase][slot]);
+    m->query_count[phase]++;
+    m->query_open = phase;
+}
+
+void metrics_gpu_end(metrics_t* m) {
+    if (m->query_open >= 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m->query_open = -1;
+    }
+}
+
+void metrics_gpu_free(metrics_t* m) {
+    for (int p = 0; p < METRICS_N_PHASES; p++) {
+        if (m->queries[p][0] != 0) {
+            glDeleteQueries(METRICS_GPU_RING, m->queries[p]);
+            m->queries[p][0] = 0;
+            m->query_count[p] = 0;
+        }
+    }
+}
+
+void metrics_set_Tmean(metrics_t* m, double Tmean) {
+    atomic_store(&m->Tmean, Tmean);
+}
+
+void metrics_set_pending_frames(metrics_t* m, long frames) {
+    atomic_store(&m->pending_frames, frames);
+}
+
+void metrics_set_gpu_bytes(metrics_t* m, long bytes) {
+    atomic_store(&m->gpu_bytes, bytes);
+}
+
+// resident set size of this process from /proc
+static long host_memory_bytes() {
+    long pages = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file != NULL) {
+        if (fscanf(file, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(file);
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+static int format_metrics(metrics_t* m, char* buffer, size_t size) {
+    int n = 0;
+    n += snprintf(buffer + n, size - n,
+        "# HELP glebm_steps_total Model steps taken.\n"
+        "# TYPE glebm_steps_total counter\n"
+        "glebm_steps_total %llu\n"
+        "# HELP glebm_steps_per_second Recent step rate.\n"
+        "# TYPE glebm_steps_per_second gauge\n"
+        "glebm_steps_per_second %.3f\n"
+        "# HELP glebm_sim_years_per_wall_day Simulated years per wall clock day.\n"
+        "# TYPE glebm_sim_years_per_wall_day gauge\n"
+        "glebm_sim_years_per_wall_day %.3f\n"
+        "# HELP glebm_model_time_days Current model time.\n"
+        "# TYPE glebm_model_time_days gauge\n"
+        "glebm_model_time_days %.6f\n"
+        "# HELP glebm_global_mean_ts_kelvin Area weighted mean surface temperature at the last sample.\n"
+        "# TYPE glebm_global_mean_ts_kelvin gauge\n"
+        "glebm_global_mean_ts_kelvin %.4f\n",
+        atomic_load(&m->steps), atomic_load(&m->steps_per_sec),
+        atomic_load(&m->sim_years_per_day), atomic_load(&m->t_days),
+        atomic_load(&m->Tmean));
+
+    n += snprintf(buffer + n, size - n,
+        "# HELP glebm_host_phase_seconds_total Host wall time spent in each phase of the main loop, GPU work is only submitted in it.\n"
+        "# TYPE glebm_host_phase_seconds_total counter\n");
+    for (int p = 0; p < METRICS_N_PHASES; p++) {
+        n += snprintf(buffer + n, size - n,
+            "glebm_host_phase_seconds_total{phase=\"%s\"} %.6f\n",
+            phase_names[p], atomic_load(&m->phase_seconds[p]));
+    }
+
+    // only the phases timed with metrics_gpu_begin, once they have a sample
+    n += snprintf(buffer + n, size - n,
+        "# HELP glebm_gpu_phase_seconds_total GPU execution time of the timed steps of each phase.\n"
+        "# TYPE glebm_gpu_phase_seconds_total counter\n"
+        "# HELP glebm_gpu_phase_samples_total Steps whose GPU time has been measured.\n"
+        "# TYPE glebm_gpu_phase_samples_total counter\n");
+    for (int p = 0; p < METRICS_N_PHASES; p++) {
+        if (atomic_load(&m->gpu_samples[p]) == 0) {
+            continue;
+        }
+        n += snprintf(buffer + n, size - n,
+            "glebm_gpu_phase_seconds_total{phase=\"%s\"} %.6f\n"
+            "glebm_gpu_phase_samples_total{phase=\"%s\"} %llu\n",
+            phase_names[p], atomic_load(&m->gpu_seconds[p]), phase_names[p],
+            atomic_load(&m->gpu_samples[p]));
+    }
+
+    n += snprintf(buffer + n, size - n,
+        "# HELP glebm_pending_output_frames Frames held in memory until the output is written.\n"
+        "# TYPE glebm_pending_output_frames gauge\n"
+        "glebm_pending_output_frames %ld\n"
+        "# HELP glebm_host_memory_bytes Resident host memory.\n"
+        "# TYPE glebm_host_memory_bytes gauge\n"
+        "glebm_host_memory_bytes %ld\n"
+        "# HELP glebm_gpu_memory_bytes Textures holding the model state and parameters.\n"
+        "# TYPE glebm_gpu_memory_bytes gauge\n"
+        "glebm_gpu_memory_bytes %ld\n",
+        atomic_load(&m->pending_frames), host_memory_bytes(),
+        atomic_load(&m->gpu_bytes));
+
+    n += snprintf(buffer + n, size - n,
+        "# HELP glebm_memory_bytes Tracked allocations by category.\n"
+        "# TYPE glebm_memory_bytes gauge\n");
+    for (int k = 0; k < MEM_N_CATEGORIES; k++) {
+        n += snprintf(buffer + n, size - n,
+            "glebm_memory_bytes{category=\"%s\",kind=\"current\"} %lld\n"
+            "glebm_memory_bytes{category=\"%s\",kind=\"peak\"} %lld\n",
+            mem_category_name((mem_category_t) k),
+            mem_current((mem_category_t) k),
+            mem_category_name((mem_category_t) k),
+            mem_peak((mem_category_t) k));
+    }
+
+    return n;
+}
+
+// MSG_NOSIGNAL so a scraper hanging up mid response only drops that client
+// instead of raising SIGPIPE in the model process
+static int send_all(int client, const char* data, int len) {
+    while (len > 0) {
+        ssize_t n = send(client, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void serve_client(metrics_t* m, int client) {
+    // the request itself does not matter, every path gets the metrics. A
+    // client that connects and stays silent must not hold up later scrapes
+    // or metrics_stop.
+    struct pollfd pfd = { .fd = client, .events = POLLIN };
+    if (poll(&pfd, 1, METRICS_CLIENT_TIMEOUT) <= 0) {
+        return;
+    }
+    char request[1024];
+    if (read(client, request, sizeof(request)) < 0) {
+        return;
+    }
+
+    char body[8192];
+    int body_len = format_metrics(m, body, sizeof(body));
+    char header[256];
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %d\r\n"
+        "Connection: close\r\n\r\n", body_len);
+
+    if (send_all(client, header, header_len) < 0) {
+        return;
+    }
+    send_all(client, body, body_len);
+}
+
+static void* metrics_main(void* arg) {
+    metrics_t* m = (metrics_t*) arg;
+    struct pollfd pfd = { .fd = m->fd, .events = POLLIN };
+
+    // wake up regularly to notice metrics_stop
+    while (m->running) {
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        int client = accept(m->fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        serve_client(m, client);
+        close(client);
+    }
+    return NULL;
+}
+
+// only ever remove a unix socket, never a file that happens to have the
+// name that was passed
+static void unlink_socket(const char* path) {
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+}
+
+// a bare port number listens on localhost, anything else is a unix socket
+static int open_listener(char* address) {
+    char* end;
+    long port = strtol(address, &end, 10);
+    int fd;
+
+    if (*end == '\0' && port > 0 && port < 65536) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short) port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            return -1;
+        }
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+        unlink_socket(address);
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            return -1;
+        }
+    }
+
+    if (listen(fd, 4) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+void metrics_start(metrics_t* m, char* address) {
+    m->fd = open_listener(address);
+    if (m->fd < 0) {
+        printf("Error: unable to serve metrics on %s\n", address);
+        exit(1);
+    }
+    m->address = address;
+    m->running = 1;
+    if (pthread_create(&m->thread, NULL, metrics_main, m)) {
+        printf("Error: unable to start metrics thread.\n");
+        exit(1);
+    }
+    printf("Serving metrics on %s\n", address);
+}
+
+void metrics_stop(metrics_t* m) {
+    if (!m->running) {
+        return;
+    }
+    m->running = 0;
+    pthread_join(m->thread, NULL);
+    close(m->fd);
+
+    // leave no stale unix socket behind
+    char* end;
+    strtol(m->address, &end, 10);
+    if (*end != '\0') {
+        unlink_socket(m->address);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stddef.h>
+
+// queries in flight per timed phase, results are read this many steps late
+#define METRICS_GPU_RING 4
+
+// host wall time is split into these phases of the main loop. The host time
+// of the step phase is mostly the driver taking the dispatches, so the step
+// is also timed on the GPU.
+typedef enum {
+    METRICS_PHASE_STEP,
+    METRICS_PHASE_RENDER,
+    METRICS_PHASE_READBACK,
+    METRICS_PHASE_OUTPUT,
+    METRICS_N_PHASES
+} metrics_phase_t;
+
+// counters are written by the simulation thread and read by the server
+// thread, which never takes a lock the simulation waits on
+typedef struct {
+    _Atomic unsigned long long steps;
+    _Atomic double t_days;
+    _Atomic double steps_per_sec;
+    _Atomic double sim_years_per_day;
+    _Atomic double Tmean;
+    _Atomic double phase_seconds[METRICS_N_PHASES];
+    _Atomic double gpu_seconds[METRICS_N_PHASES];
+    _Atomic unsigned long long gpu_samples[METRICS_N_PHASES];
+    _Atomic long pending_frames;
+    _Atomic long gpu_bytes;
+
+    // rate window, only touched by the simulation thread
+    unsigned long long window_steps;
+    double window_start;
+
+    // GL_TIME_ELAPSED queries, only touched by the simulation thread
+    unsigned int queries[METRICS_N_PHASES][METRICS_GPU_RING];
+    double query_start[METRICS_N_PHASES][METRICS_GPU_RING]; // wall time
+    int query_head[METRICS_N_PHASES], query_count[METRICS_N_PHASES];
+    int query_open; // phase being timed, -1 for none
+
+    // server
+    char* address;
+    int fd;
+    _Atomic int running;
+    pthread_t thread;
+} metrics_t;
+
+void init_metrics(metrics_t* m);
+void metrics_start(metrics_t* m, char* address);
+void metrics_stop(metrics_t* m);
+
+void metrics_progress(metrics_t* m, unsigned long long steps, double t_days,
+    double dt_days, double wall);
+void metrics_add_phase(metrics_t* m, metrics_phase_t phase, double seconds);
+
+// time the GL work submitted between begin and end on the GPU. Finished
+// queries are collected on the next begin without waiting, and a step is
+// left untimed when all of its queries are still in flight, so the samples
+// count says how many steps the GPU time covers. Nothing is timed unless
+// the metrics are being served.
+void metrics_gpu_begin(metrics_t* m, metrics_phase_t phase);
+void metrics_gpu_end(metrics_t* m);
+void metrics_gpu_free(metrics_t* m); // needs the GL context
+void metrics_set_Tmean(metrics_t* m, double Tmean);
+void metrics_set_pending_frames(metrics_t* m, long frames);
+void metrics_set_gpu_bytes(metrics_t* m, long bytes);
+
+#endif // _METRICS_H
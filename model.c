@@ -0,0 +1,417 @@
+#include "model.h"
+#include "common.h"
+#include "initial.h"
+#include "renderutil.h"
+#include "fetch.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+static void init_state_texture(unsigned int texture, size_t nx, size_t ny,
+    GLenum format, GLenum layout, GLenum type, size_t texel_bytes,
+    void* data) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, nx, ny, 0, layout, type, data);
+    mem_track_texture(texture, nx * ny * texel_bytes);
+}
+
+// temperature channel of an RGBA state
+static float* extract_T(float* data, size_t n) {
+    float* T = (float*) mem_alloc(MEM_STAGING, n * sizeof(float));
+    for (size_t i = 0; i < n; i++) {
+        T[i] = data[i * 4];
+    }
+    return T;
+}
+
+// 0 if either program could not be built, for the library
+int load_compute_kernel(compute_kernel_t* kernel, const char* path) {
+    kernel->program = load_cshader(path);
+    kernel->filter_program = load_cshader("shader/polar.cs");
+    kernel->slow_program = 0;
+    if (kernel->program == 0 || kernel->filter_program == 0) {
+        glDeleteProgram(kernel->program);
+        glDeleteProgram(kernel->filter_program);
+        return 0;
+    }
+    kernel->year_frac_l  = glGetUniformLocation(kernel->program, "year_frac");
+    kernel->day_frac_l   = glGetUniformLocation(kernel->program, "day_frac");
+    kernel->dt_l         = glGetUniformLocation(kernel->program, "dt");
+    kernel->daily_mean_l = glGetUniformLocation(kernel->program, "daily_mean");
+    kernel->write_diag_l = glGetUniformLocation(kernel->program, "write_diag");
+    kernel->insol_LUT_l  = glGetUniformLocation(kernel->program, "insol_LUT");
+    kernel->physp_LUT1_l = glGetUniformLocation(kernel->program, "physp_LUT1");
+    kernel->physp_LUT2_l = glGetUniformLocation(kernel->program, "physp_LUT2");
+    kernel->forcing_w_l  = glGetUniformLocation(kernel->program, "forcing_w");
+    kernel->forcing_LUT1_l =
+        glGetUniformLocation(kernel->program, "forcing_LUT1");
+    kernel->forcing_LUT2_l =
+        glGetUniformLocation(kernel->program, "forcing_LUT2");
+    kernel->polar_rows_l = glGetUniformLocation(kernel->program, "polar_rows");
+    kernel->multirate_l  = glGetUniformLocation(kernel->program, "multirate");
+    kernel->diffusivity_l =
+        glGetUniformLocation(kernel->program, "diffusivity");
+    kernel->freezing_T_l = glGetUniformLocation(kernel->program, "freezing_T");
+    kernel->solar_constant_l =
+        glGetUniformLocation(kernel->program, "solar_constant");
+
+    kernel->filter_dt_l = glGetUniformLocation(kernel->filter_program, "dt");
+    kernel->filter_write_diag_l =
+        glGetUniformLocation(kernel->filter_program, "write_diag");
+    kernel->filter_rows_l =
+        glGetUniformLocation(kernel->filter_program, "polar_rows");
+    kernel->filter_cos_l =
+        glGetUniformLocation(kernel->filter_program, "polar_cos");
+    kernel->filter_LUT_l =
+        glGetUniformLocation(kernel->filter_program, "physp_LUT1");
+    return 1;
+}
+
+void init_compute_kernel(compute_kernel_t* kernel, const char* path) {
+    if (!load_compute_kernel(kernel, path)) {
+        exit(1);
+    }
+}
+
+int load_multirate_kernel(compute_kernel_t* kernel) {
+    if (kernel->slow_program != 0) {
+        return 1;
+    }
+    unsigned int p = load_cshader("shader/slow.cs");
+    if (p == 0) {
+        return 0;
+    }
+    kernel->slow_program = p;
+    kernel->slow_year_frac_l  = glGetUniformLocation(p, "year_frac");
+    kernel->slow_day_frac_l   = glGetUniformLocation(p, "day_frac");
+    kernel->slow_daily_mean_l = glGetUniformLocation(p, "daily_mean");
+    kernel->slow_forcing_w_l  = glGetUniformLocation(p, "forcing_w");
+    kernel->slow_freezing_T_l = glGetUniformLocation(p, "freezing_T");
+    kernel->slow_solar_constant_l =
+        glGetUniformLocation(p, "solar_constant");
+    return 1;
+}
+
+void init_model_state(model_state_t* state, size_t nx, size_t ny,
+    model_initial_t* initial, float* data) {
+    state->nx = nx;
+    state->ny = ny;
+    state->current = 0;
+    state->forcing_LUT1 = 0;
+    state->forcing_LUT2 = 0;
+    state->forcing_w = 0.0f;
+    state->zonal_texture = 0;
+    state->polar_rows[0] = 0;
+    state->polar_rows[1] = 0;
+    state->polar_lat = 90.0f;
+    state->diffusivity = DEFAULT_DIFFUSIVITY;
+    state->freezing_T = DEFAULT_FREEZING_T;
+    state->solar_constant = S0;
+    state->slow_texture = 0;
+    state->slow_every = 1;
+    state->slow_age = 0;
+
+    // create ping-pong temperature textures and the diagnostic texture
+    float* T = extract_T(data, nx * ny);
+    glGenTextures(2, state->T_textures);
+    for (int i = 0; i < 2; i++) {
+        init_state_texture(state->T_textures[i], nx, ny, GL_R32F, GL_RED,
+            GL_FLOAT, sizeof(float), T);
+    }
+    mem_free(T);
+    unsigned short* zeros = (unsigned short*) mem_calloc(MEM_STAGING,
+        nx * ny * 4, sizeof(unsigned short));
+    glGenTextures(1, &state->diag_texture);
+    init_state_texture(state->diag_texture, nx, ny, GL_RGBA16F, GL_RGBA,
+        GL_HALF_FLOAT, 4 * sizeof(unsigned short), zeros);
+    mem_free(zeros);
+
+    // create physical LUT (lat, lon, B, lambda) textures
+    make_LUTs(nx, ny, initial, &state->physp_LUT1, &state->physp_LUT2);
+}
+
+// filter the zonal tendency of every row poleward of polar_lat, 90 or more
+// turns the filter off
+void model_state_set_polar_filter(model_state_t* state,
+    model_initial_t* initial, float polar_lat) {
+    state->polar_lat = polar_lat;
+    state->polar_rows[0] = 0;
+    state->polar_rows[1] = 0;
+    if (polar_lat > 0.0f && polar_lat < 90.0f) {
+        for (size_t j = 0; j < state->ny; j++) {
+            if (fabsf(initial->lats[j]) > polar_lat) {
+                state->polar_rows[(j < state->ny / 2) ? 0 : 1]++;
+            }
+        }
+    }
+
+    int filtered = state->polar_rows[0] + state->polar_rows[1] > 0;
+    if (filtered && state->nx > POLAR_MAX_LON) {
+        printf("Error: the polar filter supports at most %d longitudes.\n",
+            POLAR_MAX_LON);
+        exit(1);
+    }
+    if (filtered && state->zonal_texture == 0) {
+        glGenTextures(1, &state->zonal_texture);
+        init_state_texture(state->zonal_texture, state->nx, state->ny,
+            GL_RG32F, GL_RG, GL_FLOAT, 2 * sizeof(float), NULL);
+    } else if (!filtered && state->zonal_texture != 0) {
+        mem_delete_textures(1, &state->zonal_texture);
+        state->zonal_texture = 0;
+    }
+}
+
+// recompute the slow physics only every slow_every steps, 1 steps everything
+// at the same rate
+void model_state_set_multirate(model_state_t* state, int slow_every) {
+    state->slow_every = (slow_every > 1) ? slow_every : 1;
+    state->slow_age = 0;
+    if (state->slow_every > 1 && state->slow_texture == 0) {
+        glGenTextures(1, &state->slow_texture);
+        init_state_texture(state->slow_texture, state->nx, state->ny,
+            GL_RGBA32F, GL_RGBA, GL_FLOAT, 4 * sizeof(float), NULL);
+    } else if (state->slow_every == 1 && state->slow_texture != 0) {
+        mem_delete_textures(1, &state->slow_texture);
+        state->slow_texture = 0;
+    }
+}
+
+void model_state_reset(model_state_t* state, model_initial_t* initial,
+    float* data) {
+    // reuse the textures, only their contents change
+    float* T = extract_T(data, state->nx * state->ny);
+    state->current = 0;
+    state->slow_age = 0;
+    glBindTexture(GL_TEXTURE_2D, state->T_textures[0]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, state->nx, state->ny,
+        GL_RED, GL_FLOAT, T);
+    mem_free(T);
+    update_LUTs(state->nx, state->ny, initial, state->physp_LUT1,
+        state->physp_LUT2);
+}
+
+// radiative and diffusive update of one state, without the barrier that has
+// to follow it
+static void dispatch_step(model_state_t* state, compute_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt, int write_diag) {
+    // bind state and lookup tables
+    glBindImageTexture(0, state->T_textures[state->current], 0, GL_FALSE, 0,
+        GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(1, state->T_textures[1 - state->current], 0, GL_FALSE,
+        0, GL_WRITE_ONLY, GL_R32F);
+    glBindImageTexture(2, state->diag_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+        GL_RGBA16F);
+    glBindImageTexture(3, state->zonal_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+        GL_RG32F);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, solar_LUT);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, state->physp_LUT1);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, state->physp_LUT2);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, state->forcing_LUT1);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, state->forcing_LUT2);
+    glActiveTexture(GL_TEXTURE0);
+
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+
+    // refresh the cached slow physics from the incoming state
+    int multirate = state->slow_every > 1;
+    if (multirate && state->slow_age == 0) {
+        glBindImageTexture(4, state->slow_texture, 0, GL_FALSE, 0,
+            GL_WRITE_ONLY, GL_RGBA32F);
+        glUseProgram(kernel->slow_program);
+        glUniform1f(kernel->slow_year_frac_l, year_frac);
+        glUniform1f(kernel->slow_day_frac_l, day_frac);
+        glUniform1f(kernel->slow_forcing_w_l, state->forcing_w);
+        glUniform1f(kernel->slow_freezing_T_l, state->freezing_T);
+        glUniform1f(kernel->slow_solar_constant_l, state->solar_constant);
+        glDispatchCompute((unsigned int) state->nx / 32,
+            (unsigned int) state->ny / 32, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    if (multirate) {
+        glBindImageTexture(4, state->slow_texture, 0, GL_FALSE, 0,
+            GL_READ_ONLY, GL_RGBA32F);
+        state->slow_age = (state->slow_age + 1) % state->slow_every;
+    }
+
+    // dispatch compute shader
+    glUseProgram(kernel->program);
+    glUniform1f(kernel->year_frac_l, year_frac);
+    glUniform1f(kernel->day_frac_l, day_frac);
+    glUniform1f(kernel->dt_l, dt);
+    glUniform1i(kernel->write_diag_l, write_diag);
+    glUniform1i(kernel->insol_LUT_l, 1);
+    glUniform1i(kernel->physp_LUT1_l, 2);
+    glUniform1i(kernel->physp_LUT2_l, 3);
+    glUniform1i(kernel->forcing_LUT1_l, 4);
+    glUniform1i(kernel->forcing_LUT2_l, 5);
+    glUniform1f(kernel->forcing_w_l, state->forcing_w);
+    glUniform1i(kernel->multirate_l, multirate);
+    glUniform2i(kernel->polar_rows_l, state->polar_rows[0],
+        state->polar_rows[1]);
+    glUniform1f(kernel->diffusivity_l, state->diffusivity);
+    glUniform1f(kernel->freezing_T_l, state->freezing_T);
+    glUniform1f(kernel->solar_constant_l, state->solar_constant);
+    glDispatchCompute((unsigned int) state->nx / 32,
+        (unsigned int) state->ny / 32, 1);
+}
+
+// add the filtered zonal tendency of the polar rows, once the step pass is
+// visible
+static void dispatch_filter(model_state_t* state, compute_kernel_t* kernel,
+    float dt, int write_diag) {
+    int polar_rows = state->polar_rows[0] + state->polar_rows[1];
+    if (polar_rows > 0) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, state->physp_LUT1);
+        glActiveTexture(GL_TEXTURE0);
+        glBindImageTexture(1, state->T_textures[1 - state->current], 0,
+            GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(2, state->diag_texture, 0, GL_FALSE, 0,
+            GL_READ_WRITE, GL_RGBA16F);
+        glBindImageTexture(3, state->zonal_texture, 0, GL_FALSE, 0,
+            GL_READ_ONLY, GL_RG32F);
+        glUseProgram(kernel->filter_program);
+        glUniform1f(kernel->filter_dt_l, dt);
+        glUniform1i(kernel->filter_write_diag_l, write_diag);
+        glUniform2i(kernel->filter_rows_l, state->polar_rows[0],
+            state->polar_rows[1]);
+        glUniform1f(kernel->filter_cos_l, cosf(deg2rad(state->polar_lat)));
+        glUniform1i(kernel->filter_LUT_l, 2);
+        glDispatchCompute(1, (unsigned int) polar_rows, 1);
+    }
+}
+
+void model_state_step(model_state_t* state, compute_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt, int write_diag) {
+    dispatch_step(state, kernel, solar_LUT, t, dt, write_diag);
+    if (state->polar_rows[0] + state->polar_rows[1] > 0) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        dispatch_filter(state, kernel, dt, write_diag);
+    }
+
+    // next step (or readback) must see this one
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    state->current = 1 - state->current;
+}
+
+// one step of several independent states of the same size, each at its own
+// time t[i]. The states share the barriers, so the GPU can overlap their
+// passes when each alone is too small to fill it.
+void model_state_step_many(int n, model_state_t** states,
+    compute_kernel_t* kernel, unsigned int solar_LUT, const double* t,
+    float dt) {
+    int filtered = 0;
+    for (int i = 0; i < n; i++) {
+        dispatch_step(states[i], kernel, solar_LUT, t[i], dt, 0);
+        filtered |= states[i]->polar_rows[0] + states[i]->polar_rows[1] > 0;
+    }
+    if (filtered) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        for (int i = 0; i < n; i++) {
+            dispatch_filter(states[i], kernel, dt, 0);
+        }
+    }
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    for (int i = 0; i < n; i++) {
+        states[i]->current = 1 - states[i]->current;
+    }
+}
+
+// fill the diagnostics for the current state without advancing it, the
+// scratch Ts goes to the texture the next step overwrites anyway
+void model_state_diagnose(model_state_t* state, compute_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt) {
+    int slow_age = state->slow_age;
+    model_state_step(state, kernel, solar_LUT, t, dt, 1);
+    state->current = 1 - state->current;
+    state->slow_age = slow_age;
+}
+
+unsigned int model_state_texture(model_state_t* state) {
+    return state->T_textures[state->current];
+}
+
+void model_state_read(model_state_t* state, float* data) {
+    fetch_2d_fields(model_state_texture(state), state->diag_texture,
+        state->nx, state->ny, data);
+}
+
+void model_state_read_T(model_state_t* state, float* T) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, model_state_texture(state));
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, T);
+}
+
+void model_state_write_T(model_state_t* state, float* T) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, model_state_texture(state));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, state->nx, state->ny,
+        GL_RED, GL_FLOAT, T);
+}
+
+// nominal memory traffic of one step: Ts in and out, both parameter LUTs
+// (twice while blending forcing slices), and the half precision diagnostics
+// when they are written
+size_t model_state_bytes_per_step(model_state_t* state, int write_diag) {
+    size_t per_cell = 2 * sizeof(float) + 8 * sizeof(float);
+    if (state->forcing_w > 0.0f) {
+        per_cell += 8 * sizeof(float);
+    }
+    if (write_diag) {
+        per_cell += 4 * sizeof(unsigned short);
+    }
+    // the slow pass reads Ts and both LUTs and writes its cache once every
+    // slow_every steps, the steps in between read the cache instead of
+    // the second LUT
+    if (state->slow_every > 1) {
+        per_cell += (sizeof(float) + 12 * sizeof(float)) / state->slow_every;
+    }
+    return per_cell * state->nx * state->ny;
+}
+
+// textures owned by the state: two Ts images, the diagnostics and both LUTs
+// plus the forcing LUTs and the polar tendency when there are any
+size_t model_state_gpu_bytes(model_state_t* state) {
+    size_t per_cell = 2 * sizeof(float) + 4 * sizeof(unsigned short) +
+        8 * sizeof(float);
+    if (state->forcing_LUT1 != 0) {
+        per_cell += 8 * sizeof(float);
+    }
+    if (state->zonal_texture != 0) {
+        per_cell += 2 * sizeof(float);
+    }
+    if (state->slow_texture != 0) {
+        per_cell += 4 * sizeof(float);
+    }
+    return per_cell * state->nx * state->ny;
+}
+
+void model_state_free(model_state_t* state) {
+    mem_delete_textures(2, state->T_textures);
+    mem_delete_textures(1, &state->diag_texture);
+    mem_delete_textures(1, &state->physp_LUT1);
+    mem_delete_textures(1, &state->physp_LUT2);
+    if (state->forcing_LUT1 != 0) {
+        mem_delete_textures(1, &state->forcing_LUT1);
+        mem_delete_textures(1, &state->forcing_LUT2);
+    }
+    if (state->zonal_texture != 0) {
+        mem_delete_textures(1, &state->zonal_texture);
+    }
+    if (state->slow_texture != 0) {
+        mem_delete_textures(1, &state->slow_texture);
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef _MODEL_H
+#define _MODEL_H
+
+#include <stddef.h>
+#include "nctools.h"
+
+#define DEFAULT_DIFFUSIVITY 0.555f  // W/m^2/K
+#define DEFAULT_FREEZING_T  263.15f // K
+
+// compiled compute shader and its uniform locations
+// longitudes a row of the polar filter can hold in shared memory
+#define POLAR_MAX_LON 1024
+
+typedef struct {
+    unsigned int program;
+    unsigned int year_frac_l, day_frac_l, dt_l, daily_mean_l, write_diag_l;
+    unsigned int insol_LUT_l, physp_LUT1_l, physp_LUT2_l;
+    unsigned int forcing_w_l, forcing_LUT1_l, forcing_LUT2_l;
+    unsigned int polar_rows_l, multirate_l;
+    unsigned int diffusivity_l, freezing_T_l, solar_constant_l;
+
+    // polar filter pass
+    unsigned int filter_program;
+    unsigned int filter_dt_l, filter_write_diag_l, filter_rows_l, filter_cos_l;
+    unsigned int filter_LUT_l;
+
+    // slow physics pass of the multi-rate scheme, 0 until
+    // load_multirate_kernel
+    unsigned int slow_program;
+    unsigned int slow_year_frac_l, slow_day_frac_l, slow_daily_mean_l;
+    unsigned int slow_forcing_w_l, slow_freezing_T_l, slow_solar_constant_l;
+} compute_kernel_t;
+
+// GPU resident state and parameters for a single grid. Ts is the only
+// prognostic field, dT/dt (K/day), Q and albedo are kept at half precision
+// and only written on steps that ask for them. With time varying forcing the
+// parameters are blended towards the forcing LUTs by forcing_w, which are 0
+// otherwise. Rows poleward of polar_lat leave their zonal tendency in
+// zonal_texture for the polar filter, which is off when it is 0. The
+// diffusivity, the freezing point of the albedo and the solar constant are
+// plain uniforms, so they can be changed between any two steps. With
+// slow_every > 1 the radiative tendency and the diffusivity scale are only
+// recomputed into slow_texture every slow_every steps and the steps in
+// between just add the diffusion, setting slow_age to 0 forces a refresh.
+typedef struct {
+    size_t nx, ny;
+    unsigned int T_textures[2];
+    unsigned int diag_texture;
+    unsigned int physp_LUT1, physp_LUT2;
+    unsigned int forcing_LUT1, forcing_LUT2;
+    float forcing_w;
+    unsigned int zonal_texture;
+    int polar_rows[2];
+    float polar_lat;
+    float diffusivity, freezing_T, solar_constant;
+    unsigned int slow_texture;
+    int slow_every, slow_age;
+    int current;
+} model_state_t;
+
+// the load_ functions return 0 when a shader could not be built, init_
+// exits instead
+int load_compute_kernel(compute_kernel_t* kernel, const char* path);
+void init_compute_kernel(compute_kernel_t* kernel, const char* path);
+int load_multirate_kernel(compute_kernel_t* kernel);
+
+void init_model_state(model_state_t* state, size_t nx, size_t ny,
+    model_initial_t* initial, float* data);
+void model_state_set_polar_filter(model_state_t* state,
+    model_initial_t* initial, float polar_lat);
+void model_state_set_multirate(model_state_t* state, int slow_every);
+void model_state_reset(model_state_t* state, model_initial_t* initial,
+    float* data);
+void model_state_step(model_state_t* state, compute_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt, int write_diag);
+void model_state_step_many(int n, model_state_t** states,
+    compute_kernel_t* kernel, unsigned int solar_LUT, const double* t,
+    float dt);
+void model_state_diagnose(model_state_t* state, compute_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt);
+unsigned int model_state_texture(model_state_t* state);
+void model_state_read(model_state_t* state, float* data);
+void model_state_read_T(model_state_t* state, float* T);
+void model_state_write_T(model_state_t* state, float* T);
+size_t model_state_bytes_per_step(model_state_t* state, int write_diag);
+size_t model_state_gpu_bytes(model_state_t* state);
+void model_state_free(model_state_t* state);
+
+#endif // _MODEL_H
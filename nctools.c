@@ -3,8 +3,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "common.h"
+#include "mem.h"
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
+
+// netcdf is not thread safe, every call into it goes through this lock
+static pthread_mutex_t nc_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 int try_read_ncvar(int ncid, int prev_ret, const char* name, int* varid) {
     if (prev_ret == NC_NOERR) return prev_ret;
@@ -24,28 +29,38 @@ void check_retval(int retval) {
     }
 }
 
-void init_model_storage(model_storage_t* model, float final_time,
+void init_model_storage(model_storage_t* model, double final_time,
     int model_width, int model_height) {
     model->timestep = (1.0f / 24.0f) * (5.0f / 60.0f); // in days
     model->final_time = final_time;
-    model->n_timesteps = (int) ceilf(final_time / model->timestep);
+    model->n_timesteps = (int) ceil(final_time / model->timestep);
     model->n_slots = (model->n_timesteps / 500) + 1;
+    model->n_cells = (size_t) model_width * model_height;
 
     // create head
-    model->head = malloc(sizeof(storage_frame_t));
+    model->head = mem_alloc(MEM_FRAMES, sizeof(storage_frame_t));
     model->head->next = NULL;
     model->head->prev = NULL;
-    model->head->time = 0.0f;
+    model->head->time = 0.0;
     model->head->data = NULL;
 }
 
-void model_storage_add_frame(model_storage_t* model, float time, float* data) {
+void model_storage_add_frame(model_storage_t* model, double time,
+    const float* data) {
     // create a frame
-    storage_frame_t* frame = (storage_frame_t*) malloc(sizeof(storage_frame_t));
+    storage_frame_t* frame =
+        (storage_frame_t*) mem_alloc(MEM_FRAMES, sizeof(storage_frame_t));
     frame->prev = model->head;
     frame->next = NULL;
     frame->time = time;
-    frame->data = data;
+
+    // only Ts is written out, so keep just that. The RGBA state stays with
+    // the caller, which can reuse it for the next sample.
+    frame->data = (float*) mem_alloc(MEM_FRAMES,
+        model->n_cells * sizeof(float));
+    for (size_t i = 0; i < model->n_cells; i++) {
+        frame->data[i] = data[(i * 4) + 0];
+    }
 
     // update head
     model->head->next = frame;
@@ -100,6 +115,7 @@ void model_storage_write(int size_x, int size_y, model_storage_t* model,
     const char* units_m      = "m";
 
     // create a nc file
+    pthread_mutex_lock(&nc_mutex);
     retval = nc_create(path, NC_CLOBBER, &ncid);
     check_retval(retval);
 
@@ -124,7 +140,7 @@ void model_storage_write(int size_x, int size_y, model_storage_t* model,
     check_retval(retval);
 
     // make time coord var
-    retval = nc_def_var(ncid, time_name, NC_FLOAT, 1, &time_dimid, &time_varid);
+    retval = nc_def_var(ncid, time_name, NC_DOUBLE, 1, &time_dimid, &time_varid);
     check_retval(retval);
 
     // define units for lat coord var
@@ -245,7 +261,6 @@ void model_storage_write(int size_x, int size_y, model_storage_t* model,
     // write Ts frame by frame
     size_t counts[] = {1, size_y, size_x};
     size_t starts[] = {0, 0, 0};
-    float* Tdata = malloc(size_y * size_x * sizeof(float));
     while (model->head->next != NULL) {
         model->head = model->head->next;
 
@@ -254,32 +269,125 @@ void model_storage_write(int size_x, int size_y, model_storage_t* model,
             model->head->time, model->head->data);
 #endif
 
-        // copy temperature data from model output
-        for (size_t i = 0; i < size_y * size_x; i++) {
-            Tdata[i] = model->head->data[(i * 4) + 0];
-        }
-
         // write Ts
-        retval = nc_put_vara_float(ncid, Ts_varid, starts, counts, Tdata);
+        retval = nc_put_vara_float(ncid, Ts_varid, starts, counts,
+            model->head->data);
         check_retval(retval);
 
         // write time
-        float t_in_s = model->head->time * 86400.0f;
-        retval = nc_put_var1_float(ncid, time_varid, &starts[0], &t_in_s);
+        double t_in_s = model->head->time * 86400.0;
+        retval = nc_put_var1_double(ncid, time_varid, &starts[0], &t_in_s);
         check_retval(retval);
 
         starts[0]++;
     }
-    free(Tdata);
 
     // close file
     retval = nc_close(ncid);
     check_retval(retval);
+    pthread_mutex_unlock(&nc_mutex);
 
     printf("Finished writing to %s.\n", path);
 }
 
+void append_2d_fields(const char* path, int size_x, int size_y, int n_fields,
+    const char** names, const char** units, float** fields) {
+    int retval, ncid, lat_dimid, lon_dimid;
+    int* varids = (int*) malloc(n_fields * sizeof(int));
+
+    // reopen a file written by model_storage_write
+    pthread_mutex_lock(&nc_mutex);
+    retval = nc_open(path, NC_WRITE, &ncid);
+    check_retval(retval);
+    retval = nc_inq_dimid(ncid, "lat", &lat_dimid);
+    check_retval(retval);
+    retval = nc_inq_dimid(ncid, "lon", &lon_dimid);
+    check_retval(retval);
+
+    // define the new variables on the existing grid
+    retval = nc_redef(ncid);
+    check_retval(retval);
+    int dimid_2d[] = {lat_dimid, lon_dimid};
+    for (int k = 0; k < n_fields; k++) {
+        retval = nc_def_var(ncid, names[k], NC_FLOAT, 2, dimid_2d, &varids[k]);
+        check_retval(retval);
+        retval = nc_put_att_text(ncid, varids[k], "units", strlen(units[k]),
+            units[k]);
+        check_retval(retval);
+    }
+    retval = nc_enddef(ncid);
+    check_retval(retval);
+
+    for (int k = 0; k < n_fields; k++) {
+        retval = nc_put_var_float(ncid, varids[k], fields[k]);
+        check_retval(retval);
+    }
+
+    retval = nc_close(ncid);
+    check_retval(retval);
+    pthread_mutex_unlock(&nc_mutex);
+    free(varids);
+
+    printf("Added %d fields to %s.\n", n_fields, path);
+}
+
+void append_time_series(const char* path, const char* time_name,
+    const char* time_units, int n, double* times, int n_vars, const char** names, const char** units,
+    int* lengths, float** values) {
+    int retval, ncid, lat_dimid, time_dimid, time_varid;
+    int* varids = (int*) malloc(n_vars * sizeof(int));
+
+    // reopen a file written by model_storage_write
+    pthread_mutex_lock(&nc_mutex);
+    retval = nc_open(path, NC_WRITE, &ncid);
+    check_retval(retval);
+    retval = nc_inq_dimid(ncid, "lat", &lat_dimid);
+    check_retval(retval);
+
+    // the samples get their own time axis, independent of the frames
+    retval = nc_redef(ncid);
+    check_retval(retval);
+    retval = nc_def_dim(ncid, time_name, n, &time_dimid);
+    check_retval(retval);
+    retval = nc_def_var(ncid, time_name, NC_DOUBLE, 1, &time_dimid,
+        &time_varid);
+    check_retval(retval);
+    retval = nc_put_att_text(ncid, time_varid, "units", strlen(time_units),
+        time_units);
+    check_retval(retval);
+    int dimids[] = {time_dimid, lat_dimid};
+    for (int k = 0; k < n_vars; k++) {
+        retval = nc_def_var(ncid, names[k], NC_FLOAT, (lengths[k] > 1) ? 2 : 1,
+            dimids, &varids[k]);
+        check_retval(retval);
+        retval = nc_put_att_text(ncid, varids[k], "units", strlen(units[k]),
+            units[k]);
+        check_retval(retval);
+    }
+    retval = nc_enddef(ncid);
+    check_retval(retval);
+
+    retval = nc_put_var_double(ncid, time_varid, times);
+    check_retval(retval);
+    for (int k = 0; k < n_vars; k++) {
+        retval = nc_put_var_float(ncid, varids[k], values[k]);
+        check_retval(retval);
+    }
+
+    retval = nc_close(ncid);
+    check_retval(retval);
+    pthread_mutex_unlock(&nc_mutex);
+    free(varids);
+
+    printf("Added %d series of %d samples to %s.\n", n_vars, n, path);
+}
+
 void model_storage_free(model_storage_t* model) {
+    // already freed
+    if (model->head == NULL) {
+        return;
+    }
+
     // find first node
     int num = 0;
     while (model->head->prev != NULL) {
@@ -293,18 +401,116 @@ void model_storage_free(model_storage_t* model) {
         printf("Model storage is mangled!\n");
         exit(3);
     }
+
+    // free every frame along with its data
+    storage_frame_t* frame = model->head;
+    while (frame != NULL) {
+        storage_frame_t* next = (storage_frame_t*) frame->next;
+        mem_free(frame->data);
+        mem_free(frame);
+        frame = next;
+    }
+    model->head = NULL;
 }
 
-void read_input(char* path, size_t* model_width, size_t* model_height,
-    model_initial_t* model) {
+static float* copy_field(float* src, size_t n) {
+    float* dst = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    memcpy(dst, src, n * sizeof(float));
+    return dst;
+}
+
+void copy_initial(model_initial_t* src, model_initial_t* dst,
+    size_t model_width, size_t model_height) {
+    size_t n = model_width * model_height;
+    dst->lats   = copy_field(src->lats, model_height);
+    dst->lons   = copy_field(src->lons, model_width);
+    dst->Ts     = copy_field(src->Ts, n);
+    dst->Bs     = copy_field(src->Bs, n);
+    dst->As     = copy_field(src->As, n);
+    dst->depths = copy_field(src->depths, n);
+    dst->a0s    = copy_field(src->a0s, n);
+    dst->a2s    = copy_field(src->a2s, n);
+    dst->ais    = copy_field(src->ais, n);
+    dst->zonally_symmetric = src->zonally_symmetric;
+    dst->time_varying = src->time_varying;
+}
+
+void free_initial(model_initial_t* model) {
+    mem_free(model->lats);
+    mem_free(model->lons);
+    mem_free(model->Ts);
+    mem_free(model->Bs);
+    mem_free(model->As);
+    mem_free(model->depths);
+    mem_free(model->a0s);
+    mem_free(model->a2s);
+    mem_free(model->ais);
+}
+
+static int is_field_zonally_symmetric(float* field, size_t model_width,
+    size_t model_height) {
+    for (size_t y = 0; y < model_height; y++) {
+        float first = field[y * model_width];
+        for (size_t x = 1; x < model_width; x++) {
+            if (fabsf(field[(y * model_width) + x] - first) >
+                1e-6f * fabsf(first)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int is_zonally_symmetric(model_initial_t* m, size_t model_width,
+    size_t model_height) {
+    return is_field_zonally_symmetric(m->Ts, model_width, model_height) &&
+        is_field_zonally_symmetric(m->Bs, model_width, model_height) &&
+        is_field_zonally_symmetric(m->As, model_width, model_height) &&
+        is_field_zonally_symmetric(m->depths, model_width, model_height) &&
+        is_field_zonally_symmetric(m->a0s, model_width, model_height) &&
+        is_field_zonally_symmetric(m->a2s, model_width, model_height) &&
+        is_field_zonally_symmetric(m->ais, model_width, model_height);
+}
+
+// read a (lat, lon) field, or only the first slice of a (time, lat, lon)
+// one, and return the number of time slices
+static size_t read_found_field(int ncid, int varid, size_t model_width,
+    size_t model_height, float* field, const char* what) {
+    int ndims;
+    check_retval(nc_inq_varndims(ncid, varid, &ndims));
+    if (ndims != 3) {
+        printf("Found %s.\n", what);
+        check_retval(nc_get_var_float(ncid, varid, field));
+        return 1;
+    }
+
+    int dimids[3];
+    size_t n_slices;
+    check_retval(nc_inq_vardimid(ncid, varid, dimids));
+    check_retval(nc_inq_dimlen(ncid, dimids[0], &n_slices));
+    if (n_slices > 1) {
+        printf("Found %s, %lu time slices.\n", what, n_slices);
+    } else {
+        printf("Found %s.\n", what);
+    }
+    size_t starts[] = {0, 0, 0};
+    size_t counts[] = {1, model_height, model_width};
+    check_retval(nc_get_vara_float(ncid, varid, starts, counts, field));
+    return n_slices;
+}
+
+static void read_fields(char* path, size_t* model_width,
+    size_t* model_height, model_initial_t* model, int any_size) {
     int retval; // temporary for nc queries
     int ncid, lat_varid, lon_varid, lat_dimid, lon_dimid;
     int Ts_varid, Bs_varid, As_varid, depths_varid, a0s_varid, a2s_varid,
         ais_varid;
 
     printf("Reading input file: %s\n", path);
+    model->time_varying = 0;
 
     // open the file
+    pthread_mutex_lock(&nc_mutex);
     if ((retval = nc_open(path, NC_NOWRITE, &ncid))) {
        abort_ncop(retval);
     }
@@ -330,7 +536,7 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
     if (retval != NC_NOERR) {
         abort_ncop(retval);
     }
-    if ((*model_height) % 32 != 0) {
+    if (!any_size && (*model_height) % 32 != 0) {
         printf("Error: lat (model_height) must be a multiple of 32\n");
     }
     if ((*model_height) <= 0) {
@@ -341,7 +547,7 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
     if (retval) {
         abort_ncop(retval);
     }
-    if ((*model_width) % 32 != 0) {
+    if (!any_size && (*model_width) % 32 != 0) {
         printf("Error: lon (model_width) must be a multiple of 32\n");
         exit(3);
     }
@@ -352,19 +558,19 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
     printf("Model size: (n_lon=%lu, n_lat=%lu)\n", *model_width, *model_height);
 
     // get lats
-    model->lats = (float*) malloc((*model_height) * sizeof(float));
+    model->lats = (float*) mem_alloc(MEM_FIELDS, (*model_height) * sizeof(float));
     if (retval = nc_get_var_float(ncid, lat_varid, model->lats)) {
         abort_ncop(retval);
     }
 
     // get lons
-    model->lons = (float*) malloc((*model_width) * sizeof(float));
+    model->lons = (float*) mem_alloc(MEM_FIELDS, (*model_width) * sizeof(float));
     if (retval = nc_get_var_float(ncid, lon_varid, model->lons)) {
         abort_ncop(retval);
     }
 
     // allocate memory for temperature
-    model->Ts = (float*) malloc(
+    model->Ts = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for temperature (could be named many diff things)
@@ -379,12 +585,12 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->Ts[i] = 273.15;
         }
     } else {
-        printf("Found temperature data.\n");
-        nc_get_var_float(ncid, Ts_varid, model->Ts);
+        read_found_field(ncid, Ts_varid, *model_width, *model_height,
+            model->Ts, "temperature data");
     }
 
     // allocate memory for B parameter
-    model->Bs = (float*) malloc(
+    model->Bs = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for B parameter (could be named many diff things)
@@ -397,12 +603,14 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->Bs[i] = 2.0f;
         }
     } else {
-        printf("Found B parameter data.\n");
-        nc_get_var_float(ncid, Bs_varid, model->Bs);
+        if (read_found_field(ncid, Bs_varid, *model_width, *model_height,
+            model->Bs, "B parameter data") > 1) {
+            model->time_varying = 1;
+        }
     }
 
     // allocate memory for A parameter
-    model->As = (float*) malloc(
+    model->As = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for A parameter (could be named many diff things)
@@ -415,12 +623,14 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->As[i] = 210.0f;
         }
     } else {
-        printf("Found A parameter data.\n");
-        nc_get_var_float(ncid, As_varid, model->As);
+        if (read_found_field(ncid, As_varid, *model_width, *model_height,
+            model->As, "A parameter data") > 1) {
+            model->time_varying = 1;
+        }
     }
 
     // allocate memory for depths
-    model->depths = (float*) malloc(
+    model->depths = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for depths (could be named many diff things)
@@ -433,12 +643,14 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->depths[i] = 30.0f;
         }
     } else {
-        printf("Found depth data.\n");
-        nc_get_var_float(ncid, depths_varid, model->depths);
+        if (read_found_field(ncid, depths_varid, *model_width, *model_height,
+            model->depths, "depth data") > 1) {
+            model->time_varying = 1;
+        }
     }
 
     // allocate memory for a0s
-    model->a0s = (float*) malloc(
+    model->a0s = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for a0s (could be named many diff things)
@@ -451,12 +663,14 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->a0s[i] = 0.3f;
         }
     } else {
-        printf("Found a0 data.\n");
-        nc_get_var_float(ncid, a0s_varid, model->a0s);
+        if (read_found_field(ncid, a0s_varid, *model_width, *model_height,
+            model->a0s, "a0 data") > 1) {
+            model->time_varying = 1;
+        }
     }
 
     // allocate memory for a2s
-    model->a2s = (float*) malloc(
+    model->a2s = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for a0s (could be named many diff things)
@@ -469,12 +683,14 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->a2s[i] = 0.078f;
         }
     } else {
-        printf("Found a2 data.\n");
-        nc_get_var_float(ncid, a2s_varid, model->a2s);
+        if (read_found_field(ncid, a2s_varid, *model_width, *model_height,
+            model->a2s, "a2 data") > 1) {
+            model->time_varying = 1;
+        }
     }
 
     // allocate memory for ais
-    model->ais = (float*) malloc(
+    model->ais = (float*) mem_alloc(MEM_FIELDS, 
         (*model_width) * (*model_height) * sizeof(float));
 
     // check for ais (could be named many diff things)
@@ -487,7 +703,184 @@ void read_input(char* path, size_t* model_width, size_t* model_height,
             model->ais[i] = 0.62f;
         }
     } else {
-        printf("Found ai data.\n");
-        nc_get_var_float(ncid, ais_varid, model->ais);
+        if (read_found_field(ncid, ais_varid, *model_width, *model_height,
+            model->ais, "ai data") > 1) {
+            model->time_varying = 1;
+        }
+    }
+
+    // close file
+    retval = nc_close(ncid);
+    check_retval(retval);
+    pthread_mutex_unlock(&nc_mutex);
+
+    // fields that only vary with latitude can use the 1-D fast path
+    model->zonally_symmetric = is_zonally_symmetric(model,
+        *model_width, *model_height);
+    if (model->zonally_symmetric) {
+        printf("Input is zonally symmetric.\n");
+    }
+}
+
+void read_input(char* path, size_t* model_width, size_t* model_height,
+    model_initial_t* model) {
+    read_fields(path, model_width, model_height, model, 0);
+}
+
+// inputs that are regridded after reading can have any size
+void read_input_any(char* path, size_t* model_width, size_t* model_height,
+    model_initial_t* model) {
+    read_fields(path, model_width, model_height, model, 1);
+}
+
+static const char* forcing_names[N_FORCING_FIELDS][2] = {
+    { "A", "As" }, { "B", "Bs" }, { "depth", "depths" },
+    { "a0", "a0s" }, { "a2", "a2s" }, { "ai", "ais" }
+};
+
+// time coordinate in days, going by the units attribute when there is one
+// NULL on any error, which has been printed
+static double* read_forcing_times(int ncid, int time_dimid, size_t n_slices) {
+    char name[NC_MAX_NAME + 1];
+    int varid;
+    int retval = nc_inq_dimname(ncid, time_dimid, name);
+    if (retval != NC_NOERR) {
+        printf("Error: %s\n", nc_strerror(retval));
+        return NULL;
+    }
+    if (nc_inq_varid(ncid, name, &varid) != NC_NOERR) {
+        printf("Error: time varying fields need a %s coordinate.\n", name);
+        return NULL;
+    }
+
+    double* times = (double*) malloc(n_slices * sizeof(double));
+    if ((retval = nc_get_var_double(ncid, varid, times))) {
+        printf("Error: %s\n", nc_strerror(retval));
+        free(times);
+        return NULL;
     }
+
+    double scale = 1.0;
+    size_t len;
+    if (nc_inq_attlen(ncid, varid, "units", &len) == NC_NOERR) {
+        char* units = (char*) calloc(len + 1, 1);
+        if (nc_get_att_text(ncid, varid, "units", units) == NC_NOERR) {
+            if (strncmp(units, "second", 6) == 0) {
+                scale = 1.0 / 86400.0;
+            } else if (strncmp(units, "hour", 4) == 0) {
+                scale = 1.0 / 24.0;
+            } else if (strncmp(units, "year", 4) == 0) {
+                scale = days_per_year;
+            }
+        }
+        free(units);
+    }
+
+    for (size_t k = 0; k < n_slices; k++) {
+        times[k] *= scale;
+        if (k > 0 && times[k] <= times[k - 1]) {
+            printf("Error: %s must be strictly increasing.\n", name);
+            free(times);
+            return NULL;
+        }
+    }
+    return times;
+}
+
+// give up on a forcing file opened under nc_mutex, retval is printed unless
+// the error already was
+static int close_on_error(forcing_file_t* f, const char* path, int retval) {
+    if (retval != NC_NOERR) {
+        printf("Error: %s: %s\n", path, nc_strerror(retval));
+    }
+    nc_close(f->ncid);
+    pthread_mutex_unlock(&nc_mutex);
+    return -1;
+}
+
+// the number of time varying fields, or -1 when the file can not be used.
+// Errors are printed and returned rather than exiting, as this is called
+// from the library.
+int open_forcing_file(const char* path, size_t model_width,
+    size_t model_height, forcing_file_t* f) {
+    int retval;
+    int time_dimid = -1;
+
+    pthread_mutex_lock(&nc_mutex);
+    if ((retval = nc_open(path, NC_NOWRITE, &f->ncid))) {
+        pthread_mutex_unlock(&nc_mutex);
+        printf("Error: %s: %s\n", path, nc_strerror(retval));
+        return -1;
+    }
+
+    // every (time, lat, lon) parameter has to share the same time axis
+    f->n_fields = 0;
+    for (int k = 0; k < N_FORCING_FIELDS; k++) {
+        int varid, ndims, dimids[3];
+        retval = try_read_ncvar(f->ncid, NC_ENOTVAR, forcing_names[k][0],
+            &varid);
+        retval = try_read_ncvar(f->ncid, retval, forcing_names[k][1], &varid);
+        if (retval != NC_NOERR) {
+            continue;
+        }
+        if ((retval = nc_inq_varndims(f->ncid, varid, &ndims))) {
+            return close_on_error(f, path, retval);
+        }
+        if (ndims != 3) {
+            continue;
+        }
+        if ((retval = nc_inq_vardimid(f->ncid, varid, dimids))) {
+            return close_on_error(f, path, retval);
+        }
+        if (time_dimid >= 0 && dimids[0] != time_dimid) {
+            printf("Error: %s uses a different time axis.\n",
+                forcing_names[k][0]);
+            return close_on_error(f, path, NC_NOERR);
+        }
+        time_dimid = dimids[0];
+        f->fields[f->n_fields] = (forcing_field_t) k;
+        f->varids[f->n_fields] = varid;
+        f->n_fields++;
+    }
+
+    if (f->n_fields == 0) {
+        nc_close(f->ncid);
+        pthread_mutex_unlock(&nc_mutex);
+        return 0;
+    }
+
+    if ((retval = nc_inq_dimlen(f->ncid, time_dimid, &f->n_slices))) {
+        return close_on_error(f, path, retval);
+    }
+    f->times = read_forcing_times(f->ncid, time_dimid, f->n_slices);
+    if (f->times == NULL) {
+        return close_on_error(f, path, NC_NOERR);
+    }
+    pthread_mutex_unlock(&nc_mutex);
+
+    printf("Forcing: %d time varying fields, %lu slices over %.2f days\n",
+        f->n_fields, f->n_slices, f->times[f->n_slices - 1] - f->times[0]);
+    return f->n_fields;
+}
+
+// slice of every forced field, stacked in the order of f->fields
+void read_forcing_slice(forcing_file_t* f, size_t slice, size_t model_width,
+    size_t model_height, float* out) {
+    size_t starts[] = {slice, 0, 0};
+    size_t counts[] = {1, model_height, model_width};
+    size_t n = model_width * model_height;
+
+    pthread_mutex_lock(&nc_mutex);
+    for (int k = 0; k < f->n_fields; k++) {
+        check_retval(nc_get_vara_float(f->ncid, f->varids[k], starts, counts,
+            &out[k * n]));
+    }
+    pthread_mutex_unlock(&nc_mutex);
+}
+
+void close_forcing_file(forcing_file_t* f) {
+    pthread_mutex_lock(&nc_mutex);
+    nc_close(f->ncid);
+    pthread_mutex_unlock(&nc_mutex);
+    free(f->times);
 }
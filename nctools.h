@@ -3,33 +3,87 @@
 
 #include <stddef.h>
 
+// every field is a MEM_FIELDS allocation released by free_initial
 typedef struct {
     float *lats, *lons;
     float *Ts, *Bs, *depths, *a0s, *a2s, *ais, *As;
+    int zonally_symmetric;
+    int time_varying; // some parameter has a time dimension
 } model_initial_t;
 
+// parameter fields that may carry a time dimension, in the order
+// read_forcing_slice stacks them
+typedef enum {
+    FORCING_A,
+    FORCING_B,
+    FORCING_DEPTH,
+    FORCING_A0,
+    FORCING_A2,
+    FORCING_AI,
+    N_FORCING_FIELDS
+} forcing_field_t;
+
+// an input file opened for reading (time, lat, lon) parameters slice by slice
+typedef struct {
+    int ncid;
+    size_t n_slices;
+    double* times; // days
+    int n_fields;
+    forcing_field_t fields[N_FORCING_FIELDS];
+    int varids[N_FORCING_FIELDS];
+} forcing_file_t;
+
 // linked list time oh yeah
 typedef struct {
     struct storage_frame_t* next;
     struct storage_frame_t* prev;
-    float time;
+    double time; // days
     float* data;
 } storage_frame_t;
 
+// frames hold Ts only, model_storage_add_frame copies it out of an RGBA
+// state that stays owned by the caller
 typedef struct {
     int n_timesteps, n_slots;
-    float final_time, timestep;
+    size_t n_cells;
+    double final_time;
+    float timestep;
     storage_frame_t* head;
 } model_storage_t;
 
-void init_model_storage(model_storage_t* model, float final_time,
+void init_model_storage(model_storage_t* model, double final_time,
     int model_width, int model_height);
-void model_storage_add_frame(model_storage_t* model, float time, float* data);
+void model_storage_add_frame(model_storage_t* model, double time,
+    const float* data);
 void model_storage_write(int size_x, int size_y, model_storage_t* model,
     model_initial_t* initial, const char* path);
 void model_storage_free(model_storage_t* model);
+void append_2d_fields(const char* path, int size_x, int size_y, int n_fields,
+    const char** names, const char** units, float** fields);
+
+// time series of n samples on their own axis (usually time, in time_units),
+// each variable holds either one value or one per latitude
+// (lengths[k] == size_y) per sample
+void append_time_series(const char* path, const char* time_name,
+    const char* time_units, int n, double* times, int n_vars, const char** names, const char** units,
+    int* lengths, float** values);
+
+void copy_initial(model_initial_t* src, model_initial_t* dst,
+    size_t model_width, size_t model_height);
+void free_initial(model_initial_t* model);
+
+int is_zonally_symmetric(model_initial_t* m, size_t model_width,
+    size_t model_height);
 
 void read_input(char* path, size_t* model_width, size_t* model_height,
     model_initial_t* m);
+void read_input_any(char* path, size_t* model_width, size_t* model_height,
+    model_initial_t* m);
+
+int open_forcing_file(const char* path, size_t model_width,
+    size_t model_height, forcing_file_t* f);
+void read_forcing_slice(forcing_file_t* f, size_t slice, size_t model_width,
+    size_t model_height, float* out);
+void close_forcing_file(forcing_file_t* f);
 
 #endif
@@ -0,0 +1,410 @@
+#include "options.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "regrid.h"
+
+void print_useage() {
+    printf("Useage: glEBM [options] <input_file.nc> <output_file.nc>\n");
+    printf("        glEBM [options] -b <job_list>\n");
+    printf("Options:\n");
+    printf("  -s <levels>  spin up on <levels> grids, coarsest first\n");
+    printf("  -e <tol>     spin-up equilibrium tolerance in K/yr (default %.3f)\n",
+        DEFAULT_SPINUP_TOL);
+    printf("  -y <years>   maximum spin-up years per level (default %d)\n",
+        DEFAULT_SPINUP_MAX_YEARS);
+    printf("  -N           solve for the periodic equilibrium by Newton-Krylov\n");
+    printf("               shooting before the run, to the tolerance of -e\n");
+    printf("               within the years of -y\n");
+    printf("  -G <w>x<h>[:bilinear] regrid the input from any regular lat/lon\n");
+    printf("               grid onto <w>x<h> cells, conservatively by default\n");
+    printf("  -C <dir>     cache regrid weights in <dir> (default %s)\n",
+        DEFAULT_REGRID_CACHE);
+    printf("  -R           run on a reduced grid with fewer cells near the poles\n");
+    printf("  -T <w>x<h>   split the grid into tiles of <w>x<h> cells, by default\n");
+    printf("               only when it exceeds the maximum texture size\n");
+    printf("  -k <tiles>   keep at most <tiles> tiles on the GPU, streaming\n");
+    printf("               the others in and out\n");
+    printf("  -t <mins>    timestep in minutes (default 5)\n");
+    printf("  -P <lat>     filter zonal diffusion poleward of <lat> degrees\n");
+    printf("               (default %.0f, 90 to disable)\n", DEFAULT_POLAR_LAT);
+    printf("  -r <steps>   recompute insolation, albedo, OLR and the moist\n");
+    printf("               amplification every <steps> steps and only step\n");
+    printf("               the diffusion in between (default 1)\n");
+    printf("  -S <steps>   write zonal means and the global energy budget every\n");
+    printf("               <steps> steps\n");
+    printf("  -i           read parameter changes from stdin while running\n");
+    printf("  -V <target>  export colour mapped frames as PNGs into the directory\n");
+    printf("               <target>, or as raw RGB to the command after a '|'\n");
+    printf("  -v <steps>   export every <steps> steps (default %d)\n",
+        DEFAULT_EXPORT_EVERY);
+    printf("  -W <w>x<h>   export resolution (default %dx%d)\n",
+        DEFAULT_EXPORT_WIDTH, DEFAULT_EXPORT_HEIGHT);
+    printf("  -H <name>[+|*]:<from>:<to>:<step> sweep A, B, depth, a0, a2, ai,\n");
+    printf("               S0, D or Tf up and back down, writing the\n");
+    printf("               equilibrium at every value. Fields are offset (+)\n");
+    printf("               or scaled (*) from their input values\n");
+    printf("  -L <years>   run for <years> years (default %.0f)\n",
+        DEFAULT_RUN_YEARS);
+    printf("  -F <n>[y]    split the output into files of <n> frames, or <n>\n");
+    printf("               years with a trailing y, published as each ends\n");
+    printf("  -O <orbit>[:<kyr>[:<accel>]] take the orbit from the table <orbit>\n");
+    printf("               or the Berger series (berger), starting <kyr>\n");
+    printf("               thousand years after 1950 and <accel> times faster\n");
+    printf("               than model time\n");
+    printf("  -d           use daily mean insolation\n");
+    printf("  -Z           never use the 1-D path for zonally symmetric input\n");
+    printf("  -g <lat0:lat1>[:check] write the gradient of the mean final\n");
+    printf("               temperature between two latitudes to every parameter,\n");
+    printf("               check verifies it against the tangent linear model\n");
+    printf("  -p <slices>[:<mins>] integrate <slices> time slices side by side\n");
+    printf("               with Parareal, correcting them with a daily mean\n");
+    printf("               model stepped every <mins> minutes\n");
+    printf("  -m <addr>    serve Prometheus metrics on a localhost port or a\n");
+    printf("               unix socket path\n");
+    printf("  -b <jobs>    run every job in <jobs> in one process\n");
+    printf("  -M <blocks>  run on the CPU under MPI, splitting latitude bands\n");
+    printf("               into <blocks> longitude blocks (needs make MPI=1)\n");
+}
+
+void parse_options(int argc, char* argv[], model_options_t* opts) {
+    // defaults
+    opts->input_path = NULL;
+    opts->output_path = NULL;
+    opts->batch_path = NULL;
+    opts->spinup_levels = 0;
+    opts->spinup_max_years = DEFAULT_SPINUP_MAX_YEARS;
+    opts->spinup_tol = DEFAULT_SPINUP_TOL;
+    opts->shooting = 0;
+    opts->regrid_width = 0;
+    opts->regrid_height = 0;
+    opts->regrid_bilinear = 0;
+    opts->regrid_cache = DEFAULT_REGRID_CACHE;
+    opts->reduced_grid = 0;
+    opts->tile_width = 0;
+    opts->tile_height = 0;
+    opts->tile_resident = 0;
+    opts->timestep = 0.0f;
+    opts->polar_lat = DEFAULT_POLAR_LAT;
+    opts->slow_every = 1;
+    opts->daily_mean = 0;
+    opts->force_2d = 0;
+    opts->mpi_blocks = 0;
+    opts->adjoint = 0;
+    opts->adjoint_check = 0;
+    opts->parareal_slices = 0;
+    opts->parareal_coarse_dt = 0.0f;
+    opts->metrics_address = NULL;
+    opts->stats_every = 0;
+    opts->interactive = 0;
+    opts->export_target = NULL;
+    opts->export_every = DEFAULT_EXPORT_EVERY;
+    opts->export_width = DEFAULT_EXPORT_WIDTH;
+    opts->export_height = DEFAULT_EXPORT_HEIGHT;
+    opts->sweep_param[0] = '\0';
+    opts->sweep_op = '=';
+    opts->run_years = DEFAULT_RUN_YEARS;
+    opts->orbit_source[0] = '\0';
+    opts->orbit_start_kyr = 0.0;
+    opts->orbit_accel = 1.0f;
+    opts->segment_frames = 0;
+    opts->segment_years = 0.0f;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:e:y:NG:C:RT:k:t:P:r:S:iV:v:W:H:L:F:O:dZM:b:g:p:m:")) != -1) {
+        switch (c) {
+        case 's':
+            opts->spinup_levels = atoi(optarg);
+            break;
+        case 'e':
+            opts->spinup_tol = atof(optarg);
+            break;
+        case 'y':
+            opts->spinup_max_years = atoi(optarg);
+            break;
+        case 'N':
+            opts->shooting = 1;
+            break;
+        case 'G': {
+            char method[16] = "";
+            if (sscanf(optarg, "%dx%d:%15s", &opts->regrid_width,
+                &opts->regrid_height, method) < 2 || (method[0] != '\0' &&
+                strcmp(method, "bilinear") != 0 &&
+                strcmp(method, "conservative") != 0)) {
+                printf("Error: expected -G <width>x<height>[:bilinear].\n");
+                exit(1);
+            }
+            opts->regrid_bilinear = strcmp(method, "bilinear") == 0;
+            break;
+        }
+        case 'C':
+            opts->regrid_cache = optarg;
+            break;
+        case 'R':
+            opts->reduced_grid = 1;
+            break;
+        case 'T':
+            if (sscanf(optarg, "%dx%d", &opts->tile_width,
+                &opts->tile_height) != 2) {
+                printf("Error: expected -T <width>x<height>.\n");
+                exit(1);
+            }
+            break;
+        case 'k':
+            opts->tile_resident = atoi(optarg);
+            break;
+        case 't':
+            opts->timestep = atof(optarg);
+            break;
+        case 'P':
+            opts->polar_lat = atof(optarg);
+            break;
+        case 'r':
+            opts->slow_every = atoi(optarg);
+            break;
+        case 'S':
+            opts->stats_every = atoi(optarg);
+            break;
+        case 'i':
+            opts->interactive = 1;
+            break;
+        case 'V':
+            opts->export_target = optarg;
+            break;
+        case 'v':
+            opts->export_every = atoi(optarg);
+            break;
+        case 'W':
+            if (sscanf(optarg, "%dx%d", &opts->export_width,
+                &opts->export_height) != 2) {
+                printf("Error: expected -W <width>x<height>.\n");
+                exit(1);
+            }
+            break;
+        case 'H': {
+            if (sscanf(optarg, "%15[^:]:%f:%f:%f", opts->sweep_param,
+                &opts->sweep_from, &opts->sweep_to, &opts->sweep_step) != 4) {
+                printf("Error: expected -H <name>:<from>:<to>:<step>.\n");
+                exit(1);
+            }
+            size_t n = strlen(opts->sweep_param);
+            if (n > 1 && (opts->sweep_param[n - 1] == '+' ||
+                opts->sweep_param[n - 1] == '*')) {
+                opts->sweep_op = opts->sweep_param[n - 1];
+                opts->sweep_param[n - 1] = '\0';
+            }
+            break;
+        }
+        case 'L':
+            opts->run_years = atof(optarg);
+            break;
+        case 'F': {
+            char* end;
+            double n = strtod(optarg, &end);
+            if (end == optarg || n <= 0.0 || (*end != '\0' &&
+                strcmp(end, "y") != 0)) {
+                printf("Error: expected -F <frames> or -F <years>y.\n");
+                exit(1);
+            }
+            if (*end == 'y') {
+                opts->segment_years = (float) n;
+            } else {
+                opts->segment_frames = (int) n;
+            }
+            break;
+        }
+        case 'O':
+            if (sscanf(optarg, "%255[^:]:%lf:%f", opts->orbit_source,
+                &opts->orbit_start_kyr, &opts->orbit_accel) < 1) {
+                printf("Error: expected -O <orbit>[:<kyr>[:<accel>]].\n");
+                exit(1);
+            }
+            break;
+        case 'd':
+            opts->daily_mean = 1;
+            break;
+        case 'Z':
+            opts->force_2d = 1;
+            break;
+        case 'b':
+            opts->batch_path = optarg;
+            break;
+        case 'g': {
+            opts->adjoint = 1;
+            char check[8] = "";
+            if (sscanf(optarg, "%f:%f:%7s", &opts->adjoint_lat0,
+                &opts->adjoint_lat1, check) < 2 ||
+                (check[0] != '\0' && strcmp(check, "check") != 0)) {
+                printf("Error: expected -g <lat0:lat1>[:check].\n");
+                exit(1);
+            }
+            opts->adjoint_check = check[0] != '\0';
+            break;
+        }
+        case 'p':
+            if (sscanf(optarg, "%d:%f", &opts->parareal_slices,
+                &opts->parareal_coarse_dt) < 1) {
+                printf("Error: expected -p <slices>[:<mins>].\n");
+                exit(1);
+            }
+            break;
+        case 'm':
+            opts->metrics_address = optarg;
+            break;
+        case 'M':
+            opts->mpi_blocks = atoi(optarg);
+            break;
+        default:
+            print_useage();
+            exit(1);
+        }
+    }
+
+    // positional arguments, batch runs take their paths from the job list
+    if (opts->batch_path != NULL) {
+        if (argc - optind != 0) {
+            print_useage();
+            exit(1);
+        }
+    } else {
+        if (argc - optind != 2) {
+            print_useage();
+            exit(1);
+        }
+        opts->input_path = argv[optind];
+        opts->output_path = argv[optind + 1];
+    }
+
+    if (opts->spinup_levels < 0 || opts->spinup_tol <= 0.0f ||
+        opts->spinup_max_years <= 0) {
+        printf("Error: invalid spin-up settings.\n");
+        exit(1);
+    }
+    if (opts->mpi_blocks < 0) {
+        printf("Error: invalid number of longitude blocks.\n");
+        exit(1);
+    }
+    if (opts->adjoint && opts->adjoint_lat0 >= opts->adjoint_lat1) {
+        printf("Error: adjoint region must have lat0 < lat1.\n");
+        exit(1);
+    }
+    if (opts->adjoint && (opts->batch_path != NULL || opts->mpi_blocks > 0)) {
+        printf("Error: adjoint runs cannot be combined with -b or -M.\n");
+        exit(1);
+    }
+    if (opts->batch_path != NULL && opts->mpi_blocks > 0) {
+        printf("Error: batch runs are not supported under MPI.\n");
+        exit(1);
+    }
+    if (opts->timestep < 0.0f) {
+        printf("Error: timestep must be positive.\n");
+        exit(1);
+    }
+    if (opts->polar_lat <= 0.0f || opts->polar_lat > 90.0f) {
+        printf("Error: polar filter latitude must be in (0, 90].\n");
+        exit(1);
+    }
+    if (opts->slow_every < 1) {
+        printf("Error: the slow physics interval must be at least 1.\n");
+        exit(1);
+    }
+    if (opts->interactive && (opts->batch_path != NULL || opts->adjoint ||
+        opts->mpi_blocks > 0)) {
+        printf("Error: -i only applies to windowed runs.\n");
+        exit(1);
+    }
+    if (opts->export_target != NULL && (opts->batch_path != NULL ||
+        opts->adjoint || opts->mpi_blocks > 0)) {
+        printf("Error: -V only applies to windowed runs.\n");
+        exit(1);
+    }
+    if (opts->export_target != NULL && (opts->export_every <= 0 ||
+        opts->export_width <= 0 || opts->export_height <= 0)) {
+        printf("Error: invalid export settings.\n");
+        exit(1);
+    }
+    if (opts->sweep_param[0] != '\0' && (opts->sweep_step <= 0.0f ||
+        opts->sweep_from == opts->sweep_to)) {
+        printf("Error: a sweep needs a positive step and two different "
+            "end points.\n");
+        exit(1);
+    }
+    if (opts->sweep_param[0] != '\0' && (opts->batch_path != NULL ||
+        opts->adjoint || opts->mpi_blocks > 0 || opts->interactive ||
+        opts->export_target != NULL)) {
+        printf("Error: -H can not be combined with -b, -g, -M, -i or -V.\n");
+        exit(1);
+    }
+    if (opts->tile_width < 0 || opts->tile_height < 0 ||
+        (opts->tile_width > 0) != (opts->tile_height > 0) ||
+        opts->tile_resident < 0) {
+        printf("Error: invalid tile settings.\n");
+        exit(1);
+    }
+    if (opts->tile_width > 0 && (opts->reduced_grid ||
+        opts->batch_path != NULL || opts->adjoint || opts->mpi_blocks > 0 ||
+        opts->sweep_param[0] != '\0' || opts->export_target != NULL)) {
+        printf("Error: -T can not be combined with -R, -b, -g, -M, -H or "
+            "-V.\n");
+        exit(1);
+    }
+    if (opts->run_years <= 0.0f) {
+        printf("Error: run length must be positive.\n");
+        exit(1);
+    }
+    if (opts->orbit_source[0] != '\0' && opts->orbit_accel <= 0.0f) {
+        printf("Error: orbital acceleration must be positive.\n");
+        exit(1);
+    }
+    if (opts->orbit_source[0] != '\0' && (opts->batch_path != NULL ||
+        opts->adjoint || opts->mpi_blocks > 0 ||
+        opts->sweep_param[0] != '\0')) {
+        printf("Error: -O can not be combined with -b, -g, -M or -H.\n");
+        exit(1);
+    }
+    if (opts->parareal_slices < 0 || opts->parareal_slices == 1 ||
+        opts->parareal_coarse_dt < 0.0f) {
+        printf("Error: Parareal needs at least two slices and a positive "
+            "coarse timestep.\n");
+        exit(1);
+    }
+    if (opts->parareal_slices > 0 && (opts->batch_path != NULL ||
+        opts->adjoint || opts->mpi_blocks > 0 ||
+        opts->sweep_param[0] != '\0' || opts->reduced_grid ||
+        opts->tile_width > 0 || opts->interactive ||
+        opts->export_target != NULL || opts->orbit_source[0] != '\0' ||
+        opts->slow_every > 1)) {
+        printf("Error: -p can not be combined with -b, -g, -M, -H, -R, -T, "
+            "-i, -V, -O or -r.\n");
+        exit(1);
+    }
+    if (opts->shooting && (opts->batch_path != NULL || opts->adjoint ||
+        opts->mpi_blocks > 0 || opts->sweep_param[0] != '\0' ||
+        opts->tile_width > 0 || opts->orbit_source[0] != '\0')) {
+        printf("Error: -N can not be combined with -b, -g, -M, -H, -T or "
+            "-O.\n");
+        exit(1);
+    }
+    if (opts->regrid_width < 0 || opts->regrid_height < 0 ||
+        opts->regrid_width % 32 != 0 || opts->regrid_height % 32 != 0) {
+        printf("Error: the regridded size must be a positive multiple of "
+            "32.\n");
+        exit(1);
+    }
+    if (opts->regrid_width > 0 && (opts->batch_path != NULL ||
+        opts->mpi_blocks > 0)) {
+        printf("Error: -G can not be combined with -b or -M.\n");
+        exit(1);
+    }
+    if ((opts->segment_frames > 0 || opts->segment_years > 0.0f) &&
+        (opts->batch_path != NULL || opts->adjoint || opts->mpi_blocks > 0 ||
+        opts->sweep_param[0] != '\0' || opts->parareal_slices > 0)) {
+        printf("Error: -F can not be combined with -b, -g, -M, -H or -p.\n");
+        exit(1);
+    }
+    if (opts->stats_every < 0) {
+        printf("Error: invalid statistics interval.\n");
+        exit(1);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef _OPTIONS_H
+#define _OPTIONS_H
+
+#define DEFAULT_SPINUP_TOL       0.01f // K/yr
+#define DEFAULT_SPINUP_MAX_YEARS 200
+#define DEFAULT_POLAR_LAT        60.0f // degrees
+#define DEFAULT_EXPORT_EVERY     100   // steps
+#define DEFAULT_EXPORT_WIDTH     512
+#define DEFAULT_EXPORT_HEIGHT    256
+#define DEFAULT_RUN_YEARS        3.0f
+
+typedef struct {
+    char* input_path;
+    char* output_path;
+
+    // job list for batch runs (NULL = single run)
+    char* batch_path;
+
+    // coarse-to-fine spin-up (0 = disabled)
+    int spinup_levels;
+    int spinup_max_years;
+    float spinup_tol;
+
+    // solve for the periodic equilibrium by Newton-Krylov shooting before
+    // the run, starting from the spin-up if there is one
+    int shooting;
+
+    // remap the input onto a regrid_width x regrid_height grid, area
+    // weighted or bilinearly (0 = the input is already on the model grid),
+    // caching the weights in regrid_cache
+    int regrid_width, regrid_height;
+    int regrid_bilinear;
+    char* regrid_cache;
+
+    // reduced (quasi-uniform) grid
+    int reduced_grid;
+
+    // tiles of tile_width x tile_height cells (0 = only when the grid
+    // exceeds the texture size limit), at most tile_resident on the GPU
+    // (0 = all)
+    int tile_width, tile_height;
+    int tile_resident;
+
+    // daily mean insolation, and whether to allow the 1-D fast path for it
+    int daily_mean;
+    int force_2d;
+
+    // MPI run on the CPU with this many longitude blocks (0 = disabled)
+    int mpi_blocks;
+
+    // adjoint sensitivity of the mean final Ts between two latitudes
+    int adjoint;
+    float adjoint_lat0, adjoint_lat1;
+    int adjoint_check; // also run the tangent linear model as a check
+
+    // Parareal over this many time slices (0 = disabled), with a coarse
+    // timestep in minutes (0 = the diffusion limit)
+    int parareal_slices;
+    float parareal_coarse_dt;
+
+    // port or unix socket path to serve metrics on (NULL = disabled)
+    char* metrics_address;
+
+    // timestep override in minutes (0 = default)
+    float timestep;
+
+    // filter the zonal diffusion poleward of this latitude (90 = disabled)
+    float polar_lat;
+
+    // recompute the radiative terms every this many steps, stepping only
+    // the diffusion in between (1 = single rate)
+    int slow_every;
+
+    // zonal means and the energy budget every this many steps (0 = disabled)
+    int stats_every;
+
+    // read steering commands from stdin
+    int interactive;
+
+    // colour mapped frames written to a directory or piped to a command
+    // (NULL = disabled)
+    char* export_target;
+    int export_every, export_width, export_height;
+
+    // continuation sweep of one parameter from sweep_from to sweep_to and
+    // back (empty name = disabled). sweep_op is '+' or '*' to offset or
+    // scale the initial value, '=' to set it
+    char sweep_param[16];
+    char sweep_op;
+    float sweep_from, sweep_to, sweep_step;
+
+    // split the output into files of segment_frames frames or
+    // segment_years years (both 0 = one file)
+    int segment_frames;
+    float segment_years;
+
+    // years of model time to run for
+    float run_years;
+
+    // orbital parameters from a table or "berger" (empty = present day),
+    // starting at orbit_start_kyr and running orbit_accel times faster than
+    // model time
+    char orbit_source[256];
+    double orbit_start_kyr;
+    float orbit_accel;
+} model_options_t;
+
+void parse_options(int argc, char* argv[], model_options_t* opts);
+void print_useage();
+
+#endif // _OPTIONS_H
@@ -0,0 +1,305 @@
+#include "orbit.h"
+#include "common.h"
+#include "renderutil.h"
+#include "nctools.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+void init_insol_kernel(insol_kernel_t* kernel) {
+    kernel->program = create_cshader("shader/insolation.cs");
+    kernel->ecc_l       = glGetUniformLocation(kernel->program, "ecc");
+    kernel->obliquity_l = glGetUniformLocation(kernel->program, "obliquity");
+    kernel->long_peri_l = glGetUniformLocation(kernel->program, "long_peri");
+}
+
+// the LUT is the 512x512 RGBA32F texture made by make_solar_table
+void insol_kernel_fill(insol_kernel_t* kernel, unsigned int solar_LUT,
+    const glebm_orbit_t* orbit) {
+    glUseProgram(kernel->program);
+    glUniform1f(kernel->ecc_l, orbit->ecc);
+    glUniform1f(kernel->obliquity_l, orbit->obliquity);
+    glUniform1f(kernel->long_peri_l, orbit->long_peri);
+    glBindImageTexture(0, solar_LUT, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+        GL_RGBA32F);
+    glDispatchCompute(512 / 32, 512 / 32, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void insol_kernel_free(insol_kernel_t* kernel) {
+    glDeleteProgram(kernel->program);
+}
+
+// leading terms of Berger (1978) as tabulated in the CESM orbital code,
+// amplitudes in arc seconds, rates in arc seconds per year and phases in
+// degrees. Good to a few percent of the full series over the last few
+// million years.
+#define BERGER_TERMS 10
+
+static const double ob_amp[BERGER_TERMS] = {
+    -2462.2214466, -857.3232075, -629.3231835, -414.2804924, -311.7632587,
+    308.9408604, -162.5533601, -116.1077911, 101.1189923, -67.6856209
+};
+static const double ob_rate[BERGER_TERMS] = {
+    31.609974, 32.620504, 24.172203, 31.983787, 44.828336,
+    30.973257, 43.668246, 32.246691, 30.599444, 42.681324
+};
+static const double ob_phase[BERGER_TERMS] = {
+    251.9025, 280.8325, 128.3057, 292.7252, 15.3747,
+    263.7951, 308.4258, 240.0099, 222.9725, 268.7809
+};
+
+static const double ec_amp[BERGER_TERMS] = {
+    0.01860798, 0.01627522, -0.01300660, 0.00988829, -0.00336700,
+    0.00333077, -0.00235400, 0.00140015, 0.00100700, 0.00085700
+};
+static const double ec_rate[BERGER_TERMS] = {
+    4.2072050, 7.3460910, 17.8572630, 17.2205460, 16.8467330,
+    5.1990790, 18.2310760, 26.2167580, 6.3591690, 16.2100160
+};
+static const double ec_phase[BERGER_TERMS] = {
+    28.620089, 193.788772, 308.307024, 320.199637, 279.376984,
+    87.195000, 349.129677, 128.443387, 154.143880, 291.269597
+};
+
+static const double mv_amp[BERGER_TERMS] = {
+    7391.0225890, 2555.1526947, 2022.7629188, -1973.6517951, 1240.2321818,
+    953.8679112, -931.7537108, 872.3795383, 606.3544732, -496.0274038
+};
+static const double mv_rate[BERGER_TERMS] = {
+    31.609974, 32.620504, 24.172203, 0.636717, 31.983787,
+    3.138886, 30.973257, 44.828336, 0.991874, 0.373813
+};
+static const double mv_phase[BERGER_TERMS] = {
+    251.9025, 280.8325, 128.3057, 348.1074, 292.7252,
+    165.1686, 263.7951, 15.3747, 58.5749, 40.8226
+};
+
+void orbit_berger(double kyr, glebm_orbit_t* orbit) {
+    const double psecdeg = 1.0 / 3600.0;
+    const double degrad = M_PI / 180.0;
+    double years = kyr * 1000.0;
+
+    double obliquity = 23.320556;
+    double cossum = 0.0, sinsum = 0.0, mvsum = 0.0;
+    for (int i = 0; i < BERGER_TERMS; i++) {
+        obliquity += ob_amp[i] * psecdeg *
+            cos((ob_rate[i] * psecdeg * years + ob_phase[i]) * degrad);
+        double ec_arg = (ec_rate[i] * psecdeg * years + ec_phase[i]) * degrad;
+        cossum += ec_amp[i] * cos(ec_arg);
+        sinsum += ec_amp[i] * sin(ec_arg);
+        mvsum += mv_amp[i] * psecdeg *
+            sin((mv_rate[i] * psecdeg * years + mv_phase[i]) * degrad);
+    }
+
+    // the series gives the longitude of perihelion from the moving vernal
+    // equinox, the model measures it from the opposite point
+    double fvelp = atan2(sinsum, cossum) / degrad;
+    double mvelp = fvelp + 50.439273 * psecdeg * years + 3.392506 + mvsum;
+    double lp = fmod(mvelp + 180.0, 360.0);
+    if (lp < 0.0) {
+        lp += 360.0;
+    }
+
+    orbit->ecc = (float) sqrt(cossum * cossum + sinsum * sinsum);
+    orbit->obliquity = (float) obliquity;
+    orbit->long_peri = (float) lp;
+}
+
+// table rows are "kyr ecc obliquity long_peri" with kyr increasing, lines
+// starting with # are skipped
+static void read_orbit_table(orbit_forcing_t* f, const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Error: could not open orbit table %s.\n", path);
+        exit(1);
+    }
+
+    int capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        double kyr, e, obl, lp;
+        int n = sscanf(line, "%lf %lf %lf %lf", &kyr, &e, &obl, &lp);
+        if (n <= 0) {
+            continue;
+        }
+        if (n != 4) {
+            printf("Error: orbit table rows need kyr, ecc, obliquity and "
+                "long_peri (row %d of %s).\n", f->n + 1, path);
+            exit(1);
+        }
+        if (f->n > 0 && kyr <= f->kyr[f->n - 1]) {
+            printf("Error: orbit table times must increase (row %d of %s).\n",
+                f->n + 1, path);
+            exit(1);
+        }
+        if (e < 0.0 || e >= 1.0) {
+            printf("Error: eccentricity %f out of range (row %d of %s).\n",
+                e, f->n + 1, path);
+            exit(1);
+        }
+        if (f->n == capacity) {
+            capacity = (capacity > 0) ? 2 * capacity : 64;
+            f->kyr = (double*) realloc(f->kyr, capacity * sizeof(double));
+            f->ecc = (double*) realloc(f->ecc, capacity * sizeof(double));
+            f->obliquity = (double*) realloc(f->obliquity,
+                capacity * sizeof(double));
+            f->long_peri = (double*) realloc(f->long_peri,
+                capacity * sizeof(double));
+        }
+        f->kyr[f->n] = kyr;
+        f->ecc[f->n] = e;
+        f->obliquity[f->n] = obl;
+        // unwrap so precession interpolates across 0/360
+        if (f->n > 0) {
+            double prev = f->long_peri[f->n - 1];
+            while (lp - prev > 180.0) {
+                lp -= 360.0;
+            }
+            while (lp - prev < -180.0) {
+                lp += 360.0;
+            }
+        }
+        f->long_peri[f->n] = lp;
+        f->n++;
+    }
+    fclose(fp);
+
+    if (f->n == 0) {
+        printf("Error: orbit table %s is empty.\n", path);
+        exit(1);
+    }
+}
+
+// source is a table path or "berger"
+void init_orbit_forcing(orbit_forcing_t* f, const char* source,
+    double start_kyr, float accel) {
+    memset(f, 0, sizeof(orbit_forcing_t));
+    f->start_kyr = start_kyr;
+    f->accel = accel;
+    f->checked_day = -1;
+    if (strcmp(source, "berger") != 0) {
+        read_orbit_table(f, source);
+        if (start_kyr < f->kyr[0] || start_kyr > f->kyr[f->n - 1]) {
+            printf("Warning: orbit start %.1f kyr is outside the table "
+                "(%.1f to %.1f kyr), the ends are held.\n", start_kyr,
+                f->kyr[0], f->kyr[f->n - 1]);
+        }
+    }
+}
+
+// orbital time at model time t (days)
+double orbit_forcing_kyr(orbit_forcing_t* f, double t) {
+    return f->start_kyr + f->accel * (t / days_per_year) / 1000.0;
+}
+
+void orbit_forcing_at(orbit_forcing_t* f, double kyr, glebm_orbit_t* orbit) {
+    if (f->n == 0) {
+        orbit_berger(kyr, orbit);
+        return;
+    }
+
+    int i = 0;
+    double w = 0.0;
+    if (kyr >= f->kyr[f->n - 1]) {
+        i = f->n - 1;
+    } else if (kyr > f->kyr[0]) {
+        // the run moves monotonically through the table so this is cheap
+        // enough, and it only happens once per model day
+        while (f->kyr[i + 1] <= kyr) {
+            i++;
+        }
+        w = (kyr - f->kyr[i]) / (f->kyr[i + 1] - f->kyr[i]);
+    }
+    int i1 = (i + 1 < f->n) ? i + 1 : i;
+
+    double lp = (1.0 - w) * f->long_peri[i] + w * f->long_peri[i1];
+    lp = fmod(lp, 360.0);
+    if (lp < 0.0) {
+        lp += 360.0;
+    }
+    orbit->ecc = (float) ((1.0 - w) * f->ecc[i] + w * f->ecc[i1]);
+    orbit->obliquity =
+        (float) ((1.0 - w) * f->obliquity[i] + w * f->obliquity[i1]);
+    orbit->long_peri = (float) lp;
+}
+
+static int orbit_changed(const glebm_orbit_t* a, const glebm_orbit_t* b) {
+    float dlp = fabsf(a->long_peri - b->long_peri);
+    if (dlp > 180.0f) {
+        dlp = 360.0f - dlp;
+    }
+    return fabsf(a->ecc - b->ecc) > 1e-5f ||
+        fabsf(a->obliquity - b->obliquity) > 1e-3f || dlp > 1e-2f;
+}
+
+// checks the orbit once per model day. Returns 1 with the new orbit when the
+// LUT needs to be refilled, which is always the case on the first call.
+int orbit_forcing_update(orbit_forcing_t* f, double t, glebm_orbit_t* orbit) {
+    long day = (long) floor(t);
+    if (day == f->checked_day) {
+        return 0;
+    }
+    f->checked_day = day;
+
+    double kyr = orbit_forcing_kyr(f, t);
+    glebm_orbit_t next;
+    orbit_forcing_at(f, kyr, &next);
+    if (f->n_updates > 0 && !orbit_changed(&next, &f->current)) {
+        return 0;
+    }
+    f->current = next;
+    f->n_updates++;
+
+    if (f->n_samples == f->capacity) {
+        f->capacity = (f->capacity > 0) ? 2 * f->capacity : 64;
+        f->times = (double*) mem_realloc(MEM_FRAMES, f->times,
+            f->capacity * sizeof(double));
+        for (int k = 0; k < 4; k++) {
+            f->samples[k] = (float*) mem_realloc(MEM_FRAMES, f->samples[k],
+                f->capacity * sizeof(float));
+        }
+    }
+    size_t i = f->n_samples++;
+    f->times[i] = t;
+    f->samples[0][i] = (float) kyr;
+    f->samples[1][i] = next.ecc;
+    f->samples[2][i] = next.obliquity;
+    f->samples[3][i] = next.long_peri;
+
+    *orbit = next;
+    return 1;
+}
+
+static const char* orbit_names[4] = {
+    "orbit_kyr", "eccentricity", "obliquity", "long_peri"
+};
+static const char* orbit_units[4] = {
+    "kyr since 1950", "1", "degrees", "degrees"
+};
+
+void orbit_forcing_write(orbit_forcing_t* f, const char* path) {
+    if (f->n_samples == 0) {
+        return;
+    }
+    int lengths[4] = { 1, 1, 1, 1 };
+    append_time_series(path, "orbit_time", "days", (int) f->n_samples,
+        f->times, 4, orbit_names, orbit_units, lengths, f->samples);
+}
+
+void orbit_forcing_free(orbit_forcing_t* f) {
+    free(f->kyr);
+    free(f->ecc);
+    free(f->obliquity);
+    free(f->long_peri);
+    mem_free(f->times);
+    for (int k = 0; k < 4; k++) {
+        mem_free(f->samples[k]);
+    }
+    memset(f, 0, sizeof(orbit_forcing_t));
+}
@@ -0,0 +1,48 @@
+#ifndef _ORBIT_H
+#define _ORBIT_H
+
+#include <stddef.h>
+#include "glebm.h"
+
+// compiled insolation shader, rewrites a solar LUT for one orbit
+typedef struct {
+    unsigned int program;
+    unsigned int ecc_l, obliquity_l, long_peri_l;
+} insol_kernel_t;
+
+void init_insol_kernel(insol_kernel_t* kernel);
+void insol_kernel_fill(insol_kernel_t* kernel, unsigned int solar_LUT,
+    const glebm_orbit_t* orbit);
+void insol_kernel_free(insol_kernel_t* kernel);
+
+// orbital parameters along a run. Orbital time advances accel times faster
+// than model time from start_kyr (thousands of years after 1950, negative in
+// the past). The parameters come from a table or, without one, from the
+// Berger (1978) series.
+typedef struct {
+    int n; // table rows, 0 for the computed series
+    double *kyr, *ecc, *obliquity, *long_peri;
+    double start_kyr;
+    float accel;
+
+    glebm_orbit_t current; // orbit the LUT was last filled with
+    long checked_day;
+    int n_updates;
+
+    // one sample per update, written next to the model output
+    size_t n_samples, capacity;
+    double* times; // days
+    float* samples[4]; // kyr, ecc, obliquity, long_peri
+} orbit_forcing_t;
+
+void orbit_berger(double kyr, glebm_orbit_t* orbit);
+
+void init_orbit_forcing(orbit_forcing_t* f, const char* source,
+    double start_kyr, float accel);
+double orbit_forcing_kyr(orbit_forcing_t* f, double t);
+void orbit_forcing_at(orbit_forcing_t* f, double kyr, glebm_orbit_t* orbit);
+int orbit_forcing_update(orbit_forcing_t* f, double t, glebm_orbit_t* orbit);
+void orbit_forcing_write(orbit_forcing_t* f, const char* path);
+void orbit_forcing_free(orbit_forcing_t* f);
+
+#endif // _ORBIT_H
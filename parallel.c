@@ -0,0 +1,396 @@
+#include "parallel.h"
+#include <stdio.h>
+
+#ifdef USE_MPI
+
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "nctools.h"
+#include "process/ebm.h"
+
+// halo messages are tagged by the direction they travel in
+#define TAG_NORTH 1
+#define TAG_SOUTH 2
+#define TAG_EAST  3
+#define TAG_WEST  4
+
+// split n cells into parts as evenly as possible
+static void block_extent(size_t n, int parts, int idx, size_t* start,
+    size_t* len) {
+    *start = (n * idx) / parts;
+    *len = ((n * (idx + 1)) / parts) - *start;
+}
+
+static void bcast_field(float** field, size_t n, int rank) {
+    if (rank != 0) {
+        *field = (float*) malloc(n * sizeof(float));
+    }
+    MPI_Bcast(*field, n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+}
+
+// rank 0 reads the input and hands it to everyone else
+static void bcast_input(model_options_t* opts, int rank, size_t* nx,
+    size_t* ny, model_initial_t* m) {
+    unsigned long dims[2];
+    if (rank == 0) {
+        read_input(opts->input_path, nx, ny, m);
+        if (m->time_varying) {
+            printf("Warning: the MPI solver only uses the first time slice "
+                "of the input.\n");
+        }
+        dims[0] = *nx;
+        dims[1] = *ny;
+    }
+    MPI_Bcast(dims, 2, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    *nx = dims[0];
+    *ny = dims[1];
+
+    bcast_field(&m->lats, *ny, rank);
+    bcast_field(&m->lons, *nx, rank);
+    bcast_field(&m->Ts, (*nx) * (*ny), rank);
+    bcast_field(&m->Bs, (*nx) * (*ny), rank);
+    bcast_field(&m->As, (*nx) * (*ny), rank);
+    bcast_field(&m->depths, (*nx) * (*ny), rank);
+    bcast_field(&m->a0s, (*nx) * (*ny), rank);
+    bcast_field(&m->a2s, (*nx) * (*ny), rank);
+    bcast_field(&m->ais, (*nx) * (*ny), rank);
+}
+
+// post the non-blocking halo exchange for T, four receives then four sends
+static void start_halo_exchange(ebm_params_t* p, float* T, MPI_Comm cart,
+    MPI_Datatype column, int south, int north, int west, int east,
+    MPI_Request* reqs) {
+    MPI_Irecv(&T[EBM_INDEX(p, -1, 0)], p->nx, MPI_FLOAT, south, TAG_NORTH,
+        cart, &reqs[0]);
+    MPI_Irecv(&T[EBM_INDEX(p, p->ny, 0)], p->nx, MPI_FLOAT, north, TAG_SOUTH,
+        cart, &reqs[1]);
+    MPI_Irecv(&T[EBM_INDEX(p, 0, -1)], 1, column, west, TAG_EAST,
+        cart, &reqs[2]);
+    MPI_Irecv(&T[EBM_INDEX(p, 0, p->nx)], 1, column, east, TAG_WEST,
+        cart, &reqs[3]);
+
+    MPI_Isend(&T[EBM_INDEX(p, p->ny - 1, 0)], p->nx, MPI_FLOAT, north,
+        TAG_NORTH, cart, &reqs[4]);
+    MPI_Isend(&T[EBM_INDEX(p, 0, 0)], p->nx, MPI_FLOAT, south,
+        TAG_SOUTH, cart, &reqs[5]);
+    MPI_Isend(&T[EBM_INDEX(p, 0, p->nx - 1)], 1, column, east,
+        TAG_EAST, cart, &reqs[6]);
+    MPI_Isend(&T[EBM_INDEX(p, 0, 0)], 1, column, west,
+        TAG_WEST, cart, &reqs[7]);
+}
+
+// area weighted global mean, min and max of T
+static void global_stats(ebm_params_t* p, float* T, float* Tmean,
+    float* Tmin, float* Tmax) {
+    double sums[2] = {0.0, 0.0};
+    float lmin = 1e9f;
+    float lmax = -1e9f;
+    for (size_t j = 0; j < p->ny; j++) {
+        double w = cos(deg2rad(p->lats[j]));
+        for (size_t x = 0; x < p->nx; x++) {
+            float v = T[EBM_INDEX(p, j, x)];
+            sums[0] += w * v;
+            sums[1] += w;
+            if (v < lmin) lmin = v;
+            if (v > lmax) lmax = v;
+        }
+    }
+
+    double gsums[2];
+    MPI_Allreduce(sums, gsums, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&lmin, Tmin, 1, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&lmax, Tmax, 1, MPI_FLOAT, MPI_MAX, MPI_COMM_WORLD);
+    *Tmean = (float) (gsums[0] / gsums[1]);
+}
+
+// the polar rows are split across the longitude blocks of a band, so each
+// rank gathers their zonal second differences whole, filters them and adds
+// back its own part. Every rank of the band filters the same rows the same
+// way, which keeps the result independent of the number of blocks.
+static void filter_polar_rows(ebm_params_t* p, MPI_Comm band, int blocks,
+    const float* zonal, float* Tout, float* diag, float dt) {
+    size_t n_polar = 0;
+    for (size_t j = 0; j < p->ny; j++) {
+        n_polar += ebm_polar_row(p, j);
+    }
+    if (n_polar == 0) {
+        return;
+    }
+
+    float* local = (float*) malloc(n_polar * p->nx * sizeof(float));
+    float* gathered = (float*) malloc(n_polar * p->global_nx * sizeof(float));
+    float* row = (float*) malloc(p->global_nx * sizeof(float));
+    int* counts = (int*) malloc(blocks * sizeof(int));
+    int* displs = (int*) malloc(blocks * sizeof(int));
+
+    size_t k = 0;
+    for (size_t j = 0; j < p->ny; j++) {
+        if (ebm_polar_row(p, j)) {
+            for (size_t x = 0; x < p->nx; x++) {
+                local[(k * p->nx) + x] = zonal[(((j * p->nx) + x) * 2) + 0];
+            }
+            k++;
+        }
+    }
+    for (int b = 0; b < blocks; b++) {
+        size_t col0, cols;
+        block_extent(p->global_nx, blocks, b, &col0, &cols);
+        counts[b] = (int) (n_polar * cols);
+        displs[b] = (int) (n_polar * col0);
+    }
+    MPI_Allgatherv(local, (int) (n_polar * p->nx), MPI_FLOAT, gathered,
+        counts, displs, MPI_FLOAT, band);
+
+    k = 0;
+    for (size_t j = 0; j < p->ny; j++) {
+        if (!ebm_polar_row(p, j)) {
+            continue;
+        }
+        for (int b = 0; b < blocks; b++) {
+            size_t col0, cols;
+            block_extent(p->global_nx, blocks, b, &col0, &cols);
+            memcpy(&row[col0], &gathered[displs[b] + (k * cols)],
+                cols * sizeof(float));
+        }
+        ebm_polar_filter(p, p->lats[j], row);
+        ebm_add_zonal(p, j, &row[p->col0], zonal, Tout, diag, dt);
+        k++;
+    }
+
+    free(local);
+    free(gathered);
+    free(row);
+    free(counts);
+    free(displs);
+}
+
+// collect every block's RGBA state on rank 0 as one full grid
+static float* gather_state(ebm_params_t* p, float* diag, MPI_Comm cart,
+    int rank, int size, int* dims) {
+    int count = (int) (p->nx * p->ny * 4);
+    int* counts = NULL;
+    int* displs = NULL;
+    float* blocks = NULL;
+    if (rank == 0) {
+        counts = (int*) malloc(size * sizeof(int));
+        displs = (int*) malloc(size * sizeof(int));
+    }
+    MPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, cart);
+    if (rank == 0) {
+        int total = 0;
+        for (int r = 0; r < size; r++) {
+            displs[r] = total;
+            total += counts[r];
+        }
+        blocks = (float*) malloc(total * sizeof(float));
+    }
+    MPI_Gatherv(diag, count, MPI_FLOAT, blocks, counts, displs, MPI_FLOAT, 0,
+        cart);
+
+    if (rank != 0) {
+        return NULL;
+    }
+
+    // put each block in place
+    float* data = (float*) malloc(
+        p->global_nx * p->global_ny * 4 * sizeof(float));
+    for (int r = 0; r < size; r++) {
+        int coords[2];
+        size_t row0, rows, col0, cols;
+        MPI_Cart_coords(cart, r, 2, coords);
+        block_extent(p->global_ny, dims[0], coords[0], &row0, &rows);
+        block_extent(p->global_nx, dims[1], coords[1], &col0, &cols);
+        for (size_t j = 0; j < rows; j++) {
+            memcpy(&data[(((row0 + j) * p->global_nx) + col0) * 4],
+                &blocks[displs[r] + (j * cols * 4)], cols * 4 * sizeof(float));
+        }
+    }
+    free(counts);
+    free(displs);
+    free(blocks);
+
+    return data;
+}
+
+int run_parallel(model_options_t* opts) {
+    MPI_Init(NULL, NULL);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // latitude bands, each optionally split into longitude blocks
+    int dims[2] = {size / opts->mpi_blocks, opts->mpi_blocks};
+    if (dims[0] * dims[1] != size) {
+        if (rank == 0) {
+            printf("Error: %d ranks cannot be split into %d longitude blocks.\n",
+                size, opts->mpi_blocks);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    int periods[2] = {0, 1};
+    MPI_Comm cart;
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &cart);
+    int coords[2];
+    MPI_Cart_coords(cart, rank, 2, coords);
+    int south, north, west, east;
+    MPI_Cart_shift(cart, 0, 1, &south, &north);
+    MPI_Cart_shift(cart, 1, 1, &west, &east);
+    int remain[2] = {0, 1};
+    MPI_Comm band;
+    MPI_Cart_sub(cart, remain, &band);
+
+    // load netcdf4 input file
+    model_initial_t initial_model;
+    size_t model_size_x, model_size_y;
+    bcast_input(opts, rank, &model_size_x, &model_size_y, &initial_model);
+    if (model_size_y < (size_t) dims[0] || model_size_x < (size_t) dims[1]) {
+        if (rank == 0) {
+            printf("Error: grid is too small for %d x %d blocks.\n",
+                dims[0], dims[1]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // this rank's block
+    size_t row0, rows, col0, cols;
+    block_extent(model_size_y, dims[0], coords[0], &row0, &rows);
+    block_extent(model_size_x, dims[1], coords[1], &col0, &cols);
+    ebm_params_t params;
+    ebm_init_params(&params, &initial_model, model_size_x, model_size_y,
+        col0, row0, cols, rows, opts->polar_lat);
+
+    MPI_Datatype column;
+    MPI_Type_vector(rows, 1, cols + 2, MPI_FLOAT, &column);
+    MPI_Type_commit(&column);
+
+    // state with halos, starting from the usual uniform field
+    float* Tin  = (float*) calloc(ebm_halo_size(&params), sizeof(float));
+    float* Tout = (float*) calloc(ebm_halo_size(&params), sizeof(float));
+    float* diag = (float*) calloc(cols * rows * 4, sizeof(float));
+    float* zonal = (float*) calloc(cols * rows * 2, sizeof(float));
+    for (size_t j = 0; j < rows; j++) {
+        for (size_t x = 0; x < cols; x++) {
+            Tin[EBM_INDEX(&params, j, x)] = 273.15f;
+            diag[(((j * cols) + x) * 4) + 0] = 273.15f;
+        }
+    }
+
+    model_storage_t model;
+    init_model_storage(&model, opts->run_years * days_per_year,
+        model_size_x, model_size_y);
+    if (opts->timestep > 0.0f) {
+        model.timestep = opts->timestep / (24.0f * 60.0f);
+        model.n_timesteps = (int) ceil(model.final_time / model.timestep);
+    }
+    float dt = model.timestep;
+
+    if (rank == 0) {
+        float dt_limit = ebm_diffusion_limit(&initial_model, model_size_x,
+            model_size_y, opts->polar_lat);
+        if (dt > dt_limit) {
+            printf("Warning: timestep of %.1f min exceeds the diffusion "
+                "limit of %.1f min.\n", dt * 24.0f * 60.0f,
+                dt_limit * 24.0f * 60.0f);
+        }
+        printf("Running on %d ranks (%d x %d blocks), block size %lux%lu\n",
+            size, dims[0], dims[1], cols, rows);
+    }
+
+    // the interior does not touch the halo and overlaps the exchange
+    int overlap = (rows > 2) && (cols > 2);
+    double t_start = MPI_Wtime();
+    double t_wait = 0.0;
+    MPI_Request reqs[8];
+    for (int step = 0; step <= model.n_timesteps; step++) {
+        double t = (double) step * dt;
+        float year_frac, day_frac;
+        model_phase(t, &year_frac, &day_frac);
+
+        start_halo_exchange(&params, Tin, cart, column, south, north, west,
+            east, reqs);
+        if (overlap) {
+            ebm_step_block(&params, Tin, Tout, diag, zonal, 1, rows - 1, 1,
+                cols - 1, year_frac, day_frac, dt, opts->daily_mean);
+        }
+        double t_wait_start = MPI_Wtime();
+        MPI_Waitall(8, reqs, MPI_STATUSES_IGNORE);
+        t_wait += MPI_Wtime() - t_wait_start;
+        if (overlap) {
+            ebm_step_block(&params, Tin, Tout, diag, zonal, 0, 1, 0, cols,
+                year_frac, day_frac, dt, opts->daily_mean);
+            ebm_step_block(&params, Tin, Tout, diag, zonal, rows - 1, rows, 0,
+                cols, year_frac, day_frac, dt, opts->daily_mean);
+            ebm_step_block(&params, Tin, Tout, diag, zonal, 1, rows - 1, 0, 1,
+                year_frac, day_frac, dt, opts->daily_mean);
+            ebm_step_block(&params, Tin, Tout, diag, zonal, 1, rows - 1,
+                cols - 1, cols, year_frac, day_frac, dt, opts->daily_mean);
+        } else {
+            ebm_step_block(&params, Tin, Tout, diag, zonal, 0, rows, 0, cols,
+                year_frac, day_frac, dt, opts->daily_mean);
+        }
+        filter_polar_rows(&params, band, dims[1], zonal, Tout, diag, dt);
+
+        float* tmp = Tin;
+        Tin = Tout;
+        Tout = tmp;
+
+        // collect statistics
+        if (step % 500 == 0 || step == model.n_timesteps) {
+            float Tmean, Tmin, Tmax;
+            global_stats(&params, Tin, &Tmean, &Tmin, &Tmax);
+            float* data = gather_state(&params, diag, cart, rank, size, dims);
+            if (rank == 0) {
+#ifndef REDUCED_OUTPUT
+                printf("step=%d t=%.4f (days) sps=%.2f\n", step, t + dt,
+                    (step + 1) / (MPI_Wtime() - t_start));
+                printf("  Temperature  min=%.4f max=%.4f mean=%.4f\n",
+                    Tmin, Tmax, Tmean);
+#endif // REDUCED_OUTPUT
+                model_storage_add_frame(&model, t + dt, data);
+                free(data);
+            }
+        }
+    }
+    double t_total = MPI_Wtime() - t_start;
+
+    // report scaling numbers, the slowest rank sets the pace
+    double t_wait_max;
+    MPI_Reduce(&t_wait, &t_wait_max, 1, MPI_DOUBLE, MPI_MAX, 0, cart);
+    if (rank == 0) {
+        printf("Run complete: ranks=%d cells/rank=%lu steps=%d wall=%.2fs "
+            "sps=%.2f halo_wait=%.2fs\n", size, rows * cols,
+            model.n_timesteps + 1, t_total, (model.n_timesteps + 1) / t_total,
+            t_wait_max);
+        printf("Saving results to %s...\n", opts->output_path);
+        model_storage_write(model_size_x, model_size_y, &model, &initial_model,
+            opts->output_path);
+        model_storage_free(&model);
+    }
+
+    MPI_Type_free(&column);
+    ebm_free_params(&params);
+    free(Tin);
+    free(Tout);
+    free(diag);
+    free(zonal);
+    MPI_Comm_free(&band);
+    MPI_Comm_free(&cart);
+    MPI_Finalize();
+
+    return 0;
+}
+
+#else
+
+int run_parallel(model_options_t* opts) {
+    printf("Error: glEBM was built without MPI, rebuild with make MPI=1\n");
+    return 1;
+}
+
+#endif // USE_MPI
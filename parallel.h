@@ -0,0 +1,8 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include "options.h"
+
+int run_parallel(model_options_t* opts);
+
+#endif // _PARALLEL_H
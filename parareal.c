@@ -0,0 +1,207 @@
+#include "parareal.h"
+#include "common.h"
+#include "mem.h"
+#include "process/ebm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// coarse solution of one slice starting from T at t0
+static void coarse_slice(model_state_t* coarse, compute_kernel_t* kernel,
+    unsigned int solar_LUT, float* T, double t0, int n_steps, float dt,
+    float* out) {
+    model_state_write_T(coarse, T);
+    for (int s = 0; s < n_steps; s++) {
+        model_state_step(coarse, kernel, solar_LUT, t0 + (double) s * dt, dt,
+            0);
+    }
+    model_state_read_T(coarse, out);
+}
+
+int run_parareal(model_options_t* opts, compute_kernel_t* kernel,
+    model_initial_t* initial, size_t nx, size_t ny, model_storage_t* model,
+    unsigned int solar_LUT, float* data) {
+    size_t n = nx * ny;
+    int n_slices = opts->parareal_slices;
+    float dt = model->timestep;
+
+    // the coarse step is a whole number of fine ones, by default the longest
+    // within the diffusion limit
+    float dt_limit = ebm_diffusion_limit(initial, nx, ny, opts->polar_lat);
+    float dt_coarse_wanted = (opts->parareal_coarse_dt > 0.0f) ?
+        opts->parareal_coarse_dt / (24.0f * 60.0f) : dt_limit;
+    int ratio = (int) floorf(dt_coarse_wanted / dt);
+    if (ratio < 1) {
+        ratio = 1;
+    }
+    float dt_coarse = (float) ratio * dt;
+    if (dt_coarse > dt_limit) {
+        printf("Warning: coarse timestep of %.1f min exceeds the diffusion "
+            "limit of %.1f min.\n", dt_coarse * 24.0f * 60.0f,
+            dt_limit * 24.0f * 60.0f);
+    }
+
+    // slices hold a whole number of coarse steps, so the run may end a few
+    // steps after final_time
+    int coarse_steps = (int) ceil((double) model->n_timesteps /
+        n_slices / ratio);
+    int fine_steps = coarse_steps * ratio;
+    double slice_len = (double) fine_steps * dt;
+    printf("Parareal: %d slices of %d steps, coarse step %.1f min\n",
+        n_slices, fine_steps, dt_coarse * 24.0f * 60.0f);
+
+    // the coarse propagator only differs in its daily mean insolation
+    compute_kernel_t coarse_kernel;
+    init_compute_kernel(&coarse_kernel, "shader/compute.cs");
+    glUseProgram(coarse_kernel.program);
+    glUniform1i(coarse_kernel.daily_mean_l, 1);
+    model_state_t coarse;
+    init_model_state(&coarse, nx, ny, initial, data);
+    model_state_set_polar_filter(&coarse, initial, opts->polar_lat);
+
+    // one fine state per slice, all stepped together
+    model_state_t* fine =
+        (model_state_t*) malloc(n_slices * sizeof(model_state_t));
+    model_state_t** active =
+        (model_state_t**) malloc(n_slices * sizeof(model_state_t*));
+    double* t = (double*) malloc(n_slices * sizeof(double));
+    for (int i = 0; i < n_slices; i++) {
+        init_model_state(&fine[i], nx, ny, initial, data);
+        model_state_set_polar_filter(&fine[i], initial, opts->polar_lat);
+    }
+
+    // slice boundaries of the current iterate, and the coarse and fine
+    // solutions of each slice from the last one
+    float* U = (float*) mem_alloc(MEM_FIELDS,
+        (n_slices + 1) * n * sizeof(float));
+    float* G = (float*) mem_alloc(MEM_FIELDS,
+        (n_slices + 1) * n * sizeof(float));
+    float* F = (float*) mem_alloc(MEM_FIELDS,
+        (n_slices + 1) * n * sizeof(float));
+    float* g = (float*) mem_alloc(MEM_STAGING, n * sizeof(float));
+    for (size_t c = 0; c < n; c++) {
+        U[c] = data[c * 4];
+    }
+
+    // rate of plain serial stepping, for the speedup
+    int probe = (fine_steps < 1000) ? fine_steps : 1000;
+    model_state_write_T(&fine[0], U);
+    glFinish();
+    double t_start = glfwGetTime();
+    for (int s = 0; s < probe; s++) {
+        model_state_step(&fine[0], kernel, solar_LUT, (double) s * dt, dt, 0);
+    }
+    glFinish();
+    double serial_seconds = (glfwGetTime() - t_start) / probe *
+        (double) fine_steps * n_slices;
+
+    // first guess from the coarse propagator alone
+    double t_coarse = 0.0, t_fine = 0.0;
+    t_start = glfwGetTime();
+    for (int i = 0; i < n_slices; i++) {
+        coarse_slice(&coarse, &coarse_kernel, solar_LUT, &U[i * n],
+            i * slice_len, coarse_steps, dt_coarse, &G[(i + 1) * n]);
+        memcpy(&U[(i + 1) * n], &G[(i + 1) * n], n * sizeof(float));
+    }
+    t_coarse += glfwGetTime() - t_start;
+
+    // after iteration k the first k slices are exact, so at most n_slices
+    // iterations are needed
+    float* changes = (float*) malloc(n_slices * sizeof(float));
+    double* iterations = (double*) malloc(n_slices * sizeof(double));
+    int n_iters = 0;
+    for (int k = 1; k <= n_slices; k++) {
+        int first = k - 1;
+        int n_active = n_slices - first;
+
+        t_start = glfwGetTime();
+        for (int i = 0; i < n_active; i++) {
+            active[i] = &fine[first + i];
+            model_state_write_T(active[i], &U[(first + i) * n]);
+        }
+        for (int s = 0; s < fine_steps; s++) {
+            for (int i = 0; i < n_active; i++) {
+                t[i] = (first + i) * slice_len + (double) s * dt;
+            }
+            model_state_step_many(n_active, active, kernel, solar_LUT, t, dt);
+        }
+        for (int i = 0; i < n_active; i++) {
+            model_state_read_T(active[i], &F[(first + i + 1) * n]);
+        }
+        t_fine += glfwGetTime() - t_start;
+
+        // serial correction, new coarse plus the old fine minus the old
+        // coarse solution
+        t_start = glfwGetTime();
+        float change = 0.0f;
+        for (int i = first; i < n_slices; i++) {
+            coarse_slice(&coarse, &coarse_kernel, solar_LUT, &U[i * n],
+                i * slice_len, coarse_steps, dt_coarse, g);
+            float* u = &U[(i + 1) * n];
+            float* f = &F[(i + 1) * n];
+            float* g_old = &G[(i + 1) * n];
+            for (size_t c = 0; c < n; c++) {
+                float next = g[c] + f[c] - g_old[c];
+                change = fmaxf(change, fabsf(next - u[c]));
+                u[c] = next;
+                g_old[c] = g[c];
+            }
+        }
+        t_coarse += glfwGetTime() - t_start;
+
+        changes[n_iters] = change;
+        iterations[n_iters] = k;
+        n_iters++;
+#ifndef REDUCED_OUTPUT
+        printf("Parareal iteration %d: max boundary change %.4f K\n", k,
+            change);
+#endif // REDUCED_OUTPUT
+        if (change < DEFAULT_PARAREAL_TOL) {
+            break;
+        }
+    }
+
+    double t_total = t_coarse + t_fine;
+    printf("Parareal complete: %d iterations in %.2fs (fine %.2fs, coarse "
+        "%.2fs), serial stepping %.2fs, speedup %.2fx\n", n_iters, t_total,
+        t_fine, t_coarse, serial_seconds, serial_seconds / t_total);
+
+    // the slice boundaries are the output frames. Only Ts is written, the
+    // other channels of the frame stay zero.
+    float* frame = (float*) mem_calloc(MEM_STAGING, n * 4, sizeof(float));
+    for (int i = 1; i <= n_slices; i++) {
+        for (size_t c = 0; c < n; c++) {
+            frame[c * 4] = U[i * n + c];
+        }
+        model_storage_add_frame(model, i * slice_len, frame);
+    }
+    model_storage_write(nx, ny, model, initial, opts->output_path);
+    model_storage_free(model);
+
+    const char* names[1] = { "parareal_change" };
+    const char* units[1] = { "K" };
+    int lengths[1] = { 1 };
+    append_time_series(opts->output_path, "parareal_iteration", "1",
+        n_iters, iterations, 1, names, units, lengths, &changes);
+
+    // clean up
+    mem_free(frame);
+    mem_free(U);
+    mem_free(G);
+    mem_free(F);
+    mem_free(g);
+    free(changes);
+    free(iterations);
+    for (int i = 0; i < n_slices; i++) {
+        model_state_free(&fine[i]);
+    }
+    free(fine);
+    free(active);
+    free(t);
+    model_state_free(&coarse);
+    glDeleteProgram(coarse_kernel.program);
+    glDeleteProgram(coarse_kernel.filter_program);
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _PARAREAL_H
+#define _PARAREAL_H
+
+#include <stddef.h>
+#include "nctools.h"
+#include "options.h"
+#include "model.h"
+
+#define DEFAULT_PARAREAL_TOL 0.01f // K
+
+// Parareal over the whole run. The run is cut into slices whose fine
+// solutions are stepped side by side on the GPU, while a coarse propagator
+// (daily mean insolation at a longer timestep) carries the corrections from
+// slice to slice until the slice boundaries stop moving.
+int run_parareal(model_options_t* opts, compute_kernel_t* kernel,
+    model_initial_t* initial, size_t nx, size_t ny, model_storage_t* model,
+    unsigned int solar_LUT, float* data);
+
+#endif // _PARAREAL_H
@@ -0,0 +1,292 @@
+#include "ebm.h"
+#include "solar.h"
+#include "../common.h"
+#include <math.h>
+#include <stdlib.h>
+
+// CPU port of the physics in shader/physics.glsl and shader/compute.cs.
+// Temperatures are stored with a one cell halo around the block, see
+// EBM_INDEX, which the caller fills from neighbouring blocks or by wrapping.
+
+static const float secs_per_day = 86400.0f;
+static const float Rd           =   287.0f;
+static const float Rv           =   461.5f;
+static const float Lh_vap       =     2.5e6f;
+static const float gas_cp       =  1004.0f;
+static const float Tf           =   263.15f;
+static const float D            =     0.555f;
+
+void ebm_init_params(ebm_params_t* p, model_initial_t* m, size_t global_nx,
+    size_t global_ny, size_t col0, size_t row0, size_t nx, size_t ny,
+    float polar_lat) {
+    p->nx = nx;
+    p->ny = ny;
+    p->col0 = col0;
+    p->row0 = row0;
+    p->global_nx = global_nx;
+    p->global_ny = global_ny;
+
+    p->lats = (float*) malloc(ny * sizeof(float));
+    p->lons = (float*) malloc(nx * sizeof(float));
+    p->Bs   = (float*) malloc(nx * ny * sizeof(float));
+    p->As   = (float*) malloc(nx * ny * sizeof(float));
+    p->Cs   = (float*) malloc(nx * ny * sizeof(float));
+    p->a0s  = (float*) malloc(nx * ny * sizeof(float));
+    p->a2s  = (float*) malloc(nx * ny * sizeof(float));
+    p->ais  = (float*) malloc(nx * ny * sizeof(float));
+
+    for (size_t x = 0; x < nx; x++) {
+        p->lons[x] = m->lons[col0 + x];
+    }
+    for (size_t y = 0; y < ny; y++) {
+        p->lats[y] = m->lats[row0 + y];
+        for (size_t x = 0; x < nx; x++) {
+            size_t i = (y * nx) + x;
+            size_t g = ((row0 + y) * global_nx) + col0 + x;
+            p->Bs[i]  = m->Bs[g];
+            p->As[i]  = m->As[g];
+            p->Cs[i]  = 4181.3f * 1.0e3f * m->depths[g];
+            p->a0s[i] = m->a0s[g];
+            p->a2s[i] = m->a2s[g];
+            p->ais[i] = m->ais[g];
+        }
+    }
+
+    p->polar_lat = polar_lat;
+    p->dft_cos = (double*) malloc(global_nx * sizeof(double));
+    p->dft_sin = (double*) malloc(global_nx * sizeof(double));
+    p->spectrum = (double*) malloc((global_nx + 2) * sizeof(double));
+    for (size_t i = 0; i < global_nx; i++) {
+        double a = 2 * M_PI * (double) i / (double) global_nx;
+        p->dft_cos[i] = cos(a);
+        p->dft_sin[i] = sin(a);
+    }
+}
+
+void ebm_free_params(ebm_params_t* p) {
+    free(p->lats);
+    free(p->lons);
+    free(p->Bs);
+    free(p->As);
+    free(p->Cs);
+    free(p->a0s);
+    free(p->a2s);
+    free(p->ais);
+    free(p->dft_cos);
+    free(p->dft_sin);
+    free(p->spectrum);
+}
+
+size_t ebm_halo_size(ebm_params_t* p) {
+    return (p->nx + 2) * (p->ny + 2);
+}
+
+void ebm_wrap_columns(ebm_params_t* p, float* T) {
+    for (size_t j = 0; j < p->ny; j++) {
+        T[EBM_INDEX(p, j, -1)] = T[EBM_INDEX(p, j, p->nx - 1)];
+        T[EBM_INDEX(p, j, p->nx)] = T[EBM_INDEX(p, j, 0)];
+    }
+}
+
+void ebm_orbit(float day, float* abra, float* delta) {
+    float long_peri_rad = deg2rad(long_peri);
+    float slon = solar_lon(ecc, long_peri_rad, day);
+    *abra = a2_b2_ratio(ecc, slon, long_peri_rad);
+    *delta = asinf(sinf(deg2rad(obliquity)) * sinf(slon));
+}
+
+float ebm_insolation(float lat, float lon, float day_frac, float abra,
+    float delta) {
+    float phi = deg2rad(lat);
+    float h = (fmodf(day_frac + (lon / 360.0f), 1.0f) - 0.5f) * 2 * pi;
+    float coszen = sinf(phi) * sinf(delta) + cosf(phi) * cosf(delta) * cosf(h);
+    float Fsw = abra * coszen;
+    return (Fsw > 0.0f) ? Fsw : 0.0f;
+}
+
+float ebm_insolation_daily(float lat, float abra, float delta) {
+    float phi = deg2rad(lat);
+    float x = -tanf(phi) * tanf(delta);
+    float h0 = acosf(x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x));
+    return abra / pi * (h0 * sinf(phi) * sinf(delta) +
+        cosf(phi) * cosf(delta) * sinf(h0));
+}
+
+float ebm_albedo(float Ts, float lat, float a0, float a2, float ai) {
+    if (Tf > Ts) {
+        return ai;
+    }
+    // matches calcP2(phi) in the shaders
+    float phi = deg2rad(lat);
+    return a0 + a2 * 0.5f * (3.0f * phi * phi - 1.0f);
+}
+
+static float calc_qsat(float T, float P) {
+    float eps = Rd / Rv;
+    float Tcel = T - 273.15f;
+    float es = 6.112f * expf(17.67f * Tcel / (Tcel + 243.5f));
+    return eps * es / (P - (1 - eps) * es);
+}
+
+float ebm_f(float T) {
+    const float RH     = 0.8f;
+    const float deltaT = 0.01f;
+
+    float dqsdTs = (calc_qsat(T + deltaT / 2.0f, 1000.0f) -
+        calc_qsat(T - deltaT / 2.0f, 1000.0f)) / deltaT;
+
+    return Lh_vap * RH * dqsdTs / gas_cp;
+}
+
+// largest stable explicit timestep (days) of the diffusion in the full grid
+// kernel, for the shallowest column at a warm 300 K. Rows poleward of
+// polar_lat count as if they were at polar_lat, which the polar filter
+// guarantees.
+float ebm_diffusion_limit(model_initial_t* m, size_t nx, size_t ny,
+    float polar_lat) {
+    float depth = m->depths[0];
+    for (size_t i = 1; i < nx * ny; i++) {
+        depth = fminf(depth, m->depths[i]);
+    }
+    float K = D / (4181.3f * 1.0e3f * depth) * (1 + ebm_f(300.0f));
+
+    float dphi = pi / (float) ny;
+    float dlam = (2 * pi) / (float) nx;
+    float c_min = cosf(deg2rad(polar_lat));
+    float rate = 0.0f;
+    for (size_t j = 0; j < ny; j++) {
+        float phi = deg2rad(m->lats[j]);
+        float W_i = cosf(phi);
+        float c = (polar_lat < 90.0f) ? fmaxf(W_i, c_min) : W_i;
+
+        // diagonal of the stencil, twice it bounds the largest eigenvalue
+        float Wb = ((j > 0) ? cosf(phi - (dphi / 2)) : 0.0f) +
+            ((j < ny - 1) ? cosf(phi + (dphi / 2)) : 0.0f);
+        float diag = Wb / (W_i * dphi * dphi) + 2.0f / (c * c * dlam * dlam);
+        rate = fmaxf(rate, K * diag);
+    }
+    return 1.0f / rate / secs_per_day;
+}
+
+int ebm_polar_row(ebm_params_t* p, size_t j) {
+    return p->polar_lat > 0.0f && p->polar_lat < 90.0f &&
+        fabsf(p->lats[j]) > p->polar_lat;
+}
+
+// the CPU version of shader/polar.cs, z is the second difference along a
+// whole row at lat and is filtered in place. Every wavenumber is damped so
+// that it diffuses no faster than the shortest wave at polar_lat.
+void ebm_polar_filter(ebm_params_t* p, float lat, float* z) {
+    size_t n = p->global_nx;
+    double* re = p->spectrum;
+    double* im = &p->spectrum[(n / 2) + 1];
+    double c = cos(deg2rad(lat)) / cos(deg2rad(p->polar_lat));
+    for (size_t k = 0; k <= n / 2; k++) {
+        double s = sin(M_PI * (double) k / (double) n);
+        double keep = (k == 0) ? 1.0 : fmin(1.0, (c * c) / (s * s));
+        re[k] = 0.0;
+        im[k] = 0.0;
+        if (keep < 1.0) {
+            for (size_t i = 0; i < n; i++) {
+                re[k] += z[i] * p->dft_cos[(k * i) % n];
+                im[k] -= z[i] * p->dft_sin[(k * i) % n];
+            }
+            re[k] *= 1.0 - keep;
+            im[k] *= 1.0 - keep;
+        }
+    }
+
+    // subtract the removed part of the spectrum
+    for (size_t i = 0; i < n; i++) {
+        double removed = 0.0;
+        for (size_t k = 1; k <= n / 2; k++) {
+            double w = (2 * k == n) ? 1.0 : 2.0;
+            removed += w * (re[k] * p->dft_cos[(k * i) % n] -
+                im[k] * p->dft_sin[(k * i) % n]);
+        }
+        z[i] -= (float) (removed / (double) n);
+    }
+}
+
+void ebm_step_block(ebm_params_t* p, const float* Tin, float* Tout,
+    float* diag, float* zonal, size_t j0, size_t j1, size_t x0, size_t x1,
+    float year_frac, float day_frac, float dt, int daily_mean) {
+    size_t nx = p->nx;
+    float abra, delta;
+    ebm_orbit(year_frac * days_per_year, &abra, &delta);
+
+    float dphi = pi / (float) p->global_ny;
+    float dlam = (2 * pi) / (float) p->global_nx;
+
+    for (size_t j = j0; j < j1; j++) {
+        size_t gj = p->row0 + j;
+        float lat = p->lats[j];
+        float phi = deg2rad(lat);
+        float Q_daily = ebm_insolation_daily(lat, abra, delta);
+        int polar = ebm_polar_row(p, j);
+
+        // no flux through the poles
+        float Wb_j   = (gj > 0) ? cosf(phi - (dphi / 2)) : 0.0f;
+        float Wb_jp1 = (gj < p->global_ny - 1) ? cosf(phi + (dphi / 2)) : 0.0f;
+        float W_i    = cosf(phi);
+
+        // cells get narrower towards the poles
+        float dx2 = W_i * W_i * dlam * dlam;
+
+        for (size_t x = x0; x < x1; x++) {
+            size_t i = (j * nx) + x;
+            size_t c = EBM_INDEX(p, j, x);
+            float T = Tin[c];
+
+            // radiation
+            float Q = daily_mean ? Q_daily :
+                ebm_insolation(lat, p->lons[x], day_frac, abra, delta);
+            float alpha = ebm_albedo(T, lat, p->a0s[i], p->a2s[i], p->ais[i]);
+            float OLR = p->As[i] + (p->Bs[i] * (T - 273.15f));
+            float ASR = (1 - alpha) * Q;
+            T += (ASR - OLR) / p->Cs[i] * dt * secs_per_day;
+
+            // diffusion with moist amplification
+            float K = D / p->Cs[i] * (1 + ebm_f(T));
+            float dTdt_merid = K * (Wb_jp1 * (Tin[c + nx + 2] - T) -
+                Wb_j * (T - Tin[c - nx - 2])) / (W_i * dphi * dphi);
+            float dTdt_zonal;
+            if (polar) {
+                // the filter needs a plain second difference, whose row
+                // mean is zero, so it is taken before the radiative update
+                float z = (Tin[c - 1] - 2 * Tin[c] + Tin[c + 1]) / dx2;
+                dTdt_zonal = K * z;
+                zonal[(i * 2) + 0] = z;
+                zonal[(i * 2) + 1] = K;
+                T += dTdt_merid * dt * secs_per_day;
+            } else {
+                dTdt_zonal = K * (Tin[c - 1] - 2 * T + Tin[c + 1]) / dx2;
+                T += (dTdt_merid + dTdt_zonal) * dt * secs_per_day;
+            }
+
+            Tout[c] = T;
+            if (diag) {
+                diag[(i * 4) + 0] = T;
+                diag[(i * 4) + 1] = dTdt_merid + dTdt_zonal;
+                diag[(i * 4) + 2] = Q;
+                diag[(i * 4) + 3] = alpha;
+            }
+        }
+    }
+}
+
+// add the filtered zonal tendency of polar row j, z holds this block's part
+// of the filtered row
+void ebm_add_zonal(ebm_params_t* p, size_t j, const float* z,
+    const float* zonal, float* Tout, float* diag, float dt) {
+    for (size_t x = 0; x < p->nx; x++) {
+        size_t i = (j * p->nx) + x;
+        size_t c = EBM_INDEX(p, j, x);
+        float K = zonal[(i * 2) + 1];
+        Tout[c] += K * z[x] * dt * secs_per_day;
+        if (diag) {
+            diag[(i * 4) + 0] = Tout[c];
+            diag[(i * 4) + 1] -= K * (zonal[(i * 2) + 0] - z[x]);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _EBM_H
+#define _EBM_H
+
+#include <stddef.h>
+#include "../nctools.h"
+
+// parameters for an nx by ny block of the grid starting at (col0, row0).
+// Rows poleward of polar_lat are polar filtered, see ebm_polar_filter.
+typedef struct {
+    size_t nx, ny, col0, row0, global_nx, global_ny;
+    float *lats, *lons;
+    float *Bs, *As, *Cs, *a0s, *a2s, *ais;
+    float polar_lat;
+    double *dft_cos, *dft_sin; // cos and sin of 2 pi m / global_nx
+    double* spectrum; // removed part of a filtered row, re and im
+} ebm_params_t;
+
+// temperatures carry a one cell halo on every side of the block
+#define EBM_INDEX(p, j, x) ((((j) + 1) * ((p)->nx + 2)) + (x) + 1)
+
+void ebm_init_params(ebm_params_t* p, model_initial_t* m, size_t global_nx,
+    size_t global_ny, size_t col0, size_t row0, size_t nx, size_t ny,
+    float polar_lat);
+void ebm_free_params(ebm_params_t* p);
+size_t ebm_halo_size(ebm_params_t* p);
+void ebm_wrap_columns(ebm_params_t* p, float* T);
+
+void ebm_orbit(float day, float* abra, float* delta);
+float ebm_insolation(float lat, float lon, float day_frac, float abra,
+    float delta);
+float ebm_insolation_daily(float lat, float abra, float delta);
+float ebm_albedo(float Ts, float lat, float a0, float a2, float ai);
+float ebm_f(float T);
+float ebm_diffusion_limit(model_initial_t* m, size_t nx, size_t ny,
+    float polar_lat);
+
+int ebm_polar_row(ebm_params_t* p, size_t j);
+void ebm_polar_filter(ebm_params_t* p, float lat, float* z);
+
+// polar rows leave their zonal second difference and diffusivity in zonal
+// (two floats per cell) instead of adding them to Tout, the caller filters
+// whole rows and adds them back with ebm_add_zonal
+void ebm_step_block(ebm_params_t* p, const float* Tin, float* Tout,
+    float* diag, float* zonal, size_t j0, size_t j1, size_t x0, size_t x1,
+    float year_frac, float day_frac, float dt, int daily_mean);
+void ebm_add_zonal(ebm_params_t* p, size_t j, const float* z,
+    const float* zonal, float* Tout, float* diag, float dt);
+
+#endif // _EBM_H
@@ -1,4 +1,5 @@
 #include "profile.h"
+#include "mem.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -37,5 +38,6 @@ void tick_profile(profile_t* profile, float delta, int frame_ctr) {
         max *= 1000.0f;
 
         printf("mean=%.3f min=%.3f max=%.3f\n", mean, min, max);
+        mem_report();
     }
 }
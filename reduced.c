@@ -0,0 +1,186 @@
+#include "reduced.h"
+#include "common.h"
+#include "renderutil.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+void init_reduced_kernel(reduced_kernel_t* kernel) {
+    kernel->step_program  = create_cshader("shader/reduced.cs");
+    kernel->remap_program = create_cshader("shader/remap.cs");
+    kernel->year_frac_l =
+        glGetUniformLocation(kernel->step_program, "year_frac");
+    kernel->day_frac_l =
+        glGetUniformLocation(kernel->step_program, "day_frac");
+    kernel->dt_l      = glGetUniformLocation(kernel->step_program, "dt");
+    kernel->n_cells_l = glGetUniformLocation(kernel->step_program, "n_cells");
+    kernel->n_rows_l  = glGetUniformLocation(kernel->step_program, "n_rows");
+    kernel->daily_mean_l =
+        glGetUniformLocation(kernel->step_program, "daily_mean");
+}
+
+// conservative average of one regular row over the fraction [u0, u1) of it
+static float row_average(float* field, size_t stride, size_t nx, float u0,
+    float u1) {
+    size_t x0 = (size_t) floorf(u0 * nx);
+    size_t x1 = (size_t) ceilf(u1 * nx);
+    if (x1 > nx) x1 = nx;
+
+    float sum = 0.0f;
+    float wsum = 0.0f;
+    for (size_t x = x0; x < x1; x++) {
+        float a = fmaxf(u0, (float) x / nx);
+        float b = fminf(u1, (float) (x + 1) / nx);
+        float w = fmaxf(b - a, 0.0f);
+        sum += w * field[x * stride];
+        wsum += w;
+    }
+    return sum / wsum;
+}
+
+void init_reduced_grid(reduced_grid_t* grid, size_t nx, size_t ny,
+    model_initial_t* initial, float* data) {
+    grid->nx = nx;
+    grid->ny = ny;
+    grid->current = 0;
+
+    // pick row lengths so cells stay roughly square
+    grid->nlon = (int*) malloc(ny * sizeof(int));
+    grid->offsets = (int*) malloc((ny + 1) * sizeof(int));
+    grid->offsets[0] = 0;
+    for (size_t y = 0; y < ny; y++) {
+        int n = (int) roundf(nx * cos(deg2rad(initial->lats[y])));
+        if (n < REDUCED_MIN_NLON) n = REDUCED_MIN_NLON;
+        if (n > (int) nx) n = nx;
+        grid->nlon[y] = n;
+        grid->offsets[y + 1] = grid->offsets[y] + n;
+    }
+    grid->n_cells = grid->offsets[ny];
+
+    // packed rows, parameters and initial state
+    int* rows = (int*) malloc(ny * 2 * sizeof(int));
+    float* params = (float*) mem_alloc(MEM_STAGING,
+        grid->n_cells * 8 * sizeof(float));
+    float* state = (float*) mem_alloc(MEM_STAGING,
+        grid->n_cells * 4 * sizeof(float));
+    float lon_west = initial->lons[0] - 0.5f * 360.0f / nx;
+    for (size_t y = 0; y < ny; y++) {
+        int n = grid->nlon[y];
+        rows[(y * 2) + 0] = grid->offsets[y];
+        rows[(y * 2) + 1] = n;
+
+        for (int k = 0; k < n; k++) {
+            size_t c = grid->offsets[y] + k;
+            float u0 = (float) k / n;
+            float u1 = (float) (k + 1) / n;
+            size_t r = y * nx;
+
+            params[(c * 8) + 0] = row_average(&initial->Bs[r], 1, nx, u0, u1);
+            params[(c * 8) + 1] = row_average(&initial->As[r], 1, nx, u0, u1);
+            params[(c * 8) + 2] = row_average(&initial->depths[r], 1, nx, u0, u1);
+            params[(c * 8) + 3] = initial->lats[y];
+            params[(c * 8) + 4] = row_average(&initial->a0s[r], 1, nx, u0, u1);
+            params[(c * 8) + 5] = row_average(&initial->a2s[r], 1, nx, u0, u1);
+            params[(c * 8) + 6] = row_average(&initial->ais[r], 1, nx, u0, u1);
+            params[(c * 8) + 7] = lon_west + 0.5f * (u0 + u1) * 360.0f;
+
+            for (size_t ch = 0; ch < 4; ch++) {
+                state[(c * 4) + ch] =
+                    row_average(&data[(r * 4) + ch], 4, nx, u0, u1);
+            }
+        }
+    }
+
+    // upload buffers
+    glGenBuffers(1, &grid->rows_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid->rows_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ny * 2 * sizeof(int), rows,
+        GL_STATIC_DRAW);
+    mem_track_buffer(grid->rows_buffer, ny * 2 * sizeof(int));
+    glGenBuffers(1, &grid->params_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid->params_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, grid->n_cells * 8 * sizeof(float),
+        params, GL_STATIC_DRAW);
+    mem_track_buffer(grid->params_buffer, grid->n_cells * 8 * sizeof(float));
+    glGenBuffers(2, grid->state_buffers);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid->state_buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+            grid->n_cells * 4 * sizeof(float), state, GL_DYNAMIC_COPY);
+        mem_track_buffer(grid->state_buffers[i],
+            grid->n_cells * 4 * sizeof(float));
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    free(rows);
+    mem_free(params);
+    mem_free(state);
+
+    // the zonal stencil limit scales with (cos(lat) * dlon)^2 per row
+    float worst_regular = 1e9f;
+    float worst_reduced = 1e9f;
+    for (size_t y = 0; y < ny; y++) {
+        float c = cos(deg2rad(initial->lats[y]));
+        float regular = c * (2.0f * pi / nx);
+        float reduced = c * (2.0f * pi / grid->nlon[y]);
+        if (regular < worst_regular) worst_regular = regular;
+        if (reduced < worst_reduced) worst_reduced = reduced;
+    }
+    printf("Reduced grid: %lu cells (%.1f%% of %lu), zonal dt limit x%.1f\n",
+        grid->n_cells, 100.0f * grid->n_cells / (nx * ny), nx * ny,
+        (worst_reduced * worst_reduced) / (worst_regular * worst_regular));
+}
+
+void reduced_grid_step(reduced_grid_t* grid, reduced_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt) {
+    // bind buffers and lookup tables
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0,
+        grid->state_buffers[grid->current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1,
+        grid->state_buffers[1 - grid->current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, grid->params_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, grid->rows_buffer);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, solar_LUT);
+    glActiveTexture(GL_TEXTURE0);
+
+    // dispatch compute shader
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+    glUseProgram(kernel->step_program);
+    glUniform1f(kernel->year_frac_l, year_frac);
+    glUniform1f(kernel->day_frac_l, day_frac);
+    glUniform1f(kernel->dt_l, dt);
+    glUniform1i(kernel->n_cells_l, (int) grid->n_cells);
+    glUniform1i(kernel->n_rows_l, (int) grid->ny);
+    glDispatchCompute((unsigned int) (grid->n_cells + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    grid->current = 1 - grid->current;
+}
+
+void reduced_grid_remap(reduced_grid_t* grid, reduced_kernel_t* kernel,
+    unsigned int T_texture, unsigned int diag_texture) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0,
+        grid->state_buffers[grid->current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, grid->rows_buffer);
+    glBindImageTexture(0, T_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+        GL_R32F);
+    glBindImageTexture(1, diag_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+        GL_RGBA16F);
+
+    glUseProgram(kernel->remap_program);
+    glDispatchCompute((unsigned int) grid->nx / 32,
+        (unsigned int) grid->ny / 32, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+void reduced_grid_free(reduced_grid_t* grid) {
+    mem_delete_buffers(1, &grid->rows_buffer);
+    mem_delete_buffers(1, &grid->params_buffer);
+    mem_delete_buffers(2, grid->state_buffers);
+    free(grid->nlon);
+    free(grid->offsets);
+}
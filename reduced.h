@@ -0,0 +1,37 @@
+#ifndef _REDUCED_H
+#define _REDUCED_H
+
+#include <stddef.h>
+#include "nctools.h"
+
+#define REDUCED_MIN_NLON 4
+
+// compiled reduced grid step and remap shaders
+typedef struct {
+    unsigned int step_program, remap_program;
+    unsigned int year_frac_l, day_frac_l, dt_l, n_cells_l, n_rows_l, daily_mean_l;
+} reduced_kernel_t;
+
+// packed row-offset layout, row j holds nlon[j] cells starting at offsets[j]
+typedef struct {
+    size_t nx, ny;
+    size_t n_cells;
+    int* nlon;
+    int* offsets;
+    unsigned int rows_buffer;
+    unsigned int params_buffer;
+    unsigned int state_buffers[2];
+    int current;
+} reduced_grid_t;
+
+void init_reduced_kernel(reduced_kernel_t* kernel);
+
+void init_reduced_grid(reduced_grid_t* grid, size_t nx, size_t ny,
+    model_initial_t* initial, float* data);
+void reduced_grid_step(reduced_grid_t* grid, reduced_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt);
+void reduced_grid_remap(reduced_grid_t* grid, reduced_kernel_t* kernel,
+    unsigned int T_texture, unsigned int diag_texture);
+void reduced_grid_free(reduced_grid_t* grid);
+
+#endif // _REDUCED_H
@@ -0,0 +1,199 @@
+#include "regrid.h"
+#include "common.h"
+#include "mem.h"
+#include "startup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define REGRID_CACHE_VERSION 1
+
+// the cache file starts with the grids it was made for
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t method;
+    uint32_t pad;
+    uint64_t key;
+    uint64_t src_nx, src_ny, dst_nx, dst_ny, nnz;
+} regrid_header_t;
+
+static const char* method_names[] = {
+    [REGRID_CONSERVATIVE] = "conservative", [REGRID_BILINEAR] = "bilinear"
+};
+
+// FNV-1a over everything that decides the weights
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*) data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t grid_key(regrid_method_t method, const float* lats,
+    const float* lons, size_t src_nx, size_t src_ny, size_t dst_nx,
+    size_t dst_ny) {
+    uint64_t dims[5] = { method, src_nx, src_ny, dst_nx, dst_ny };
+    uint64_t h = 14695981039346656037ULL;
+    h = hash_bytes(h, dims, sizeof(dims));
+    h = hash_bytes(h, lats, src_ny * sizeof(float));
+    return hash_bytes(h, lons, src_nx * sizeof(float));
+}
+
+
+static int load_weights(const char* path, regrid_weights_t* w) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    regrid_header_t h;
+    size_t n_dst = w->dst_nx * w->dst_ny;
+    if (fread(&h, sizeof(h), 1, file) != 1 ||
+        memcmp(h.magic, "GLRG", 4) != 0 ||
+        h.version != REGRID_CACHE_VERSION || h.method != w->method ||
+        h.key != w->key || h.src_nx != w->src_nx || h.src_ny != w->src_ny ||
+        h.dst_nx != w->dst_nx || h.dst_ny != w->dst_ny) {
+        printf("Warning: ignoring stale regrid weights in %s.\n", path);
+        fclose(file);
+        return 0;
+    }
+    w->row_start = (size_t*) mem_alloc(MEM_FIELDS,
+        (n_dst + 1) * sizeof(size_t));
+    w->cols = (uint32_t*) mem_alloc(MEM_FIELDS, h.nnz * sizeof(uint32_t));
+    w->weights = (float*) mem_alloc(MEM_FIELDS, h.nnz * sizeof(float));
+    int ok = fread(w->row_start, sizeof(size_t), n_dst + 1, file) ==
+            n_dst + 1 &&
+        fread(w->cols, sizeof(uint32_t), h.nnz, file) == h.nnz &&
+        fread(w->weights, sizeof(float), h.nnz, file) == h.nnz &&
+        w->row_start[n_dst] == h.nnz;
+    fclose(file);
+    if (!ok) {
+        printf("Warning: ignoring truncated regrid weights in %s.\n", path);
+        mem_free(w->row_start);
+        mem_free(w->cols);
+        mem_free(w->weights);
+        return 0;
+    }
+    return 1;
+}
+
+// written next to its final name and renamed, so concurrent runs never see
+// half a file
+static void save_weights(const char* cache_dir, const char* path,
+    regrid_weights_t* w) {
+    struct stat st = {0};
+    if (stat(cache_dir, &st) == -1) {
+        mkdir(cache_dir, 0777);
+    }
+    char tmp_path[4096 + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int) getpid());
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        printf("Warning: unable to cache regrid weights in %s.\n", cache_dir);
+        return;
+    }
+    size_t n_dst = w->dst_nx * w->dst_ny;
+    regrid_header_t h = {
+        .magic = { 'G', 'L', 'R', 'G' }, .version = REGRID_CACHE_VERSION,
+        .method = w->method, .pad = 0, .key = w->key,
+        .src_nx = w->src_nx, .src_ny = w->src_ny,
+        .dst_nx = w->dst_nx, .dst_ny = w->dst_ny, .nnz = w->row_start[n_dst]
+    };
+    int ok = fwrite(&h, sizeof(h), 1, file) == 1 &&
+        fwrite(w->row_start, sizeof(size_t), n_dst + 1, file) == n_dst + 1 &&
+        fwrite(w->cols, sizeof(uint32_t), h.nnz, file) == h.nnz &&
+        fwrite(w->weights, sizeof(float), h.nnz, file) == h.nnz;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        printf("Warning: unable to cache regrid weights in %s.\n", cache_dir);
+        remove(tmp_path);
+    }
+}
+
+
+// replace a source field with its remapped copy
+static float* remap_field(regrid_weights_t* w, float* src) {
+    float* dst = (float*) mem_alloc(MEM_FIELDS,
+        w->dst_nx * w->dst_ny * sizeof(float));
+    regrid_apply(w, src, dst);
+    mem_free(src);
+    return dst;
+}
+
+void regrid_input(char* path, size_t dst_nx, size_t dst_ny,
+    regrid_method_t method, const char* cache_dir, size_t* model_width,
+    size_t* model_height, model_initial_t* model) {
+    size_t src_nx, src_ny;
+    read_input_any(path, &src_nx, &src_ny, model);
+    if (model->time_varying) {
+        printf("Warning: regridded inputs only use the first time slice.\n");
+        model->time_varying = 0;
+    }
+
+    // the target grid spans the globe from the western edge of the input,
+    // with latitudes in the same order
+    double* src_lon_edges = (double*) malloc((src_nx + 1) * sizeof(double));
+    regrid_cell_edges(model->lons, src_nx, 360.0, src_lon_edges);
+    double west = fmin(src_lon_edges[0], src_lon_edges[src_nx]);
+    free(src_lon_edges);
+    int descending = src_ny > 1 && model->lats[src_ny - 1] < model->lats[0];
+    float* dst_lats = (float*) mem_alloc(MEM_FIELDS, dst_ny * sizeof(float));
+    float* dst_lons = (float*) mem_alloc(MEM_FIELDS, dst_nx * sizeof(float));
+    for (size_t j = 0; j < dst_ny; j++) {
+        float lat = ((float) j + 0.5f) / (float) dst_ny * 180.0f - 90.0f;
+        dst_lats[j] = descending ? -lat : lat;
+    }
+    for (size_t i = 0; i < dst_nx; i++) {
+        dst_lons[i] = (float) (west + ((double) i + 0.5) / dst_nx * 360.0);
+    }
+
+    regrid_weights_t w = {
+        .method = method, .src_nx = src_nx, .src_ny = src_ny,
+        .dst_nx = dst_nx, .dst_ny = dst_ny,
+        .key = grid_key(method, model->lats, model->lons, src_nx, src_ny,
+            dst_nx, dst_ny)
+    };
+    char cache_path[4096];
+    snprintf(cache_path, sizeof(cache_path), "%s/%s_%lux%lu_%lux%lu_%016llx.bin",
+        cache_dir, method_names[method], src_nx, src_ny, dst_nx, dst_ny,
+        (unsigned long long) w.key);
+
+    double t_start = startup_clock();
+    int cached = load_weights(cache_path, &w);
+    if (!cached) {
+        regrid_compute_weights(&w, model->lats, model->lons, dst_lats,
+            dst_lons);
+        save_weights(cache_dir, cache_path, &w);
+    }
+    double t_weights = startup_clock() - t_start;
+
+    t_start = startup_clock();
+    model->Ts     = remap_field(&w, model->Ts);
+    model->Bs     = remap_field(&w, model->Bs);
+    model->As     = remap_field(&w, model->As);
+    model->depths = remap_field(&w, model->depths);
+    model->a0s    = remap_field(&w, model->a0s);
+    model->a2s    = remap_field(&w, model->a2s);
+    model->ais    = remap_field(&w, model->ais);
+    double t_apply = startup_clock() - t_start;
+    mem_free(model->lats);
+    mem_free(model->lons);
+    model->lats = dst_lats;
+    model->lons = dst_lons;
+
+    printf("Regridded %lux%lu input to %lux%lu (%s, %lu weights %s in "
+        "%.3fs, applied in %.3fs)\n", src_nx, src_ny, dst_nx, dst_ny,
+        method_names[method], w.row_start[dst_nx * dst_ny],
+        cached ? "loaded" : "computed", t_weights, t_apply);
+    regrid_weights_free(&w);
+
+    *model_width = dst_nx;
+    *model_height = dst_ny;
+    model->zonally_symmetric = is_zonally_symmetric(model, dst_nx, dst_ny);
+}
@@ -0,0 +1,43 @@
+#ifndef _REGRID_H
+#define _REGRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "nctools.h"
+
+#define DEFAULT_REGRID_CACHE "regrid_cache"
+
+typedef enum {
+    REGRID_CONSERVATIVE,
+    REGRID_BILINEAR
+} regrid_method_t;
+
+// sparse remapping weights in CSR form, one row per target cell
+typedef struct {
+    regrid_method_t method;
+    size_t src_nx, src_ny, dst_nx, dst_ny;
+    uint64_t key;
+    size_t* row_start; // dst_nx * dst_ny + 1
+    uint32_t* cols;
+    float* weights;
+} regrid_weights_t;
+
+// read an input on any regular lat/lon grid and remap every field onto a
+// dst_nx x dst_ny grid spanning the globe. The weights are computed by
+// all cores the first time a pair of grids is seen and kept in cache_dir.
+void regrid_input(char* path, size_t dst_nx, size_t dst_ny,
+    regrid_method_t method, const char* cache_dir, size_t* model_width,
+    size_t* model_height, model_initial_t* model);
+
+// cell edges halfway between the centres of one axis, n + 1 of them
+void regrid_cell_edges(const float* c, size_t n, double span, double* edges);
+
+// fill the CSR arrays of w for its method and grid sizes, with a thread per
+// band of target rows
+void regrid_compute_weights(regrid_weights_t* w, const float* src_lats,
+    const float* src_lons, const float* dst_lats, const float* dst_lons);
+
+void regrid_apply(regrid_weights_t* w, const float* src, float* dst);
+void regrid_weights_free(regrid_weights_t* w);
+
+#endif // _REGRID_H
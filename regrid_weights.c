@@ -0,0 +1,332 @@
+#include "regrid.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// cell edges halfway between the centres, the outer ones half a spacing out
+void regrid_cell_edges(const float* c, size_t n, double span, double* edges) {
+    if (n == 1) {
+        edges[0] = c[0] - span / 2.0;
+        edges[1] = c[0] + span / 2.0;
+        return;
+    }
+    for (size_t k = 1; k < n; k++) {
+        edges[k] = 0.5 * ((double) c[k - 1] + c[k]);
+    }
+    edges[0] = c[0] - 0.5 * ((double) c[1] - c[0]);
+    edges[n] = c[n - 1] + 0.5 * ((double) c[n - 1] - c[n - 2]);
+}
+
+static double sin_deg(double x) {
+    return sin(x * M_PI / 180.0);
+}
+
+static double overlap(double a0, double a1, double b0, double b1) {
+    double lo = fmax(fmin(a0, a1), fmin(b0, b1));
+    double hi = fmin(fmax(a0, a1), fmax(b0, b1));
+    return (hi > lo) ? hi - lo : 0.0;
+}
+
+// longitudes wrap, so the source interval is tried a turn either way
+static double lon_overlap(double a0, double a1, double b0, double b1) {
+    double sum = 0.0;
+    for (int k = -2; k <= 2; k++) {
+        sum += overlap(a0, a1, b0 + 360.0 * k, b1 + 360.0 * k);
+    }
+    return sum;
+}
+
+// source index below x and the fraction of the way to the next one, in a
+// monotonic array of centres. Outside the centres the nearest one is used.
+static size_t bracket(const float* c, size_t n, double x, double* frac) {
+    if (n == 1) {
+        *frac = 0.0;
+        return 0;
+    }
+    double sign = (c[n - 1] > c[0]) ? 1.0 : -1.0;
+    x *= sign;
+    if (x <= sign * c[0]) {
+        *frac = 0.0;
+        return 0;
+    }
+    if (x >= sign * c[n - 1]) {
+        *frac = 1.0;
+        return n - 2;
+    }
+    size_t lo = 0, hi = n - 1;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (sign * c[mid] <= x) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    *frac = (x - sign * c[lo]) / (sign * c[lo + 1] - sign * c[lo]);
+    return lo;
+}
+
+// the weights of a band of target rows, built by one thread
+typedef struct {
+    size_t j0, j1;
+    size_t n, cap;
+    uint32_t* cols;
+    float* weights;
+    size_t* row_len;
+
+    // shared inputs
+    regrid_method_t method;
+    const float *src_lats, *src_lons, *dst_lats, *dst_lons;
+    const double *src_lat_edges, *dst_lat_edges;
+    const size_t* lon_start;
+    const uint32_t* lon_cols;
+    const double* lon_weights;
+    size_t src_nx, src_ny, dst_nx;
+} regrid_band_t;
+
+static void band_push(regrid_band_t* b, uint32_t col, float weight) {
+    if (b->n == b->cap) {
+        b->cap = (b->cap > 0) ? b->cap * 2 : 1024;
+        b->cols = (uint32_t*) mem_realloc(MEM_STAGING, b->cols,
+            b->cap * sizeof(uint32_t));
+        b->weights = (float*) mem_realloc(MEM_STAGING, b->weights,
+            b->cap * sizeof(float));
+    }
+    b->cols[b->n] = col;
+    b->weights[b->n] = weight;
+    b->n++;
+}
+
+// area weights are separable on regular grids, the overlap in sin(lat)
+// times the overlap in longitude
+static void conservative_row(regrid_band_t* b, size_t j, size_t* lat_rows,
+    double* lat_weights) {
+    double s0 = sin_deg(b->dst_lat_edges[j]);
+    double s1 = sin_deg(b->dst_lat_edges[j + 1]);
+    size_t n_rows = 0;
+    for (size_t sj = 0; sj < b->src_ny; sj++) {
+        double w = overlap(s0, s1, sin_deg(b->src_lat_edges[sj]),
+            sin_deg(b->src_lat_edges[sj + 1]));
+        if (w > 0.0) {
+            lat_rows[n_rows] = sj;
+            lat_weights[n_rows] = w;
+            n_rows++;
+        }
+    }
+
+    for (size_t i = 0; i < b->dst_nx; i++) {
+        size_t first = b->n;
+        double total = 0.0;
+        for (size_t r = 0; r < n_rows; r++) {
+            for (size_t k = b->lon_start[i]; k < b->lon_start[i + 1]; k++) {
+                double w = lat_weights[r] * b->lon_weights[k];
+                band_push(b, (uint32_t) (lat_rows[r] * b->src_nx +
+                    b->lon_cols[k]), (float) w);
+                total += w;
+            }
+        }
+
+        // cells the source does not fully cover are averaged over the part
+        // it does
+        if (total <= 0.0) {
+            printf("Error: target cell (%lu, %lu) does not overlap the "
+                "input grid.\n", i, j);
+            exit(3);
+        }
+        for (size_t k = first; k < b->n; k++) {
+            b->weights[k] = (float) (b->weights[k] / total);
+        }
+        b->row_len[(j - b->j0) * b->dst_nx + i] = b->n - first;
+    }
+}
+
+static void bilinear_row(regrid_band_t* b, size_t j) {
+    double fy;
+    size_t sj = bracket(b->src_lats, b->src_ny, b->dst_lats[j], &fy);
+    size_t sj1 = (b->src_ny > 1) ? sj + 1 : sj;
+    double lon0 = b->src_lons[0];
+    for (size_t i = 0; i < b->dst_nx; i++) {
+        // bring the target into the turn starting at the first centre, the
+        // last source cell then interpolates towards the first
+        double lon = fmod(b->dst_lons[i] - lon0, 360.0);
+        if (lon < 0.0) {
+            lon += 360.0;
+        }
+        lon += lon0;
+        double fx;
+        size_t si = bracket(b->src_lons, b->src_nx, lon, &fx);
+        size_t si1 = (si + 1) % b->src_nx;
+        if (b->src_nx > 1 && lon > b->src_lons[b->src_nx - 1]) {
+            si = b->src_nx - 1;
+            si1 = 0;
+            fx = (lon - b->src_lons[si]) / (lon0 + 360.0 - b->src_lons[si]);
+        }
+
+        size_t first = b->n;
+        band_push(b, sj * b->src_nx + si, (1.0 - fx) * (1.0 - fy));
+        band_push(b, sj * b->src_nx + si1, fx * (1.0 - fy));
+        band_push(b, sj1 * b->src_nx + si, (1.0 - fx) * fy);
+        band_push(b, sj1 * b->src_nx + si1, fx * fy);
+        b->row_len[(j - b->j0) * b->dst_nx + i] = b->n - first;
+    }
+}
+
+static void* band_main(void* arg) {
+    regrid_band_t* b = (regrid_band_t*) arg;
+    size_t* lat_rows = (size_t*) mem_alloc(MEM_STAGING,
+        b->src_ny * sizeof(size_t));
+    double* lat_weights = (double*) mem_alloc(MEM_STAGING,
+        b->src_ny * sizeof(double));
+    for (size_t j = b->j0; j < b->j1; j++) {
+        if (b->method == REGRID_CONSERVATIVE) {
+            conservative_row(b, j, lat_rows, lat_weights);
+        } else {
+            bilinear_row(b, j);
+        }
+    }
+    mem_free(lat_rows);
+    mem_free(lat_weights);
+    return NULL;
+}
+
+void regrid_compute_weights(regrid_weights_t* w, const float* src_lats,
+    const float* src_lons, const float* dst_lats, const float* dst_lons) {
+    double* src_lat_edges = (double*) mem_alloc(MEM_STAGING,
+        (w->src_ny + 1) * sizeof(double));
+    double* src_lon_edges = (double*) mem_alloc(MEM_STAGING,
+        (w->src_nx + 1) * sizeof(double));
+    double* dst_lat_edges = (double*) mem_alloc(MEM_STAGING,
+        (w->dst_ny + 1) * sizeof(double));
+    double* dst_lon_edges = (double*) mem_alloc(MEM_STAGING,
+        (w->dst_nx + 1) * sizeof(double));
+    regrid_cell_edges(src_lats, w->src_ny, 180.0, src_lat_edges);
+    regrid_cell_edges(src_lons, w->src_nx, 360.0, src_lon_edges);
+    regrid_cell_edges(dst_lats, w->dst_ny, 180.0, dst_lat_edges);
+    regrid_cell_edges(dst_lons, w->dst_nx, 360.0, dst_lon_edges);
+    for (size_t k = 0; k <= w->src_ny; k++) {
+        src_lat_edges[k] = fmin(fmax(src_lat_edges[k], -90.0), 90.0);
+    }
+
+    // the source columns overlapping every target column, shared by all
+    // the rows
+    size_t* lon_start = (size_t*) mem_alloc(MEM_STAGING,
+        (w->dst_nx + 1) * sizeof(size_t));
+    size_t lon_cap = w->dst_nx + w->src_nx + 2;
+    uint32_t* lon_cols = (uint32_t*) mem_alloc(MEM_STAGING,
+        lon_cap * sizeof(uint32_t));
+    double* lon_weights = (double*) mem_alloc(MEM_STAGING,
+        lon_cap * sizeof(double));
+    size_t n_lon = 0;
+    for (size_t i = 0; i < w->dst_nx; i++) {
+        lon_start[i] = n_lon;
+        for (size_t si = 0; si < w->src_nx; si++) {
+            double o = lon_overlap(dst_lon_edges[i], dst_lon_edges[i + 1],
+                src_lon_edges[si], src_lon_edges[si + 1]);
+            if (o <= 0.0) {
+                continue;
+            }
+            if (n_lon == lon_cap) {
+                lon_cap *= 2;
+                lon_cols = (uint32_t*) mem_realloc(MEM_STAGING, lon_cols,
+                    lon_cap * sizeof(uint32_t));
+                lon_weights = (double*) mem_realloc(MEM_STAGING, lon_weights,
+                    lon_cap * sizeof(double));
+            }
+            lon_cols[n_lon] = (uint32_t) si;
+            lon_weights[n_lon] = o;
+            n_lon++;
+        }
+    }
+    lon_start[w->dst_nx] = n_lon;
+
+    // bands of target rows, one per core
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_bands = (n_cpus > 1) ? (int) n_cpus : 1;
+    if ((size_t) n_bands > w->dst_ny) {
+        n_bands = (int) w->dst_ny;
+    }
+    regrid_band_t* bands = (regrid_band_t*) calloc(n_bands,
+        sizeof(regrid_band_t));
+    pthread_t* threads = (pthread_t*) malloc(n_bands * sizeof(pthread_t));
+    for (int k = 0; k < n_bands; k++) {
+        regrid_band_t* b = &bands[k];
+        b->j0 = w->dst_ny * k / n_bands;
+        b->j1 = w->dst_ny * (k + 1) / n_bands;
+        b->row_len = (size_t*) mem_alloc(MEM_STAGING,
+            (b->j1 - b->j0) * w->dst_nx * sizeof(size_t));
+        b->method = w->method;
+        b->src_lats = src_lats;
+        b->src_lons = src_lons;
+        b->dst_lats = dst_lats;
+        b->dst_lons = dst_lons;
+        b->src_lat_edges = src_lat_edges;
+        b->dst_lat_edges = dst_lat_edges;
+        b->lon_start = lon_start;
+        b->lon_cols = lon_cols;
+        b->lon_weights = lon_weights;
+        b->src_nx = w->src_nx;
+        b->src_ny = w->src_ny;
+        b->dst_nx = w->dst_nx;
+        if (pthread_create(&threads[k], NULL, band_main, b)) {
+            printf("Error: unable to start regrid thread.\n");
+            exit(1);
+        }
+    }
+
+    // stitch the bands together in row order
+    size_t n_dst = w->dst_nx * w->dst_ny;
+    size_t nnz = 0;
+    for (int k = 0; k < n_bands; k++) {
+        pthread_join(threads[k], NULL);
+        nnz += bands[k].n;
+    }
+    w->row_start = (size_t*) mem_alloc(MEM_FIELDS,
+        (n_dst + 1) * sizeof(size_t));
+    w->cols = (uint32_t*) mem_alloc(MEM_FIELDS, nnz * sizeof(uint32_t));
+    w->weights = (float*) mem_alloc(MEM_FIELDS, nnz * sizeof(float));
+    size_t row = 0, at = 0;
+    for (int k = 0; k < n_bands; k++) {
+        regrid_band_t* b = &bands[k];
+        memcpy(&w->cols[at], b->cols, b->n * sizeof(uint32_t));
+        memcpy(&w->weights[at], b->weights, b->n * sizeof(float));
+        for (size_t r = 0; r < (b->j1 - b->j0) * w->dst_nx; r++) {
+            w->row_start[row++] = at;
+            at += b->row_len[r];
+        }
+        mem_free(b->cols);
+        mem_free(b->weights);
+        mem_free(b->row_len);
+    }
+    w->row_start[n_dst] = at;
+
+    free(bands);
+    free(threads);
+    mem_free(src_lat_edges);
+    mem_free(src_lon_edges);
+    mem_free(dst_lat_edges);
+    mem_free(dst_lon_edges);
+    mem_free(lon_start);
+    mem_free(lon_cols);
+    mem_free(lon_weights);
+}
+
+void regrid_apply(regrid_weights_t* w, const float* src, float* dst) {
+    size_t n_dst = w->dst_nx * w->dst_ny;
+    for (size_t r = 0; r < n_dst; r++) {
+        float sum = 0.0f;
+        for (size_t k = w->row_start[r]; k < w->row_start[r + 1]; k++) {
+            sum += w->weights[k] * src[w->cols[k]];
+        }
+        dst[r] = sum;
+    }
+}
+
+void regrid_weights_free(regrid_weights_t* w) {
+    mem_free(w->row_start);
+    mem_free(w->cols);
+    mem_free(w->weights);
+}
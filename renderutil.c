@@ -1,15 +1,23 @@
 #include "renderutil.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "common.h"
 
-char* scanfilecontents(const char* name) {
+// directory shader paths are relative to, the working directory by default
+static char shader_root[256] = "";
+
+// NULL when the file cannot be read, with the reason printed
+static char* readfilecontents(const char* name) {
     FILE *fp;
     long lSize;
     char *buffer;
 
     fp = fopen ( name , "rb" );
-    if( !fp ) perror(name),exit(1);
+    if( !fp ) {
+        perror(name);
+        return NULL;
+    }
 
     fseek( fp , 0L , SEEK_END);
     lSize = ftell( fp );
@@ -17,19 +25,104 @@ char* scanfilecontents(const char* name) {
 
     /* allocate memory for entire content */
     buffer = (char*)calloc( 1, lSize+1 );
-    if( !buffer ) fclose(fp),fputs("memory alloc fails",stderr),exit(1);
+    if( !buffer ) {
+        fclose(fp),fputs("memory alloc fails\n",stderr);
+        return NULL;
+    }
 
     /* copy the file into the buffer */
-    if( 1!=fread( buffer , lSize, 1 , fp) )
-      fclose(fp),free(buffer),fputs("entire read fails",stderr),exit(1);
-
-    /* do your work here, buffer is a string contains the whole text */
+    if( lSize > 0 && 1!=fread( buffer , lSize, 1 , fp) ) {
+        fclose(fp),free(buffer),fputs("entire read fails\n",stderr);
+        return NULL;
+    }
 
     fclose(fp);
 
     return buffer;
 }
 
+char* scanfilecontents(const char* name) {
+    char* buffer = readfilecontents(name);
+    if (buffer == NULL) {
+        exit(1);
+    }
+    return buffer;
+}
+
+void set_shader_root(const char* root) {
+    if (root == NULL || root[0] == '\0') {
+        shader_root[0] = '\0';
+        return;
+    }
+    size_t len = strlen(root);
+    snprintf(shader_root, sizeof(shader_root), "%s%s", root,
+        (root[len - 1] == '/') ? "" : "/");
+}
+
+static const char* shader_path(const char* name, char* path, size_t size) {
+    if (name[0] == '/') {
+        return name;
+    }
+    snprintf(path, size, "%s%s", shader_root, name);
+    return path;
+}
+
+char* scanshadercontents(const char* name) {
+    char* source = readfilecontents(name);
+    if (source == NULL) {
+        return NULL;
+    }
+
+    // includes are resolved relative to the including file
+    char dir[256];
+    strncpy(dir, name, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char* slash = strrchr(dir, '/');
+    if (slash) {
+        *(slash + 1) = '\0';
+    } else {
+        dir[0] = '\0';
+    }
+
+    // splice the contents of every #include "file" line into the source
+    size_t len = strlen(source);
+    char* out = (char*) calloc(1, len + 1);
+    size_t out_len = 0;
+    char* line = source;
+    while (*line) {
+        char* end = strchr(line, '\n');
+        size_t line_len = end ? (size_t) (end - line) + 1 : strlen(line);
+
+        char inc[256];
+        if (sscanf(line, "#include \"%255[^\"]\"", inc) == 1) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s%s", dir, inc);
+            char* included = scanshadercontents(path);
+            if (included == NULL) {
+                free(out);
+                free(source);
+                return NULL;
+            }
+            size_t inc_len = strlen(included);
+            out = (char*) realloc(out, out_len + inc_len + len + 2);
+            memcpy(out + out_len, included, inc_len);
+            out_len += inc_len;
+            out[out_len++] = '\n';
+            free(included);
+        } else {
+            out = (char*) realloc(out, out_len + line_len + len + 1);
+            memcpy(out + out_len, line, line_len);
+            out_len += line_len;
+        }
+        out[out_len] = '\0';
+
+        line += line_len;
+    }
+
+    free(source);
+    return out;
+}
+
 void check_shader_compile_errors(unsigned int shader, char type) {
     GLint success;
 	GLchar infoLog[1024];
@@ -53,16 +146,22 @@ void check_shader_compile_errors(unsigned int shader, char type) {
 }
 
 unsigned int create_shader(const char* vs, const char* fs) {
-    const char* vertex_code = scanfilecontents(vs);
-    const char* fragment_code = scanfilecontents(fs);
+    char vs_path[512], fs_path[512];
+    char* vertex_code = scanshadercontents(
+        shader_path(vs, vs_path, sizeof(vs_path)));
+    char* fragment_code = scanshadercontents(
+        shader_path(fs, fs_path, sizeof(fs_path)));
+    if (vertex_code == NULL || fragment_code == NULL) {
+        exit(1);
+    }
 
     unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vertex_code, NULL);
+    glShaderSource(vertex, 1, (const char**) &vertex_code, NULL);
     glCompileShader(vertex);
     check_shader_compile_errors(vertex, 'V');
 
     unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
+    glShaderSource(fragment, 1, (const char**) &fragment_code, NULL);
     glCompileShader(fragment);
     check_shader_compile_errors(fragment, 'F');
 
@@ -75,16 +174,23 @@ unsigned int create_shader(const char* vs, const char* fs) {
 
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+    free(vertex_code);
+    free(fragment_code);
 
     return ID;
 }
 
-unsigned int create_cshader(const char* cs) {
-    const char* compute_code = scanfilecontents(cs);
+unsigned int load_cshader(const char* cs) {
+    char cs_path[512];
+    char* compute_code = scanshadercontents(
+        shader_path(cs, cs_path, sizeof(cs_path)));
+    if (compute_code == NULL) {
+        return 0;
+    }
 
     // compute shader
     unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(compute, 1, &compute_code, NULL);
+    glShaderSource(compute, 1, (const char**) &compute_code, NULL);
     glCompileShader(compute);
     check_shader_compile_errors(compute, 'C');
 
@@ -95,6 +201,33 @@ unsigned int create_cshader(const char* cs) {
     check_shader_compile_errors(ID, 'P');
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(compute);
+    free(compute_code);
+
+    GLint linked;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(ID);
+        return 0;
+    }
+    return ID;
+}
 
+unsigned int create_cshader(const char* cs) {
+    unsigned int ID = load_cshader(cs);
+    if (ID == 0) {
+        exit(1);
+    }
     return ID;
 }
+
+int shader_readable(const char* name) {
+    char path[512];
+    const char* full = shader_path(name, path, sizeof(path));
+    FILE* fp = fopen(full, "rb");
+    if (fp == NULL) {
+        perror(full);
+        return 0;
+    }
+    fclose(fp);
+    return 1;
+}
@@ -3,10 +3,20 @@
 
 char* scanfilecontents(const char* name);
 
+char* scanshadercontents(const char* name);
+
 void check_shader_compile_errors(unsigned int shader, char type);
 
 unsigned int create_shader(const char* vs, const char* fs);
 
+// 0 if the source cannot be read or the program does not link, the
+// library's way in. create_cshader exits instead.
+unsigned int load_cshader(const char* cs);
 unsigned int create_cshader(const char* cs);
 
+// relative to the shader root, prints why not
+int shader_readable(const char* name);
+
+void set_shader_root(const char* root);
+
 #endif
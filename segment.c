@@ -0,0 +1,184 @@
+#include "segment.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void init_segment_writer(segment_writer_t* seg, const char* output_path,
+    int every_frames, float every_years, size_t nx, size_t ny,
+    model_initial_t* initial) {
+    // out.nc becomes out.0000.nc, out.0001.nc, ... and out.index
+    snprintf(seg->base, sizeof(seg->base), "%s", output_path);
+    size_t len = strlen(seg->base);
+    if (len > 3 && strcmp(&seg->base[len - 3], ".nc") == 0) {
+        seg->base[len - 3] = '\0';
+    }
+    seg->every_frames = every_frames;
+    seg->every_years = every_years;
+    seg->nx = nx;
+    seg->ny = ny;
+    seg->initial = initial;
+    seg->n_segments = 0;
+    seg->t_start = 0.0;
+    seg->n_frames = 0;
+    seg->records = NULL;
+    seg->n_records = 0;
+    seg->records_cap = 0;
+    seg->job = NULL;
+    seg->running = 0;
+    seg->closed = 0;
+    seg->wait_seconds = 0.0;
+}
+
+int segment_writer_add(segment_writer_t* seg, double t) {
+    seg->n_frames++;
+    if (seg->every_frames > 0) {
+        return seg->n_frames >= seg->every_frames;
+    }
+    // boundaries are kept at whole multiples so segments do not drift
+    return t >= (seg->n_segments + 1) * seg->every_years * days_per_year -
+        1e-6;
+}
+
+// the index is replaced as a whole, so it always lists complete segments
+static void write_index(segment_writer_t* seg, int complete) {
+    char path[4096 + 16], tmp_path[4096 + 32];
+    snprintf(path, sizeof(path), "%s.index", seg->base);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        printf("Error: unable to write %s.\n", tmp_path);
+        exit(2);
+    }
+    fprintf(file, "# file start_day end_day frames\n");
+    for (int i = 0; i < seg->n_records; i++) {
+        segment_record_t* r = &seg->records[i];
+        fprintf(file, "%s %.6f %.6f %d\n", r->name, r->t_start, r->t_end,
+            r->n_frames);
+    }
+    if (complete) {
+        fprintf(file, "complete\n");
+    }
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        printf("Error: unable to write %s.\n", path);
+        exit(2);
+    }
+}
+
+// rename into place, drop the marker next to it and list it
+static void publish(segment_writer_t* seg, segment_job_t* job) {
+    if (rename(job->tmp_path, job->path) != 0) {
+        printf("Error: unable to publish %s.\n", job->path);
+        exit(2);
+    }
+    char marker[4096 + 32];
+    snprintf(marker, sizeof(marker), "%s.done", job->path);
+    FILE* file = fopen(marker, "w");
+    if (file == NULL) {
+        printf("Error: unable to write %s.\n", marker);
+        exit(2);
+    }
+    fclose(file);
+
+    if (seg->n_records == seg->records_cap) {
+        seg->records_cap = (seg->records_cap > 0) ? seg->records_cap * 2 : 16;
+        seg->records = (segment_record_t*) realloc(seg->records,
+            seg->records_cap * sizeof(segment_record_t));
+    }
+    seg->records[seg->n_records++] = job->record;
+    write_index(seg, 0);
+#ifndef REDUCED_OUTPUT
+    printf("Published %s (t=%.2f to %.2f days, %d frames)\n", job->path,
+        job->record.t_start, job->record.t_end, job->record.n_frames);
+#endif // REDUCED_OUTPUT
+}
+
+static void* writer_main(void* arg) {
+    segment_writer_t* seg = (segment_writer_t*) arg;
+    segment_job_t* job = seg->job;
+    model_storage_write(seg->nx, seg->ny, &job->model, seg->initial,
+        job->tmp_path);
+    model_storage_free(&job->model);
+    publish(seg, job);
+    return NULL;
+}
+
+// the previous segment has to be out before the next one is handed over
+static void wait_for_job(segment_writer_t* seg) {
+    if (!seg->running) {
+        return;
+    }
+    double t_start = glfwGetTime();
+    pthread_join(seg->thread, NULL);
+    seg->wait_seconds += glfwGetTime() - t_start;
+    free(seg->job);
+    seg->job = NULL;
+    seg->running = 0;
+}
+
+// take the frames out of model, leaving it empty for the next segment
+static segment_job_t* take_segment(segment_writer_t* seg,
+    model_storage_t* model, double t) {
+    segment_job_t* job = (segment_job_t*) malloc(sizeof(segment_job_t));
+    snprintf(job->path, sizeof(job->path), "%s.%04d.nc", seg->base,
+        seg->n_segments);
+    snprintf(job->tmp_path, sizeof(job->tmp_path), "%s.tmp", job->path);
+    const char* name = strrchr(job->path, '/');
+    snprintf(job->record.name, sizeof(job->record.name), "%s",
+        (name != NULL) ? name + 1 : job->path);
+    job->record.t_start = seg->t_start;
+    job->record.t_end = t;
+    job->record.n_frames = seg->n_frames;
+
+    job->model = *model;
+    init_model_storage(model, job->model.final_time, seg->nx, seg->ny);
+    model->timestep = job->model.timestep;
+    model->n_timesteps = job->model.n_timesteps;
+
+    seg->n_segments++;
+    seg->t_start = t;
+    seg->n_frames = 0;
+    return job;
+}
+
+void segment_writer_flush(segment_writer_t* seg, model_storage_t* model,
+    double t) {
+    wait_for_job(seg);
+    seg->job = take_segment(seg, model, t);
+    seg->running = 1;
+    if (pthread_create(&seg->thread, NULL, writer_main, seg)) {
+        printf("Error: unable to start segment writer thread.\n");
+        exit(1);
+    }
+}
+
+const char* segment_writer_finish(segment_writer_t* seg,
+    model_storage_t* model, double t) {
+    wait_for_job(seg);
+    seg->job = take_segment(seg, model, t);
+    model_storage_write(seg->nx, seg->ny, &seg->job->model, seg->initial,
+        seg->job->tmp_path);
+    model_storage_free(&seg->job->model);
+    return seg->job->tmp_path;
+}
+
+void segment_writer_close(segment_writer_t* seg, int complete) {
+    if (seg->closed) {
+        return;
+    }
+    seg->closed = 1;
+    wait_for_job(seg);
+
+    // a job left by segment_writer_finish is written but not published
+    if (seg->job != NULL) {
+        publish(seg, seg->job);
+        free(seg->job);
+        seg->job = NULL;
+    }
+    write_index(seg, complete);
+#ifndef REDUCED_OUTPUT
+    printf("Output in %d segments listed in %s.index, %.2fs spent waiting "
+        "for the writer\n", seg->n_records, seg->base, seg->wait_seconds);
+#endif // REDUCED_OUTPUT
+    free(seg->records);
+}
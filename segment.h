@@ -0,0 +1,68 @@
+#ifndef _SEGMENT_H
+#define _SEGMENT_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "nctools.h"
+
+// a published segment as listed in the index
+typedef struct {
+    char name[4096 + 16];
+    double t_start, t_end; // days
+    int n_frames;
+} segment_record_t;
+
+// the frames of a finished segment on their way to disk
+typedef struct {
+    model_storage_t model;
+    char tmp_path[4096 + 32];
+    char path[4096 + 16];
+    segment_record_t record;
+} segment_job_t;
+
+// output split into <base>.NNNN.nc files of every_frames frames or
+// every_years years. Each is written to a temporary name by a background
+// thread, renamed into place and marked with <file>.done, and then listed in
+// <base>.index, so readers never see a partial file.
+typedef struct {
+    char base[4096];
+    int every_frames;
+    float every_years;
+    size_t nx, ny;
+    model_initial_t* initial;
+
+    int n_segments;
+    double t_start;
+    int n_frames;
+
+    segment_record_t* records;
+    int n_records, records_cap;
+
+    segment_job_t* job; // in flight or waiting to be published (NULL = none)
+    int running;
+    pthread_t thread;
+    int closed;
+    double wait_seconds;
+} segment_writer_t;
+
+void init_segment_writer(segment_writer_t* seg, const char* output_path,
+    int every_frames, float every_years, size_t nx, size_t ny,
+    model_initial_t* initial);
+
+// count a frame just added to model, 1 when the segment is full
+int segment_writer_add(segment_writer_t* seg, double t);
+
+// hand the frames in model to the writer and start the next segment
+void segment_writer_flush(segment_writer_t* seg, model_storage_t* model,
+    double t);
+
+// write the last segment to its temporary name and return that, so whole
+// run series can be appended before segment_writer_close publishes it
+const char* segment_writer_finish(segment_writer_t* seg,
+    model_storage_t* model, double t);
+
+// publish what is left and write the index, marked complete if the run
+// reached its end
+void segment_writer_close(segment_writer_t* seg, int complete);
+
+#endif // _SEGMENT_H
@@ -0,0 +1,97 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// adjoint of forward.cs, takes the sensitivity to the state after a step back
+// to the state before it and accumulates the sensitivity to the parameters
+layout(r32f, binding = 0) uniform readonly image2D state;
+layout(r32f, binding = 1) uniform readonly image2D adjointIn;
+layout(r32f, binding = 2) uniform writeonly image2D adjointOut;
+layout(rgba32f, binding = 3) uniform image2D grad1; // A, B, depth
+layout(rgba32f, binding = 4) uniform image2D grad2; // a0, a2, ai
+layout(binding = 2) uniform sampler2D physp_LUT1;
+layout(binding = 3) uniform sampler2D physp_LUT2;
+// filtered zonal second difference of the polar rows and the filtered
+// K h lambda, from polar_linear.cs
+layout(rg32f, binding = 5) uniform readonly image2D zonalIn;
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float dt;
+layout(location = 2) uniform int daily_mean;
+layout(location = 3) uniform float day_frac;
+layout(location = 4) uniform ivec2 polar_rows;
+
+#include "physics.glsl"
+#include "linear.glsl"
+
+float cell_Q(vec4 p1) {
+    return (daily_mean != 0) ? calc_Q_daily(p1.r, year_frac) :
+        calc_Q(p1.r, p1.g, year_frac, day_frac);
+}
+
+// sensitivity flowing back from neighbour m through its stencil weight
+// w(m)[dir] towards this cell
+float neighbour_adjoint(ivec2 m, int dir, ivec2 size, float h) {
+    vec4 p1 = texelFetch(physp_LUT1, m, 0);
+    vec4 p2 = texelFetch(physp_LUT2, m, 0);
+    ebm_step_t st = calc_step_radiation(imageLoad(state, m).r, cell_Q(p1),
+        p1, p2, h);
+    vec3 w = calc_stencil(m.y, size, p1.r);
+    return imageLoad(adjointIn, m).r * st.K * h * w[dir];
+}
+
+void main() {
+    ivec2 c = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(state);
+    float h = dt * secs_per_day;
+
+    vec4 p1 = texelFetch(physp_LUT1, c, 0);
+    vec4 p2 = texelFetch(physp_LUT2, c, 0);
+    float Q = cell_Q(p1);
+    vec3 w = calc_stencil(c.y, size, p1.r);
+    float wz = w.z;
+    bool polar = calc_polar(c.y, size, polar_rows);
+    float zonal = 0.0;
+    if (polar) {
+        zonal = wz * imageLoad(zonalIn, c).r;
+        w.z = 0.0;
+    }
+
+    vec4 nbrs = vec4(imageLoad(state, ivec2(c.x, min(c.y + 1, size.y - 1))).r,
+                     imageLoad(state, ivec2(c.x, max(c.y - 1, 0))).r,
+                     imageLoad(state, ivec2((c.x + size.x - 1) % size.x, c.y)).r,
+                     imageLoad(state, ivec2((c.x + 1) % size.x, c.y)).r);
+    ebm_step_t st = calc_step(imageLoad(state, c).r, nbrs, w, zonal, Q, p1,
+        p2, h);
+    float dT_dx;
+    vec3 dT_dp1, dT_dp2;
+    calc_step_partials(st, w, Q, p1, p2, h, dT_dx, dT_dp1, dT_dp2);
+
+    // own cell
+    float lambda = imageLoad(adjointIn, c).r;
+    float adj = lambda * dT_dx;
+
+    // this cell is the southern neighbour of the row above, the northern
+    // neighbour of the row below, and an east/west neighbour in its row
+    if (c.y < size.y - 1) {
+        adj += neighbour_adjoint(ivec2(c.x, c.y + 1), 1, size, h);
+    }
+    if (c.y > 0) {
+        adj += neighbour_adjoint(ivec2(c.x, c.y - 1), 0, size, h);
+    }
+    ivec2 cw = ivec2((c.x + size.x - 1) % size.x, c.y);
+    ivec2 ce = ivec2((c.x + 1) % size.x, c.y);
+    if (polar) {
+        // the transpose of w.z P D2 is w.z D2 P
+        adj += wz * (imageLoad(zonalIn, cw).g + imageLoad(zonalIn, ce).g -
+            2 * imageLoad(zonalIn, c).g);
+    } else {
+        adj += neighbour_adjoint(cw, 2, size, h);
+        adj += neighbour_adjoint(ce, 2, size, h);
+    }
+    imageStore(adjointOut, c, vec4(adj, 0, 0, 0));
+
+    // parameters only act on their own cell
+    imageStore(grad1, c, imageLoad(grad1, c) + vec4(lambda * dT_dp1, 0));
+    imageStore(grad2, c, imageLoad(grad2, c) + vec4(lambda * dT_dp2, 0));
+}
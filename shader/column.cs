@@ -0,0 +1,54 @@
+#version 430 core
+
+layout(local_size_x = 1, local_size_y = 32, local_size_z = 1) in;
+
+// single column of a zonally symmetric model, one texel per latitude row
+layout(rgba32f, binding = 0) uniform readonly image2D stateIn;
+layout(rgba32f, binding = 1) uniform writeonly image2D stateOut;
+layout(binding = 2) uniform sampler2D physp_LUT1;
+layout(binding = 3) uniform sampler2D physp_LUT2;
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float dt;
+
+#include "physics.glsl"
+
+void main() {
+    int j = int(gl_GlobalInvocationID.y);
+    int n_rows = imageSize(stateIn).y;
+    vec2 uv = vec2(0.5, (float(j) + 0.5) / float(n_rows));
+
+    // Ts, dT/dt, Q, alpha
+    vec4 value = imageLoad(stateIn, ivec2(0, j));
+
+    vec4 physical_params = texture(physp_LUT1, uv);
+    float lat = physical_params.r;
+    float B   = physical_params.b;
+    float A   = physical_params.a;
+    vec4 alb_params = texture(physp_LUT2, uv);
+
+    // zonal mean insolation and albedo
+    float Q = calc_Q_daily(lat, year_frac);
+    float alpha = calc_albedo(value.r, lat, alb_params);
+    value.a = alpha;
+    value.b = Q;
+
+    // compute temperature
+    float C_val = calc_Cval(alb_params.a);
+    float OLR = calc_OLR(value.r, A, B);
+    float ASR = calc_ASR(alpha, Q);
+    value.r += calc_Ts(ASR, OLR, C_val) * dt * secs_per_day;
+
+    // meridional diffusion only, the zonal term vanishes
+    const float D = 0.555;
+    float f = calc_f(value.r);
+    float K = D / C_val * (1 + f);
+    float dphi = pi / float(n_rows);
+    float T_jm1 = (j > 0)          ? imageLoad(stateIn, ivec2(0, j - 1)).r : value.r;
+    float T_jp1 = (j < n_rows - 1) ? imageLoad(stateIn, ivec2(0, j + 1)).r : value.r;
+    value.g = calc_merid_diffusion(T_jm1, value.r, T_jp1, deg2rad(lat), dphi,
+        j > 0, j < n_rows - 1, K);
+    value.r += value.g * dt * secs_per_day;
+
+    imageStore(stateOut, ivec2(0, j), value);
+}
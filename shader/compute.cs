@@ -2,86 +2,47 @@
 
 layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
 
-layout(rgba32f, binding = 0) uniform image2D stateOut;
-layout(binding = 1) uniform sampler2D insol_LUT;
-layout(binding = 2) uniform sampler2D physp_LUT1;
-layout(binding = 3) uniform sampler2D physp_LUT2;
-
-layout(location = 0) uniform float t;
+// prognostic Ts is ping-ponged at full precision, the diagnostics (dT/dt in
+// K/day, Q, albedo) are only written at half precision when asked for
+layout(r32f, binding = 0) uniform readonly image2D stateIn;
+layout(r32f, binding = 1) uniform writeonly image2D stateOut;
+layout(rgba16f, binding = 2) uniform writeonly image2D diagOut;
+// zonal tendency of the polar rows and the diffusivity scale (1 + f) / C it
+// carries, added by the polar filter pass instead
+layout(rg32f, binding = 3) uniform writeonly image2D zonalOut;
+// radiative tendency, (1 + f) / C, Q and albedo cached by slow.cs, only read
+// when multirate is set
+layout(rgba32f, binding = 4) uniform readonly image2D slowIn;
+
+layout(location = 0) uniform float year_frac;
 layout(location = 1) uniform float dt;
+layout(location = 2) uniform int daily_mean;
+layout(location = 3) uniform int write_diag;
+layout(location = 4) uniform float day_frac;
+layout(location = 6) uniform ivec2 polar_rows; // filtered rows at each end
+uniform int multirate;
 
-// physical constants
-const float pi            =     3.14159265;
-const float days_per_year =   365.2422f;
-const float secs_per_day  = 86400.0f;
-const float Re            =     6.373e6f;
-const float Rd            =   287.0;
-const float Rv            =   461.5;
-const float Lh_vap        =     2.5e6;
-const float gas_cp        =  1004.0;
-const float eps = Rd / Rv;
-
-// albedo parameters
-const float Tf = 263.15f;
-
-float deg2rad(float x) {
-    return pi / 180.0f * x;
-}
-
-float calcP2(float x) {
-    return 0.5 * (3 * x * x - 1.0);
-}
+#include "physics.glsl"
+#include "params.glsl"
 
 float calc_Cval(vec2 uv) {
-    return 4181.3 * 1.0e3 * texture(physp_LUT2, uv).a;
-}
-
-float calc_Q(float lat, float lon, float day) {
-    vec2 coord  = vec2(day / days_per_year, (lat + 90.0f) / 180.0f);
-    vec4 soldat = texture(insol_LUT, coord); // 0.0f, S0*b2/a2, 0.0f, delta
-
-    float phi    = deg2rad(lat);
-    float h      = (mod((mod(day, 1.0) + (lon / 360)), 1.0) - 0.5) * 2 * pi;
-    float coszen = sin(phi)*sin(soldat.g) + cos(phi)*cos(soldat.g)*cos(h);
-    float Fsw    = soldat.r * coszen;
-    Fsw          = Fsw * float(Fsw > 0);
-
-    return Fsw;
+    return calc_Cval(params2(uv).a);
 }
 
 float calc_albedo(float Ts, float lat, vec2 uv) {
-    // a0 = r, a2 = g, ai = b
-    vec4 alb_params = texture(physp_LUT2, uv);
-    float phi = deg2rad(lat);
-    float is_freezing = float(Tf > Ts);
-    float albedo = 0;
-    albedo += is_freezing * alb_params.b;
-    albedo += (1 - is_freezing) * (alb_params.r + alb_params.g * calcP2(phi));
-    return albedo;
-}
-
-float calc_OLR(float Ts, float olr_A, float olr_B) {
-    return olr_A + (olr_B * (Ts - 273.15));
-}
-
-float calc_ASR(float albedo, float Q) {
-    return (1 - albedo) * Q;
-}
-
-float calc_Ts(float ASR, float OLR, float C) {
-    return (1 / C) * (ASR - OLR);
+    return calc_albedo(Ts, lat, params2(uv), freezing_T);
 }
 
-vec4 calc_merid_advdiff(vec4 N, ivec2 coord, float lat, float C, float f) {
-    const float D = 0.555;
-    ivec2 imgsize = imageSize(stateOut);
+float calc_merid_advdiff(float N, ivec2 coord, float lat, float C, float f) {
+    float D = diffusivity;
+    ivec2 imgsize = imageSize(stateIn);
 
     float phi = deg2rad(lat);
     float dphi = pi / float(gl_NumWorkGroups.y * gl_WorkGroupSize.y);
     float dy = Re * dphi;
 
-    vec4 N_im1   = imageLoad(stateOut, coord + ivec2(0, -1));
-    vec4 N_ip1   = imageLoad(stateOut, coord + ivec2(0,  1));
+    float N_im1  = imageLoad(stateIn, coord + ivec2(0, -1)).r;
+    float N_ip1  = imageLoad(stateIn, coord + ivec2(0,  1)).r;
 
     float X_i    = phi * Re;
     float X_ip1  = X_i + dy;
@@ -114,13 +75,15 @@ vec4 calc_merid_advdiff(vec4 N, ivec2 coord, float lat, float C, float f) {
     return (Tl * N_im1 + Tm * N + Tu * N_ip1) + S_i;
 }
 
-vec4 calc_zonal_advdiff(vec4 N, ivec2 coord, float lon, float C, float f) {
-    const float D = 0.555;
-    ivec2 imgsize = imageSize(stateOut);
+float calc_zonal_advdiff(float N, ivec2 coord, float lat, float lon, float C,
+    float f) {
+    float D = diffusivity;
+    ivec2 imgsize = imageSize(stateIn);
 
+    // cells get narrower towards the poles
     float phi = deg2rad(lon);
     float dphi = (2 * pi) / float(gl_NumWorkGroups.x * gl_WorkGroupSize.x);
-    float dy = Re * dphi;
+    float dy = Re * cos(deg2rad(lat)) * dphi;
 
     ivec2 com1   = coord + ivec2(-1, 0) + imgsize;
     com1.x = com1.x % imgsize.x;
@@ -128,8 +91,8 @@ vec4 calc_zonal_advdiff(vec4 N, ivec2 coord, float lon, float C, float f) {
     ivec2 cop1   = coord + ivec2( 1, 0) + imgsize;
     cop1.x = cop1.x % imgsize.x;
     cop1.y = cop1.y % imgsize.y;
-    vec4 N_im1   = imageLoad(stateOut, com1);
-    vec4 N_ip1   = imageLoad(stateOut, cop1);
+    float N_im1  = imageLoad(stateIn, com1).r;
+    float N_ip1  = imageLoad(stateIn, cop1).r;
 
     float X_i    = phi * Re;
     float X_ip1  = X_i + dy;
@@ -162,70 +125,70 @@ vec4 calc_zonal_advdiff(vec4 N, ivec2 coord, float lon, float C, float f) {
     return (Tl * N_im1 + Tm * N + Tu * N_ip1) + S_i;
 }
 
-float calc_clausius_clapeyron(float T) {
-    float Tcel = T - 273.15;
-    return 6.112 * exp(17.67 * Tcel / (Tcel + 243.5));
-}
-
-float calc_qsat(float T, float P) {
-    // T in Kelvin
-    // P in hPa or mb
-    float es = calc_clausius_clapeyron(T);
-    return eps * es / (P - (1 - eps) * es);
-}
-
-float calc_f(float T) {
-    // could be an input later
-    const float RH     = 0.8f;
-    const float deltaT = 0.01;
-
-    float dqsdTs = (calc_qsat(T + deltaT / 2.0f, 1000.0) - calc_qsat(T - deltaT / 2.0f, 1000.0)) / deltaT;
-
-    return Lh_vap * RH * dqsdTs / gas_cp;
-}
-
 void main() {
     ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
     vec2 uv = vec2(gl_GlobalInvocationID.x + 0.5, gl_GlobalInvocationID.y + 0.5) /
         vec2(float(gl_NumWorkGroups.x * gl_WorkGroupSize.x), float(gl_NumWorkGroups.y * gl_WorkGroupSize.y));
-    // Ts, q, alpha, Q
-    //  r, g,     b, a
-    vec4 value = imageLoad(stateOut, texelCoord);
+    float Ts = imageLoad(stateIn, texelCoord).r;
+    float Ts_in = Ts;
 
     // coordinates
-    float day = t; //mod(t, days_per_year);
-    vec4 physical_params = texture(physp_LUT1, uv);
+    vec4 physical_params = params1(uv);
     float lat = physical_params.r;
     float lon = physical_params.g;
     float B   = physical_params.b;
     float A   = physical_params.a;
 
-    // compute instant insolation
-    float Q = calc_Q(lat, lon, day);
-
-    // compute albedo
-    float alpha = calc_albedo(value.r, lat, uv);
-
-    // emit albedo as a and insol as b
-    value.a = alpha;
-    value.b = Q;
-
-    // calculate water depth
-    float C_val = calc_Cval(uv);
-
-    // compute temperature
-    float OLR = calc_OLR(value.r, A, B);
-    float ASR = calc_ASR(alpha, Q);
-    value.r += calc_Ts(ASR, OLR, C_val) * dt * secs_per_day;
-
-    // compute moist ampl factor
-    float f = calc_f(value.r);
+    float Q, alpha, C_val, f;
+    if (multirate != 0) {
+        // only the diffusion is stepped, the stencils need no more than
+        // the cached (1 + f) / C
+        vec4 slow = imageLoad(slowIn, texelCoord);
+        Q = slow.b;
+        alpha = slow.a;
+        Ts += slow.r * dt * secs_per_day;
+        C_val = 1 / slow.g;
+        f = 0;
+    } else {
+        // compute instant (or daily mean) insolation
+        Q = (daily_mean != 0) ? calc_Q_daily(lat, year_frac) :
+            calc_Q(lat, lon, year_frac, day_frac);
+        Q *= solar_constant / S0;
+
+        // compute albedo
+        alpha = calc_albedo(Ts, lat, uv);
+
+        // calculate water depth
+        C_val = calc_Cval(uv);
+
+        // compute temperature
+        float OLR = calc_OLR(Ts, A, B);
+        float ASR = calc_ASR(alpha, Q);
+        Ts += calc_Ts(ASR, OLR, C_val) * dt * secs_per_day;
+
+        // compute moist ampl factor
+        f = calc_f(Ts);
+    }
 
     // adv diff
-    float dTdt_merid = calc_merid_advdiff(value, texelCoord, lat, C_val, f).r;
-    float dTdt_zonal = calc_zonal_advdiff(value, texelCoord, lon, C_val, f).r;
-    value.g = dTdt_merid + dTdt_zonal;
-    value.r += (dTdt_merid + dTdt_zonal) * dt * secs_per_day;
-
-    imageStore(stateOut, texelCoord, value);
+    float dTdt_merid = calc_merid_advdiff(Ts, texelCoord, lat, C_val, f);
+    bool polar = texelCoord.y < polar_rows.x ||
+        texelCoord.y >= imageSize(stateIn).y - polar_rows.y;
+    // the polar filter needs a plain second difference, whose row mean is
+    // zero, so the polar rows take it before the radiative update
+    float dTdt_zonal = calc_zonal_advdiff(polar ? Ts_in : Ts, texelCoord, lat,
+        lon, C_val, f);
+    if (polar) {
+        Ts += dTdt_merid * dt * secs_per_day;
+        imageStore(zonalOut, texelCoord,
+            vec4(dTdt_zonal, (1 + f) / C_val, 0, 0));
+    } else {
+        Ts += (dTdt_merid + dTdt_zonal) * dt * secs_per_day;
+    }
+
+    imageStore(stateOut, texelCoord, vec4(Ts, 0, 0, 0));
+    if (write_diag != 0) {
+        imageStore(diagOut, texelCoord,
+            vec4((dTdt_merid + dTdt_zonal) * secs_per_day, Q, alpha, 0));
+    }
 }
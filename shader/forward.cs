@@ -0,0 +1,50 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// differentiable forward step for the adjoint, see linear.glsl
+layout(r32f, binding = 0) uniform readonly image2D stateIn;
+layout(r32f, binding = 1) uniform writeonly image2D stateOut;
+layout(binding = 2) uniform sampler2D physp_LUT1;
+layout(binding = 3) uniform sampler2D physp_LUT2;
+// filtered zonal second difference of the polar rows, from polar_linear.cs
+layout(rg32f, binding = 5) uniform readonly image2D zonalIn;
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float dt;
+layout(location = 2) uniform int daily_mean;
+layout(location = 3) uniform float day_frac;
+layout(location = 4) uniform ivec2 polar_rows;
+
+#include "physics.glsl"
+#include "linear.glsl"
+
+// (north, south, west, east), clamped at the poles where they carry no weight
+vec4 load_neighbours(ivec2 c, ivec2 size) {
+    return vec4(imageLoad(stateIn, ivec2(c.x, min(c.y + 1, size.y - 1))).r,
+                imageLoad(stateIn, ivec2(c.x, max(c.y - 1, 0))).r,
+                imageLoad(stateIn, ivec2((c.x + size.x - 1) % size.x, c.y)).r,
+                imageLoad(stateIn, ivec2((c.x + 1) % size.x, c.y)).r);
+}
+
+void main() {
+    ivec2 c = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(stateIn);
+
+    vec4 p1 = texelFetch(physp_LUT1, c, 0);
+    vec4 p2 = texelFetch(physp_LUT2, c, 0);
+    float Q = (daily_mean != 0) ? calc_Q_daily(p1.r, year_frac) :
+        calc_Q(p1.r, p1.g, year_frac, day_frac);
+
+    vec3 w = calc_stencil(c.y, size, p1.r);
+    float zonal = 0.0;
+    if (calc_polar(c.y, size, polar_rows)) {
+        zonal = w.z * imageLoad(zonalIn, c).r;
+        w.z = 0.0;
+    }
+
+    ebm_step_t st = calc_step(imageLoad(stateIn, c).r, load_neighbours(c, size),
+        w, zonal, Q, p1, p2, dt * secs_per_day);
+
+    imageStore(stateOut, c, vec4(st.T, 0, 0, 0));
+}
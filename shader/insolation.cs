@@ -0,0 +1,46 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// insolation table for one set of orbital parameters, the same layout as
+// make_solar_table: columns are days of the year, every row holds
+// S0 * (b/a)^2 and the declination
+layout(rgba32f, binding = 0) uniform writeonly image2D insolOut;
+
+uniform float ecc;
+uniform float obliquity; // degrees
+uniform float long_peri; // degrees
+
+#include "physics.glsl"
+
+// process/solar.c
+float solar_lon(float ecc, float long_peri_rad, float day) {
+    float delta_lambda = (day - 80.0f) * 2 * pi / days_per_year;
+    float ecc2 = ecc * ecc;
+    float ecc3 = ecc2 * ecc;
+    float beta = sqrt(1 - ecc2);
+    float lambda_long_m = -2.0f * ((ecc/2.0f + ecc3/8.0f ) * (1.0f+beta) * sin(-long_peri_rad) -
+        (ecc2/4.0f) * (0.5f + beta) * sin(-2.0f*long_peri_rad) + (ecc3/8.0f) *
+        (0.333333333f + beta) * sin(-3*long_peri_rad)) + delta_lambda;
+    return lambda_long_m + (2*ecc - (ecc3/4.0f))*sin(lambda_long_m - long_peri_rad) +
+        (1.25f*ecc2) * sin(2*(lambda_long_m - long_peri_rad)) + (1.08333333333f*ecc3)
+        * sin(3.0f*(lambda_long_m - long_peri_rad));
+}
+
+float a2_b2_ratio(float ecc, float lambda_long, float long_peri_rad) {
+    float a1 = (1-ecc*ecc);
+    float b1 = (1+ecc*cos(lambda_long - long_peri_rad));
+    return S0 * (b1 * b1) / (a1 * a1);
+}
+
+void main() {
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    float day = float(coord.x) / float(imageSize(insolOut).x) * days_per_year;
+
+    float long_peri_rad = deg2rad(long_peri);
+    float slon = solar_lon(ecc, long_peri_rad, day);
+    float abra = a2_b2_ratio(ecc, slon, long_peri_rad);
+    float delta = asin(sin(deg2rad(obliquity)) * sin(slon));
+
+    imageStore(insolOut, coord, vec4(abra, delta, 0, 0));
+}
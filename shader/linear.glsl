@@ -0,0 +1,113 @@
+// differentiable form of one model step, shared by forward.cs, tangent.cs
+// and adjoint.cs. included after physics.glsl.
+//
+// the step matches compute.cs except that neighbours are always taken from
+// the previous state and the freezing step in the albedo is smoothed over a
+// few kelvin so that it has a usable derivative. As there, the zonal
+// diffusion of the polar rows is filtered, see polar_linear.cs.
+
+const float D_diff       = 0.555;
+const float albedo_width = 2.0f; // K
+
+// fraction of the cell treated as frozen, 1 well below Tf and 0 well above
+float calc_ice_fraction(float Ts) {
+    return 0.5 * (1.0 - tanh((Ts - Tf) / albedo_width));
+}
+
+float calc_ice_fraction_dT(float Ts) {
+    float th = tanh((Ts - Tf) / albedo_width);
+    return -0.5 * (1.0 - th * th) / albedo_width;
+}
+
+float calc_albedo_smooth(float Ts, float lat, vec4 alb_params) {
+    float s = calc_ice_fraction(Ts);
+    float open = alb_params.r + alb_params.g * calcP2(deg2rad(lat));
+    return s * alb_params.b + (1 - s) * open;
+}
+
+float calc_f_dT(float T) {
+    const float delta = 0.05;
+    return (calc_f(T + delta) - calc_f(T - delta)) / (2 * delta);
+}
+
+// diffusion weights towards the north, south and east/west neighbours of
+// row j, in 1/radian^2, with no flux through the poles. cells get narrower
+// towards the poles.
+vec3 calc_stencil(int j, ivec2 size, float lat) {
+    float phi  = deg2rad(lat);
+    float dphi = pi / float(size.y);
+    float dlam = (2 * pi) / float(size.x);
+    float W    = cos(phi) * dphi * dphi;
+    return vec3(cos(phi + (dphi / 2)) * float(j < size.y - 1) / W,
+                cos(phi - (dphi / 2)) * float(j > 0) / W,
+                1.0 / (cos(phi) * cos(phi) * dlam * dlam));
+}
+
+// polar_rows holds the number of filtered rows at each end
+bool calc_polar(int j, ivec2 size, ivec2 polar_rows) {
+    return j < polar_rows.x || j >= size.y - polar_rows.y;
+}
+
+// intermediate values of a step, p1 = (lat, lon, B, A), p2 = (a0, a2, ai,
+// depth) as in the parameter LUTs
+struct ebm_step_t {
+    float x;    // temperature before the step
+    float R;    // net radiation at x
+    float y;    // temperature after the radiative update
+    float C, K;
+    float L;    // stencil applied to y and the neighbours, plus zonal
+    float T;    // temperature after the step
+};
+
+// temperature after the radiative update, and the diffusivity it implies
+ebm_step_t calc_step_radiation(float x, float Q, vec4 p1, vec4 p2, float h) {
+    ebm_step_t st;
+    st.x = x;
+    st.C = calc_Cval(p2.a);
+    float alpha = calc_albedo_smooth(x, p1.r, p2);
+    st.R = calc_ASR(alpha, Q) - calc_OLR(x, p1.a, p1.b);
+    st.y = x + st.R * h / st.C;
+    st.K = D_diff / st.C * (1 + calc_f(st.y));
+    return st;
+}
+
+// full step, nbrs = (north, south, west, east) temperatures. polar rows pass
+// w.z = 0 and their filtered zonal second difference of x, times the old
+// w.z, as zonal, which is 0 elsewhere.
+ebm_step_t calc_step(float x, vec4 nbrs, vec3 w, float zonal, float Q,
+    vec4 p1, vec4 p2, float h) {
+    ebm_step_t st = calc_step_radiation(x, Q, p1, p2, h);
+    st.L = w.x * (nbrs.x - st.y) + w.y * (nbrs.y - st.y) +
+           w.z * (nbrs.z + nbrs.w - 2 * st.y) + zonal;
+    st.T = st.y + st.K * st.L * h;
+    return st;
+}
+
+// derivatives of st.T with respect to the cell's own previous temperature
+// (dT_dx), and to (A, B, depth) and (a0, a2, ai). the derivative with respect
+// to a neighbour is st.K * h times its stencil weight. the filtered zonal
+// term of a polar row is linear in the row of x and is left to the caller.
+void calc_step_partials(ebm_step_t st, vec3 w, float Q, vec4 p1, vec4 p2,
+    float h, out float dT_dx, out vec3 dT_dp1, out vec3 dT_dp2) {
+    float s    = calc_ice_fraction(st.x);
+    float P2   = calcP2(deg2rad(p1.r));
+    float open = p2.r + p2.g * P2;
+
+    // through the radiative update
+    float dalpha_dx = calc_ice_fraction_dT(st.x) * (p2.b - open);
+    float dy_dx = 1 + (-dalpha_dx * Q - p1.b) * h / st.C;
+
+    // through diffusion, K depends on y via the moist amplification
+    float dK_dy = D_diff / st.C * calc_f_dT(st.y);
+    float dT_dy = 1 + h * (dK_dy * st.L - st.K * (w.x + w.y + 2 * w.z));
+    dT_dx = dT_dy * dy_dx;
+
+    float g = dT_dy * h / st.C;
+    float dC_ddepth = calc_Cval(1.0);
+    dT_dp1 = vec3(-g,
+                  -g * (st.x - 273.15),
+                  (-g * st.R / st.C - h * st.L * st.K / st.C) * dC_ddepth);
+    dT_dp2 = vec3(-g * (1 - s) * Q,
+                  -g * (1 - s) * P2 * Q,
+                  -g * s * Q);
+}
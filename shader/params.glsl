@@ -0,0 +1,23 @@
+// parameter LUTs and the constants that can be changed while running,
+// included after #version. The parameters of the next forcing slice are
+// blended in by forcing_w.
+
+layout(binding = 2) uniform sampler2D physp_LUT1;
+layout(binding = 3) uniform sampler2D physp_LUT2;
+layout(binding = 4) uniform sampler2D forcing_LUT1;
+layout(binding = 5) uniform sampler2D forcing_LUT2;
+
+uniform float forcing_w;
+uniform float diffusivity = 0.555; // D (W/m^2/K)
+uniform float freezing_T = 263.15; // albedo is ai below this (K)
+uniform float solar_constant = 1365.2; // insolation is scaled by this / S0
+
+vec4 params1(vec2 uv) {
+    vec4 p = texture(physp_LUT1, uv);
+    return (forcing_w > 0) ? mix(p, texture(forcing_LUT1, uv), forcing_w) : p;
+}
+
+vec4 params2(vec2 uv) {
+    vec4 p = texture(physp_LUT2, uv);
+    return (forcing_w > 0) ? mix(p, texture(forcing_LUT2, uv), forcing_w) : p;
+}
@@ -0,0 +1,116 @@
+// shared physics for the compute kernels, included after #version
+
+layout(binding = 1) uniform sampler2D insol_LUT;
+
+// physical constants
+const float pi            =     3.14159265;
+const float days_per_year =   365.2422f;
+const float secs_per_day  = 86400.0f;
+const float Re            =     6.373e6f;
+const float Rd            =   287.0;
+const float Rv            =   461.5;
+const float Lh_vap        =     2.5e6;
+const float gas_cp        =  1004.0;
+const float eps = Rd / Rv;
+const float S0            =  1365.2f; // the insolation LUT is made with this
+
+// albedo parameters
+const float Tf = 263.15f;
+
+float deg2rad(float x) {
+    return pi / 180.0f * x;
+}
+
+float calcP2(float x) {
+    return 0.5 * (3 * x * x - 1.0);
+}
+
+float calc_Cval(float depth) {
+    return 4181.3 * 1.0e3 * depth;
+}
+
+// the time of year and time of day come in as fractions in [0, 1), reduced on
+// the host in double precision so the cycles keep their phase on long runs
+float calc_Q(float lat, float lon, float year_frac, float day_frac) {
+    vec2 coord  = vec2(year_frac, (lat + 90.0f) / 180.0f);
+    vec4 soldat = texture(insol_LUT, coord); // 0.0f, S0*b2/a2, 0.0f, delta
+
+    float phi    = deg2rad(lat);
+    float h      = (mod(day_frac + (lon / 360), 1.0) - 0.5) * 2 * pi;
+    float coszen = sin(phi)*sin(soldat.g) + cos(phi)*cos(soldat.g)*cos(h);
+    float Fsw    = soldat.r * coszen;
+    Fsw          = Fsw * float(Fsw > 0);
+
+    return Fsw;
+}
+
+// zonal mean of calc_Q, i.e. the daily mean insolation at this latitude
+float calc_Q_daily(float lat, float year_frac) {
+    vec2 coord  = vec2(year_frac, (lat + 90.0f) / 180.0f);
+    vec4 soldat = texture(insol_LUT, coord);
+
+    float phi = deg2rad(lat);
+    float h0  = acos(clamp(-tan(phi) * tan(soldat.g), -1.0, 1.0));
+    return soldat.r / pi * (h0 * sin(phi) * sin(soldat.g) +
+        cos(phi) * cos(soldat.g) * sin(h0));
+}
+
+float calc_albedo(float Ts, float lat, vec4 alb_params, float T_freeze) {
+    // a0 = r, a2 = g, ai = b
+    float phi = deg2rad(lat);
+    float is_freezing = float(T_freeze > Ts);
+    float albedo = 0;
+    albedo += is_freezing * alb_params.b;
+    albedo += (1 - is_freezing) * (alb_params.r + alb_params.g * calcP2(phi));
+    return albedo;
+}
+
+float calc_albedo(float Ts, float lat, vec4 alb_params) {
+    return calc_albedo(Ts, lat, alb_params, Tf);
+}
+
+float calc_OLR(float Ts, float olr_A, float olr_B) {
+    return olr_A + (olr_B * (Ts - 273.15));
+}
+
+float calc_ASR(float albedo, float Q) {
+    return (1 - albedo) * Q;
+}
+
+float calc_Ts(float ASR, float OLR, float C) {
+    return (1 / C) * (ASR - OLR);
+}
+
+// meridional diffusion on the sphere between rows j-1, j and j+1, with K in
+// 1/s per radian^2 and no flux through the poles
+float calc_merid_diffusion(float T_jm1, float T, float T_jp1, float phi,
+    float dphi, bool has_jm1, bool has_jp1, float K) {
+    float Wb_j   = cos(phi - (dphi / 2)) * float(has_jm1);
+    float Wb_jp1 = cos(phi + (dphi / 2)) * float(has_jp1);
+    float W_i    = cos(phi);
+
+    return K * (Wb_jp1 * (T_jp1 - T) - Wb_j * (T - T_jm1)) /
+        (W_i * dphi * dphi);
+}
+
+float calc_clausius_clapeyron(float T) {
+    float Tcel = T - 273.15;
+    return 6.112 * exp(17.67 * Tcel / (Tcel + 243.5));
+}
+
+float calc_qsat(float T, float P) {
+    // T in Kelvin
+    // P in hPa or mb
+    float es = calc_clausius_clapeyron(T);
+    return eps * es / (P - (1 - eps) * es);
+}
+
+float calc_f(float T) {
+    // could be an input later
+    const float RH     = 0.8f;
+    const float deltaT = 0.01;
+
+    float dqsdTs = (calc_qsat(T + deltaT / 2.0f, 1000.0) - calc_qsat(T - deltaT / 2.0f, 1000.0)) / deltaT;
+
+    return Lh_vap * RH * dqsdTs / gas_cp;
+}
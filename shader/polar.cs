@@ -0,0 +1,87 @@
+#version 430 core
+
+// spectral polar filter, one work group per filtered row. The zonal tendency
+// deferred by compute.cs is divided by its diffusivity, so that what is
+// filtered is the plain second difference of Ts along the row, every
+// wavenumber of it is damped so that it diffuses no faster than the shortest
+// wave at the reference latitude, and the result is scaled back and added to
+// the new state. Filtering the tendency itself is unstable where the depth
+// changes along the row.
+#define MAX_ROW 1024
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(r32f, binding = 1) uniform image2D stateOut;
+layout(rgba16f, binding = 2) uniform image2D diagOut;
+layout(rg32f, binding = 3) uniform readonly image2D zonalIn;
+layout(binding = 2) uniform sampler2D physp_LUT1;
+
+layout(location = 0) uniform float dt;
+layout(location = 1) uniform int write_diag;
+layout(location = 2) uniform ivec2 polar_rows;
+layout(location = 3) uniform float polar_cos; // cos of the reference latitude
+
+#include "physics.glsl"
+
+shared float z[MAX_ROW];
+shared float scale[MAX_ROW];
+shared float Zr[MAX_ROW / 2 + 1];
+shared float Zi[MAX_ROW / 2 + 1];
+
+void main() {
+    ivec2 size = imageSize(zonalIn);
+    int n = size.x;
+    int r = int(gl_WorkGroupID.y);
+    int j = (r < polar_rows.x) ? r : size.y - polar_rows.y + (r - polar_rows.x);
+    int t = int(gl_LocalInvocationID.x);
+    int m = int(gl_WorkGroupSize.x);
+
+    for (int i = t; i < n; i += m) {
+        vec2 zonal = imageLoad(zonalIn, ivec2(i, j)).rg;
+        z[i] = zonal.r / zonal.g;
+        scale[i] = zonal.g;
+    }
+    barrier();
+
+    // the second difference damps wavenumber k at 4 sin^2(pi k / n) / cos^2,
+    // keep the part of each wave that stays below the reference latitude
+    float lat = texelFetch(physp_LUT1, ivec2(0, j), 0).r;
+    float c = cos(deg2rad(lat)) / polar_cos;
+    for (int k = t; k <= n / 2; k += m) {
+        float s = sin(pi * float(k) / float(n));
+        float keep = (k == 0) ? 1.0 : min(1.0, (c * c) / (s * s));
+        float re = 0.0, im = 0.0;
+        if (keep < 1.0) {
+            for (int i = 0; i < n; i++) {
+                float a = 2 * pi * float((k * i) % n) / float(n);
+                re += z[i] * cos(a);
+                im -= z[i] * sin(a);
+            }
+        }
+        Zr[k] = (1.0 - keep) * re;
+        Zi[k] = (1.0 - keep) * im;
+    }
+    barrier();
+
+    // subtract the removed part of the spectrum
+    for (int i = t; i < n; i += m) {
+        float removed = 0.0;
+        for (int k = 1; k <= n / 2; k++) {
+            float a = 2 * pi * float((k * i) % n) / float(n);
+            float w = (2 * k == n) ? 1.0 : 2.0;
+            removed += w * (Zr[k] * cos(a) - Zi[k] * sin(a));
+        }
+        removed *= scale[i] / float(n);
+        float dTdt_zonal = z[i] * scale[i] - removed;
+
+        ivec2 coord = ivec2(i, j);
+        float Ts = imageLoad(stateOut, coord).r;
+        imageStore(stateOut, coord,
+            vec4(Ts + dTdt_zonal * dt * secs_per_day, 0, 0, 0));
+        if (write_diag != 0) {
+            vec4 diag = imageLoad(diagOut, coord);
+            diag.r -= removed * secs_per_day;
+            imageStore(diagOut, coord, diag);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#version 430 core
+
+// polar filter of the sensitivity kernels, one work group per filtered row.
+// The zonal diffusion of a polar row is w.z P D2 x, where D2 is the second
+// difference along the row and P the filter of polar.cs. Both are symmetric
+// and circulant, so the tangent linear model filters D2 of the perturbation
+// as well, and the adjoint filters K h lambda and takes D2 of the result
+// itself. zonalOut.r is always P D2 of the state.
+#define MAX_ROW 1024
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(r32f, binding = 0) uniform readonly image2D state;
+layout(r32f, binding = 1) uniform readonly image2D fieldIn; // tangent, adjoint
+layout(rg32f, binding = 5) uniform writeonly image2D zonalOut;
+layout(binding = 2) uniform sampler2D physp_LUT1;
+layout(binding = 3) uniform sampler2D physp_LUT2;
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float dt;
+layout(location = 2) uniform int daily_mean;
+layout(location = 3) uniform float day_frac;
+layout(location = 4) uniform ivec2 polar_rows;
+layout(location = 5) uniform float polar_cos; // cos of the reference latitude
+layout(location = 6) uniform int mode; // 0 forward, 1 tangent, 2 adjoint
+
+#include "physics.glsl"
+#include "linear.glsl"
+
+shared float z[2][MAX_ROW];
+shared float Zr[2][MAX_ROW / 2 + 1];
+shared float Zi[2][MAX_ROW / 2 + 1];
+
+void main() {
+    ivec2 size = imageSize(state);
+    int n = size.x;
+    int r = int(gl_WorkGroupID.y);
+    int j = (r < polar_rows.x) ? r : size.y - polar_rows.y + (r - polar_rows.x);
+    int t = int(gl_LocalInvocationID.x);
+    int m = int(gl_WorkGroupSize.x);
+    int channels = (mode != 0) ? 2 : 1;
+    float h = dt * secs_per_day;
+
+    for (int i = t; i < n; i += m) {
+        ivec2 c  = ivec2(i, j);
+        ivec2 cw = ivec2((i + n - 1) % n, j);
+        ivec2 ce = ivec2((i + 1) % n, j);
+        z[0][i] = imageLoad(state, cw).r + imageLoad(state, ce).r -
+            2 * imageLoad(state, c).r;
+        if (mode == 1) {
+            z[1][i] = imageLoad(fieldIn, cw).r + imageLoad(fieldIn, ce).r -
+                2 * imageLoad(fieldIn, c).r;
+        } else if (mode == 2) {
+            vec4 p1 = texelFetch(physp_LUT1, c, 0);
+            vec4 p2 = texelFetch(physp_LUT2, c, 0);
+            float Q = (daily_mean != 0) ? calc_Q_daily(p1.r, year_frac) :
+                calc_Q(p1.r, p1.g, year_frac, day_frac);
+            ebm_step_t st = calc_step_radiation(imageLoad(state, c).r, Q, p1,
+                p2, h);
+            z[1][i] = st.K * h * imageLoad(fieldIn, c).r;
+        }
+    }
+    barrier();
+
+    // keep the part of each wave that stays below the reference latitude
+    float lat = texelFetch(physp_LUT1, ivec2(0, j), 0).r;
+    float cr = cos(deg2rad(lat)) / polar_cos;
+    for (int k = t; k <= n / 2; k += m) {
+        float s = sin(pi * float(k) / float(n));
+        float keep = (k == 0) ? 1.0 : min(1.0, (cr * cr) / (s * s));
+        for (int ch = 0; ch < channels; ch++) {
+            float re = 0.0, im = 0.0;
+            if (keep < 1.0) {
+                for (int i = 0; i < n; i++) {
+                    float a = 2 * pi * float((k * i) % n) / float(n);
+                    re += z[ch][i] * cos(a);
+                    im -= z[ch][i] * sin(a);
+                }
+            }
+            Zr[ch][k] = (1.0 - keep) * re;
+            Zi[ch][k] = (1.0 - keep) * im;
+        }
+    }
+    barrier();
+
+    // subtract the removed part of the spectrum
+    for (int i = t; i < n; i += m) {
+        vec2 filtered = vec2(0.0);
+        for (int ch = 0; ch < channels; ch++) {
+            float removed = 0.0;
+            for (int k = 1; k <= n / 2; k++) {
+                float a = 2 * pi * float((k * i) % n) / float(n);
+                float w = (2 * k == n) ? 1.0 : 2.0;
+                removed += w * (Zr[ch][k] * cos(a) - Zi[ch][k] * sin(a));
+            }
+            filtered[ch] = z[ch][i] - removed / float(n);
+        }
+        imageStore(zonalOut, ivec2(i, j), vec4(filtered, 0, 0));
+    }
+}
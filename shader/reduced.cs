@@ -0,0 +1,108 @@
+#version 430 core
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// packed reduced grid, rows[j] = (first cell, cells in row)
+layout(std430, binding = 0) readonly buffer StateIn { vec4 stateIn[]; };
+layout(std430, binding = 1) writeonly buffer StateOut { vec4 stateOut[]; };
+layout(std430, binding = 2) readonly buffer Params { vec4 params[]; };
+layout(std430, binding = 3) readonly buffer Rows { ivec2 rows[]; };
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float dt;
+layout(location = 2) uniform int n_cells;
+layout(location = 3) uniform int n_rows;
+layout(location = 4) uniform int daily_mean;
+layout(location = 5) uniform float day_frac;
+
+#include "physics.glsl"
+
+int find_row(int cell) {
+    int lo = 0;
+    int hi = n_rows - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (rows[mid].x <= cell) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+// temperature of row j linearly interpolated (periodic) at fraction u of the
+// way around the row, measured from the shared western edge
+float sample_row(int j, float u) {
+    int n = rows[j].y;
+    float x = u * float(n) - 0.5;
+    float x0f = floor(x);
+    int x0 = (int(x0f) + n) % n;
+    int x1 = (x0 + 1) % n;
+    return mix(stateIn[rows[j].x + x0].r, stateIn[rows[j].x + x1].r, x - x0f);
+}
+
+float calc_zonal_advdiff(float T, int j, int i, float phi, float K) {
+    int n = rows[j].y;
+    float dlam = (2 * pi) / float(n);
+    float W_i = cos(phi);
+
+    float T_im1 = stateIn[rows[j].x + ((i - 1 + n) % n)].r;
+    float T_ip1 = stateIn[rows[j].x + ((i + 1) % n)].r;
+
+    return K * (T_im1 - 2 * T + T_ip1) / (W_i * W_i * dlam * dlam);
+}
+
+float calc_merid_advdiff(float T, int j, int i, float phi, float K) {
+    float dphi = pi / float(n_rows);
+    float u = (float(i) + 0.5) / float(rows[j].y);
+
+    float T_jm1 = (j > 0)          ? sample_row(j - 1, u) : T;
+    float T_jp1 = (j < n_rows - 1) ? sample_row(j + 1, u) : T;
+
+    return calc_merid_diffusion(T_jm1, T, T_jp1, phi, dphi, j > 0,
+        j < n_rows - 1, K);
+}
+
+void main() {
+    int cell = int(gl_GlobalInvocationID.x);
+    if (cell >= n_cells) {
+        return;
+    }
+    int j = find_row(cell);
+    int i = cell - rows[j].x;
+
+    // (B, A, depth, lat) and (a0, a2, ai, lon)
+    vec4 p1 = params[2 * cell + 0];
+    vec4 p2 = params[2 * cell + 1];
+    float lat = p1.a;
+    float lon = p2.a;
+
+    // Ts, dT/dt, Q, alpha
+    vec4 value = stateIn[cell];
+
+    // compute instant insolation and albedo
+    float Q = (daily_mean != 0) ? calc_Q_daily(lat, year_frac) :
+        calc_Q(lat, lon, year_frac, day_frac);
+    float alpha = calc_albedo(value.r, lat, p2);
+    value.a = alpha;
+    value.b = Q;
+
+    // compute temperature
+    float C_val = calc_Cval(p1.b);
+    float OLR = calc_OLR(value.r, p1.g, p1.r);
+    float ASR = calc_ASR(alpha, Q);
+    value.r += calc_Ts(ASR, OLR, C_val) * dt * secs_per_day;
+
+    // diffusion on the sphere with moist amplification
+    const float D = 0.555;
+    float f = calc_f(value.r);
+    float K = D / C_val * (1 + f);
+    float phi = deg2rad(lat);
+    float dTdt_merid = calc_merid_advdiff(value.r, j, i, phi, K);
+    float dTdt_zonal = calc_zonal_advdiff(value.r, j, i, phi, K);
+    value.g = dTdt_merid + dTdt_zonal;
+    value.r += (dTdt_merid + dTdt_zonal) * dt * secs_per_day;
+
+    stateOut[cell] = value;
+}
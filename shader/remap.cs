@@ -0,0 +1,35 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// conservative remap of the packed reduced grid onto the regular grid, in
+// the same split layout as compute.cs
+layout(r32f, binding = 0) uniform writeonly image2D stateOut;
+layout(rgba16f, binding = 1) uniform writeonly image2D diagOut;
+layout(std430, binding = 0) readonly buffer State { vec4 state[]; };
+layout(std430, binding = 3) readonly buffer Rows { ivec2 rows[]; };
+
+void main() {
+    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 imgsize = imageSize(stateOut);
+    int n = rows[texelCoord.y].y;
+
+    // span of the regular cell as a fraction of the row
+    float u0 = float(texelCoord.x) / float(imgsize.x);
+    float u1 = float(texelCoord.x + 1) / float(imgsize.x);
+    int k0 = int(floor(u0 * float(n)));
+    int k1 = min(int(ceil(u1 * float(n))) - 1, n - 1);
+
+    vec4 value = vec4(0.0);
+    float wsum = 0.0;
+    for (int k = k0; k <= k1; k++) {
+        float w = max(min(u1, float(k + 1) / float(n)) - max(u0, float(k) / float(n)), 0.0);
+        value += w * state[rows[texelCoord.y].x + k];
+        wsum += w;
+    }
+
+    value /= wsum;
+    imageStore(stateOut, texelCoord, vec4(value.r, 0, 0, 0));
+    imageStore(diagOut, texelCoord,
+        vec4(value.g * 86400.0, value.b, value.a, 0));
+}
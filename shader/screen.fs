@@ -24,12 +24,13 @@ vec3 color_map(float t) {
 }
 
 void main() {
-    vec4 value = texture(tex, TexCoords).rgba;
+    // only Ts is kept at full resolution in the state texture
+    float T = texture(tex, TexCoords).r;
 //    vec4 value = texture(physp_LUT, TexCoords).rgba;
 
-    value = (value - mins) / (maxs - mins);
+    T = (T - mins.r) / (maxs.r - mins.r);
 
-    FragColor = vec4(color_map(clamp(value.r, 0, 1)), 1.0);
+    FragColor = vec4(color_map(clamp(T, 0, 1)), 1.0);
 //    FragColor = vec4(color_map(clamp(value.b, 0, 1)), 1.0);
 //    FragColor = vec4(vec3(value.r), 1.0);
 //    FragColor = vec4(vec3(value.a), 1.0);
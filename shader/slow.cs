@@ -0,0 +1,43 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// slow physics of the multi-rate scheme. The radiative tendency (K/s), the
+// diffusivity scale (1 + f) / C, Q and albedo are cached here every few
+// steps and compute.cs only adds the diffusion in between.
+layout(r32f, binding = 0) uniform readonly image2D stateIn;
+layout(rgba32f, binding = 4) uniform writeonly image2D slowOut;
+
+uniform float year_frac;
+uniform int daily_mean;
+uniform float day_frac;
+
+#include "physics.glsl"
+#include "params.glsl"
+
+void main() {
+    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+    vec2 uv = (vec2(texelCoord) + 0.5) / vec2(imageSize(stateIn));
+    float Ts = imageLoad(stateIn, texelCoord).r;
+
+    vec4 physical_params = params1(uv);
+    float lat = physical_params.r;
+    float lon = physical_params.g;
+    float B   = physical_params.b;
+    float A   = physical_params.a;
+    vec4 albedo_params = params2(uv);
+
+    float Q = (daily_mean != 0) ? calc_Q_daily(lat, year_frac) :
+        calc_Q(lat, lon, year_frac, day_frac);
+    Q *= solar_constant / S0;
+
+    float alpha = calc_albedo(Ts, lat, albedo_params, freezing_T);
+    float C_val = calc_Cval(albedo_params.a);
+
+    float OLR = calc_OLR(Ts, A, B);
+    float ASR = calc_ASR(alpha, Q);
+    float dTdt = calc_Ts(ASR, OLR, C_val);
+
+    imageStore(slowOut, texelCoord,
+        vec4(dTdt, (1 + calc_f(Ts)) / C_val, Q, alpha));
+}
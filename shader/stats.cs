@@ -0,0 +1,96 @@
+#version 430 core
+
+// zonal means and the global energy budget of the current state. The row
+// pass runs one work group per row and stores the plain zonal means, the
+// global pass runs a single work group that weights the rows by cos(lat).
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(r32f, binding = 0) uniform readonly image2D stateIn;
+
+layout(std430, binding = 0) buffer stats_buffer {
+    vec4 global; // Ts, ASR, OLR, ASR - OLR
+    vec4 ice;    // southern and northern ice edge latitude, ice area fraction
+    vec4 rows[]; // Ts, ASR, OLR and ice fraction of each row
+};
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float day_frac;
+layout(location = 2) uniform int daily_mean;
+layout(location = 3) uniform int global_pass;
+
+#include "physics.glsl"
+#include "params.glsl"
+
+shared vec4 sums[64];
+shared vec4 ice_sums[64];
+
+// tree reduction of both shared arrays into their first element
+void reduce(int t) {
+    for (int s = int(gl_WorkGroupSize.x) / 2; s > 0; s /= 2) {
+        barrier();
+        if (t < s) {
+            sums[t] += sums[t + s];
+            ice_sums[t] += ice_sums[t + s];
+        }
+    }
+    barrier();
+}
+
+void reduce_row(ivec2 size, int t) {
+    int j = int(gl_WorkGroupID.y);
+    vec4 sum = vec4(0.0);
+    for (int i = t; i < size.x; i += int(gl_WorkGroupSize.x)) {
+        vec2 uv = (vec2(i, j) + 0.5) / vec2(size);
+        float Ts = imageLoad(stateIn, ivec2(i, j)).r;
+        vec4 p1 = params1(uv);
+        float Q = (daily_mean != 0) ? calc_Q_daily(p1.r, year_frac) :
+            calc_Q(p1.r, p1.g, year_frac, day_frac);
+        Q *= solar_constant / S0;
+        float alpha = calc_albedo(Ts, p1.r, params2(uv), freezing_T);
+        sum += vec4(Ts, calc_ASR(alpha, Q), calc_OLR(Ts, p1.a, p1.b),
+            float(Ts < freezing_T));
+    }
+    sums[t] = sum;
+    ice_sums[t] = vec4(0.0);
+    reduce(t);
+    if (t == 0) {
+        rows[j] = sums[0] / float(size.x);
+    }
+}
+
+// the ice edge is placed where a polar cap of the same area would end, so it
+// moves smoothly as cells freeze and is +-90 for an ice free hemisphere
+void reduce_global(ivec2 size, int t) {
+    vec4 sum = vec4(0.0);
+    vec4 ice_sum = vec4(0.0); // south ice, south area, north ice, north area
+    for (int j = t; j < size.y; j += int(gl_WorkGroupSize.x)) {
+        float lat = texelFetch(physp_LUT1, ivec2(0, j), 0).r;
+        float w = cos(deg2rad(lat));
+        vec4 row = rows[j];
+        sum += w * vec4(row.rgb, 1.0);
+        ice_sum += (lat < 0.0) ? vec4(w * row.a, w, 0, 0) :
+            vec4(0, 0, w * row.a, w);
+    }
+    sums[t] = sum;
+    ice_sums[t] = ice_sum;
+    reduce(t);
+    if (t == 0) {
+        vec3 mean = sums[0].rgb / sums[0].a;
+        vec4 s = ice_sums[0];
+        float south = (s.g > 0.0) ? s.r / s.g : 0.0;
+        float north = (s.a > 0.0) ? s.b / s.a : 0.0;
+        global = vec4(mean, mean.g - mean.b);
+        ice = vec4(-degrees(asin(1.0 - south)), degrees(asin(1.0 - north)),
+            (s.r + s.b) / (s.g + s.a), 0.0);
+    }
+}
+
+void main() {
+    ivec2 size = imageSize(stateIn);
+    int t = int(gl_LocalInvocationID.x);
+    if (global_pass != 0) {
+        reduce_global(size, t);
+    } else {
+        reduce_row(size, t);
+    }
+}
@@ -0,0 +1,73 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// tangent linear model of forward.cs, carries a perturbation of Ts forward
+// given a perturbation of the parameters
+layout(r32f, binding = 0) uniform readonly image2D state;
+layout(r32f, binding = 1) uniform readonly image2D tangentIn;
+layout(r32f, binding = 2) uniform writeonly image2D tangentOut;
+layout(binding = 2) uniform sampler2D physp_LUT1;
+layout(binding = 3) uniform sampler2D physp_LUT2;
+layout(binding = 4) uniform sampler2D dparam1; // dA, dB, ddepth
+layout(binding = 5) uniform sampler2D dparam2; // da0, da2, dai
+// filtered zonal second difference of the polar rows and of the
+// perturbation, from polar_linear.cs
+layout(rg32f, binding = 5) uniform readonly image2D zonalIn;
+
+layout(location = 0) uniform float year_frac;
+layout(location = 1) uniform float dt;
+layout(location = 2) uniform int daily_mean;
+layout(location = 3) uniform float day_frac;
+layout(location = 4) uniform ivec2 polar_rows;
+
+#include "physics.glsl"
+#include "linear.glsl"
+
+vec4 load_neighbours(ivec2 c, ivec2 size) {
+    return vec4(imageLoad(state, ivec2(c.x, min(c.y + 1, size.y - 1))).r,
+                imageLoad(state, ivec2(c.x, max(c.y - 1, 0))).r,
+                imageLoad(state, ivec2((c.x + size.x - 1) % size.x, c.y)).r,
+                imageLoad(state, ivec2((c.x + 1) % size.x, c.y)).r);
+}
+
+vec4 load_tangent_neighbours(ivec2 c, ivec2 size) {
+    return vec4(imageLoad(tangentIn, ivec2(c.x, min(c.y + 1, size.y - 1))).r,
+                imageLoad(tangentIn, ivec2(c.x, max(c.y - 1, 0))).r,
+                imageLoad(tangentIn, ivec2((c.x + size.x - 1) % size.x, c.y)).r,
+                imageLoad(tangentIn, ivec2((c.x + 1) % size.x, c.y)).r);
+}
+
+void main() {
+    ivec2 c = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(state);
+    float h = dt * secs_per_day;
+
+    vec4 p1 = texelFetch(physp_LUT1, c, 0);
+    vec4 p2 = texelFetch(physp_LUT2, c, 0);
+    float Q = (daily_mean != 0) ? calc_Q_daily(p1.r, year_frac) :
+        calc_Q(p1.r, p1.g, year_frac, day_frac);
+    vec3 w = calc_stencil(c.y, size, p1.r);
+    float wz = w.z;
+    vec2 zonal = vec2(0.0);
+    if (calc_polar(c.y, size, polar_rows)) {
+        zonal = imageLoad(zonalIn, c).rg;
+        w.z = 0.0;
+    }
+
+    ebm_step_t st = calc_step(imageLoad(state, c).r, load_neighbours(c, size),
+        w, wz * zonal.r, Q, p1, p2, h);
+    float dT_dx;
+    vec3 dT_dp1, dT_dp2;
+    calc_step_partials(st, w, Q, p1, p2, h, dT_dx, dT_dp1, dT_dp2);
+
+    // own cell, neighbours, then parameters
+    vec4 dn = load_tangent_neighbours(c, size);
+    float dT = dT_dx * imageLoad(tangentIn, c).r;
+    dT += st.K * h * (w.x * dn.x + w.y * dn.y + w.z * (dn.z + dn.w) +
+        wz * zonal.g);
+    dT += dot(dT_dp1, texelFetch(dparam1, c, 0).rgb);
+    dT += dot(dT_dp2, texelFetch(dparam2, c, 0).rgb);
+
+    imageStore(tangentOut, c, vec4(dT, 0, 0, 0));
+}
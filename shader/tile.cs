@@ -0,0 +1,146 @@
+#version 430 core
+
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+
+// one tile of a grid too large for a single texture. Ts carries a one cell
+// halo on every side that is refreshed from the neighbouring tiles before
+// each step, the parameters and diagnostics only cover the interior.
+layout(r32f, binding = 0) uniform readonly image2D stateIn;
+layout(r32f, binding = 1) uniform writeonly image2D stateOut;
+layout(rgba16f, binding = 2) uniform writeonly image2D diagOut;
+
+uniform float year_frac;
+uniform float dt;
+uniform int daily_mean;
+uniform int write_diag;
+uniform float day_frac;
+uniform ivec2 tile_origin; // first interior cell in the full grid
+uniform ivec2 grid_size;   // cells in the full grid
+
+#include "physics.glsl"
+#include "params.glsl"
+
+float calc_Cval(vec2 uv) {
+    return calc_Cval(params2(uv).a);
+}
+
+float calc_albedo(float Ts, float lat, vec2 uv) {
+    return calc_albedo(Ts, lat, params2(uv), freezing_T);
+}
+
+// same stencils as compute.cs, with the neighbours read from the halo and
+// the boundaries taken from the full grid
+float calc_merid_advdiff(float N, ivec2 coord, int j, float lat, float C,
+    float f) {
+    float D = diffusivity;
+
+    float phi = deg2rad(lat);
+    float dphi = pi / float(grid_size.y);
+    float dy = Re * dphi;
+
+    float N_im1  = imageLoad(stateIn, coord + ivec2(0, -1)).r;
+    float N_ip1  = imageLoad(stateIn, coord + ivec2(0,  1)).r;
+
+    float X_i    = phi * Re;
+    float X_ip1  = X_i + dy;
+    float X_im1  = X_i - dy;
+
+    float Xb_j   = X_i - (dy / 2);
+    float Xb_jp1 = X_i + (dy / 2);
+
+    float Wb_j   = cos(phi - (dphi / 2)) * float(j > 0);
+    float Wb_jp1 = cos(phi + (dphi / 2)) * float(j < grid_size.y - 1);
+
+    float W_i    = cos(phi);
+
+    float K_j    = D / C * Re * Re * (1 + f);
+    float K_jp1  = D / C * Re * Re * (1 + f);
+
+    float Tl = (Wb_j / W_i) * K_j / ((Xb_jp1 - Xb_j) * (X_i - X_im1));
+
+    float Tm = 0;
+    Tm -= (Wb_jp1 * K_jp1) / (W_i * (Xb_jp1 - Xb_j) * (X_ip1 - X_i  ));
+    Tm -= (Wb_j   * K_j  ) / (W_i * (Xb_jp1 - Xb_j) * (X_i   - X_im1));
+
+    float Tu = (Wb_jp1 / W_i) * K_jp1 / ((Xb_jp1 - Xb_j) * (X_ip1 - X_i));
+
+    return Tl * N_im1 + Tm * N + Tu * N_ip1;
+}
+
+float calc_zonal_advdiff(float N, ivec2 coord, float lat, float lon, float C,
+    float f) {
+    float D = diffusivity;
+
+    // cells get narrower towards the poles
+    float phi = deg2rad(lon);
+    float dphi = (2 * pi) / float(grid_size.x);
+    float dy = Re * cos(deg2rad(lat)) * dphi;
+
+    float N_im1  = imageLoad(stateIn, coord + ivec2(-1, 0)).r;
+    float N_ip1  = imageLoad(stateIn, coord + ivec2( 1, 0)).r;
+
+    float X_i    = phi * Re;
+    float X_ip1  = X_i + dy;
+    float X_im1  = X_i - dy;
+
+    float Xb_j   = X_i - (dy / 2);
+    float Xb_jp1 = X_i + (dy / 2);
+
+    float K_j    = D / C * Re * Re * (1 + f);
+    float K_jp1  = D / C * Re * Re * (1 + f);
+
+    float Tl = K_j / ((Xb_jp1 - Xb_j) * (X_i - X_im1));
+
+    float Tm = 0;
+    Tm -= K_jp1 / ((Xb_jp1 - Xb_j) * (X_ip1 - X_i  ));
+    Tm -= K_j   / ((Xb_jp1 - Xb_j) * (X_i   - X_im1));
+
+    float Tu = K_jp1 / ((Xb_jp1 - Xb_j) * (X_ip1 - X_i));
+
+    return Tl * N_im1 + Tm * N + Tu * N_ip1;
+}
+
+void main() {
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 texelCoord = cell + ivec2(1, 1);
+    vec2 uv = (vec2(cell) + 0.5) / vec2(imageSize(diagOut));
+    float Ts = imageLoad(stateIn, texelCoord).r;
+
+    // coordinates
+    vec4 physical_params = params1(uv);
+    float lat = physical_params.r;
+    float lon = physical_params.g;
+    float B   = physical_params.b;
+    float A   = physical_params.a;
+
+    // compute instant (or daily mean) insolation
+    float Q = (daily_mean != 0) ? calc_Q_daily(lat, year_frac) :
+        calc_Q(lat, lon, year_frac, day_frac);
+    Q *= solar_constant / S0;
+
+    // compute albedo
+    float alpha = calc_albedo(Ts, lat, uv);
+
+    // calculate water depth
+    float C_val = calc_Cval(uv);
+
+    // compute temperature
+    float OLR = calc_OLR(Ts, A, B);
+    float ASR = calc_ASR(alpha, Q);
+    Ts += calc_Ts(ASR, OLR, C_val) * dt * secs_per_day;
+
+    // compute moist ampl factor
+    float f = calc_f(Ts);
+
+    // adv diff, tiles are never polar filtered
+    float dTdt_merid = calc_merid_advdiff(Ts, texelCoord,
+        tile_origin.y + cell.y, lat, C_val, f);
+    float dTdt_zonal = calc_zonal_advdiff(Ts, texelCoord, lat, lon, C_val, f);
+    Ts += (dTdt_merid + dTdt_zonal) * dt * secs_per_day;
+
+    imageStore(stateOut, texelCoord, vec4(Ts, 0, 0, 0));
+    if (write_diag != 0) {
+        imageStore(diagOut, cell,
+            vec4((dTdt_merid + dTdt_zonal) * secs_per_day, Q, alpha, 0));
+    }
+}
@@ -0,0 +1,267 @@
+#include "shooting.h"
+#include "common.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// the one year map and the number of times it has been applied
+typedef struct {
+    model_state_t state;
+    compute_kernel_t* kernel;
+    unsigned int solar_LUT;
+    float dt;
+    int steps_per_year;
+    int years;
+} year_map_t;
+
+static void year_map(year_map_t* map, float* T, float* out) {
+    model_state_write_T(&map->state, T);
+    for (int step = 0; step < map->steps_per_year; step++) {
+        model_state_step(&map->state, map->kernel, map->solar_LUT,
+            step * map->dt, map->dt, 0);
+    }
+    model_state_read_T(&map->state, out);
+    map->years++;
+}
+
+static double dot(const double* a, const double* b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static float max_abs(const float* a, size_t n) {
+    float m = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        m = fmaxf(m, fabsf(a[i]));
+    }
+    return m;
+}
+
+static double norm2(const float* a, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (double) a[i] * a[i];
+    }
+    return sqrt(sum);
+}
+
+// approximately solve J M^-1 y = -r for the Newton step delta = M^-1 y with
+// unrestarted GMRES, J v = (P(T + eps v) - P(T)) / eps - v. Returns the
+// number of Jacobian products taken.
+static int newton_step(year_map_t* map, float* T, float* PT, float* r,
+    float* Minv, size_t n, int max_years, float* delta) {
+    const int m = SHOOTING_KRYLOV;
+    double* V = (double*) mem_alloc(MEM_STAGING, (m + 1) * n * sizeof(double));
+    double H[SHOOTING_KRYLOV + 1][SHOOTING_KRYLOV];
+    double cs[SHOOTING_KRYLOV], sn[SHOOTING_KRYLOV], g[SHOOTING_KRYLOV + 1];
+    float* z = (float*) mem_alloc(MEM_STAGING, n * sizeof(float));
+    float* Pz = (float*) mem_alloc(MEM_STAGING, n * sizeof(float));
+
+    double beta = norm2(r, n);
+    for (size_t i = 0; i < n; i++) {
+        V[i] = -r[i] / beta;
+    }
+    memset(g, 0, sizeof(g));
+    g[0] = beta;
+
+    // each inner solve only has to gain an order of magnitude
+    int k = 0;
+    while (k < m && map->years < max_years) {
+        double* v = &V[k * n];
+        double* w = &V[(k + 1) * n];
+
+        // probe P with a perturbation of a fixed size in K, so rounding in
+        // the year long integration stays small against it
+        float zmax = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            z[i] = (float) (Minv[i] * v[i]);
+            zmax = fmaxf(zmax, fabsf(z[i]));
+        }
+        float eps = SHOOTING_PERTURB / zmax;
+        for (size_t i = 0; i < n; i++) {
+            Pz[i] = T[i] + eps * z[i];
+        }
+        year_map(map, Pz, Pz);
+        for (size_t i = 0; i < n; i++) {
+            w[i] = (Pz[i] - PT[i]) / eps - z[i];
+        }
+
+        // modified Gram-Schmidt
+        for (int j = 0; j <= k; j++) {
+            H[j][k] = dot(w, &V[j * n], n);
+            for (size_t i = 0; i < n; i++) {
+                w[i] -= H[j][k] * V[j * n + i];
+            }
+        }
+        double h_next = sqrt(dot(w, w, n));
+        H[k + 1][k] = h_next;
+        if (h_next > 0.0) {
+            for (size_t i = 0; i < n; i++) {
+                w[i] /= h_next;
+            }
+        }
+
+        // Givens rotations keep H upper triangular, g tracks the residual
+        for (int j = 0; j < k; j++) {
+            double a = H[j][k];
+            double b = H[j + 1][k];
+            H[j][k]     =  cs[j] * a + sn[j] * b;
+            H[j + 1][k] = -sn[j] * a + cs[j] * b;
+        }
+        double rho = hypot(H[k][k], H[k + 1][k]);
+        cs[k] = H[k][k] / rho;
+        sn[k] = H[k + 1][k] / rho;
+        H[k][k] = rho;
+        H[k + 1][k] = 0.0;
+        g[k + 1] = -sn[k] * g[k];
+        g[k]     =  cs[k] * g[k];
+        k++;
+
+        if (fabs(g[k]) < 0.1 * beta || h_next == 0.0) {
+            break;
+        }
+    }
+
+    // back substitution, then delta = M^-1 V y
+    double y[SHOOTING_KRYLOV];
+    for (int j = k - 1; j >= 0; j--) {
+        y[j] = g[j];
+        for (int l = j + 1; l < k; l++) {
+            y[j] -= H[j][l] * y[l];
+        }
+        y[j] /= H[j][j];
+    }
+    for (size_t i = 0; i < n; i++) {
+        double sum = 0.0;
+        for (int j = 0; j < k; j++) {
+            sum += V[j * n + i] * y[j];
+        }
+        delta[i] = (float) (Minv[i] * sum);
+    }
+
+    mem_free(V);
+    mem_free(z);
+    mem_free(Pz);
+    return k;
+}
+
+float* run_shooting(model_initial_t* initial, size_t nx, size_t ny,
+    model_options_t* opts, compute_kernel_t* kernel, unsigned int solar_LUT,
+    float dt, float* guess) {
+    size_t n = nx * ny;
+    int max_years = opts->spinup_max_years;
+    float tol = opts->spinup_tol;
+
+    year_map_t map;
+    init_model_state(&map.state, nx, ny, initial, guess);
+    model_state_set_polar_filter(&map.state, initial, opts->polar_lat);
+    map.kernel = kernel;
+    map.solar_LUT = solar_LUT;
+    map.dt = dt;
+    map.steps_per_year = (int) roundf(days_per_year / dt);
+    map.years = 0;
+
+    // a column relaxing at B / C alone would see its perturbations shrink
+    // by exp(-B/C year) over the year
+    float* Minv = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    double year = (double) days_per_year * 86400.0;
+    for (size_t i = 0; i < n; i++) {
+        double C = 4181.3 * 1.0e3 * initial->depths[i];
+        Minv[i] = (float) (1.0 / expm1(-initial->Bs[i] / C * year));
+    }
+
+    float* T  = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    float* PT = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    float* r  = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    float* delta = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    float* Tn = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    float* PTn = (float*) mem_alloc(MEM_FIELDS, n * sizeof(float));
+    for (size_t i = 0; i < n; i++) {
+        T[i] = guess[i * 4];
+    }
+
+    double t_start = glfwGetTime();
+    year_map(&map, T, PT);
+    for (size_t i = 0; i < n; i++) {
+        r[i] = PT[i] - T[i];
+    }
+
+    int newton = 0;
+    int converged = 0;
+    while (map.years < max_years) {
+        float res = max_abs(r, n);
+#ifndef REDUCED_OUTPUT
+        printf("  newton=%d years=%d residual=%.4e K\n", newton, map.years,
+            res);
+#endif // REDUCED_OUTPUT
+        if (res < tol) {
+            converged = 1;
+            break;
+        }
+
+        int products = newton_step(&map, T, PT, r, Minv, n, max_years, delta);
+        newton++;
+        if (map.years >= max_years) {
+            break;
+        }
+
+        // halve the step while it makes the residual worse, the albedo
+        // switch makes P far from smooth across the ice edge
+        double rnorm = norm2(r, n);
+        float lambda = 1.0f;
+        for (int tries = 0; tries < 4 && map.years < max_years; tries++) {
+            for (size_t i = 0; i < n; i++) {
+                Tn[i] = T[i] + lambda * delta[i];
+            }
+            year_map(&map, Tn, PTn);
+            double rn = 0.0;
+            for (size_t i = 0; i < n; i++) {
+                float d = PTn[i] - Tn[i];
+                rn += (double) d * d;
+            }
+            if (sqrt(rn) < rnorm || tries == 3) {
+                break;
+            }
+            lambda *= 0.5f;
+        }
+#ifndef REDUCED_OUTPUT
+        printf("  gmres=%d step=%.3f\n", products, lambda);
+#endif // REDUCED_OUTPUT
+
+        float* tmp = T;  T = Tn;  Tn = tmp;
+        tmp = PT;  PT = PTn;  PTn = tmp;
+        for (size_t i = 0; i < n; i++) {
+            r[i] = PT[i] - T[i];
+        }
+    }
+    double t_total = glfwGetTime() - t_start;
+
+    if (!converged) {
+        printf("Warning: shooting did not converge in %d years.\n",
+            max_years);
+    }
+    printf("Shooting complete: newton=%d years=%d residual=%.4e K "
+        "wall=%.2fs\n", newton, map.years, max_abs(r, n), t_total);
+
+    // the state a year on lies on the periodic orbit as well and has seen
+    // one more pass of the full model
+    float* data = (float*) mem_calloc(MEM_STAGING, n * 4, sizeof(float));
+    for (size_t i = 0; i < n; i++) {
+        data[i * 4] = PT[i];
+    }
+
+    model_state_free(&map.state);
+    mem_free(Minv);
+    mem_free(T);
+    mem_free(PT);
+    mem_free(r);
+    mem_free(delta);
+    mem_free(Tn);
+    mem_free(PTn);
+    return data;
+}
@@ -0,0 +1,22 @@
+#ifndef _SHOOTING_H
+#define _SHOOTING_H
+
+#include <stddef.h>
+#include "nctools.h"
+#include "model.h"
+#include "options.h"
+
+#define SHOOTING_KRYLOV  12    // GMRES basis vectors per Newton step
+#define SHOOTING_PERTURB 0.05f // largest Ts change of a Jacobian probe (K)
+
+// periodic seasonal equilibrium found directly rather than by spinning up.
+// With P the map taking Ts through one model year, Newton's method solves
+// P(Ts) - Ts = 0, each step solved by GMRES with Jacobian vector products
+// from finite differences of P. The GMRES is preconditioned with the
+// linearised relaxation of every column over a year, exp(-B/C year) - 1.
+// The result is an RGBA state like run_spinup returns.
+float* run_shooting(model_initial_t* initial, size_t nx, size_t ny,
+    model_options_t* opts, compute_kernel_t* kernel, unsigned int solar_LUT,
+    float dt, float* guess);
+
+#endif // _SHOOTING_H
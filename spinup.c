@@ -0,0 +1,211 @@
+#include "spinup.h"
+#include "common.h"
+#include "initial.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define MAX_SPINUP_LEVELS 8
+
+float global_mean_T(float* data, size_t nx, size_t ny, float* lats) {
+    double sum = 0.0;
+    double wsum = 0.0;
+    for (size_t y = 0; y < ny; y++) {
+        double w = cos(deg2rad(lats[y]));
+        for (size_t x = 0; x < nx; x++) {
+            sum += w * data[(((y * nx) + x) * 4) + 0];
+        }
+        wsum += w * nx;
+    }
+    return (float) (sum / wsum);
+}
+
+// area weighted (cos(lat)) average of a 2x2 block of fine cells
+static float coarsen_cell(float* field, float* lats, size_t nx,
+    size_t cx, size_t cy) {
+    float sum = 0.0f;
+    float wsum = 0.0f;
+    for (size_t y = 2 * cy; y < 2 * cy + 2; y++) {
+        float w = cos(deg2rad(lats[y]));
+        for (size_t x = 2 * cx; x < 2 * cx + 2; x++) {
+            sum += w * field[(y * nx) + x];
+            wsum += w;
+        }
+    }
+    return sum / wsum;
+}
+
+static float* coarsen_field(float* field, float* lats, size_t nx, size_t ny) {
+    size_t cnx = nx / 2;
+    size_t cny = ny / 2;
+    float* out = (float*) mem_alloc(MEM_FIELDS, cnx * cny * sizeof(float));
+    for (size_t cy = 0; cy < cny; cy++) {
+        for (size_t cx = 0; cx < cnx; cx++) {
+            out[(cy * cnx) + cx] = coarsen_cell(field, lats, nx, cx, cy);
+        }
+    }
+    return out;
+}
+
+void coarsen_initial(model_initial_t* fine, size_t nx, size_t ny,
+    model_initial_t* coarse) {
+    size_t cnx = nx / 2;
+    size_t cny = ny / 2;
+
+    // coarse cell centers sit between each pair of fine centers
+    coarse->lats = (float*) mem_alloc(MEM_FIELDS, cny * sizeof(float));
+    for (size_t y = 0; y < cny; y++) {
+        coarse->lats[y] = 0.5f * (fine->lats[2 * y] + fine->lats[2 * y + 1]);
+    }
+    coarse->lons = (float*) mem_alloc(MEM_FIELDS, cnx * sizeof(float));
+    for (size_t x = 0; x < cnx; x++) {
+        coarse->lons[x] = 0.5f * (fine->lons[2 * x] + fine->lons[2 * x + 1]);
+    }
+
+    coarse->Ts     = coarsen_field(fine->Ts,     fine->lats, nx, ny);
+    coarse->Bs     = coarsen_field(fine->Bs,     fine->lats, nx, ny);
+    coarse->As     = coarsen_field(fine->As,     fine->lats, nx, ny);
+    coarse->depths = coarsen_field(fine->depths, fine->lats, nx, ny);
+    coarse->a0s    = coarsen_field(fine->a0s,    fine->lats, nx, ny);
+    coarse->a2s    = coarsen_field(fine->a2s,    fine->lats, nx, ny);
+    coarse->ais    = coarsen_field(fine->ais,    fine->lats, nx, ny);
+    coarse->zonally_symmetric = fine->zonally_symmetric;
+    coarse->time_varying = fine->time_varying;
+}
+
+void prolong_state(float* coarse, size_t cnx, size_t cny, float* fine) {
+    size_t nx = cnx * 2;
+    size_t ny = cny * 2;
+
+    for (size_t y = 0; y < ny; y++) {
+        // fine center in coarse index space, clamped at the poles
+        float yc = ((float) y + 0.5f) / 2.0f - 0.5f;
+        if (yc < 0.0f) yc = 0.0f;
+        if (yc > (float) (cny - 1)) yc = (float) (cny - 1);
+        size_t y0 = (size_t) yc;
+        size_t y1 = (y0 + 1 < cny) ? y0 + 1 : y0;
+        float wy = yc - (float) y0;
+
+        for (size_t x = 0; x < nx; x++) {
+            // periodic in longitude
+            float xc = ((float) x + 0.5f) / 2.0f - 0.5f;
+            if (xc < 0.0f) xc += (float) cnx;
+            size_t x0 = ((size_t) xc) % cnx;
+            size_t x1 = (x0 + 1) % cnx;
+            float wx = xc - floorf(xc);
+
+            float T00 = coarse[(((y0 * cnx) + x0) * 4) + 0];
+            float T01 = coarse[(((y0 * cnx) + x1) * 4) + 0];
+            float T10 = coarse[(((y1 * cnx) + x0) * 4) + 0];
+            float T11 = coarse[(((y1 * cnx) + x1) * 4) + 0];
+
+            size_t i = (y * nx) + x;
+            fine[(i * 4) + 0] = (1.0f - wy) * ((1.0f - wx) * T00 + wx * T01) +
+                                         wy * ((1.0f - wx) * T10 + wx * T11);
+            fine[(i * 4) + 1] = 0.0f;
+            fine[(i * 4) + 2] = 0.0f;
+            fine[(i * 4) + 3] = 0.0f;
+        }
+    }
+}
+
+// integrate whole years until the annual change in global mean temperature
+// drops below tol, returns the number of years taken
+static int spinup_stage(model_state_t* state, compute_kernel_t* kernel,
+    unsigned int solar_LUT, float dt, float* lats, float tol, int max_years,
+    float* data, float* Tmean) {
+    int steps_per_year = (int) roundf(days_per_year / dt);
+
+    model_state_read(state, data);
+    float Tlast = global_mean_T(data, state->nx, state->ny, lats);
+
+    int year;
+    for (year = 1; year <= max_years; year++) {
+        for (int step = 0; step < steps_per_year; step++) {
+            model_state_step(state, kernel, solar_LUT, step * dt, dt, 0);
+        }
+
+        model_state_read(state, data);
+        *Tmean = global_mean_T(data, state->nx, state->ny, lats);
+#ifndef REDUCED_OUTPUT
+        printf("  year=%d Tmean=%.4f dT=%.4e\n", year, *Tmean, *Tmean - Tlast);
+#endif // REDUCED_OUTPUT
+        if (fabsf(*Tmean - Tlast) < tol) {
+            break;
+        }
+        Tlast = *Tmean;
+    }
+
+    if (year > max_years) {
+        printf("Warning: spin-up did not converge in %d years.\n", max_years);
+        year = max_years;
+    }
+
+    return year;
+}
+
+float* run_spinup(model_initial_t* initial, size_t nx, size_t ny,
+    model_options_t* opts, compute_kernel_t* kernel, unsigned int solar_LUT,
+    float dt) {
+    // every level has to stay a multiple of 32 in both directions
+    int levels = 1;
+    while (levels < opts->spinup_levels && levels < MAX_SPINUP_LEVELS &&
+        (nx >> levels) % 32 == 0 && (ny >> levels) % 32 == 0 &&
+        (nx >> levels) > 0 && (ny >> levels) > 0) {
+        levels++;
+    }
+    if (levels < opts->spinup_levels) {
+        printf("Warning: grid only supports %d spin-up levels.\n", levels);
+    }
+
+    // build coarsened parameter fields, level 0 is the input grid
+    model_initial_t grids[MAX_SPINUP_LEVELS];
+    grids[0] = *initial;
+    for (int k = 1; k < levels; k++) {
+        coarsen_initial(&grids[k - 1], nx >> (k - 1), ny >> (k - 1),
+            &grids[k]);
+    }
+
+    // start from the usual uniform field on the coarsest grid
+    float* data = make_2d_initial(nx >> (levels - 1), ny >> (levels - 1));
+
+    double t_total = 0.0;
+    int years_total = 0;
+    for (int k = levels - 1; k >= 0; k--) {
+        size_t lnx = nx >> k;
+        size_t lny = ny >> k;
+        printf("Spin-up level %d: %lux%lu\n", k, lnx, lny);
+
+        model_state_t state;
+        init_model_state(&state, lnx, lny, &grids[k], data);
+        model_state_set_polar_filter(&state, &grids[k], opts->polar_lat);
+
+        float Tmean = 0.0f;
+        double t_start = glfwGetTime();
+        int years = spinup_stage(&state, kernel, solar_LUT, dt, grids[k].lats,
+            opts->spinup_tol, opts->spinup_max_years, data, &Tmean);
+        double t_stage = glfwGetTime() - t_start;
+
+        printf("Spin-up level %d done: years=%d Tmean=%.4f wall=%.2fs\n",
+            k, years, Tmean, t_stage);
+        t_total += t_stage;
+        years_total += years;
+        model_state_free(&state);
+
+        // carry the temperature field onto the next finer grid
+        if (k > 0) {
+            float* finer = (float*) mem_alloc(MEM_STAGING,
+                (lnx * 2) * (lny * 2) * 4 * sizeof(float));
+            prolong_state(data, lnx, lny, finer);
+            mem_free(data);
+            free_initial(&grids[k]);
+            data = finer;
+        }
+    }
+
+    printf("Spin-up complete: levels=%d years=%d wall=%.2fs\n",
+        levels, years_total, t_total);
+
+    return data;
+}
@@ -0,0 +1,19 @@
+#ifndef _SPINUP_H
+#define _SPINUP_H
+
+#include <stddef.h>
+#include "nctools.h"
+#include "model.h"
+#include "options.h"
+
+float global_mean_T(float* data, size_t nx, size_t ny, float* lats);
+
+void coarsen_initial(model_initial_t* fine, size_t nx, size_t ny,
+    model_initial_t* coarse);
+void prolong_state(float* coarse, size_t cnx, size_t cny, float* fine);
+
+float* run_spinup(model_initial_t* initial, size_t nx, size_t ny,
+    model_options_t* opts, compute_kernel_t* kernel, unsigned int solar_LUT,
+    float dt);
+
+#endif // _SPINUP_H
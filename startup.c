@@ -0,0 +1,189 @@
+#include "startup.h"
+#include "context.h"
+#include "initial.h"
+#include "renderutil.h"
+#include "regrid.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+double startup_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9;
+}
+
+void init_startup_graph(startup_graph_t* g) {
+    g->n_tasks = 0;
+    g->n_done = 0;
+    g->t0 = 0.0;
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->changed, NULL);
+}
+
+// tasks may only depend on ones added before them
+int startup_add(startup_graph_t* g, const char* name, startup_fn_t run,
+    void* arg, int on_main, int n_deps, const int* deps) {
+    if (g->n_tasks == STARTUP_MAX_TASKS || n_deps > STARTUP_MAX_DEPS) {
+        printf("Error: startup graph is full.\n");
+        exit(1);
+    }
+    int id = g->n_tasks++;
+    startup_task_t* task = &g->tasks[id];
+    task->name = name;
+    task->run = run;
+    task->arg = arg;
+    task->on_main = on_main;
+    task->n_deps = n_deps;
+    for (int d = 0; d < n_deps; d++) {
+        task->deps[d] = deps[d];
+    }
+    task->state = 0;
+    task->start = task->end = 0.0;
+    return id;
+}
+
+static int task_ready(startup_graph_t* g, startup_task_t* task) {
+    if (task->state != 0) {
+        return 0;
+    }
+    for (int d = 0; d < task->n_deps; d++) {
+        if (g->tasks[task->deps[d]].state != 2) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// run whichever tasks become ready for this kind of thread until the whole
+// graph is done
+static void drain(startup_graph_t* g, int on_main) {
+    pthread_mutex_lock(&g->lock);
+    while (g->n_done < g->n_tasks) {
+        startup_task_t* task = NULL;
+        for (int i = 0; i < g->n_tasks && task == NULL; i++) {
+            if (g->tasks[i].on_main == on_main && task_ready(g, &g->tasks[i])) {
+                task = &g->tasks[i];
+            }
+        }
+        if (task == NULL) {
+            pthread_cond_wait(&g->changed, &g->lock);
+            continue;
+        }
+
+        task->state = 1;
+        task->start = startup_clock() - g->t0;
+        pthread_mutex_unlock(&g->lock);
+        task->run(task->arg);
+        pthread_mutex_lock(&g->lock);
+        task->end = startup_clock() - g->t0;
+        task->state = 2;
+        g->n_done++;
+        pthread_cond_broadcast(&g->changed);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+static void* worker_main(void* arg) {
+    drain((startup_graph_t*) arg, 0);
+    return NULL;
+}
+
+void startup_run(startup_graph_t* g, int n_workers) {
+    if (n_workers < 1) {
+        n_workers = 1;
+    }
+    pthread_t* workers = (pthread_t*) malloc(n_workers * sizeof(pthread_t));
+    g->t0 = startup_clock();
+    for (int w = 0; w < n_workers; w++) {
+        if (pthread_create(&workers[w], NULL, worker_main, g)) {
+            printf("Error: unable to start startup worker thread.\n");
+            exit(1);
+        }
+    }
+    drain(g, 1);
+    for (int w = 0; w < n_workers; w++) {
+        pthread_join(workers[w], NULL);
+    }
+    free(workers);
+}
+
+void startup_graph_free(startup_graph_t* g) {
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->changed);
+}
+
+static void task_context(void* arg) {
+    startup_t* s = (startup_t*) arg;
+    s->window = create_gl_context(1);
+}
+
+static void task_read(void* arg) {
+    startup_t* s = (startup_t*) arg;
+    model_options_t* opts = s->opts;
+    if (opts->regrid_width > 0) {
+        regrid_input(opts->input_path, opts->regrid_width,
+            opts->regrid_height, opts->regrid_bilinear ? REGRID_BILINEAR :
+            REGRID_CONSERVATIVE, opts->regrid_cache, &s->nx, &s->ny,
+            &s->initial);
+    } else {
+        read_input(opts->input_path, &s->nx, &s->ny, &s->initial);
+    }
+}
+
+static void task_solar(void* arg) {
+    startup_t* s = (startup_t*) arg;
+    s->solar_data = (float*) mem_alloc(MEM_STAGING,
+        SOLAR_TABLE_NX * SOLAR_TABLE_NY * 4 * sizeof(float));
+    fill_solar_table(s->solar_data);
+}
+
+static void task_shaders(void* arg) {
+    startup_t* s = (startup_t*) arg;
+    init_compute_kernel(&s->compute_kernel, "shader/compute.cs");
+    glUseProgram(s->compute_kernel.program);
+    glUniform1i(s->compute_kernel.daily_mean_l, s->opts->daily_mean);
+    s->screen_shader = (s->opts->batch_path == NULL) ?
+        create_shader("shader/screen.vs", "shader/screen.fs") : 0;
+}
+
+static void task_upload(void* arg) {
+    startup_t* s = (startup_t*) arg;
+    s->solar_LUT = upload_solar_table(s->solar_data);
+    mem_free(s->solar_data);
+    s->solar_data = NULL;
+}
+
+void run_startup(startup_t* s, model_options_t* opts) {
+    s->opts = opts;
+    s->nx = s->ny = 0;
+
+    // NetCDF is not thread safe, so the input is read by a single task
+    startup_graph_t g;
+    init_startup_graph(&g);
+    int n_workers = 1;
+    int context = startup_add(&g, "context", task_context, s, 1, 0, NULL);
+    if (opts->batch_path == NULL) {
+        startup_add(&g, "read_input", task_read, s, 0, 0, NULL);
+        n_workers++;
+    }
+    int solar = startup_add(&g, "solar_table", task_solar, s, 0, 0, NULL);
+    startup_add(&g, "shaders", task_shaders, s, 1, 1, &context);
+    int upload_deps[2] = { context, solar };
+    startup_add(&g, "solar_upload", task_upload, s, 1, 2, upload_deps);
+    startup_run(&g, n_workers);
+
+#ifndef REDUCED_OUTPUT
+    double work = 0.0, wall = 0.0;
+    for (int i = 0; i < g.n_tasks; i++) {
+        startup_task_t* task = &g.tasks[i];
+        printf("  %-12s %7.3fs - %7.3fs\n", task->name, task->start,
+            task->end);
+        work += task->end - task->start;
+        wall = (task->end > wall) ? task->end : wall;
+    }
+    printf("Startup took %.3fs for %.3fs of work\n", wall, work);
+#endif // REDUCED_OUTPUT
+    startup_graph_free(&g);
+}
@@ -0,0 +1,63 @@
+#ifndef _STARTUP_H
+#define _STARTUP_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "common.h"
+#include "nctools.h"
+#include "model.h"
+#include "options.h"
+
+#define STARTUP_MAX_TASKS 8
+#define STARTUP_MAX_DEPS  2
+
+typedef void (*startup_fn_t)(void* arg);
+
+// one node of the startup graph. GL work has to stay on the thread that
+// owns the context, everything else goes to the pool.
+typedef struct {
+    const char* name;
+    startup_fn_t run;
+    void* arg;
+    int on_main;
+    int n_deps;
+    int deps[STARTUP_MAX_DEPS];
+    int state; // 0 waiting, 1 running, 2 done
+    double start, end;
+} startup_task_t;
+
+typedef struct {
+    startup_task_t tasks[STARTUP_MAX_TASKS];
+    int n_tasks;
+    int n_done;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    double t0;
+} startup_graph_t;
+
+void init_startup_graph(startup_graph_t* g);
+int startup_add(startup_graph_t* g, const char* name, startup_fn_t run,
+    void* arg, int on_main, int n_deps, const int* deps);
+void startup_run(startup_graph_t* g, int n_workers);
+void startup_graph_free(startup_graph_t* g);
+
+// seconds on a monotonic clock, valid before GLFW is initialised
+double startup_clock();
+
+// everything main needs before the first step. The input is read and the
+// solar table filled by the pool while the context is created and the
+// shaders are compiled.
+typedef struct {
+    GLFWwindow* window;
+    model_initial_t initial; // not read for batch runs
+    size_t nx, ny;
+    float* solar_data;
+    unsigned int solar_LUT;
+    compute_kernel_t compute_kernel;
+    unsigned int screen_shader;
+    model_options_t* opts;
+} startup_t;
+
+void run_startup(startup_t* s, model_options_t* opts);
+
+#endif // _STARTUP_H
@@ -0,0 +1,177 @@
+#include "stats.h"
+#include "common.h"
+#include "renderutil.h"
+#include "nctools.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void init_stats(stats_t* stats, size_t ny, int daily_mean) {
+    stats->program = create_cshader("shader/stats.cs");
+    stats->year_frac_l  = glGetUniformLocation(stats->program, "year_frac");
+    stats->day_frac_l   = glGetUniformLocation(stats->program, "day_frac");
+    stats->daily_mean_l = glGetUniformLocation(stats->program, "daily_mean");
+    stats->global_pass_l = glGetUniformLocation(stats->program, "global_pass");
+    stats->insol_LUT_l  = glGetUniformLocation(stats->program, "insol_LUT");
+    stats->physp_LUT1_l = glGetUniformLocation(stats->program, "physp_LUT1");
+    stats->physp_LUT2_l = glGetUniformLocation(stats->program, "physp_LUT2");
+    stats->forcing_w_l  = glGetUniformLocation(stats->program, "forcing_w");
+    stats->forcing_LUT1_l =
+        glGetUniformLocation(stats->program, "forcing_LUT1");
+    stats->forcing_LUT2_l =
+        glGetUniformLocation(stats->program, "forcing_LUT2");
+    stats->freezing_T_l = glGetUniformLocation(stats->program, "freezing_T");
+    stats->solar_constant_l =
+        glGetUniformLocation(stats->program, "solar_constant");
+    glUseProgram(stats->program);
+    glUniform1i(stats->daily_mean_l, daily_mean);
+
+    stats->ny = ny;
+    size_t bytes = 4 * (ny + 2) * sizeof(float);
+    stats->values = (float*) calloc(4 * (ny + 2), sizeof(float));
+    glGenBuffers(1, &stats->buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats->buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, NULL, GL_DYNAMIC_READ);
+    mem_track_buffer(stats->buffer, bytes);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// reduce the current state of the model at time t, the LUT bindings match
+// model_state_step
+void stats_compute(stats_t* stats, model_state_t* state,
+    unsigned int solar_LUT, double t) {
+    glBindImageTexture(0, model_state_texture(state), 0, GL_FALSE, 0,
+        GL_READ_ONLY, GL_R32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, stats->buffer);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, solar_LUT);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, state->physp_LUT1);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, state->physp_LUT2);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, state->forcing_LUT1);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, state->forcing_LUT2);
+    glActiveTexture(GL_TEXTURE0);
+
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+    glUseProgram(stats->program);
+    glUniform1f(stats->year_frac_l, year_frac);
+    glUniform1f(stats->day_frac_l, day_frac);
+    glUniform1i(stats->insol_LUT_l, 1);
+    glUniform1i(stats->physp_LUT1_l, 2);
+    glUniform1i(stats->physp_LUT2_l, 3);
+    glUniform1i(stats->forcing_LUT1_l, 4);
+    glUniform1i(stats->forcing_LUT2_l, 5);
+    glUniform1f(stats->forcing_w_l, state->forcing_w);
+    glUniform1f(stats->freezing_T_l, state->freezing_T);
+    glUniform1f(stats->solar_constant_l, state->solar_constant);
+
+    // zonal means of every row, then the weighted sums over the rows
+    glUniform1i(stats->global_pass_l, 0);
+    glDispatchCompute(1, (unsigned int) stats->ny, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1i(stats->global_pass_l, 1);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats->buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+        4 * (stats->ny + 2) * sizeof(float), stats->values);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void stats_get(stats_t* stats, glebm_stats_t* out) {
+    out->Ts           = stats->values[0];
+    out->ASR          = stats->values[1];
+    out->OLR          = stats->values[2];
+    out->imbalance    = stats->values[3];
+    out->ice_edge[0]  = stats->values[4];
+    out->ice_edge[1]  = stats->values[5];
+    out->ice_fraction = stats->values[6];
+    out->zonal        = &stats->values[8];
+}
+
+void stats_free(stats_t* stats) {
+    glDeleteProgram(stats->program);
+    mem_delete_buffers(1, &stats->buffer);
+    free(stats->values);
+}
+
+// the first six variables hold one value per sample, the rest one per row
+static const char* series_names[STATS_N_VARS] = {
+    "Ts_global", "ASR_global", "OLR_global", "imbalance_global",
+    "ice_edge_south", "ice_edge_north",
+    "Ts_zonal", "ASR_zonal", "OLR_zonal", "ice_zonal"
+};
+static const char* series_units[STATS_N_VARS] = {
+    "K", "W/m^2", "W/m^2", "W/m^2", "degrees_north", "degrees_north",
+    "K", "W/m^2", "W/m^2", "1"
+};
+#define STATS_N_GLOBAL 6
+
+static size_t series_length(stats_series_t* series, int k) {
+    return (k < STATS_N_GLOBAL) ? 1 : series->ny;
+}
+
+void init_stats_series(stats_series_t* series, size_t ny) {
+    series->ny = ny;
+    series->n = 0;
+    series->capacity = 0;
+    series->times = NULL;
+    for (int k = 0; k < STATS_N_VARS; k++) {
+        series->vars[k] = NULL;
+    }
+}
+
+void stats_series_add(stats_series_t* series, double t,
+    const glebm_stats_t* stats) {
+    if (series->n == series->capacity) {
+        series->capacity = (series->capacity > 0) ? 2 * series->capacity : 64;
+        series->times = (double*) mem_realloc(MEM_FRAMES, series->times,
+            series->capacity * sizeof(double));
+        for (int k = 0; k < STATS_N_VARS; k++) {
+            series->vars[k] = (float*) mem_realloc(MEM_FRAMES, series->vars[k],
+                series->capacity * series_length(series, k) * sizeof(float));
+        }
+    }
+
+    size_t i = series->n++;
+    series->times[i] = t;
+    series->vars[0][i] = stats->Ts;
+    series->vars[1][i] = stats->ASR;
+    series->vars[2][i] = stats->OLR;
+    series->vars[3][i] = stats->imbalance;
+    series->vars[4][i] = stats->ice_edge[0];
+    series->vars[5][i] = stats->ice_edge[1];
+    for (size_t j = 0; j < series->ny; j++) {
+        for (int c = 0; c < 4; c++) {
+            series->vars[STATS_N_GLOBAL + c][i * series->ny + j] =
+                stats->zonal[j * 4 + c];
+        }
+    }
+}
+
+void stats_series_write(stats_series_t* series, const char* path) {
+    if (series->n == 0) {
+        return;
+    }
+    int lengths[STATS_N_VARS];
+    for (int k = 0; k < STATS_N_VARS; k++) {
+        lengths[k] = (int) series_length(series, k);
+    }
+    append_time_series(path, "stats_time", "days", (int) series->n,
+        series->times, STATS_N_VARS, series_names, series_units, lengths, series->vars);
+}
+
+void stats_series_free(stats_series_t* series) {
+    mem_free(series->times);
+    for (int k = 0; k < STATS_N_VARS; k++) {
+        mem_free(series->vars[k]);
+    }
+    series->n = 0;
+    series->capacity = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stddef.h>
+#include "glebm.h"
+#include "model.h"
+
+// zonal means and the global energy budget reduced on the GPU into a small
+// storage buffer, so only 4 * (ny + 2) floats come back per sample
+typedef struct {
+    unsigned int program;
+    unsigned int year_frac_l, day_frac_l, daily_mean_l, global_pass_l;
+    unsigned int insol_LUT_l, physp_LUT1_l, physp_LUT2_l;
+    unsigned int forcing_w_l, forcing_LUT1_l, forcing_LUT2_l;
+    unsigned int freezing_T_l, solar_constant_l;
+
+    size_t ny;
+    unsigned int buffer;
+    float* values; // global and ice vec4s followed by one vec4 per row
+} stats_t;
+
+// samples collected over a run, one array per output variable
+#define STATS_N_VARS 10
+
+typedef struct {
+    size_t ny, n, capacity;
+    double* times;
+    float* vars[STATS_N_VARS];
+} stats_series_t;
+
+void init_stats(stats_t* stats, size_t ny, int daily_mean);
+void stats_compute(stats_t* stats, model_state_t* state,
+    unsigned int solar_LUT, double t);
+void stats_get(stats_t* stats, glebm_stats_t* out);
+void stats_free(stats_t* stats);
+
+void init_stats_series(stats_series_t* series, size_t ny);
+void stats_series_add(stats_series_t* series, double t,
+    const glebm_stats_t* stats);
+void stats_series_write(stats_series_t* series, const char* path);
+void stats_series_free(stats_series_t* series);
+
+#endif // _STATS_H
@@ -0,0 +1,279 @@
+#include "steer.h"
+#include "model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// keys step a value up, with shift down
+typedef struct {
+    int key;
+    const char* up;
+    const char* down;
+} steer_binding_t;
+
+static const steer_binding_t bindings[] = {
+    { GLFW_KEY_A, "A + 1",      "A + -1"      },
+    { GLFW_KEY_B, "B * 1.02",   "B * 0.98"    },
+    { GLFW_KEY_0, "a0 + 0.01",  "a0 + -0.01"  },
+    { GLFW_KEY_I, "ai + 0.01",  "ai + -0.01"  },
+    { GLFW_KEY_F, "Tf + 1",     "Tf + -1"     },
+    { GLFW_KEY_D, "D * 1.1",    "D * 0.9"     },
+    { GLFW_KEY_T, "dt * 2",     "dt * 0.5"    },
+    { GLFW_KEY_P, "show",       "show"        },
+};
+
+static const char* field_names[GLEBM_N_PARAMS] = {
+    [GLEBM_A] = "A", [GLEBM_B] = "B", [GLEBM_DEPTH] = "depth",
+    [GLEBM_A0] = "a0", [GLEBM_A2] = "a2", [GLEBM_AI] = "ai"
+};
+
+// GLFW callbacks carry no user data without a window user pointer, and the
+// window belongs to main
+static steer_t* key_target = NULL;
+
+static void print_help() {
+    printf("Steering commands:\n");
+    printf("  <name> = <value>, <name> + <value> or <name> * <value>, where\n");
+    printf("  <name> is one of A, B, depth, a0, a2, ai (fields, optionally\n");
+    printf("  followed by <lat0>:<lat1> to change only that band), D, Tf,\n");
+    printf("  S0 or dt (minutes). 'show' prints the current values.\n");
+    printf("Keys (shift steps down): A, B, 0 (a0), I (ai), F (Tf), D, T (dt),\n");
+    printf("  P shows the current values.\n");
+}
+
+static void key_callback(GLFWwindow* window, int key, int scancode,
+    int action, int mods) {
+    if (key_target == NULL || action != GLFW_PRESS) {
+        return;
+    }
+    for (size_t k = 0; k < sizeof(bindings) / sizeof(bindings[0]); k++) {
+        if (bindings[k].key == key) {
+            steer_push(key_target, (mods & GLFW_MOD_SHIFT) ?
+                bindings[k].down : bindings[k].up);
+            return;
+        }
+    }
+}
+
+static void* stdin_reader(void* arg) {
+    steer_t* s = (steer_t*) arg;
+    char line[STEER_LINE];
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        steer_push(s, line);
+    }
+    return NULL;
+}
+
+void init_steer(steer_t* s, GLFWwindow* window, int read_stdin,
+    const float* lats, size_t nx, size_t ny, float dt_limit) {
+    s->lats = lats;
+    s->nx = nx;
+    s->ny = ny;
+    s->dt_limit = dt_limit;
+    s->head = 0;
+    s->count = 0;
+    pthread_mutex_init(&s->lock, NULL);
+
+    key_target = s;
+    glfwSetKeyCallback(window, key_callback);
+
+    s->read_stdin = read_stdin;
+    if (read_stdin && pthread_create(&s->thread, NULL, stdin_reader, s)) {
+        printf("Error: unable to start steering thread.\n");
+        exit(1);
+    }
+    if (read_stdin) {
+        print_help();
+    }
+}
+
+void steer_push(steer_t* s, const char* command) {
+    pthread_mutex_lock(&s->lock);
+    int full = s->count == STEER_QUEUE;
+    if (!full) {
+        int k = (s->head + s->count) % STEER_QUEUE;
+        strncpy(s->queue[k], command, STEER_LINE - 1);
+        s->queue[k][STEER_LINE - 1] = '\0';
+        s->count++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (full) {
+        printf("Warning: dropped steering command, the queue is full.\n");
+    }
+}
+
+static float apply_op(float x, char op, float value) {
+    switch (op) {
+    case '+':
+        return x + value;
+    case '*':
+        return x * value;
+    default:
+        return value;
+    }
+}
+
+static void show_values(steer_t* s, glebm_t* sim) {
+    glebm_constants_t c;
+    glebm_constants(sim, &c);
+    printf("D=%.4f W/m^2/K Tf=%.2f K S0=%.1f W/m^2 dt=%.2f min",
+        c.diffusivity, c.freezing_T, c.solar_constant, c.timestep);
+    size_t n = s->nx * s->ny;
+    for (int k = 0; k < GLEBM_N_PARAMS; k++) {
+        float* field = glebm_param(sim, (glebm_param_t) k);
+        double mean = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            mean += field[i];
+        }
+        printf(" %s=%.4g", field_names[k], mean / n);
+    }
+    printf(" (field means)\n");
+}
+
+// D, Tf, S0 and dt are uniforms, nothing is uploaded
+static int apply_constant(steer_t* s, glebm_t* sim, const char* name,
+    char op, float value) {
+    glebm_constants_t c;
+    glebm_constants(sim, &c);
+    float* target;
+    if (strcmp(name, "D") == 0) {
+        target = &c.diffusivity;
+    } else if (strcmp(name, "Tf") == 0) {
+        target = &c.freezing_T;
+    } else if (strcmp(name, "S0") == 0) {
+        target = &c.solar_constant;
+    } else if (strcmp(name, "dt") == 0) {
+        target = &c.timestep;
+    } else {
+        return -1;
+    }
+
+    float x = apply_op(*target, op, value);
+    if (x <= 0.0f) {
+        printf("Error: %s must stay positive.\n", name);
+        return 0;
+    }
+    *target = x;
+    glebm_set_constants(sim, &c);
+    printf("%s = %.4g\n", name, x);
+
+    float limit = s->dt_limit * DEFAULT_DIFFUSIVITY / c.diffusivity;
+    if (c.timestep / (24.0f * 60.0f) > limit) {
+        printf("Warning: timestep of %.1f min exceeds the diffusion limit "
+            "of %.1f min.\n", c.timestep, limit * 24.0f * 60.0f);
+    }
+    return 1;
+}
+
+// fields are changed on the host and only the rows inside the band are
+// uploaded again
+static int apply_field(steer_t* s, glebm_t* sim, const char* name, char op,
+    float value, float lat0, float lat1) {
+    int which = -1;
+    for (int k = 0; k < GLEBM_N_PARAMS; k++) {
+        if (strcmp(name, field_names[k]) == 0) {
+            which = k;
+        }
+    }
+    if (which < 0) {
+        return -1;
+    }
+
+    // depth and B divide the tendency, so the change is checked for every
+    // cell of the band before any of them is touched
+    float* field = glebm_param(sim, (glebm_param_t) which);
+    int positive = (which == GLEBM_DEPTH || which == GLEBM_B);
+    size_t j0 = s->ny, j1 = 0;
+    for (size_t j = 0; j < s->ny; j++) {
+        if (s->lats[j] < lat0 || s->lats[j] > lat1) {
+            continue;
+        }
+        for (size_t x = 0; positive && x < s->nx; x++) {
+            if (apply_op(field[j * s->nx + x], op, value) <= 0.0f) {
+                printf("Error: %s must stay positive.\n", name);
+                return 0;
+            }
+        }
+        j0 = (j < j0) ? j : j0;
+        j1 = (j + 1 > j1) ? j + 1 : j1;
+    }
+    if (j0 >= j1) {
+        printf("Error: no rows between %.2f and %.2f.\n", lat0, lat1);
+        return 0;
+    }
+    for (size_t j = j0; j < j1; j++) {
+        if (s->lats[j] < lat0 || s->lats[j] > lat1) {
+            continue;
+        }
+        for (size_t x = 0; x < s->nx; x++) {
+            field[j * s->nx + x] = apply_op(field[j * s->nx + x], op, value);
+        }
+    }
+    glebm_param_rows_changed(sim, j0, j1);
+    printf("%s %c %.4g on rows %lu to %lu\n", name, op, value, j0, j1 - 1);
+    return 1;
+}
+
+static int apply_command(steer_t* s, glebm_t* sim, const char* line) {
+    char name[16], op;
+    float value, lat0 = -90.0f, lat1 = 90.0f;
+    if (sscanf(line, "%15s", name) != 1) {
+        return 0;
+    }
+    if (strcmp(name, "show") == 0) {
+        show_values(s, sim);
+        return 0;
+    }
+    if (strcmp(name, "help") == 0) {
+        print_help();
+        return 0;
+    }
+
+    int n = sscanf(line, "%15s %c %f %f:%f", name, &op, &value, &lat0,
+        &lat1);
+    int ret = -1;
+    if ((n == 3 || n == 5) && (op == '=' || op == '+' || op == '*')) {
+        ret = (n == 3) ? apply_constant(s, sim, name, op, value) : -1;
+        if (ret < 0) {
+            ret = apply_field(s, sim, name, op, value, lat0, lat1);
+        }
+    }
+    if (ret < 0) {
+        printf("Unknown steering command: %s", line);
+        if (line[strlen(line) - 1] != '\n') {
+            printf("\n");
+        }
+        return 0;
+    }
+    return ret;
+}
+
+// run every queued command, returns 1 if any of them changed the model
+int steer_apply(steer_t* s, glebm_t* sim) {
+    char line[STEER_LINE];
+    int changed = 0;
+    while (1) {
+        pthread_mutex_lock(&s->lock);
+        int empty = s->count == 0;
+        if (!empty) {
+            memcpy(line, s->queue[s->head], STEER_LINE);
+            s->head = (s->head + 1) % STEER_QUEUE;
+            s->count--;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (empty) {
+            return changed;
+        }
+        changed |= apply_command(s, sim, line);
+    }
+}
+
+void steer_free(steer_t* s) {
+    // the reader is blocked in fgets, which is a cancellation point
+    if (s->read_stdin) {
+        pthread_cancel(s->thread);
+        pthread_join(s->thread, NULL);
+    }
+    key_target = NULL;
+    pthread_mutex_destroy(&s->lock);
+}
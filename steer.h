@@ -0,0 +1,35 @@
+#ifndef _STEER_H
+#define _STEER_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "common.h"
+#include "glebm.h"
+
+#define STEER_QUEUE 16
+#define STEER_LINE  128
+
+// live parameter changes for a running model. Commands come from stdin and
+// from key bindings of the window, are queued and only applied between
+// steps by the main loop, which owns the GL context.
+typedef struct {
+    const float* lats;
+    size_t nx, ny;
+    float dt_limit; // diffusion limit at the default diffusivity (days)
+
+    pthread_mutex_t lock;
+    char queue[STEER_QUEUE][STEER_LINE];
+    int head, count;
+
+    // stdin reader
+    int read_stdin;
+    pthread_t thread;
+} steer_t;
+
+void init_steer(steer_t* s, GLFWwindow* window, int read_stdin,
+    const float* lats, size_t nx, size_t ny, float dt_limit);
+void steer_push(steer_t* s, const char* command);
+int steer_apply(steer_t* s, glebm_t* sim);
+void steer_free(steer_t* s);
+
+#endif // _STEER_H
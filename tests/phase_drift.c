@@ -0,0 +1,66 @@
+// model_phase over 10,000 years of the default 5 minute step. The clock is
+// step * dt, as in the main loop, and every phase is compared against the
+// same product reduced in long double. A float clock stalls at 65536 days,
+// so any drift shows up as a growing error long before the end.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "common.h"
+
+#define N_YEARS 10000
+#define STRIDE  9973 // prime, so the checks fall on every time of day
+
+static int n_checks = 0, n_failed = 0;
+
+// one float ulp of the exact value, and a wrap across 0/1 counts as 0
+static int close_to(float got, long double exact) {
+    float e = (float) exact;
+    float ulp = nextafterf(e, 2.0f) - e;
+    double d = fabs((double) got - (double) exact);
+    return d <= ulp || fabs(d - 1.0) <= ulp;
+}
+
+static void check(unsigned long long step, float dt) {
+    double t = (double) step * dt;
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+
+    long double exact_t = (long double) step * (long double) dt;
+    long double exact_year = fmodl(exact_t, (long double) days_per_year) /
+        (long double) days_per_year;
+    long double exact_day = fmodl(exact_t, 1.0L);
+
+    n_checks++;
+    if (!close_to(year_frac, exact_year) || !close_to(day_frac, exact_day)) {
+        if (n_failed < 10) {
+            printf("FAIL step %llu: year_frac %.9f (exact %.9Lf) day_frac "
+                "%.9f (exact %.9Lf)\n", step, year_frac, exact_year, day_frac,
+                exact_day);
+        }
+        n_failed++;
+    }
+}
+
+int main() {
+    float dt = (1.0f / 24.0f) * (5.0f / 60.0f); // days, as in nctools.c
+    unsigned long long n_steps = (unsigned long long)
+        ceil(N_YEARS * (double) days_per_year / dt);
+
+    // the start, a spread of steps through the whole run and the last day
+    check(0, dt);
+    for (unsigned long long step = 1; step < n_steps; step += STRIDE) {
+        check(step, dt);
+    }
+    for (unsigned long long step = n_steps - 288; step <= n_steps; step++) {
+        check(step, dt);
+    }
+
+    // the first step of every millennium
+    for (int k = 1; k <= N_YEARS / 1000; k++) {
+        check((unsigned long long) ceil(k * 1000.0 * days_per_year / dt), dt);
+    }
+
+    printf("phase_drift: %d of %d checks over %llu steps failed\n", n_failed,
+        n_checks, n_steps);
+    return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// regrid weights between grids that do not line up, coarser and finer,
+// shifted in longitude and with either latitude order. Every row has to sum
+// to 1, and conservative weights have to keep the area weighted mean of a
+// field that varies in both directions.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "regrid.h"
+#include "mem.h"
+
+#define ROW_TOL  1e-5 // on a row sum
+#define MEAN_TOL 1e-3 // K, on a mean of about 260 K
+
+static int n_checks = 0, n_failed = 0;
+
+// centres of n cells spanning span degrees from start
+static float* centres(size_t n, double start, double span, int descending) {
+    float* c = (float*) malloc(n * sizeof(float));
+    for (size_t k = 0; k < n; k++) {
+        double x = start + ((double) k + 0.5) / n * span;
+        c[descending ? n - 1 - k : k] = (float) x;
+    }
+    return c;
+}
+
+// cell areas on the unit sphere, in sin(lat) times degrees of longitude
+static double* areas(const float* lats, const float* lons, size_t nx,
+    size_t ny) {
+    double* lat_edges = (double*) malloc((ny + 1) * sizeof(double));
+    double* lon_edges = (double*) malloc((nx + 1) * sizeof(double));
+    regrid_cell_edges(lats, ny, 180.0, lat_edges);
+    regrid_cell_edges(lons, nx, 360.0, lon_edges);
+    double* a = (double*) malloc(nx * ny * sizeof(double));
+    for (size_t j = 0; j < ny; j++) {
+        double s0 = sin(fmin(fmax(lat_edges[j], -90.0), 90.0) * M_PI / 180.0);
+        double s1 = sin(fmin(fmax(lat_edges[j + 1], -90.0), 90.0) *
+            M_PI / 180.0);
+        for (size_t i = 0; i < nx; i++) {
+            a[j * nx + i] = fabs(s1 - s0) * fabs(lon_edges[i + 1] -
+                lon_edges[i]);
+        }
+    }
+    free(lat_edges);
+    free(lon_edges);
+    return a;
+}
+
+static double area_mean(const float* f, const double* a, size_t n) {
+    double sum = 0.0, total = 0.0;
+    for (size_t k = 0; k < n; k++) {
+        sum += f[k] * a[k];
+        total += a[k];
+    }
+    return sum / total;
+}
+
+static void check_grids(regrid_method_t method, size_t src_nx, size_t src_ny,
+    double src_west, size_t dst_nx, size_t dst_ny, double dst_west,
+    int descending) {
+    float* src_lats = centres(src_ny, -90.0, 180.0, descending);
+    float* src_lons = centres(src_nx, src_west, 360.0, 0);
+    float* dst_lats = centres(dst_ny, -90.0, 180.0, descending);
+    float* dst_lons = centres(dst_nx, dst_west, 360.0, 0);
+
+    regrid_weights_t w = {
+        .method = method, .src_nx = src_nx, .src_ny = src_ny,
+        .dst_nx = dst_nx, .dst_ny = dst_ny
+    };
+    regrid_compute_weights(&w, src_lats, src_lons, dst_lats, dst_lons);
+    const char* name = (method == REGRID_CONSERVATIVE) ? "conservative" :
+        "bilinear";
+
+    // every row sums to 1
+    size_t n_dst = dst_nx * dst_ny;
+    double worst = 0.0;
+    for (size_t r = 0; r < n_dst; r++) {
+        double sum = 0.0;
+        for (size_t k = w.row_start[r]; k < w.row_start[r + 1]; k++) {
+            sum += w.weights[k];
+        }
+        worst = fmax(worst, fabs(sum - 1.0));
+    }
+    n_checks++;
+    if (worst > ROW_TOL) {
+        printf("FAIL %s %lux%lu -> %lux%lu: row sum off by %.3g\n", name,
+            src_nx, src_ny, dst_nx, dst_ny, worst);
+        n_failed++;
+    }
+
+    // a smooth pattern plus noise at the source resolution
+    if (method == REGRID_CONSERVATIVE) {
+        float* src = (float*) malloc(src_nx * src_ny * sizeof(float));
+        float* dst = (float*) malloc(n_dst * sizeof(float));
+        unsigned int seed = 12345;
+        for (size_t j = 0; j < src_ny; j++) {
+            for (size_t i = 0; i < src_nx; i++) {
+                seed = seed * 1103515245u + 12345u;
+                double noise = (double) (seed >> 8) / (1 << 24) - 0.5;
+                src[j * src_nx + i] = (float) (230.0 +
+                    40.0 * cos(src_lats[j] * M_PI / 180.0) +
+                    5.0 * sin(3.0 * src_lons[i] * M_PI / 180.0) +
+                    2.0 * noise);
+            }
+        }
+        regrid_apply(&w, src, dst);
+
+        double* src_areas = areas(src_lats, src_lons, src_nx, src_ny);
+        double* dst_areas = areas(dst_lats, dst_lons, dst_nx, dst_ny);
+        double src_mean = area_mean(src, src_areas, src_nx * src_ny);
+        double dst_mean = area_mean(dst, dst_areas, n_dst);
+        n_checks++;
+        if (fabs(dst_mean - src_mean) > MEAN_TOL) {
+            printf("FAIL %s %lux%lu -> %lux%lu: mean %.6f, source %.6f\n",
+                name, src_nx, src_ny, dst_nx, dst_ny, dst_mean, src_mean);
+            n_failed++;
+        }
+        free(src);
+        free(dst);
+        free(src_areas);
+        free(dst_areas);
+    }
+
+    regrid_weights_free(&w);
+    free(src_lats);
+    free(src_lons);
+    free(dst_lats);
+    free(dst_lons);
+}
+
+int main() {
+    for (int m = 0; m < 2; m++) {
+        regrid_method_t method = (m == 0) ? REGRID_CONSERVATIVE :
+            REGRID_BILINEAR;
+        check_grids(method, 96, 48, -180.0, 64, 32, 0.0, 0);
+        check_grids(method, 96, 48, -180.0, 64, 32, 0.0, 1);
+        check_grids(method, 48, 24, 7.5, 128, 64, 7.5, 0);
+        check_grids(method, 360, 181, -0.5, 64, 32, -0.5, 1);
+        check_grids(method, 100, 50, 3.0, 96, 48, 0.0, 0);
+    }
+
+    printf("regrid_weights: %d of %d checks failed\n", n_failed, n_checks);
+    return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,422 @@
+#include "tiled.h"
+#include "common.h"
+#include "initial.h"
+#include "renderutil.h"
+#include "fetch.h"
+#include "model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void init_tile_kernel(tile_kernel_t* kernel) {
+    kernel->program = create_cshader("shader/tile.cs");
+    kernel->year_frac_l  = glGetUniformLocation(kernel->program, "year_frac");
+    kernel->day_frac_l   = glGetUniformLocation(kernel->program, "day_frac");
+    kernel->dt_l         = glGetUniformLocation(kernel->program, "dt");
+    kernel->daily_mean_l = glGetUniformLocation(kernel->program, "daily_mean");
+    kernel->write_diag_l = glGetUniformLocation(kernel->program, "write_diag");
+    kernel->tile_origin_l =
+        glGetUniformLocation(kernel->program, "tile_origin");
+    kernel->grid_size_l  = glGetUniformLocation(kernel->program, "grid_size");
+    kernel->diffusivity_l =
+        glGetUniformLocation(kernel->program, "diffusivity");
+    kernel->freezing_T_l = glGetUniformLocation(kernel->program, "freezing_T");
+    kernel->solar_constant_l =
+        glGetUniformLocation(kernel->program, "solar_constant");
+}
+
+// largest tile edge, a multiple of 32 that divides n, whose texture still
+// fits with its halo. 0 if there is none.
+size_t tiled_tile_size(size_t n, int max_texture_size) {
+    for (size_t s = ((size_t) max_texture_size - 2) / 32 * 32; s >= 32;
+        s -= 32) {
+        if (n % s == 0) {
+            return s;
+        }
+    }
+    return 0;
+}
+
+static unsigned int make_texture(size_t w, size_t h, GLenum format,
+    GLenum layout, GLenum type, size_t texel_bytes, void* data) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, layout, type, data);
+    mem_track_texture(texture, w * h * texel_bytes);
+    return texture;
+}
+
+static void upload(unsigned int texture, size_t w, size_t h, GLenum layout,
+    GLenum type, void* data) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, layout, type, data);
+}
+
+static void download(unsigned int texture, GLenum layout, GLenum type,
+    void* data) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, layout, type, data);
+}
+
+// write a streamed out tile back to its host copies, both Ts buffers are
+// kept since neighbours may still need the halo of the step in progress
+static void stream_out(tiled_grid_t* grid, int k) {
+    tile_t* tile = &grid->tiles[k];
+    tile_slot_t* slot = &grid->slots[tile->slot];
+    size_t n_halo = (grid->tile_nx + 2) * (grid->tile_ny + 2);
+    size_t n = grid->tile_nx * grid->tile_ny;
+
+    glActiveTexture(GL_TEXTURE0);
+    download(slot->T_textures[0], GL_RED, GL_FLOAT, tile->T[0]);
+    download(slot->T_textures[1], GL_RED, GL_FLOAT, tile->T[1]);
+    grid->bytes_streamed += 2 * n_halo * sizeof(float);
+    if (slot->diag_fresh) {
+        download(slot->diag_texture, GL_RGBA, GL_HALF_FLOAT, tile->diag);
+        grid->bytes_streamed += n * 4 * sizeof(unsigned short);
+    }
+
+    slot->tile = -1;
+    tile->slot = -1;
+}
+
+static void stream_in(tiled_grid_t* grid, int k, int s) {
+    tile_t* tile = &grid->tiles[k];
+    tile_slot_t* slot = &grid->slots[s];
+    size_t nx = grid->tile_nx;
+    size_t ny = grid->tile_ny;
+
+    glActiveTexture(GL_TEXTURE0);
+    upload(slot->T_textures[grid->current], nx + 2, ny + 2, GL_RED, GL_FLOAT,
+        tile->T[grid->current]);
+    upload(slot->physp_LUT1, nx, ny, GL_RGBA, GL_FLOAT, tile->params1);
+    upload(slot->physp_LUT2, nx, ny, GL_RGBA, GL_FLOAT, tile->params2);
+    grid->bytes_streamed += ((nx + 2) * (ny + 2) + 8 * nx * ny) *
+        sizeof(float);
+
+    slot->tile = k;
+    slot->diag_fresh = 0;
+    tile->slot = s;
+}
+
+// slot of tile k, streaming out whichever tile was used least recently when
+// every slot is taken
+static tile_slot_t* make_resident(tiled_grid_t* grid, int k) {
+    tile_t* tile = &grid->tiles[k];
+    tile->last_used = ++grid->clock;
+    if (tile->slot >= 0) {
+        return &grid->slots[tile->slot];
+    }
+
+    int s = -1;
+    for (int i = 0; i < grid->n_slots && s < 0; i++) {
+        if (grid->slots[i].tile < 0) {
+            s = i;
+        }
+    }
+    if (s < 0) {
+        s = 0;
+        for (int i = 1; i < grid->n_slots; i++) {
+            if (grid->tiles[grid->slots[i].tile].last_used <
+                grid->tiles[grid->slots[s].tile].last_used) {
+                s = i;
+            }
+        }
+        stream_out(grid, grid->slots[s].tile);
+    }
+    stream_in(grid, k, s);
+    return &grid->slots[s];
+}
+
+// copy w x h cells of tile src at (sx, sy) into the halo of the resident
+// tile dst at (dx, dy), both positions in halo coordinates
+static void copy_halo(tiled_grid_t* grid, int src, int sx, int sy,
+    tile_slot_t* dst, int dx, int dy, int w, int h) {
+    tile_t* from = &grid->tiles[src];
+    unsigned int dst_texture = dst->T_textures[grid->current];
+    if (from->slot >= 0) {
+        glCopyImageSubData(
+            grid->slots[from->slot].T_textures[grid->current], GL_TEXTURE_2D,
+            0, sx, sy, 0, dst_texture, GL_TEXTURE_2D, 0, dx, dy, 0, w, h, 1);
+    } else {
+        int stride = (int) grid->tile_nx + 2;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+        glBindTexture(GL_TEXTURE_2D, dst_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, dx, dy, w, h, GL_RED, GL_FLOAT,
+            &from->T[grid->current][(sy * stride) + sx]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        grid->bytes_streamed += (size_t) w * h * sizeof(float);
+    }
+}
+
+// refresh the halo of tile k from the edges of its neighbours, longitude is
+// periodic and the halo beyond either pole stays zero
+static void fill_halo(tiled_grid_t* grid, int k, tile_slot_t* slot) {
+    int i = k % grid->n_tiles_x;
+    int j = k / grid->n_tiles_x;
+    int nx = (int) grid->tile_nx;
+    int ny = (int) grid->tile_ny;
+
+    int west = (j * grid->n_tiles_x) + (i + grid->n_tiles_x - 1) %
+        grid->n_tiles_x;
+    int east = (j * grid->n_tiles_x) + (i + 1) % grid->n_tiles_x;
+    copy_halo(grid, west, nx, 1, slot, 0, 1, 1, ny);
+    copy_halo(grid, east, 1, 1, slot, nx + 1, 1, 1, ny);
+    if (j > 0) {
+        copy_halo(grid, k - grid->n_tiles_x, 1, ny, slot, 1, 0, nx, 1);
+    }
+    if (j < grid->n_tiles_y - 1) {
+        copy_halo(grid, k + grid->n_tiles_x, 1, 1, slot, 1, ny + 1, nx, 1);
+    }
+}
+
+void init_tiled_grid(tiled_grid_t* grid, size_t nx, size_t ny,
+    size_t tile_nx, size_t tile_ny, int max_resident,
+    model_initial_t* initial, float* data) {
+    if (tile_nx % 32 != 0 || tile_ny % 32 != 0 || nx % tile_nx != 0 ||
+        ny % tile_ny != 0) {
+        printf("Error: tiles of %lux%lu cells do not evenly divide the "
+            "%lux%lu grid in multiples of 32.\n", tile_nx, tile_ny, nx, ny);
+        exit(1);
+    }
+
+    grid->nx = nx;
+    grid->ny = ny;
+    grid->tile_nx = tile_nx;
+    grid->tile_ny = tile_ny;
+    grid->n_tiles_x = (int) (nx / tile_nx);
+    grid->n_tiles_y = (int) (ny / tile_ny);
+    grid->n_tiles = grid->n_tiles_x * grid->n_tiles_y;
+    grid->n_slots = (max_resident > 0 && max_resident < grid->n_tiles) ?
+        max_resident : grid->n_tiles;
+    grid->current = 0;
+    grid->clock = 0;
+    grid->bytes_streamed = 0;
+    grid->diffusivity = DEFAULT_DIFFUSIVITY;
+    grid->freezing_T = DEFAULT_FREEZING_T;
+    grid->solar_constant = S0;
+    init_mem_arena(&grid->readback, MEM_STAGING);
+    printf("Using %dx%d tiles of %lux%lu cells, %d resident.\n",
+        grid->n_tiles_x, grid->n_tiles_y, tile_nx, tile_ny, grid->n_slots);
+
+    // every tile starts out in its host copies, halos zeroed
+    size_t n_halo = (tile_nx + 2) * (tile_ny + 2);
+    size_t n = tile_nx * tile_ny;
+    grid->tiles = (tile_t*) malloc(grid->n_tiles * sizeof(tile_t));
+    for (int k = 0; k < grid->n_tiles; k++) {
+        tile_t* tile = &grid->tiles[k];
+        tile->x0 = (k % grid->n_tiles_x) * tile_nx;
+        tile->y0 = (k / grid->n_tiles_x) * tile_ny;
+        tile->slot = -1;
+        tile->last_used = 0;
+        tile->T[0] = (float*) mem_calloc(MEM_FIELDS, n_halo, sizeof(float));
+        tile->T[1] = (float*) mem_calloc(MEM_FIELDS, n_halo, sizeof(float));
+        tile->diag = (unsigned short*) mem_calloc(MEM_FIELDS, n * 4,
+            sizeof(unsigned short));
+        tile->params1 = (float*) mem_alloc(MEM_FIELDS, n * 4 * sizeof(float));
+        tile->params2 = (float*) mem_alloc(MEM_FIELDS, n * 4 * sizeof(float));
+        for (size_t y = 0; y < tile_ny; y++) {
+            for (size_t x = 0; x < tile_nx; x++) {
+                size_t i = ((tile->y0 + y) * nx) + tile->x0 + x;
+                tile->T[0][((y + 1) * (tile_nx + 2)) + x + 1] = data[i * 4];
+            }
+        }
+        fill_LUT_block(nx, tile->x0, tile->y0, tile_nx, tile_ny, initial,
+            tile->params1, tile->params2);
+    }
+
+    grid->slots = (tile_slot_t*) malloc(grid->n_slots * sizeof(tile_slot_t));
+    for (int s = 0; s < grid->n_slots; s++) {
+        tile_slot_t* slot = &grid->slots[s];
+        for (int i = 0; i < 2; i++) {
+            slot->T_textures[i] = make_texture(tile_nx + 2, tile_ny + 2,
+                GL_R32F, GL_RED, GL_FLOAT, sizeof(float), NULL);
+        }
+        slot->diag_texture = make_texture(tile_nx, tile_ny, GL_RGBA16F,
+            GL_RGBA, GL_HALF_FLOAT, 4 * sizeof(unsigned short), NULL);
+        slot->physp_LUT1 = make_texture(tile_nx, tile_ny, GL_RGBA32F, GL_RGBA,
+            GL_FLOAT, 4 * sizeof(float), NULL);
+        slot->physp_LUT2 = make_texture(tile_nx, tile_ny, GL_RGBA32F, GL_RGBA,
+            GL_FLOAT, 4 * sizeof(float), NULL);
+        slot->tile = -1;
+        slot->diag_fresh = 0;
+    }
+
+    // when everything fits the tiles are loaded once and never leave
+    if (grid->n_slots == grid->n_tiles) {
+        for (int k = 0; k < grid->n_tiles; k++) {
+            tile_t* tile = &grid->tiles[k];
+            stream_in(grid, k, k);
+            mem_free(tile->T[0]);
+            mem_free(tile->T[1]);
+            mem_free(tile->diag);
+            mem_free(tile->params1);
+            mem_free(tile->params2);
+            tile->T[0] = tile->T[1] = NULL;
+            tile->diag = NULL;
+            tile->params1 = tile->params2 = NULL;
+        }
+        grid->bytes_streamed = 0;
+    }
+}
+
+void tiled_grid_step(tiled_grid_t* grid, tile_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt, int write_diag) {
+    int streaming = grid->n_slots < grid->n_tiles;
+
+    float year_frac, day_frac;
+    model_phase(t, &year_frac, &day_frac);
+    glUseProgram(kernel->program);
+    glUniform1f(kernel->year_frac_l, year_frac);
+    glUniform1f(kernel->day_frac_l, day_frac);
+    glUniform1f(kernel->dt_l, dt);
+    glUniform1i(kernel->write_diag_l, write_diag);
+    glUniform2i(kernel->grid_size_l, (int) grid->nx, (int) grid->ny);
+    glUniform1f(kernel->diffusivity_l, grid->diffusivity);
+    glUniform1f(kernel->freezing_T_l, grid->freezing_T);
+    glUniform1f(kernel->solar_constant_l, grid->solar_constant);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, solar_LUT);
+
+    for (int k = 0; k < grid->n_tiles; k++) {
+        tile_t* tile = &grid->tiles[k];
+        tile_slot_t* slot = make_resident(grid, k);
+        fill_halo(grid, k, slot);
+
+        glBindImageTexture(0, slot->T_textures[grid->current], 0, GL_FALSE, 0,
+            GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, slot->T_textures[1 - grid->current], 0,
+            GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glBindImageTexture(2, slot->diag_texture, 0, GL_FALSE, 0,
+            GL_WRITE_ONLY, GL_RGBA16F);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, slot->physp_LUT1);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, slot->physp_LUT2);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUniform2i(kernel->tile_origin_l, (int) tile->x0, (int) tile->y0);
+        glDispatchCompute((unsigned int) grid->tile_nx / 32,
+            (unsigned int) grid->tile_ny / 32, 1);
+        slot->diag_fresh |= write_diag;
+
+        // a streamed tile may be read back before the step is over
+        if (streaming) {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                GL_TEXTURE_UPDATE_BARRIER_BIT);
+        }
+    }
+
+    // next step (or readback) must see this one
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+        GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    grid->current = 1 - grid->current;
+}
+
+// interleave Ts, dT/dt (K/s), Q and albedo of every tile into data, which
+// holds nx * ny * 4 floats. Streamed out tiles are read from their host
+// copies, so only resident tiles cost a readback.
+void tiled_grid_read(tiled_grid_t* grid, float* data) {
+    size_t tnx = grid->tile_nx;
+    size_t tny = grid->tile_ny;
+    mem_arena_reset(&grid->readback);
+    float* T_buffer = (float*) mem_arena_alloc(&grid->readback,
+        (tnx + 2) * (tny + 2) * sizeof(float));
+    unsigned short* diag_buffer = (unsigned short*) mem_arena_alloc(
+        &grid->readback, tnx * tny * 4 * sizeof(unsigned short));
+
+    glActiveTexture(GL_TEXTURE0);
+    for (int k = 0; k < grid->n_tiles; k++) {
+        tile_t* tile = &grid->tiles[k];
+        float* T = tile->T[grid->current];
+        unsigned short* diag = tile->diag;
+        if (tile->slot >= 0) {
+            tile_slot_t* slot = &grid->slots[tile->slot];
+            download(slot->T_textures[grid->current], GL_RED, GL_FLOAT,
+                T_buffer);
+            download(slot->diag_texture, GL_RGBA, GL_HALF_FLOAT, diag_buffer);
+            T = T_buffer;
+            diag = diag_buffer;
+        }
+
+        for (size_t y = 0; y < tny; y++) {
+            for (size_t x = 0; x < tnx; x++) {
+                size_t i = ((tile->y0 + y) * grid->nx) + tile->x0 + x;
+                size_t l = (y * tnx) + x;
+                data[(i * 4) + 0] = T[((y + 1) * (tnx + 2)) + x + 1];
+                data[(i * 4) + 1] = half_to_float(diag[(l * 4) + 0]) /
+                    86400.0f;
+                data[(i * 4) + 2] = half_to_float(diag[(l * 4) + 1]);
+                data[(i * 4) + 3] = half_to_float(diag[(l * 4) + 2]);
+            }
+        }
+    }
+}
+
+// draw every resident tile into its part of the window with the bound screen
+// shader. The viewport is widened by the halo, so only the interior lands on
+// the tile's own cells.
+void tiled_grid_draw(tiled_grid_t* grid, unsigned int quadVAO, int width,
+    int height) {
+    float sx = (float) width / grid->nx;
+    float sy = (float) height / grid->ny;
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(quadVAO);
+    for (int k = 0; k < grid->n_tiles; k++) {
+        tile_t* tile = &grid->tiles[k];
+        if (tile->slot < 0) {
+            continue;
+        }
+        glViewport((int) ((tile->x0 - 1.0f) * sx),
+            (int) ((tile->y0 - 1.0f) * sy),
+            (int) ((grid->tile_nx + 2) * sx),
+            (int) ((grid->tile_ny + 2) * sy));
+        glBindTexture(GL_TEXTURE_2D,
+            grid->slots[tile->slot].T_textures[grid->current]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glBindVertexArray(0);
+    glViewport(0, 0, width, height);
+}
+
+// both Ts images with their halos, the diagnostics and both LUTs per slot
+size_t tiled_grid_gpu_bytes(tiled_grid_t* grid) {
+    size_t n_halo = (grid->tile_nx + 2) * (grid->tile_ny + 2);
+    size_t n = grid->tile_nx * grid->tile_ny;
+    return grid->n_slots * (2 * n_halo * sizeof(float) +
+        n * (4 * sizeof(unsigned short) + 8 * sizeof(float)));
+}
+
+void tiled_grid_free(tiled_grid_t* grid) {
+#ifndef REDUCED_OUTPUT
+    if (grid->n_slots < grid->n_tiles) {
+        printf("Tiles: streamed %.1f MiB through %d slots\n",
+            grid->bytes_streamed / 1048576.0, grid->n_slots);
+    }
+#endif // REDUCED_OUTPUT
+
+    for (int s = 0; s < grid->n_slots; s++) {
+        tile_slot_t* slot = &grid->slots[s];
+        mem_delete_textures(2, slot->T_textures);
+        mem_delete_textures(1, &slot->diag_texture);
+        mem_delete_textures(1, &slot->physp_LUT1);
+        mem_delete_textures(1, &slot->physp_LUT2);
+    }
+    for (int k = 0; k < grid->n_tiles; k++) {
+        tile_t* tile = &grid->tiles[k];
+        if (tile->T[0] != NULL) {
+            mem_free(tile->T[0]);
+            mem_free(tile->T[1]);
+            mem_free(tile->diag);
+            mem_free(tile->params1);
+            mem_free(tile->params2);
+        }
+    }
+    free(grid->tiles);
+    free(grid->slots);
+    mem_arena_free(&grid->readback);
+}
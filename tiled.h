@@ -0,0 +1,68 @@
+#ifndef _TILED_H
+#define _TILED_H
+
+#include <stddef.h>
+#include "nctools.h"
+#include "mem.h"
+
+// compiled tile shader
+typedef struct {
+    unsigned int program;
+    unsigned int year_frac_l, day_frac_l, dt_l, daily_mean_l, write_diag_l;
+    unsigned int tile_origin_l, grid_size_l;
+    unsigned int diffusivity_l, freezing_T_l, solar_constant_l;
+} tile_kernel_t;
+
+// one block of the domain. Ts carries a one cell halo on every side, the
+// parameters and diagnostics only cover the interior. A tile lives either in
+// a GPU slot or, while streamed out, in its host copies.
+typedef struct {
+    size_t x0, y0; // first interior cell in the full grid
+    int slot;      // -1 while streamed out
+    unsigned long long last_used;
+    float* T[2];   // both Ts buffers, halo included
+    unsigned short* diag;
+    float *params1, *params2;
+} tile_t;
+
+// textures one resident tile lives in
+typedef struct {
+    unsigned int T_textures[2];
+    unsigned int diag_texture;
+    unsigned int physp_LUT1, physp_LUT2;
+    int tile;       // -1 if free
+    int diag_fresh; // diagnostics were written since the tile was loaded
+} tile_slot_t;
+
+// a regular grid split into tiles of tile_nx * tile_ny cells. When there are
+// fewer slots than tiles the least recently stepped tile is streamed out to
+// make room, otherwise every tile stays resident and no host copies are kept.
+typedef struct {
+    size_t nx, ny;
+    size_t tile_nx, tile_ny;
+    int n_tiles_x, n_tiles_y, n_tiles;
+    tile_t* tiles;
+    tile_slot_t* slots;
+    int n_slots;
+    int current;
+    unsigned long long clock;
+    size_t bytes_streamed; // host <-> GPU traffic of tiles and halos
+    float diffusivity, freezing_T, solar_constant;
+    mem_arena_t readback;
+} tiled_grid_t;
+
+void init_tile_kernel(tile_kernel_t* kernel);
+
+size_t tiled_tile_size(size_t n, int max_texture_size);
+void init_tiled_grid(tiled_grid_t* grid, size_t nx, size_t ny,
+    size_t tile_nx, size_t tile_ny, int max_resident,
+    model_initial_t* initial, float* data);
+void tiled_grid_step(tiled_grid_t* grid, tile_kernel_t* kernel,
+    unsigned int solar_LUT, double t, float dt, int write_diag);
+void tiled_grid_read(tiled_grid_t* grid, float* data);
+void tiled_grid_draw(tiled_grid_t* grid, unsigned int quadVAO, int width,
+    int height);
+size_t tiled_grid_gpu_bytes(tiled_grid_t* grid);
+void tiled_grid_free(tiled_grid_t* grid);
+
+#endif // _TILED_H